@@ -0,0 +1,472 @@
+/* client.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "client.h"
+
+#include "../editor/history.h"
+#include "../model/opaque.h"
+#include "../model/run.h"
+
+/*
+ * Shares the document of an editor with other clients through a
+ * server, which puts every operation it receives in order.
+ *
+ * The client is always in one of three states:
+ *
+ *  - Synchronised: every local edit has been acknowledged.
+ *  - Awaiting: one operation has been sent and not yet acknowledged.
+ *  - Buffering: as above, with local edits waiting to be sent next.
+ *
+ * Only one operation is in flight at a time. Operations received from
+ * the server were made without knowledge of the local edits which it
+ * hasn't acknowledged yet, so they are transformed against them before
+ * being applied. In turn, the local edits are transformed so they can
+ * be sent on top of the received operation.
+ */
+
+struct _TextCollabClient
+{
+    GObject parent_instance;
+
+    TextEditor *editor;
+
+    // Number of operations received from the server,
+    // including acknowledgements of our own
+    int revision;
+
+    // Sent to the server and awaiting acknowledgement
+    TextOperation *outstanding;
+
+    // Local edits waiting to be sent
+    GQueue *buffer;
+
+    // Set while applying an operation from the server,
+    // which must not be sent back to it
+    gboolean receiving;
+};
+
+G_DEFINE_FINAL_TYPE (TextCollabClient, text_collab_client, G_TYPE_OBJECT)
+
+enum {
+    PROP_0,
+    PROP_EDITOR,
+    PROP_REVISION,
+    N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+enum {
+    SEND,
+    N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+static void _edited (TextCollabClient *self, GPtrArray *records);
+
+/**
+ * text_collab_client_new:
+ * @editor: the #TextEditor whose document is shared
+ * @revision: the server revision the document is at
+ *
+ * Creates a client which sends every edit made through @editor to the
+ * server with #TextCollabClient::send, and applies the operations it
+ * receives from the server.
+ *
+ * Returns: (transfer full): a new #TextCollabClient
+ */
+TextCollabClient *
+text_collab_client_new (TextEditor *editor,
+                        int         revision)
+{
+    return g_object_new (TEXT_TYPE_COLLAB_CLIENT,
+                         "editor", editor,
+                         "revision", revision,
+                         NULL);
+}
+
+static void
+text_collab_client_finalize (GObject *object)
+{
+    TextCollabClient *self = (TextCollabClient *)object;
+
+    g_clear_object (&self->editor);
+    g_clear_pointer (&self->outstanding, text_operation_free);
+    g_queue_free_full (self->buffer, (GDestroyNotify) text_operation_free);
+
+    G_OBJECT_CLASS (text_collab_client_parent_class)->finalize (object);
+}
+
+static void
+text_collab_client_get_property (GObject    *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+    TextCollabClient *self = TEXT_COLLAB_CLIENT (object);
+
+    switch (prop_id)
+    {
+    case PROP_EDITOR:
+        g_value_set_object (value, self->editor);
+        break;
+    case PROP_REVISION:
+        g_value_set_int (value, self->revision);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_collab_client_set_property (GObject      *object,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+    TextCollabClient *self = TEXT_COLLAB_CLIENT (object);
+
+    switch (prop_id)
+    {
+    case PROP_EDITOR:
+        self->editor = g_value_dup_object (value);
+        g_signal_connect_object (self->editor, "edited",
+                                 G_CALLBACK (_edited), self, G_CONNECT_SWAPPED);
+        break;
+    case PROP_REVISION:
+        self->revision = g_value_get_int (value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_collab_client_class_init (TextCollabClientClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = text_collab_client_finalize;
+    object_class->get_property = text_collab_client_get_property;
+    object_class->set_property = text_collab_client_set_property;
+
+    properties [PROP_EDITOR]
+        = g_param_spec_object ("editor",
+                               "Editor",
+                               "Editor",
+                               TEXT_TYPE_EDITOR,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties [PROP_REVISION]
+        = g_param_spec_int ("revision",
+                            "Revision",
+                            "Revision",
+                            0, G_MAXINT, 0,
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    g_object_class_install_properties (object_class, N_PROPS, properties);
+
+    /**
+     * TextCollabClient::send:
+     * @self: the #TextCollabClient
+     * @revision: the server revision @operation was made against
+     * @operation: the #TextOperation to send
+     *
+     * Emitted when an operation should be sent to the server. The
+     * server must reply by calling text_collab_client_acknowledge()
+     * once @operation has been put in order.
+     */
+    signals [SEND] =
+        g_signal_new ("send",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 2, G_TYPE_INT, TEXT_TYPE_OPERATION);
+}
+
+static void
+text_collab_client_init (TextCollabClient *self)
+{
+    self->buffer = g_queue_new ();
+}
+
+static TextOperation *
+_operation_from_record (TextHistoryRecord *record,
+                        int                base_length)
+{
+    TextOperation *operation;
+    TextFragment *fragment;
+    TextOperationStyle style;
+    int end;
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, record->offset);
+
+    // Inserted text always carries its style, so that it comes out
+    // the same whatever the other clients have done around it
+    switch (record->type)
+    {
+    case TEXT_HISTORY_INSERT:
+        text_operation_insert_styled (operation, record->text->str,
+                                      text_operation_style_from_history (record->style));
+        end = record->offset;
+        break;
+
+    case TEXT_HISTORY_SPLIT:
+        text_operation_insert (operation, "\n");
+        end = record->offset;
+        break;
+
+    case TEXT_HISTORY_FRAGMENT:
+        // Inline objects can't be shared yet, so other
+        // clients see them as a replacement character
+        fragment = g_ptr_array_index (record->content, 0);
+
+        if (TEXT_IS_RUN (fragment))
+            text_operation_insert_styled (operation, text_fragment_get_text (fragment),
+                                          text_operation_style_from_fragment (fragment));
+        else
+            text_operation_insert_styled (operation, TEXT_OPAQUE_REPLACEMENT_CHAR, 0);
+
+        end = record->offset;
+        break;
+
+    case TEXT_HISTORY_DELETE:
+        text_operation_delete (operation, record->length);
+        end = record->offset + record->length;
+        break;
+
+    case TEXT_HISTORY_FORMAT:
+        style = text_operation_style_from_history (record->format);
+        text_operation_format (operation, record->length, style,
+                               record->in_use ? style : 0);
+        end = record->offset + record->length;
+        break;
+
+    default:
+        g_assert_not_reached ();
+    }
+
+    text_operation_retain (operation, base_length - end);
+
+    return operation;
+}
+
+static void
+_send (TextCollabClient *self,
+       TextOperation    *operation)
+{
+    self->outstanding = operation;
+    g_signal_emit (self, signals [SEND], 0, self->revision, operation);
+}
+
+static void
+_queue (TextCollabClient *self,
+        TextOperation    *operation)
+{
+    TextOperation *last;
+    TextOperation *composed;
+
+    if (!self->outstanding)
+    {
+        _send (self, operation);
+        return;
+    }
+
+    // Edits made while waiting are sent together
+    last = g_queue_peek_tail (self->buffer);
+
+    if (last && (composed = text_operation_compose (last, operation)))
+    {
+        text_operation_free (last);
+        text_operation_free (operation);
+        g_queue_pop_tail (self->buffer);
+        g_queue_push_tail (self->buffer, composed);
+        return;
+    }
+
+    g_queue_push_tail (self->buffer, operation);
+}
+
+static void
+_edited (TextCollabClient *self,
+         GPtrArray        *records)
+{
+    TextDocument *document;
+    g_autofree int *base_lengths = NULL;
+    int length;
+
+    if (self->receiving)
+        return;
+
+    g_object_get (self->editor, "document", &document, NULL);
+    length = text_document_get_length (document);
+    g_object_unref (document);
+
+    // Records are made one after another, so work back from
+    // the current length to the length before each of them
+    base_lengths = g_new (int, records->len);
+
+    for (guint i = records->len; i > 0; i--)
+    {
+        length -= text_history_record_get_delta (g_ptr_array_index (records, i - 1));
+        base_lengths[i - 1] = length;
+    }
+
+    for (guint i = 0; i < records->len; i++)
+        _queue (self, _operation_from_record (g_ptr_array_index (records, i), base_lengths[i]));
+}
+
+/**
+ * text_collab_client_receive:
+ * @self: a #TextCollabClient
+ * @operation: an operation made by another client
+ * @error: return location for a #GError
+ *
+ * Applies an operation which the server received from another client.
+ * It is transformed against any local edits which the server hasn't
+ * acknowledged yet, and applied as a single remote transaction, so the
+ * local undo history is kept where it doesn't touch the same text.
+ *
+ * If @operation doesn't apply on top of the local edits, nothing is
+ * changed and %TEXT_OPERATION_ERROR_INVALID is set.
+ *
+ * Returns: %TRUE if @operation was applied
+ */
+gboolean
+text_collab_client_receive (TextCollabClient  *self,
+                            TextOperation     *operation,
+                            GError           **error)
+{
+    g_autoptr (TextOperation) transformed = NULL;
+    g_autoptr (TextOperation) outstanding = NULL;
+    g_autoptr (GPtrArray) buffered = NULL;
+    gboolean applied;
+    GList *l;
+
+    g_return_val_if_fail (TEXT_IS_COLLAB_CLIENT (self), FALSE);
+    g_return_val_if_fail (operation != NULL, FALSE);
+
+    // Nothing is replaced until the operation has been applied,
+    // so a bad operation leaves the client as it was
+    transformed = text_operation_copy (operation);
+    buffered = g_ptr_array_new_with_free_func ((GDestroyNotify) text_operation_free);
+
+    if (self->outstanding)
+    {
+        TextOperation *remote;
+
+        if (!text_operation_transform (self->outstanding, transformed, &outstanding, &remote))
+            goto invalid;
+
+        text_operation_free (transformed);
+        transformed = remote;
+    }
+
+    for (l = self->buffer->head; l != NULL; l = l->next)
+    {
+        TextOperation *local;
+        TextOperation *remote;
+
+        if (!text_operation_transform (l->data, transformed, &local, &remote))
+            goto invalid;
+
+        g_ptr_array_add (buffered, local);
+
+        text_operation_free (transformed);
+        transformed = remote;
+    }
+
+    self->receiving = TRUE;
+    text_editor_begin_remote_transaction (self->editor);
+    applied = text_operation_apply (transformed, self->editor, error);
+    text_editor_commit_transaction (self->editor);
+    self->receiving = FALSE;
+
+    if (!applied)
+        return FALSE;
+
+    if (self->outstanding)
+    {
+        text_operation_free (self->outstanding);
+        self->outstanding = g_steal_pointer (&outstanding);
+    }
+
+    // The transformed edits are now owned by the buffer
+    g_ptr_array_set_free_func (buffered, NULL);
+    l = self->buffer->head;
+
+    for (guint i = 0; i < buffered->len; i++, l = l->next)
+    {
+        text_operation_free (l->data);
+        l->data = g_ptr_array_index (buffered, i);
+    }
+
+    self->revision++;
+
+    return TRUE;
+
+invalid:
+    g_set_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID,
+                 "Received an operation for a different revision");
+    return FALSE;
+}
+
+/**
+ * text_collab_client_acknowledge:
+ * @self: a #TextCollabClient
+ *
+ * Tells @self that the server has put the operation it last sent in
+ * order. Any local edits made in the meantime are sent next.
+ */
+void
+text_collab_client_acknowledge (TextCollabClient *self)
+{
+    g_return_if_fail (TEXT_IS_COLLAB_CLIENT (self));
+    g_return_if_fail (self->outstanding != NULL);
+
+    g_clear_pointer (&self->outstanding, text_operation_free);
+    self->revision++;
+
+    if (!g_queue_is_empty (self->buffer))
+        _send (self, g_queue_pop_head (self->buffer));
+}
+
+TextEditor *
+text_collab_client_get_editor (TextCollabClient *self)
+{
+    g_return_val_if_fail (TEXT_IS_COLLAB_CLIENT (self), NULL);
+
+    return self->editor;
+}
+
+int
+text_collab_client_get_revision (TextCollabClient *self)
+{
+    g_return_val_if_fail (TEXT_IS_COLLAB_CLIENT (self), 0);
+
+    return self->revision;
+}
+
+/**
+ * text_collab_client_is_synchronized:
+ * @self: a #TextCollabClient
+ *
+ * Returns: %TRUE if every local edit has been acknowledged
+ */
+gboolean
+text_collab_client_is_synchronized (TextCollabClient *self)
+{
+    g_return_val_if_fail (TEXT_IS_COLLAB_CLIENT (self), FALSE);
+
+    return self->outstanding == NULL;
+}
@@ -0,0 +1,34 @@
+/* client.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "../editor/editor.h"
+#include "operation.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_COLLAB_CLIENT (text_collab_client_get_type())
+
+G_DECLARE_FINAL_TYPE (TextCollabClient, text_collab_client, TEXT, COLLAB_CLIENT, GObject)
+
+TextCollabClient *text_collab_client_new               (TextEditor *editor, int revision);
+
+TextEditor       *text_collab_client_get_editor        (TextCollabClient *self);
+int               text_collab_client_get_revision      (TextCollabClient *self);
+gboolean          text_collab_client_is_synchronized   (TextCollabClient *self);
+
+gboolean          text_collab_client_receive           (TextCollabClient *self, TextOperation *operation, GError **error);
+void              text_collab_client_acknowledge       (TextCollabClient *self);
+
+G_END_DECLS
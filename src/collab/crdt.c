@@ -0,0 +1,2026 @@
+/* crdt.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "crdt.h"
+
+#include <string.h>
+
+#include "operation.h"
+#include "../editor/history.h"
+#include "../model/opaque.h"
+#include "../model/paragraph.h"
+#include "../model/run.h"
+#include "../tree/node.h"
+
+/*
+ * A replicated growable array (RGA) mirroring the document of an
+ * editor, for replicas which sync with each other without a server.
+ *
+ * The document is a sequence of characters, with a newline for every
+ * paragraph break. Every character has an id, made of the replica
+ * which inserted it and a sequence number counting the operations of
+ * that replica, and a Lamport timestamp. A character is inserted after
+ * the character which preceded it at the time (its origin), and
+ * concurrent insertions after the same origin are ordered by their
+ * timestamps, newest first. Deleted characters are kept as tombstones
+ * so that later insertions can still find their origin.
+ *
+ * Characters typed one after another by the same replica have
+ * consecutive ids and timestamps, so they are kept together in a
+ * single item rather than one per character. Items are only split
+ * when something is inserted into, deleted from or formatted in the
+ * middle of them. The items are children of a #TextNode, so the
+ * position of an item and the item at a position are both found in
+ * O(log n) time, and merging costs time in proportion to the number
+ * of operations the replicas don't have in common.
+ *
+ * Formatting is a separate operation over ranges of ids. Each style
+ * of a character takes the value of the most recent format operation
+ * to set it, by timestamp.
+ *
+ * Deletions and format operations have a sequence number of their own,
+ * so a replica's state is summarised by the next sequence number it
+ * expects from every other replica (its state vector). An update for
+ * another replica contains every item and operation missing from its
+ * state vector, in a compact binary encoding.
+ */
+
+struct _TextCrdt
+{
+    GObject parent_instance;
+
+    TextEditor *editor;
+    guint32 replica;
+
+    // Highest timestamp seen so far
+    guint32 lamport;
+
+    // Parent of every item, in document order
+    TextNode *root;
+
+    // Maps replica ids to Site
+    GHashTable *sites;
+
+    // Entries which arrived before the ones they depend on
+    GPtrArray *pending;
+
+    // Set while applying remote changes to the editor,
+    // which must not be recorded as local changes
+    gboolean merging;
+};
+
+G_DEFINE_FINAL_TYPE (TextCrdt, text_crdt, G_TYPE_OBJECT)
+
+G_DEFINE_QUARK (text-crdt-error-quark, text_crdt_error)
+
+enum {
+    PROP_0,
+    PROP_EDITOR,
+    PROP_REPLICA,
+    N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+// Replica id of the text the document had when it was shared
+#define SEED_REPLICA 0
+
+#define UPDATE_VERSION 1
+
+// Bound on the number of entries in an update, so that a bad
+// length can't make us allocate an unreasonable amount of memory
+#define MAX_ENTRIES (1 << 24)
+
+static const TextOperationStyle styles[] = {
+    TEXT_OPERATION_BOLD,
+    TEXT_OPERATION_ITALIC,
+    TEXT_OPERATION_UNDERLINE
+};
+
+#define N_STYLES G_N_ELEMENTS (styles)
+
+typedef struct
+{
+    guint32 site;
+    guint32 seq;
+} Id;
+
+typedef struct
+{
+    guint32 lamport;
+    guint32 site;
+} Stamp;
+
+typedef struct
+{
+    guint32 site;
+    guint32 seq;
+    guint32 length;
+} Range;
+
+/*
+ * Item
+ */
+
+#define TEXT_TYPE_CRDT_ITEM (text_crdt_item_get_type())
+
+G_DECLARE_FINAL_TYPE (TextCrdtItem, text_crdt_item, TEXT, CRDT_ITEM, TextNode)
+
+// Number of characters which haven't been deleted
+#define ITEM_AGGREGATE_CHARS 0
+
+struct _TextCrdtItem
+{
+    TextNode parent_instance;
+
+    // Id and timestamp of the first character, the others
+    // following on consecutively
+    guint32 site;
+    guint32 seq;
+    guint32 lamport;
+
+    gboolean has_origin;
+    Id origin;
+
+    int length;
+
+    // Dropped once the item is deleted, only its length being kept
+    GString *text;
+    gboolean deleted;
+
+    TextOperationStyle style;
+
+    // Timestamp of the format operation which last set each style
+    Stamp stamps[N_STYLES];
+};
+
+G_DEFINE_FINAL_TYPE (TextCrdtItem, text_crdt_item, TEXT_TYPE_NODE)
+
+static TextCrdtItem *
+text_crdt_item_new (guint32     site,
+                    guint32     seq,
+                    guint32     lamport,
+                    int         length,
+                    const char *text)
+{
+    TextCrdtItem *self;
+
+    self = g_object_new (TEXT_TYPE_CRDT_ITEM, NULL);
+    self->site = site;
+    self->seq = seq;
+    self->lamport = lamport;
+    self->length = length;
+    self->text = text ? g_string_new (text) : NULL;
+    self->deleted = (text == NULL);
+
+    text_node_update_aggregates (TEXT_NODE (self));
+
+    return self;
+}
+
+static void
+text_crdt_item_finalize (GObject *object)
+{
+    TextCrdtItem *self = (TextCrdtItem *)object;
+
+    if (self->text)
+        g_string_free (self->text, TRUE);
+
+    G_OBJECT_CLASS (text_crdt_item_parent_class)->finalize (object);
+}
+
+static void
+text_crdt_item_measure (TextNode *node,
+                        int      *aggregates)
+{
+    TextCrdtItem *self = TEXT_CRDT_ITEM (node);
+
+    if (!self->deleted)
+        aggregates [ITEM_AGGREGATE_CHARS] += self->length;
+}
+
+static void
+text_crdt_item_class_init (TextCrdtItemClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = text_crdt_item_finalize;
+    TEXT_NODE_CLASS (klass)->measure = text_crdt_item_measure;
+}
+
+static void
+text_crdt_item_init (TextCrdtItem *self)
+{
+}
+
+static const int char_weights[TEXT_NODE_N_AGGREGATES] = { [ITEM_AGGREGATE_CHARS] = 1 };
+
+/*
+ * Entries, which are items and operations in transit
+ */
+
+typedef enum
+{
+    ENTRY_INSERT,
+    ENTRY_DELETE,
+    ENTRY_FORMAT
+} EntryType;
+
+#define ENTRY_TYPE_MASK  0x3
+#define ENTRY_HAS_ORIGIN (1 << 2)
+#define ENTRY_DELETED    (1 << 3)
+
+typedef struct
+{
+    EntryType type;
+
+    guint32 site;
+    guint32 seq;
+    guint32 lamport;
+
+    // Insertions
+    gboolean has_origin;
+    Id origin;
+    gboolean deleted;
+    TextOperationStyle style;
+    guint32 length;
+    char *text;
+
+    // Deletions and format operations
+    TextOperationStyle mask;
+    TextOperationStyle values;
+    GArray *ranges;
+} Entry;
+
+static Entry *
+_entry_new (EntryType type,
+            guint32   site,
+            guint32   seq,
+            guint32   lamport)
+{
+    Entry *entry;
+
+    entry = g_new0 (Entry, 1);
+    entry->type = type;
+    entry->site = site;
+    entry->seq = seq;
+    entry->lamport = lamport;
+
+    if (type != ENTRY_INSERT)
+        entry->ranges = g_array_new (FALSE, FALSE, sizeof (Range));
+
+    return entry;
+}
+
+static void
+_entry_free (Entry *entry)
+{
+    g_free (entry->text);
+    g_clear_pointer (&entry->ranges, g_array_unref);
+    g_free (entry);
+}
+
+/*
+ * Sites, which keep track of what each replica has done
+ */
+
+typedef struct
+{
+    // Sequence number of the next operation expected
+    guint32 next_seq;
+
+    // Items inserted by the replica, sorted by sequence
+    // number. These are owned by the root node.
+    GPtrArray *items;
+
+    // Deletions and format operations made by the
+    // replica, sorted by sequence number
+    GPtrArray *ops;
+} Site;
+
+static void
+_site_free (Site *site)
+{
+    g_ptr_array_unref (site->items);
+    g_ptr_array_unref (site->ops);
+    g_free (site);
+}
+
+static Site *
+_get_site (TextCrdt *self,
+           guint32   id)
+{
+    Site *site;
+
+    site = g_hash_table_lookup (self->sites, GUINT_TO_POINTER (id));
+
+    if (!site)
+    {
+        site = g_new0 (Site, 1);
+        site->items = g_ptr_array_new ();
+        site->ops = g_ptr_array_new_with_free_func ((GDestroyNotify) _entry_free);
+        g_hash_table_insert (self->sites, GUINT_TO_POINTER (id), site);
+    }
+
+    return site;
+}
+
+static guint32
+_get_next_seq (TextCrdt *self,
+               guint32   id)
+{
+    Site *site = g_hash_table_lookup (self->sites, GUINT_TO_POINTER (id));
+
+    return site ? site->next_seq : 0;
+}
+
+// Index of the first item of @site which ends after @seq
+static guint
+_bisect_items (Site    *site,
+               guint32  seq)
+{
+    guint low = 0;
+    guint high = site->items->len;
+
+    while (low < high)
+    {
+        guint mid = low + (high - low) / 2;
+        TextCrdtItem *item = g_ptr_array_index (site->items, mid);
+
+        if (item->seq + item->length <= seq)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// Index of the first operation of @site at or after @seq
+static guint
+_bisect_ops (Site    *site,
+             guint32  seq)
+{
+    guint low = 0;
+    guint high = site->ops->len;
+
+    while (low < high)
+    {
+        guint mid = low + (high - low) / 2;
+        Entry *entry = g_ptr_array_index (site->ops, mid);
+
+        if (entry->seq < seq)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+static TextCrdtItem *
+_find_item (TextCrdt *self,
+            guint32   site_id,
+            guint32   seq,
+            int      *index)
+{
+    Site *site;
+    TextCrdtItem *item;
+    guint i;
+
+    site = g_hash_table_lookup (self->sites, GUINT_TO_POINTER (site_id));
+
+    if (!site)
+        return NULL;
+
+    i = _bisect_items (site, seq);
+
+    if (i == site->items->len)
+        return NULL;
+
+    item = g_ptr_array_index (site->items, i);
+
+    if (item->seq > seq)
+        return NULL;
+
+    if (index)
+        *index = seq - item->seq;
+
+    return item;
+}
+
+static void
+_add_to_site (TextCrdt     *self,
+              TextCrdtItem *item)
+{
+    Site *site = _get_site (self, item->site);
+
+    g_ptr_array_insert (site->items, _bisect_items (site, item->seq), item);
+}
+
+/*
+ * Sequence
+ */
+
+static int
+_compare_stamps (guint32 lamport_a,
+                 guint32 site_a,
+                 guint32 lamport_b,
+                 guint32 site_b)
+{
+    if (lamport_a != lamport_b)
+        return lamport_a < lamport_b ? -1 : 1;
+
+    if (site_a != site_b)
+        return site_a < site_b ? -1 : 1;
+
+    return 0;
+}
+
+static void
+_delete_item (TextCrdtItem *item)
+{
+    item->deleted = TRUE;
+
+    if (item->text)
+    {
+        g_string_free (item->text, TRUE);
+        item->text = NULL;
+    }
+
+    text_node_update_aggregates (TEXT_NODE (item));
+}
+
+// Splits @item before its character at @index, returning the second half
+static TextCrdtItem *
+_split (TextCrdt     *self,
+        TextCrdtItem *item,
+        int           index)
+{
+    TextCrdtItem *right;
+    const char *split = NULL;
+
+    g_assert (index > 0 && index < item->length);
+
+    if (item->text)
+        split = g_utf8_offset_to_pointer (item->text->str, index);
+
+    right = text_crdt_item_new (item->site, item->seq + index, item->lamport + index,
+                                item->length - index, split);
+    right->has_origin = TRUE;
+    right->origin = (Id) { item->site, item->seq + index - 1 };
+    right->style = item->style;
+    memcpy (right->stamps, item->stamps, sizeof (item->stamps));
+
+    if (item->text)
+        g_string_truncate (item->text, split - item->text->str);
+
+    item->length = index;
+    text_node_update_aggregates (TEXT_NODE (item));
+
+    text_node_insert_child_after (self->root, TEXT_NODE (right), TEXT_NODE (item));
+    g_object_unref (right);
+
+    _add_to_site (self, right);
+
+    return right;
+}
+
+// Finds the item starting with the character @seq of @site,
+// splitting the item containing it if needed
+static TextCrdtItem *
+_split_at (TextCrdt *self,
+           guint32   site,
+           guint32   seq)
+{
+    TextCrdtItem *item;
+    int index;
+
+    item = _find_item (self, site, seq, &index);
+
+    if (item && index > 0)
+        item = _split (self, item, index);
+
+    return item;
+}
+
+// Finds the visible character at @offset, splitting the item
+// containing it so that the returned item starts with it
+static TextCrdtItem *
+_split_at_offset (TextCrdt *self,
+                  int       offset)
+{
+    TextNode *node;
+
+    node = text_node_find_child (self->root, char_weights, &offset, NULL);
+
+    if (!node)
+        return NULL;
+
+    if (offset > 0)
+        return _split (self, TEXT_CRDT_ITEM (node), offset);
+
+    return TEXT_CRDT_ITEM (node);
+}
+
+static void
+_integrate (TextCrdt     *self,
+            TextCrdtItem *item)
+{
+    TextNode *next;
+
+    if (item->has_origin)
+    {
+        TextCrdtItem *left;
+        int index;
+
+        // Checked to be an item before merging started
+        left = _find_item (self, item->origin.site, item->origin.seq, &index);
+        g_assert (left != NULL);
+
+        if (index + 1 < left->length)
+            _split (self, left, index + 1);
+
+        next = text_node_get_next (TEXT_NODE (left));
+    }
+    else
+    {
+        next = text_node_get_first_child (self->root);
+    }
+
+    // Skip past anything inserted after the origin more recently
+    // than @item, along with everything inserted after that
+    while (next && _compare_stamps (TEXT_CRDT_ITEM (next)->lamport, TEXT_CRDT_ITEM (next)->site,
+                                    item->lamport, item->site) > 0)
+        next = text_node_get_next (next);
+
+    if (next)
+        text_node_insert_child_before (self->root, TEXT_NODE (item), next);
+    else
+        text_node_append_child (self->root, TEXT_NODE (item));
+
+    g_object_unref (item);
+
+    _add_to_site (self, item);
+}
+
+static int
+_get_length (TextCrdt *self)
+{
+    return text_node_get_aggregate (self->root, ITEM_AGGREGATE_CHARS);
+}
+
+/*
+ * Editor
+ */
+
+static void
+_apply (TextCrdt      *self,
+        TextOperation *operation)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (!text_operation_apply (operation, self->editor, &error))
+        g_critical ("Document does not match its replica: %s", error->message);
+
+    text_operation_free (operation);
+}
+
+static void
+_apply_insert (TextCrdt     *self,
+               TextCrdtItem *item)
+{
+    TextOperation *operation;
+    int offset;
+
+    offset = text_node_get_offset (TEXT_NODE (item), ITEM_AGGREGATE_CHARS);
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, offset);
+    text_operation_insert_styled (operation, item->text->str, item->style);
+    text_operation_retain (operation, _get_length (self) - offset - item->length);
+    _apply (self, operation);
+}
+
+static void
+_apply_delete (TextCrdt *self,
+               int       offset,
+               int       length)
+{
+    TextOperation *operation;
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, offset);
+    text_operation_delete (operation, length);
+    text_operation_retain (operation, _get_length (self) - offset);
+    _apply (self, operation);
+}
+
+static void
+_apply_format (TextCrdt           *self,
+               int                 offset,
+               int                 length,
+               TextOperationStyle  mask,
+               TextOperationStyle  values)
+{
+    TextOperation *operation;
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, offset);
+    text_operation_format (operation, length, mask, values);
+    text_operation_retain (operation, _get_length (self) - offset - length);
+    _apply (self, operation);
+}
+
+/*
+ * Operations
+ */
+
+static void
+_insert_text (TextCrdt           *self,
+              guint32             site_id,
+              int                 offset,
+              const char         *text,
+              TextOperationStyle  style)
+{
+    Site *site;
+    TextCrdtItem *left = NULL;
+    TextCrdtItem *item;
+    int index = offset - 1;
+    int length;
+
+    length = g_utf8_strlen (text, -1);
+
+    if (length == 0)
+        return;
+
+    if (offset > 0)
+    {
+        TextNode *node = text_node_find_child (self->root, char_weights, &index, NULL);
+
+        g_return_if_fail (node != NULL);
+        left = TEXT_CRDT_ITEM (node);
+    }
+
+    site = _get_site (self, site_id);
+
+    // Typing at the end of the last item typed here carries it on
+    if (left &&
+        left->site == site_id &&
+        index == left->length - 1 &&
+        left->seq + left->length == site->next_seq &&
+        left->lamport + left->length == self->lamport + 1 &&
+        left->style == style)
+    {
+        g_string_append (left->text, text);
+        left->length += length;
+        text_node_update_aggregates (TEXT_NODE (left));
+    }
+    else
+    {
+        item = text_crdt_item_new (site_id, site->next_seq, self->lamport + 1, length, text);
+        item->style = style;
+
+        if (left)
+        {
+            item->has_origin = TRUE;
+            item->origin = (Id) { left->site, left->seq + index };
+        }
+
+        _integrate (self, item);
+    }
+
+    site->next_seq += length;
+    self->lamport += length;
+}
+
+static Entry *
+_add_op (TextCrdt  *self,
+         EntryType  type)
+{
+    Site *site;
+    Entry *entry;
+
+    site = _get_site (self, self->replica);
+
+    entry = _entry_new (type, self->replica, site->next_seq++, ++self->lamport);
+    g_ptr_array_add (site->ops, entry);
+
+    return entry;
+}
+
+static void
+_add_range (Entry        *entry,
+            TextCrdtItem *item)
+{
+    if (entry->ranges->len > 0)
+    {
+        Range *last = &g_array_index (entry->ranges, Range, entry->ranges->len - 1);
+
+        if (last->site == item->site && last->seq + last->length == item->seq)
+        {
+            last->length += item->length;
+            return;
+        }
+    }
+
+    g_array_append_val (entry->ranges, ((Range) { item->site, item->seq, item->length }));
+}
+
+// Calls @func on every item covering the @length visible characters
+// at @offset, splitting the items at either end to fit
+static void
+_visit_visible (TextCrdt *self,
+                int       offset,
+                int       length,
+                void    (*func) (TextCrdtItem *item, Entry *entry),
+                Entry    *entry)
+{
+    TextCrdtItem *item;
+    TextNode *next;
+
+    item = _split_at_offset (self, offset);
+
+    while (item && length > 0)
+    {
+        next = text_node_get_next (TEXT_NODE (item));
+
+        if (!item->deleted)
+        {
+            if (item->length > length)
+                _split (self, item, length);
+
+            length -= item->length;
+            func (item, entry);
+        }
+
+        item = next ? TEXT_CRDT_ITEM (next) : NULL;
+    }
+}
+
+static void
+_delete_local (TextCrdtItem *item,
+               Entry        *entry)
+{
+    _add_range (entry, item);
+    _delete_item (item);
+}
+
+static void
+_format_local (TextCrdtItem *item,
+               Entry        *entry)
+{
+    _add_range (entry, item);
+
+    for (guint i = 0; i < N_STYLES; i++)
+    {
+        if (entry->mask & styles[i])
+            item->stamps[i] = (Stamp) { entry->lamport, entry->site };
+    }
+
+    item->style = (item->style & ~entry->mask) | (entry->values & entry->mask);
+}
+
+static void
+_insert_fragment (TextCrdt     *self,
+                  guint32       site,
+                  int           offset,
+                  TextFragment *fragment)
+{
+    // Inline objects can't be replicated yet, so other
+    // replicas see them as a replacement character
+    if (TEXT_IS_RUN (fragment))
+        _insert_text (self, site, offset, text_fragment_get_text (fragment),
+                      text_operation_style_from_fragment (fragment));
+    else
+        _insert_text (self, site, offset, TEXT_OPAQUE_REPLACEMENT_CHAR, 0);
+}
+
+static void
+_edited (TextCrdt  *self,
+         GPtrArray *records)
+{
+    if (self->merging)
+        return;
+
+    for (guint i = 0; i < records->len; i++)
+    {
+        TextHistoryRecord *record = g_ptr_array_index (records, i);
+        Entry *entry;
+
+        switch (record->type)
+        {
+        case TEXT_HISTORY_INSERT:
+            _insert_text (self, self->replica, record->offset, record->text->str,
+                          text_operation_style_from_history (record->style));
+            break;
+
+        case TEXT_HISTORY_SPLIT:
+            _insert_text (self, self->replica, record->offset, "\n", 0);
+            break;
+
+        case TEXT_HISTORY_FRAGMENT:
+            _insert_fragment (self, self->replica, record->offset,
+                              g_ptr_array_index (record->content, 0));
+            break;
+
+        case TEXT_HISTORY_DELETE:
+            entry = _add_op (self, ENTRY_DELETE);
+            _visit_visible (self, record->offset, record->length, _delete_local, entry);
+            break;
+
+        case TEXT_HISTORY_FORMAT:
+            entry = _add_op (self, ENTRY_FORMAT);
+            entry->mask = text_operation_style_from_history (record->format);
+            entry->values = record->in_use ? entry->mask : 0;
+            _visit_visible (self, record->offset, record->length, _format_local, entry);
+            break;
+        }
+    }
+}
+
+static void
+_seed (TextCrdt *self,
+       TextNode *node,
+       gboolean *first)
+{
+    TextNode *child;
+
+    if (TEXT_IS_PARAGRAPH (node))
+    {
+        if (!*first)
+            _insert_text (self, SEED_REPLICA, _get_length (self), "\n", 0);
+
+        *first = FALSE;
+
+        for (child = text_node_get_first_child (node); child; child = text_node_get_next (child))
+            _insert_fragment (self, SEED_REPLICA, _get_length (self), TEXT_FRAGMENT (child));
+
+        return;
+    }
+
+    for (child = text_node_get_first_child (node); child; child = text_node_get_next (child))
+        _seed (self, child, first);
+}
+
+/*
+ * Merging
+ */
+
+typedef enum
+{
+    ENTRY_READY,
+    ENTRY_KNOWN,
+    ENTRY_WAITING,
+    ENTRY_INVALID
+} EntryState;
+
+// What a site would have after merging some entries, so that an
+// update can be checked before anything is changed
+typedef struct
+{
+    guint32 next_seq;
+
+    // Range of each item the site would gain, sorted by sequence number
+    GArray *items;
+} Shadow;
+
+static void
+_shadow_free (Shadow *shadow)
+{
+    g_array_unref (shadow->items);
+    g_free (shadow);
+}
+
+static Shadow *
+_get_shadow (TextCrdt   *self,
+             GHashTable *shadows,
+             guint32     site)
+{
+    Shadow *shadow;
+
+    shadow = g_hash_table_lookup (shadows, GUINT_TO_POINTER (site));
+
+    if (!shadow)
+    {
+        shadow = g_new0 (Shadow, 1);
+        shadow->next_seq = _get_next_seq (self, site);
+        shadow->items = g_array_new (FALSE, FALSE, sizeof (Range));
+        g_hash_table_insert (shadows, GUINT_TO_POINTER (site), shadow);
+    }
+
+    return shadow;
+}
+
+// Like _get_next_seq(), including the entries merged into
+// @shadows if given
+static guint32
+_lookup_next_seq (TextCrdt   *self,
+                  GHashTable *shadows,
+                  guint32     site)
+{
+    Shadow *shadow = NULL;
+
+    if (shadows)
+        shadow = g_hash_table_lookup (shadows, GUINT_TO_POINTER (site));
+
+    return shadow ? shadow->next_seq : _get_next_seq (self, site);
+}
+
+// Finds the end of the item containing the character @seq of @site,
+// or returns zero if @seq belongs to an operation instead
+static guint32
+_lookup_item_end (TextCrdt   *self,
+                  GHashTable *shadows,
+                  guint32     site,
+                  guint32     seq)
+{
+    TextCrdtItem *item;
+    Shadow *shadow = NULL;
+    guint low = 0;
+    guint high;
+
+    // Items and operations share sequence numbers
+    if (seq < _get_next_seq (self, site))
+    {
+        item = _find_item (self, site, seq, NULL);
+        return item ? item->seq + item->length : 0;
+    }
+
+    if (shadows)
+        shadow = g_hash_table_lookup (shadows, GUINT_TO_POINTER (site));
+
+    if (!shadow)
+        return 0;
+
+    high = shadow->items->len;
+
+    while (low < high)
+    {
+        guint mid = low + (high - low) / 2;
+        Range *range = &g_array_index (shadow->items, Range, mid);
+
+        if (range->seq + range->length <= seq)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low == shadow->items->len ||
+        g_array_index (shadow->items, Range, low).seq > seq)
+        return 0;
+
+    return g_array_index (shadow->items, Range, low).seq +
+           g_array_index (shadow->items, Range, low).length;
+}
+
+static gboolean
+_has_range (TextCrdt   *self,
+            GHashTable *shadows,
+            Range      *range)
+{
+    return _lookup_next_seq (self, shadows, range->site) >= range->seq + range->length;
+}
+
+static gboolean
+_is_item_range (TextCrdt   *self,
+                GHashTable *shadows,
+                Range      *range)
+{
+    guint32 seq = range->seq;
+
+    while (seq < range->seq + range->length)
+    {
+        if (!(seq = _lookup_item_end (self, shadows, range->site, seq)))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Determines whether @entry can be merged, including the entries merged
+// into @shadows if given. Anything @entry refers to which @self already
+// knows about has to be an item, or @entry is invalid.
+static EntryState
+_get_entry_state (TextCrdt   *self,
+                  GHashTable *shadows,
+                  Entry      *entry)
+{
+    guint32 next_seq;
+
+    next_seq = _lookup_next_seq (self, shadows, entry->site);
+
+    if (entry->type == ENTRY_INSERT)
+    {
+        if (entry->seq + entry->length <= next_seq)
+            return ENTRY_KNOWN;
+
+        if (entry->seq > next_seq)
+            return ENTRY_WAITING;
+
+        // Part of the item may be known already, in which case
+        // the rest follows on from it
+        if (entry->seq < next_seq)
+            return _lookup_item_end (self, shadows, entry->site, next_seq - 1)
+                 ? ENTRY_READY : ENTRY_INVALID;
+
+        if (entry->has_origin)
+        {
+            if (entry->origin.seq >= _lookup_next_seq (self, shadows, entry->origin.site))
+                return ENTRY_WAITING;
+
+            if (!_lookup_item_end (self, shadows, entry->origin.site, entry->origin.seq))
+                return ENTRY_INVALID;
+        }
+
+        return ENTRY_READY;
+    }
+
+    if (entry->seq < next_seq)
+        return ENTRY_KNOWN;
+
+    if (entry->seq > next_seq)
+        return ENTRY_WAITING;
+
+    for (guint i = 0; i < entry->ranges->len; i++)
+    {
+        if (!_has_range (self, shadows, &g_array_index (entry->ranges, Range, i)))
+            return ENTRY_WAITING;
+    }
+
+    for (guint i = 0; i < entry->ranges->len; i++)
+    {
+        if (!_is_item_range (self, shadows, &g_array_index (entry->ranges, Range, i)))
+            return ENTRY_INVALID;
+    }
+
+    return ENTRY_READY;
+}
+
+// Records what merging @entry would add to its site
+static void
+_shadow_entry (TextCrdt   *self,
+               GHashTable *shadows,
+               Entry      *entry)
+{
+    Shadow *shadow = _get_shadow (self, shadows, entry->site);
+
+    if (entry->type == ENTRY_INSERT)
+    {
+        Range range = { entry->site, shadow->next_seq, entry->seq + entry->length - shadow->next_seq };
+
+        g_array_append_val (shadow->items, range);
+        shadow->next_seq = entry->seq + entry->length;
+    }
+    else
+    {
+        shadow->next_seq = entry->seq + 1;
+    }
+}
+
+// Checks that every entry of an update which can be merged only refers
+// to items, going through the entries in the same order as merging
+// does without changing anything. Pending entries which turn out to
+// be invalid are dropped when merged, rather than failing the update.
+static gboolean
+_check_entries (TextCrdt  *self,
+                GPtrArray *entries)
+{
+    g_autoptr (GHashTable) shadows = NULL;
+    g_autoptr (GPtrArray) waiting = NULL;
+    guint n_pending = self->pending->len;
+    gboolean progress;
+
+    shadows = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) _shadow_free);
+    waiting = g_ptr_array_new ();
+
+    for (guint i = 0; i < self->pending->len; i++)
+        g_ptr_array_add (waiting, g_ptr_array_index (self->pending, i));
+
+    for (guint i = 0; i < entries->len; i++)
+    {
+        Entry *entry = g_ptr_array_index (entries, i);
+
+        switch (_get_entry_state (self, shadows, entry))
+        {
+        case ENTRY_READY:
+            _shadow_entry (self, shadows, entry);
+            break;
+        case ENTRY_KNOWN:
+            break;
+        case ENTRY_WAITING:
+            g_ptr_array_add (waiting, entry);
+            break;
+        case ENTRY_INVALID:
+            return FALSE;
+        }
+    }
+
+    do
+    {
+        progress = FALSE;
+
+        for (guint i = 0; i < waiting->len; i++)
+        {
+            Entry *entry = g_ptr_array_index (waiting, i);
+            EntryState state = _get_entry_state (self, shadows, entry);
+
+            if (state == ENTRY_WAITING)
+                continue;
+
+            // The entries of the update come after the pending ones
+            if (i < n_pending)
+                n_pending--;
+            else if (state == ENTRY_INVALID)
+                return FALSE;
+
+            if (state == ENTRY_READY)
+                _shadow_entry (self, shadows, entry);
+
+            g_ptr_array_remove_index (waiting, i--);
+            progress = TRUE;
+        }
+    }
+    while (progress);
+
+    return TRUE;
+}
+
+static void
+_merge_insert (TextCrdt *self,
+               Entry    *entry)
+{
+    TextCrdtItem *item;
+    const char *text = entry->text;
+    guint32 skip;
+
+    skip = _get_next_seq (self, entry->site) - entry->seq;
+
+    if (text)
+        text = g_utf8_offset_to_pointer (text, skip);
+
+    item = text_crdt_item_new (entry->site, entry->seq + skip, entry->lamport + skip,
+                               entry->length - skip, text);
+    item->style = entry->style;
+
+    if (skip > 0)
+    {
+        item->has_origin = TRUE;
+        item->origin = (Id) { entry->site, item->seq - 1 };
+    }
+    else
+    {
+        item->has_origin = entry->has_origin;
+        item->origin = entry->origin;
+    }
+
+    _get_site (self, entry->site)->next_seq = entry->seq + entry->length;
+    self->lamport = MAX (self->lamport, entry->lamport + entry->length - 1);
+
+    _integrate (self, item);
+
+    if (!item->deleted)
+        _apply_insert (self, item);
+}
+
+static void
+_merge_op (TextCrdt *self,
+           Entry    *entry)
+{
+    for (guint i = 0; i < entry->ranges->len; i++)
+    {
+        Range *range = &g_array_index (entry->ranges, Range, i);
+        guint32 seq = range->seq;
+        guint32 end = range->seq + range->length;
+
+        _split_at (self, range->site, seq);
+
+        while (seq < end)
+        {
+            TextCrdtItem *item;
+            TextOperationStyle changed = 0;
+
+            // Checked to be an item before merging started
+            item = _find_item (self, range->site, seq, NULL);
+            g_assert (item != NULL);
+
+            if (item->seq + item->length > end)
+                _split (self, item, end - item->seq);
+
+            seq += item->length;
+
+            if (item->deleted)
+                continue;
+
+            if (entry->type == ENTRY_DELETE)
+            {
+                int offset = text_node_get_offset (TEXT_NODE (item), ITEM_AGGREGATE_CHARS);
+
+                _delete_item (item);
+                _apply_delete (self, offset, item->length);
+                continue;
+            }
+
+            for (guint j = 0; j < N_STYLES; j++)
+            {
+                Stamp *stamp = &item->stamps[j];
+
+                if (!(entry->mask & styles[j]) ||
+                    _compare_stamps (entry->lamport, entry->site, stamp->lamport, stamp->site) <= 0)
+                    continue;
+
+                *stamp = (Stamp) { entry->lamport, entry->site };
+
+                if ((item->style ^ entry->values) & styles[j])
+                    changed |= styles[j];
+            }
+
+            if (changed)
+            {
+                item->style ^= changed;
+                _apply_format (self,
+                               text_node_get_offset (TEXT_NODE (item), ITEM_AGGREGATE_CHARS),
+                               item->length, changed, entry->values & changed);
+            }
+        }
+    }
+
+    _get_site (self, entry->site)->next_seq = entry->seq + 1;
+    self->lamport = MAX (self->lamport, entry->lamport);
+}
+
+// Merges @entry if possible, returning %FALSE if
+// it has to wait for the entries it depends on
+static gboolean
+_merge_entry (TextCrdt *self,
+              Entry    *entry)
+{
+    switch (_get_entry_state (self, NULL, entry))
+    {
+    case ENTRY_WAITING:
+        return FALSE;
+
+    // Only pending entries can be invalid by now, as updates
+    // are checked before they are merged
+    case ENTRY_KNOWN:
+    case ENTRY_INVALID:
+        _entry_free (entry);
+        return TRUE;
+
+    case ENTRY_READY:
+        break;
+    }
+
+    if (entry->type == ENTRY_INSERT)
+    {
+        _merge_insert (self, entry);
+        _entry_free (entry);
+    }
+    else
+    {
+        _merge_op (self, entry);
+        g_ptr_array_add (_get_site (self, entry->site)->ops, entry);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Encoding
+ */
+
+static void
+_write_uint (GByteArray *bytes,
+             guint32     value)
+{
+    guint8 byte;
+
+    do
+    {
+        byte = value & 0x7f;
+        value >>= 7;
+
+        if (value)
+            byte |= 0x80;
+
+        g_byte_array_append (bytes, &byte, 1);
+    }
+    while (value);
+}
+
+static void
+_write_byte (GByteArray *bytes,
+             guint8      value)
+{
+    g_byte_array_append (bytes, &value, 1);
+}
+
+static void
+_write_ranges (GByteArray *bytes,
+               GArray     *ranges)
+{
+    _write_uint (bytes, ranges->len);
+
+    for (guint i = 0; i < ranges->len; i++)
+    {
+        Range *range = &g_array_index (ranges, Range, i);
+
+        _write_uint (bytes, range->site);
+        _write_uint (bytes, range->seq);
+        _write_uint (bytes, range->length);
+    }
+}
+
+typedef struct
+{
+    const guint8 *data;
+    gsize length;
+    gsize pos;
+} Reader;
+
+static gboolean
+_read_uint (Reader  *reader,
+            guint32 *value)
+{
+    guint64 result = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        guint8 byte;
+
+        if (reader->pos >= reader->length)
+            return FALSE;
+
+        byte = reader->data[reader->pos++];
+        result |= (guint64) (byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+        {
+            if (result > G_MAXUINT32)
+                return FALSE;
+
+            *value = (guint32) result;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_read_byte (Reader *reader,
+            guint8 *value)
+{
+    if (reader->pos >= reader->length)
+        return FALSE;
+
+    *value = reader->data[reader->pos++];
+    return TRUE;
+}
+
+static gboolean
+_read_ranges (Reader *reader,
+              GArray *ranges)
+{
+    guint32 n_ranges;
+
+    if (!_read_uint (reader, &n_ranges) || n_ranges > reader->length - reader->pos)
+        return FALSE;
+
+    for (guint i = 0; i < n_ranges; i++)
+    {
+        Range range;
+
+        if (!_read_uint (reader, &range.site) ||
+            !_read_uint (reader, &range.seq) ||
+            !_read_uint (reader, &range.length) ||
+            range.length == 0 ||
+            range.seq > G_MAXUINT32 - range.length)
+            return FALSE;
+
+        g_array_append_val (ranges, range);
+    }
+
+    return TRUE;
+}
+
+static Entry *
+_read_entry (Reader *reader)
+{
+    Entry *entry;
+    guint8 flags;
+    guint8 style;
+    guint32 site, seq, lamport;
+
+    if (!_read_byte (reader, &flags) ||
+        !_read_uint (reader, &site) ||
+        !_read_uint (reader, &seq) ||
+        !_read_uint (reader, &lamport))
+        return NULL;
+
+    if ((flags & ENTRY_TYPE_MASK) > ENTRY_FORMAT)
+        return NULL;
+
+    entry = _entry_new (flags & ENTRY_TYPE_MASK, site, seq, lamport);
+
+    switch (entry->type)
+    {
+    case ENTRY_INSERT:
+        entry->has_origin = (flags & ENTRY_HAS_ORIGIN) != 0;
+        entry->deleted = (flags & ENTRY_DELETED) != 0;
+
+        if (entry->has_origin &&
+            (!_read_uint (reader, &entry->origin.site) ||
+             !_read_uint (reader, &entry->origin.seq)))
+            goto invalid;
+
+        if (!_read_byte (reader, &style) ||
+            !_read_uint (reader, &entry->length) ||
+            entry->length == 0 ||
+            entry->seq > G_MAXUINT32 - entry->length ||
+            entry->lamport > G_MAXUINT32 - entry->length)
+            goto invalid;
+
+        entry->style = style & TEXT_OPERATION_ALL_STYLES;
+
+        if (!entry->deleted)
+        {
+            guint32 size;
+
+            if (!_read_uint (reader, &size) || size > reader->length - reader->pos)
+                goto invalid;
+
+            entry->text = g_strndup ((const char *) reader->data + reader->pos, size);
+            reader->pos += size;
+
+            if (strlen (entry->text) != size ||
+                !g_utf8_validate (entry->text, size, NULL) ||
+                g_utf8_strlen (entry->text, size) != entry->length)
+                goto invalid;
+        }
+        break;
+
+    case ENTRY_FORMAT:
+        if (!_read_byte (reader, &style))
+            goto invalid;
+        entry->mask = style & TEXT_OPERATION_ALL_STYLES;
+
+        if (!_read_byte (reader, &style))
+            goto invalid;
+        entry->values = style & entry->mask;
+
+        G_GNUC_FALLTHROUGH;
+
+    case ENTRY_DELETE:
+        if (!_read_ranges (reader, entry->ranges))
+            goto invalid;
+        break;
+    }
+
+    return entry;
+
+invalid:
+    _entry_free (entry);
+    return NULL;
+}
+
+static GHashTable *
+_read_state_vector (GBytes  *state_vector,
+                    GError **error)
+{
+    GHashTable *table;
+    Reader reader = { 0 };
+    guint32 n_sites;
+
+    table = g_hash_table_new (NULL, NULL);
+
+    if (!state_vector)
+        return table;
+
+    reader.data = g_bytes_get_data (state_vector, &reader.length);
+
+    if (!_read_uint (&reader, &n_sites))
+        goto invalid;
+
+    for (guint i = 0; i < n_sites; i++)
+    {
+        guint32 site, next_seq;
+
+        if (!_read_uint (&reader, &site) || !_read_uint (&reader, &next_seq))
+            goto invalid;
+
+        g_hash_table_insert (table, GUINT_TO_POINTER (site), GUINT_TO_POINTER (next_seq));
+    }
+
+    if (reader.pos != reader.length)
+        goto invalid;
+
+    return table;
+
+invalid:
+    g_hash_table_unref (table);
+    g_set_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID,
+                 "Invalid state vector");
+    return NULL;
+}
+
+/**
+ * text_crdt_new:
+ * @editor: the #TextEditor whose document is replicated
+ * @replica: a non-zero id, unique to this replica
+ *
+ * Creates a replica of the document of @editor, which records every
+ * edit made through @editor and applies the edits merged from other
+ * replicas to it.
+ *
+ * The replicas of a document must all start out from the same text
+ * and formatting.
+ *
+ * Returns: (transfer full): a new #TextCrdt
+ */
+TextCrdt *
+text_crdt_new (TextEditor *editor,
+               guint32     replica)
+{
+    g_return_val_if_fail (TEXT_IS_EDITOR (editor), NULL);
+    g_return_val_if_fail (replica != SEED_REPLICA, NULL);
+
+    return g_object_new (TEXT_TYPE_CRDT,
+                         "editor", editor,
+                         "replica", replica,
+                         NULL);
+}
+
+static void
+text_crdt_constructed (GObject *object)
+{
+    TextCrdt *self = (TextCrdt *)object;
+    TextDocument *document;
+    gboolean first = TRUE;
+
+    G_OBJECT_CLASS (text_crdt_parent_class)->constructed (object);
+
+    g_object_get (self->editor, "document", &document, NULL);
+    _seed (self, TEXT_NODE (document->frame), &first);
+    g_object_unref (document);
+
+    g_signal_connect_object (self->editor, "edited",
+                             G_CALLBACK (_edited), self, G_CONNECT_SWAPPED);
+}
+
+static void
+text_crdt_finalize (GObject *object)
+{
+    TextCrdt *self = (TextCrdt *)object;
+
+    g_hash_table_unref (self->sites);
+    g_ptr_array_unref (self->pending);
+    g_clear_object (&self->root);
+    g_clear_object (&self->editor);
+
+    G_OBJECT_CLASS (text_crdt_parent_class)->finalize (object);
+}
+
+static void
+text_crdt_get_property (GObject    *object,
+                        guint       prop_id,
+                        GValue     *value,
+                        GParamSpec *pspec)
+{
+    TextCrdt *self = TEXT_CRDT (object);
+
+    switch (prop_id)
+    {
+    case PROP_EDITOR:
+        g_value_set_object (value, self->editor);
+        break;
+    case PROP_REPLICA:
+        g_value_set_uint (value, self->replica);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_crdt_set_property (GObject      *object,
+                        guint         prop_id,
+                        const GValue *value,
+                        GParamSpec   *pspec)
+{
+    TextCrdt *self = TEXT_CRDT (object);
+
+    switch (prop_id)
+    {
+    case PROP_EDITOR:
+        self->editor = g_value_dup_object (value);
+        break;
+    case PROP_REPLICA:
+        self->replica = g_value_get_uint (value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_crdt_class_init (TextCrdtClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->constructed = text_crdt_constructed;
+    object_class->finalize = text_crdt_finalize;
+    object_class->get_property = text_crdt_get_property;
+    object_class->set_property = text_crdt_set_property;
+
+    properties [PROP_EDITOR]
+        = g_param_spec_object ("editor",
+                               "Editor",
+                               "Editor",
+                               TEXT_TYPE_EDITOR,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties [PROP_REPLICA]
+        = g_param_spec_uint ("replica",
+                             "Replica",
+                             "Replica",
+                             0, G_MAXUINT32, 0,
+                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    g_object_class_install_properties (object_class, N_PROPS, properties);
+}
+
+static void
+text_crdt_init (TextCrdt *self)
+{
+    self->root = TEXT_NODE (text_crdt_item_new (SEED_REPLICA, 0, 0, 0, ""));
+    self->sites = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) _site_free);
+    self->pending = g_ptr_array_new_with_free_func ((GDestroyNotify) _entry_free);
+}
+
+TextEditor *
+text_crdt_get_editor (TextCrdt *self)
+{
+    g_return_val_if_fail (TEXT_IS_CRDT (self), NULL);
+
+    return self->editor;
+}
+
+guint32
+text_crdt_get_replica (TextCrdt *self)
+{
+    g_return_val_if_fail (TEXT_IS_CRDT (self), 0);
+
+    return self->replica;
+}
+
+/**
+ * text_crdt_get_n_items:
+ * @self: a #TextCrdt
+ *
+ * Gets the number of items the document is made of, including
+ * deleted ones. Each item holds a run of consecutively typed
+ * characters, so this is usually far less than the length of
+ * the document.
+ *
+ * Returns: the number of items
+ */
+guint
+text_crdt_get_n_items (TextCrdt *self)
+{
+    g_return_val_if_fail (TEXT_IS_CRDT (self), 0);
+
+    return text_node_get_num_children (self->root);
+}
+
+/**
+ * text_crdt_get_n_pending:
+ * @self: a #TextCrdt
+ *
+ * Gets the number of merged items and operations which are waiting
+ * for ones they depend on, which haven't been merged yet.
+ *
+ * Returns: the number of pending items and operations
+ */
+guint
+text_crdt_get_n_pending (TextCrdt *self)
+{
+    g_return_val_if_fail (TEXT_IS_CRDT (self), 0);
+
+    return self->pending->len;
+}
+
+/**
+ * text_crdt_encode_state_vector:
+ * @self: a #TextCrdt
+ *
+ * Encodes a summary of the items and operations @self has, to be
+ * passed to text_crdt_encode_update() on another replica.
+ *
+ * Returns: (transfer full): the encoded state vector
+ */
+GBytes *
+text_crdt_encode_state_vector (TextCrdt *self)
+{
+    GByteArray *bytes;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_return_val_if_fail (TEXT_IS_CRDT (self), NULL);
+
+    bytes = g_byte_array_new ();
+    _write_uint (bytes, g_hash_table_size (self->sites));
+
+    g_hash_table_iter_init (&iter, self->sites);
+
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        _write_uint (bytes, GPOINTER_TO_UINT (key));
+        _write_uint (bytes, ((Site *) value)->next_seq);
+    }
+
+    return g_byte_array_free_to_bytes (bytes);
+}
+
+typedef struct
+{
+    guint32 lamport;
+    guint32 site;
+
+    // Either an item, with the number of characters
+    // the other replica already has, or an operation
+    TextCrdtItem *item;
+    guint32 skip;
+    Entry *op;
+} Outgoing;
+
+static int
+_compare_outgoing (gconstpointer a,
+                   gconstpointer b)
+{
+    const Outgoing *out_a = a;
+    const Outgoing *out_b = b;
+
+    return _compare_stamps (out_a->lamport, out_a->site, out_b->lamport, out_b->site);
+}
+
+static void
+_write_item (GByteArray   *bytes,
+             TextCrdtItem *item,
+             guint32       skip)
+{
+    guint8 flags = ENTRY_INSERT;
+    Id origin = item->origin;
+
+    if (item->has_origin || skip > 0)
+        flags |= ENTRY_HAS_ORIGIN;
+
+    if (item->deleted)
+        flags |= ENTRY_DELETED;
+
+    if (skip > 0)
+        origin = (Id) { item->site, item->seq + skip - 1 };
+
+    _write_byte (bytes, flags);
+    _write_uint (bytes, item->site);
+    _write_uint (bytes, item->seq + skip);
+    _write_uint (bytes, item->lamport + skip);
+
+    if (flags & ENTRY_HAS_ORIGIN)
+    {
+        _write_uint (bytes, origin.site);
+        _write_uint (bytes, origin.seq);
+    }
+
+    _write_byte (bytes, item->style);
+    _write_uint (bytes, item->length - skip);
+
+    // Only the length of deleted text is needed
+    if (!item->deleted)
+    {
+        const char *text = g_utf8_offset_to_pointer (item->text->str, skip);
+        gsize size = item->text->len - (text - item->text->str);
+
+        _write_uint (bytes, size);
+        g_byte_array_append (bytes, (const guint8 *) text, size);
+    }
+}
+
+static void
+_write_op (GByteArray *bytes,
+           Entry      *entry)
+{
+    _write_byte (bytes, entry->type);
+    _write_uint (bytes, entry->site);
+    _write_uint (bytes, entry->seq);
+    _write_uint (bytes, entry->lamport);
+
+    if (entry->type == ENTRY_FORMAT)
+    {
+        _write_byte (bytes, entry->mask);
+        _write_byte (bytes, entry->values);
+    }
+
+    _write_ranges (bytes, entry->ranges);
+}
+
+/**
+ * text_crdt_encode_update:
+ * @self: a #TextCrdt
+ * @state_vector: (nullable): the state vector of another replica
+ * @error: return location for a #GError
+ *
+ * Encodes every item and operation which the replica that @state_vector
+ * came from doesn't have, to be passed to text_crdt_merge() on it. If
+ * @state_vector is %NULL, the whole document is encoded.
+ *
+ * This takes time in proportion to the size of the update, rather than
+ * the size of the document.
+ *
+ * Returns: (transfer full) (nullable): the encoded update, or %NULL if
+ *   @state_vector is invalid
+ */
+GBytes *
+text_crdt_encode_update (TextCrdt  *self,
+                         GBytes    *state_vector,
+                         GError   **error)
+{
+    g_autoptr (GHashTable) known = NULL;
+    g_autoptr (GArray) outgoing = NULL;
+    GByteArray *bytes;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_return_val_if_fail (TEXT_IS_CRDT (self), NULL);
+
+    if (!(known = _read_state_vector (state_vector, error)))
+        return NULL;
+
+    outgoing = g_array_new (FALSE, FALSE, sizeof (Outgoing));
+
+    g_hash_table_iter_init (&iter, self->sites);
+
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        Site *site = value;
+        guint32 next_seq;
+
+        next_seq = GPOINTER_TO_UINT (g_hash_table_lookup (known, key));
+
+        if (next_seq >= site->next_seq)
+            continue;
+
+        for (guint i = _bisect_items (site, next_seq); i < site->items->len; i++)
+        {
+            Outgoing out = { 0 };
+
+            out.item = g_ptr_array_index (site->items, i);
+            out.skip = next_seq > out.item->seq ? next_seq - out.item->seq : 0;
+            out.lamport = out.item->lamport + out.skip;
+            out.site = out.item->site;
+
+            g_array_append_val (outgoing, out);
+        }
+
+        for (guint i = _bisect_ops (site, next_seq); i < site->ops->len; i++)
+        {
+            Outgoing out = { 0 };
+
+            out.op = g_ptr_array_index (site->ops, i);
+            out.lamport = out.op->lamport;
+            out.site = out.op->site;
+
+            g_array_append_val (outgoing, out);
+        }
+    }
+
+    // Everything depends only on things with earlier timestamps,
+    // so the other replica can merge the entries in this order
+    g_array_sort (outgoing, _compare_outgoing);
+
+    bytes = g_byte_array_new ();
+    _write_byte (bytes, UPDATE_VERSION);
+    _write_uint (bytes, outgoing->len);
+
+    for (guint i = 0; i < outgoing->len; i++)
+    {
+        Outgoing *out = &g_array_index (outgoing, Outgoing, i);
+
+        if (out->item)
+            _write_item (bytes, out->item, out->skip);
+        else
+            _write_op (bytes, out->op);
+    }
+
+    return g_byte_array_free_to_bytes (bytes);
+}
+
+/**
+ * text_crdt_merge:
+ * @self: a #TextCrdt
+ * @update: an update encoded by text_crdt_encode_update()
+ * @error: return location for a #GError
+ *
+ * Merges the items and operations of another replica into @self, and
+ * applies the resulting changes to the document in a single editor
+ * transaction. Anything merged already is ignored, and anything which
+ * depends on items or operations @self doesn't have yet is kept until
+ * they are merged.
+ *
+ * An update is checked before anything is merged, so one which is
+ * malformed or refers to operations where items are expected is
+ * rejected as a whole.
+ *
+ * The merged changes aren't added to the undo history of the editor.
+ * Local edits can still be undone, unless they touch the same text.
+ *
+ * Returns: %TRUE if @update was merged, or %FALSE if it is invalid
+ */
+gboolean
+text_crdt_merge (TextCrdt  *self,
+                 GBytes    *update,
+                 GError   **error)
+{
+    g_autoptr (GPtrArray) entries = NULL;
+    Reader reader = { 0 };
+    guint8 version;
+    guint32 n_entries;
+    gboolean progress;
+
+    g_return_val_if_fail (TEXT_IS_CRDT (self), FALSE);
+    g_return_val_if_fail (update != NULL, FALSE);
+
+    reader.data = g_bytes_get_data (update, &reader.length);
+
+    if (!_read_byte (&reader, &version) || version != UPDATE_VERSION ||
+        !_read_uint (&reader, &n_entries) || n_entries > MAX_ENTRIES)
+        goto invalid;
+
+    // Decode everything first, so that nothing is
+    // merged if the update turns out to be invalid
+    entries = g_ptr_array_new_full (n_entries, (GDestroyNotify) _entry_free);
+
+    for (guint i = 0; i < n_entries; i++)
+    {
+        Entry *entry;
+
+        if (!(entry = _read_entry (&reader)))
+            goto invalid;
+
+        g_ptr_array_add (entries, entry);
+    }
+
+    if (reader.pos != reader.length || !_check_entries (self, entries))
+        goto invalid;
+
+    self->merging = TRUE;
+    text_editor_begin_remote_transaction (self->editor);
+
+    // The entries are freed or kept as they are merged
+    g_ptr_array_set_free_func (entries, NULL);
+
+    for (guint i = 0; i < entries->len; i++)
+    {
+        Entry *entry = g_ptr_array_index (entries, i);
+
+        if (!_merge_entry (self, entry))
+            g_ptr_array_add (self->pending, entry);
+    }
+
+    // Merge the pending entries, until none of them can be
+    do
+    {
+        progress = FALSE;
+
+        for (guint i = 0; i < self->pending->len; i++)
+        {
+            Entry *entry = g_ptr_array_index (self->pending, i);
+
+            if (_get_entry_state (self, NULL, entry) == ENTRY_WAITING)
+                continue;
+
+            g_ptr_array_steal_index (self->pending, i--);
+            _merge_entry (self, entry);
+            progress = TRUE;
+        }
+    }
+    while (progress);
+
+    text_editor_commit_transaction (self->editor);
+    self->merging = FALSE;
+
+    return TRUE;
+
+invalid:
+    g_set_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID,
+                 "Invalid update");
+    return FALSE;
+}
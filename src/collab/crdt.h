@@ -0,0 +1,43 @@
+/* crdt.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "../editor/editor.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_CRDT (text_crdt_get_type())
+#define TEXT_CRDT_ERROR (text_crdt_error_quark ())
+
+typedef enum
+{
+    TEXT_CRDT_ERROR_INVALID
+} TextCrdtError;
+
+G_DECLARE_FINAL_TYPE (TextCrdt, text_crdt, TEXT, CRDT, GObject)
+
+GQuark      text_crdt_error_quark           (void);
+
+TextCrdt   *text_crdt_new                   (TextEditor *editor, guint32 replica);
+
+TextEditor *text_crdt_get_editor            (TextCrdt *self);
+guint32     text_crdt_get_replica           (TextCrdt *self);
+guint       text_crdt_get_n_items           (TextCrdt *self);
+guint       text_crdt_get_n_pending         (TextCrdt *self);
+
+GBytes     *text_crdt_encode_state_vector   (TextCrdt *self);
+GBytes     *text_crdt_encode_update         (TextCrdt *self, GBytes *state_vector, GError **error);
+gboolean    text_crdt_merge                 (TextCrdt *self, GBytes *update, GError **error);
+
+G_END_DECLS
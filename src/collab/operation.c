@@ -0,0 +1,1057 @@
+/* operation.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "operation.h"
+
+#include <string.h>
+#include <json-glib/json-glib.h>
+
+#include "../model/run.h"
+
+/*
+ * An operation describes an edit to the whole document as a sequence of
+ * components which retain, insert or delete characters, walking from
+ * the start of the document to its end. Offsets count every paragraph
+ * break as a single character, which is inserted as a newline.
+ *
+ * Because an operation spans the whole document, two operations made
+ * concurrently against the same document can be transformed against
+ * each other, giving operations which apply on top of the other and
+ * lead to the same result. This is what allows several editors to
+ * share a document.
+ */
+
+struct _TextOperation
+{
+    GArray *components;
+
+    // Length of the document before and after applying
+    int base_length;
+    int target_length;
+};
+
+G_DEFINE_BOXED_TYPE (TextOperation, text_operation, text_operation_copy, text_operation_free)
+
+G_DEFINE_QUARK (text-operation-error-quark, text_operation_error)
+
+static const struct {
+    TextOperationStyle style;
+    const char *name;
+} style_names[] = {
+    { TEXT_OPERATION_BOLD, "bold" },
+    { TEXT_OPERATION_ITALIC, "italic" },
+    { TEXT_OPERATION_UNDERLINE, "underline" },
+};
+
+static void
+_component_clear (TextOperationComponent *component)
+{
+    g_clear_pointer (&component->text, g_free);
+}
+
+/**
+ * text_operation_new:
+ *
+ * Creates an empty #TextOperation. Build it up by adding components
+ * in document order, for example with text_operation_retain().
+ *
+ * Returns: (transfer full): a new #TextOperation
+ */
+TextOperation *
+text_operation_new (void)
+{
+    TextOperation *self;
+
+    self = g_slice_new0 (TextOperation);
+    self->components = g_array_new (FALSE, TRUE, sizeof (TextOperationComponent));
+    g_array_set_clear_func (self->components, (GDestroyNotify) _component_clear);
+
+    return self;
+}
+
+TextOperation *
+text_operation_copy (TextOperation *self)
+{
+    TextOperation *copy;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    copy = text_operation_new ();
+    copy->base_length = self->base_length;
+    copy->target_length = self->target_length;
+
+    g_array_append_vals (copy->components, self->components->data, self->components->len);
+
+    for (guint i = 0; i < copy->components->len; i++)
+    {
+        TextOperationComponent *component = &g_array_index (copy->components, TextOperationComponent, i);
+        component->text = g_strdup (component->text);
+    }
+
+    return copy;
+}
+
+void
+text_operation_free (TextOperation *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_array_unref (self->components);
+    g_slice_free (TextOperation, self);
+}
+
+static TextOperationComponent *
+_last (TextOperation *self,
+       guint          from_end)
+{
+    if (self->components->len <= from_end)
+        return NULL;
+
+    return &g_array_index (self->components, TextOperationComponent,
+                           self->components->len - 1 - from_end);
+}
+
+/**
+ * text_operation_retain:
+ * @self: a #TextOperation
+ * @length: number of characters
+ *
+ * Skips over @length characters, leaving them unchanged.
+ */
+void
+text_operation_retain (TextOperation *self,
+                       int            length)
+{
+    text_operation_format (self, length, 0, 0);
+}
+
+/**
+ * text_operation_format:
+ * @self: a #TextOperation
+ * @length: number of characters
+ * @mask: the styles to change
+ * @values: the new values of the styles in @mask
+ *
+ * Skips over @length characters, changing the styles in @mask.
+ */
+void
+text_operation_format (TextOperation      *self,
+                       int                 length,
+                       TextOperationStyle  mask,
+                       TextOperationStyle  values)
+{
+    TextOperationComponent *last;
+    TextOperationComponent component = { 0, };
+
+    g_return_if_fail (self != NULL);
+
+    if (length <= 0)
+        return;
+
+    values &= mask;
+
+    self->base_length += length;
+    self->target_length += length;
+
+    last = _last (self, 0);
+
+    if (last && last->type == TEXT_OPERATION_RETAIN &&
+        last->mask == mask && last->values == values)
+    {
+        last->length += length;
+        return;
+    }
+
+    component.type = TEXT_OPERATION_RETAIN;
+    component.length = length;
+    component.mask = mask;
+    component.values = values;
+    g_array_append_val (self->components, component);
+}
+
+static void
+_insert (TextOperation      *self,
+         const char         *text,
+         TextOperationStyle  mask,
+         TextOperationStyle  values)
+{
+    TextOperationComponent *last;
+    TextOperationComponent component = { 0, };
+    guint position;
+    int length;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (text != NULL);
+
+    length = (int) g_utf8_strlen (text, -1);
+
+    if (length == 0)
+        return;
+
+    values &= mask;
+    self->target_length += length;
+
+    // Inserts always come before deletes at the same position, so
+    // that equivalent operations are built the same way
+    position = self->components->len;
+    last = _last (self, 0);
+
+    if (last && last->type == TEXT_OPERATION_DELETE)
+    {
+        position--;
+        last = _last (self, 1);
+    }
+
+    if (last && last->type == TEXT_OPERATION_INSERT &&
+        last->mask == mask && last->values == values)
+    {
+        char *joined = g_strconcat (last->text, text, NULL);
+
+        g_free (last->text);
+        last->text = joined;
+        last->length += length;
+        return;
+    }
+
+    component.type = TEXT_OPERATION_INSERT;
+    component.length = length;
+    component.text = g_strdup (text);
+    component.mask = mask;
+    component.values = values;
+    g_array_insert_val (self->components, position, component);
+}
+
+/**
+ * text_operation_insert:
+ * @self: a #TextOperation
+ * @text: the text to insert
+ *
+ * Inserts @text, which takes the style of the character before it.
+ * Paragraphs are split at every newline.
+ */
+void
+text_operation_insert (TextOperation *self,
+                       const char    *text)
+{
+    _insert (self, text, 0, 0);
+}
+
+/**
+ * text_operation_insert_styled:
+ * @self: a #TextOperation
+ * @text: the text to insert
+ * @values: the styles of the inserted text
+ *
+ * Inserts @text with exactly the styles in @values. Paragraphs are
+ * split at every newline.
+ */
+void
+text_operation_insert_styled (TextOperation      *self,
+                              const char         *text,
+                              TextOperationStyle  values)
+{
+    _insert (self, text, TEXT_OPERATION_ALL_STYLES, values);
+}
+
+/**
+ * text_operation_delete:
+ * @self: a #TextOperation
+ * @length: number of characters
+ *
+ * Deletes the next @length characters.
+ */
+void
+text_operation_delete (TextOperation *self,
+                       int            length)
+{
+    TextOperationComponent *last;
+    TextOperationComponent component = { 0, };
+
+    g_return_if_fail (self != NULL);
+
+    if (length <= 0)
+        return;
+
+    self->base_length += length;
+
+    last = _last (self, 0);
+
+    if (last && last->type == TEXT_OPERATION_DELETE)
+    {
+        last->length += length;
+        return;
+    }
+
+    component.type = TEXT_OPERATION_DELETE;
+    component.length = length;
+    g_array_append_val (self->components, component);
+}
+
+/**
+ * text_operation_get_base_length:
+ * @self: a #TextOperation
+ *
+ * Returns: the length a document must have for @self to apply to it
+ */
+int
+text_operation_get_base_length (TextOperation *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->base_length;
+}
+
+/**
+ * text_operation_get_target_length:
+ * @self: a #TextOperation
+ *
+ * Returns: the length of the document after applying @self
+ */
+int
+text_operation_get_target_length (TextOperation *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->target_length;
+}
+
+/**
+ * text_operation_is_noop:
+ * @self: a #TextOperation
+ *
+ * Returns: %TRUE if applying @self leaves the document unchanged
+ */
+gboolean
+text_operation_is_noop (TextOperation *self)
+{
+    g_return_val_if_fail (self != NULL, TRUE);
+
+    for (guint i = 0; i < self->components->len; i++)
+    {
+        TextOperationComponent *component = &g_array_index (self->components, TextOperationComponent, i);
+
+        if (component->type != TEXT_OPERATION_RETAIN || component->mask != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+guint
+text_operation_get_n_components (TextOperation *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->components->len;
+}
+
+const TextOperationComponent *
+text_operation_get_component (TextOperation *self,
+                              guint          n)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (n < self->components->len, NULL);
+
+    return &g_array_index (self->components, TextOperationComponent, n);
+}
+
+// Walks the components of an operation, allowing
+// them to be consumed a few characters at a time
+typedef struct
+{
+    TextOperation *operation;
+    guint index;
+    int consumed;
+} Iter;
+
+static TextOperationComponent *
+_iter_peek (Iter *iter)
+{
+    if (iter->index >= iter->operation->components->len)
+        return NULL;
+
+    return &g_array_index (iter->operation->components, TextOperationComponent, iter->index);
+}
+
+static int
+_iter_remaining (Iter *iter)
+{
+    return _iter_peek (iter)->length - iter->consumed;
+}
+
+static void
+_iter_advance (Iter *iter,
+               int   length)
+{
+    iter->consumed += length;
+
+    if (iter->consumed >= _iter_peek (iter)->length)
+    {
+        iter->index++;
+        iter->consumed = 0;
+    }
+}
+
+/**
+ * text_operation_transform:
+ * @a: a #TextOperation
+ * @b: a #TextOperation made concurrently with @a
+ * @a_prime: (out) (optional): location for @a transformed to apply after @b
+ * @b_prime: (out) (optional): location for @b transformed to apply after @a
+ *
+ * Transforms two operations made against the same document, so that
+ * applying @a then @b_prime gives the same document as applying @b
+ * then @a_prime.
+ *
+ * Ties are broken in favour of @a: text inserted by both at the same
+ * position is placed with @a's first, and where both change the same
+ * style of the same characters, @a's value is kept.
+ *
+ * Returns: %TRUE if the operations could be transformed, or %FALSE if
+ *   they weren't made against the same document
+ */
+gboolean
+text_operation_transform (TextOperation  *a,
+                          TextOperation  *b,
+                          TextOperation **a_prime,
+                          TextOperation **b_prime)
+{
+    g_autoptr (TextOperation) ap = NULL;
+    g_autoptr (TextOperation) bp = NULL;
+    Iter ia = { a, 0, 0 };
+    Iter ib = { b, 0, 0 };
+
+    g_return_val_if_fail (a != NULL, FALSE);
+    g_return_val_if_fail (b != NULL, FALSE);
+
+    if (a->base_length != b->base_length)
+        return FALSE;
+
+    ap = text_operation_new ();
+    bp = text_operation_new ();
+
+    for (;;)
+    {
+        TextOperationComponent *ca = _iter_peek (&ia);
+        TextOperationComponent *cb = _iter_peek (&ib);
+        int length;
+
+        if (!ca && !cb)
+            break;
+
+        // Inserted text is retained by the other operation
+        if (ca && ca->type == TEXT_OPERATION_INSERT)
+        {
+            _insert (ap, ca->text, ca->mask, ca->values);
+            text_operation_retain (bp, ca->length);
+            _iter_advance (&ia, ca->length);
+            continue;
+        }
+
+        if (cb && cb->type == TEXT_OPERATION_INSERT)
+        {
+            text_operation_retain (ap, cb->length);
+            _insert (bp, cb->text, cb->mask, cb->values);
+            _iter_advance (&ib, cb->length);
+            continue;
+        }
+
+        // Both operations cover the same base length, so
+        // neither can run out of components before the other
+        if (!ca || !cb)
+            return FALSE;
+
+        length = MIN (_iter_remaining (&ia), _iter_remaining (&ib));
+
+        if (ca->type == TEXT_OPERATION_RETAIN && cb->type == TEXT_OPERATION_RETAIN)
+        {
+            text_operation_format (ap, length, ca->mask, ca->values);
+            text_operation_format (bp, length, cb->mask & ~ca->mask, cb->values);
+        }
+        else if (ca->type == TEXT_OPERATION_DELETE && cb->type == TEXT_OPERATION_RETAIN)
+        {
+            text_operation_delete (ap, length);
+        }
+        else if (ca->type == TEXT_OPERATION_RETAIN && cb->type == TEXT_OPERATION_DELETE)
+        {
+            text_operation_delete (bp, length);
+        }
+
+        // Text deleted by both is already gone
+        _iter_advance (&ia, length);
+        _iter_advance (&ib, length);
+    }
+
+    if (a_prime)
+        *a_prime = g_steal_pointer (&ap);
+
+    if (b_prime)
+        *b_prime = g_steal_pointer (&bp);
+
+    return TRUE;
+}
+
+/**
+ * text_operation_compose:
+ * @a: a #TextOperation
+ * @b: a #TextOperation to apply after @a
+ *
+ * Combines two consecutive operations into one with the same effect.
+ *
+ * Text which takes the style of the character before it can't have its
+ * style changed by the same operation, so operations which would need
+ * to do so can't be composed.
+ *
+ * Returns: (transfer full) (nullable): the composed operation, or %NULL
+ *   if @a and @b can't be composed
+ */
+TextOperation *
+text_operation_compose (TextOperation *a,
+                        TextOperation *b)
+{
+    g_autoptr (TextOperation) result = NULL;
+    Iter ia = { a, 0, 0 };
+    Iter ib = { b, 0, 0 };
+
+    g_return_val_if_fail (a != NULL, NULL);
+    g_return_val_if_fail (b != NULL, NULL);
+
+    if (a->target_length != b->base_length)
+        return NULL;
+
+    result = text_operation_new ();
+
+    for (;;)
+    {
+        TextOperationComponent *ca = _iter_peek (&ia);
+        TextOperationComponent *cb = _iter_peek (&ib);
+        int length;
+
+        if (!ca && !cb)
+            break;
+
+        // Text deleted by @a is never seen by @b
+        if (ca && ca->type == TEXT_OPERATION_DELETE)
+        {
+            length = _iter_remaining (&ia);
+            text_operation_delete (result, length);
+            _iter_advance (&ia, length);
+            continue;
+        }
+
+        if (cb && cb->type == TEXT_OPERATION_INSERT)
+        {
+            _insert (result, cb->text, cb->mask, cb->values);
+            _iter_advance (&ib, cb->length);
+            continue;
+        }
+
+        if (!ca || !cb)
+            return NULL;
+
+        length = MIN (_iter_remaining (&ia), _iter_remaining (&ib));
+
+        if (ca->type == TEXT_OPERATION_RETAIN && cb->type == TEXT_OPERATION_RETAIN)
+        {
+            text_operation_format (result, length, ca->mask | cb->mask,
+                                   (ca->values & ~cb->mask) | cb->values);
+        }
+        else if (ca->type == TEXT_OPERATION_RETAIN && cb->type == TEXT_OPERATION_DELETE)
+        {
+            text_operation_delete (result, length);
+        }
+        else if (ca->type == TEXT_OPERATION_INSERT && cb->type == TEXT_OPERATION_RETAIN)
+        {
+            g_autofree char *text = NULL;
+
+            if (cb->mask && !ca->mask)
+                return NULL;
+
+            text = g_utf8_substring (ca->text, ia.consumed, ia.consumed + length);
+            _insert (result, text, ca->mask, (ca->values & ~cb->mask) | cb->values);
+        }
+
+        // Text inserted by @a and deleted by @b cancels out
+        _iter_advance (&ia, length);
+        _iter_advance (&ib, length);
+    }
+
+    return g_steal_pointer (&result);
+}
+
+// Creates a temporary mark, which isn't registered
+// with the document and so is never adjusted
+static TextMark *
+_mark_at_offset (TextDocument *document,
+                 int           offset)
+{
+    TextParagraph *paragraph;
+    int index;
+
+    if (!text_document_get_position_at_char_offset (document, offset, &paragraph, &index))
+        return NULL;
+
+    return text_mark_new (document, paragraph, index, TEXT_GRAVITY_RIGHT);
+}
+
+static void
+_apply_format (TextEditor         *editor,
+               TextDocument       *document,
+               int                 offset,
+               int                 length,
+               TextOperationStyle  mask,
+               TextOperationStyle  values)
+{
+    g_autoptr (TextMark) start = _mark_at_offset (document, offset);
+    g_autoptr (TextMark) end = _mark_at_offset (document, offset + length);
+
+    if (!start || !end)
+        return;
+
+    if (mask & TEXT_OPERATION_BOLD)
+        text_editor_apply_format_bold (editor, start, end, (values & TEXT_OPERATION_BOLD) != 0);
+
+    if (mask & TEXT_OPERATION_ITALIC)
+        text_editor_apply_format_italic (editor, start, end, (values & TEXT_OPERATION_ITALIC) != 0);
+
+    if (mask & TEXT_OPERATION_UNDERLINE)
+        text_editor_apply_format_underline (editor, start, end, (values & TEXT_OPERATION_UNDERLINE) != 0);
+}
+
+static void
+_apply_insert (TextEditor             *editor,
+               TextDocument           *document,
+               int                     offset,
+               TextOperationComponent *component)
+{
+    const char *text = component->text;
+
+    while (*text)
+    {
+        g_autoptr (TextMark) mark = _mark_at_offset (document, offset);
+        const char *newline;
+        char *segment;
+        int length;
+
+        if (!mark)
+            return;
+
+        if (*text == '\n')
+        {
+            text_editor_split_at_mark (editor, mark);
+            offset++;
+            text++;
+            continue;
+        }
+
+        newline = strchr (text, '\n');
+        segment = newline ? g_strndup (text, newline - text) : g_strdup (text);
+        length = (int) g_utf8_strlen (segment, -1);
+
+        // The text goes into the run at the mark, which keeps its style
+        // unless it doesn't match, so typing doesn't fragment the runs
+        text_editor_insert_text_at_mark (editor, mark, segment);
+
+        if (component->mask)
+        {
+            TextOperationStyle style;
+            TextFragment *item;
+
+            item = text_editor_get_item_at_mark (editor, mark);
+            style = text_operation_style_from_fragment (item);
+
+            if (!TEXT_IS_RUN (item))
+                _apply_format (editor, document, offset, length, component->mask, component->values);
+            else if ((style & component->mask) != component->values)
+                _apply_format (editor, document, offset, length,
+                               (style & component->mask) ^ component->values,
+                               component->values);
+        }
+
+        offset += length;
+        text += strlen (segment);
+        g_free (segment);
+    }
+}
+
+/**
+ * text_operation_apply:
+ * @self: a #TextOperation
+ * @editor: the #TextEditor to apply @self through
+ * @error: return location for a #GError
+ *
+ * Applies @self to the document of @editor as a single transaction,
+ * so only the paragraphs it touches are laid out again. If the document
+ * doesn't have the base length of @self, it is left unchanged and
+ * %TEXT_OPERATION_ERROR_INVALID is set.
+ *
+ * Returns: %TRUE if @self could be applied
+ */
+gboolean
+text_operation_apply (TextOperation  *self,
+                      TextEditor     *editor,
+                      GError        **error)
+{
+    TextDocument *document;
+    int offset;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (TEXT_IS_EDITOR (editor), FALSE);
+
+    g_object_get (editor, "document", &document, NULL);
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (document), FALSE);
+
+    // The document is only borrowed from the editor
+    g_object_unref (document);
+
+    if (text_document_get_length (document) != self->base_length)
+    {
+        g_set_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID,
+                     "Operation of base length %d does not apply to a document of length %d",
+                     self->base_length, text_document_get_length (document));
+        return FALSE;
+    }
+
+    text_editor_begin_transaction (editor);
+
+    offset = 0;
+
+    for (guint i = 0; i < self->components->len; i++)
+    {
+        TextOperationComponent *component = &g_array_index (self->components, TextOperationComponent, i);
+        g_autoptr (TextMark) mark = NULL;
+
+        switch (component->type)
+        {
+        case TEXT_OPERATION_RETAIN:
+            if (component->mask)
+                _apply_format (editor, document, offset, component->length,
+                               component->mask, component->values);
+            offset += component->length;
+            break;
+
+        case TEXT_OPERATION_INSERT:
+            _apply_insert (editor, document, offset, component);
+            offset += component->length;
+            break;
+
+        case TEXT_OPERATION_DELETE:
+            if ((mark = _mark_at_offset (document, offset)))
+                text_editor_delete_at_mark (editor, mark, component->length);
+            break;
+        }
+    }
+
+    text_editor_commit_transaction (editor);
+
+    return TRUE;
+}
+
+/**
+ * text_operation_apply_to_text:
+ * @self: a #TextOperation
+ * @text: plain text, with a newline for every paragraph break
+ *
+ * Applies @self to @text, ignoring any styles. This allows a server
+ * to keep track of a shared document without laying it out.
+ *
+ * Returns: (transfer full) (nullable): the resulting text, or %NULL if
+ *   @text doesn't have the base length of @self
+ */
+char *
+text_operation_apply_to_text (TextOperation *self,
+                              const char    *text)
+{
+    GString *result;
+    const char *pos;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (text != NULL, NULL);
+
+    if (g_utf8_strlen (text, -1) != self->base_length)
+        return NULL;
+
+    result = g_string_new (NULL);
+    pos = text;
+
+    for (guint i = 0; i < self->components->len; i++)
+    {
+        TextOperationComponent *component = &g_array_index (self->components, TextOperationComponent, i);
+        const char *end;
+
+        switch (component->type)
+        {
+        case TEXT_OPERATION_RETAIN:
+            end = g_utf8_offset_to_pointer (pos, component->length);
+            g_string_append_len (result, pos, end - pos);
+            pos = end;
+            break;
+
+        case TEXT_OPERATION_INSERT:
+            g_string_append (result, component->text);
+            break;
+
+        case TEXT_OPERATION_DELETE:
+            pos = g_utf8_offset_to_pointer (pos, component->length);
+            break;
+        }
+    }
+
+    return g_string_free (result, FALSE);
+}
+
+static void
+_add_styles (JsonBuilder            *builder,
+             TextOperationComponent *component)
+{
+    for (guint i = 0; i < G_N_ELEMENTS (style_names); i++)
+    {
+        if (!(component->mask & style_names[i].style))
+            continue;
+
+        json_builder_set_member_name (builder, style_names[i].name);
+        json_builder_add_boolean_value (builder, (component->values & style_names[i].style) != 0);
+    }
+}
+
+/**
+ * text_operation_to_string:
+ * @self: a #TextOperation
+ *
+ * Serialises @self as a JSON array, in which plain retains are positive
+ * numbers, deletes are negative numbers and plain inserts are strings.
+ * Components which change or set styles are objects with a "retain"
+ * or "insert" member and a boolean member for every style.
+ *
+ * Returns: (transfer full): the serialised operation
+ */
+char *
+text_operation_to_string (TextOperation *self)
+{
+    g_autoptr (JsonBuilder) builder = NULL;
+    g_autoptr (JsonGenerator) generator = NULL;
+    g_autoptr (JsonNode) root = NULL;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    builder = json_builder_new ();
+    json_builder_begin_array (builder);
+
+    for (guint i = 0; i < self->components->len; i++)
+    {
+        TextOperationComponent *component = &g_array_index (self->components, TextOperationComponent, i);
+
+        if (component->type == TEXT_OPERATION_DELETE)
+        {
+            json_builder_add_int_value (builder, -component->length);
+        }
+        else if (component->mask == 0)
+        {
+            if (component->type == TEXT_OPERATION_RETAIN)
+                json_builder_add_int_value (builder, component->length);
+            else
+                json_builder_add_string_value (builder, component->text);
+        }
+        else
+        {
+            json_builder_begin_object (builder);
+
+            if (component->type == TEXT_OPERATION_RETAIN)
+            {
+                json_builder_set_member_name (builder, "retain");
+                json_builder_add_int_value (builder, component->length);
+            }
+            else
+            {
+                json_builder_set_member_name (builder, "insert");
+                json_builder_add_string_value (builder, component->text);
+            }
+
+            _add_styles (builder, component);
+            json_builder_end_object (builder);
+        }
+    }
+
+    json_builder_end_array (builder);
+
+    root = json_builder_get_root (builder);
+    generator = json_generator_new ();
+    json_generator_set_root (generator, root);
+
+    return json_generator_to_data (generator, NULL);
+}
+
+static gboolean
+_parse_component (TextOperation  *self,
+                  JsonNode       *node,
+                  GError        **error)
+{
+    JsonObject *object;
+    TextOperationStyle mask = 0;
+    TextOperationStyle values = 0;
+
+    if (JSON_NODE_HOLDS_VALUE (node) &&
+        json_node_get_value_type (node) == G_TYPE_INT64)
+    {
+        gint64 length = json_node_get_int (node);
+
+        if (length > 0 && length <= G_MAXINT)
+            text_operation_retain (self, (int) length);
+        else if (length < 0 && length >= -G_MAXINT)
+            text_operation_delete (self, (int) -length);
+        else
+            goto invalid;
+
+        return TRUE;
+    }
+
+    if (JSON_NODE_HOLDS_VALUE (node) &&
+        json_node_get_value_type (node) == G_TYPE_STRING)
+    {
+        const char *text = json_node_get_string (node);
+
+        if (!g_utf8_validate (text, -1, NULL))
+            goto invalid;
+
+        text_operation_insert (self, text);
+        return TRUE;
+    }
+
+    if (!JSON_NODE_HOLDS_OBJECT (node))
+        goto invalid;
+
+    object = json_node_get_object (node);
+
+    for (guint i = 0; i < G_N_ELEMENTS (style_names); i++)
+    {
+        if (!json_object_has_member (object, style_names[i].name))
+            continue;
+
+        mask |= style_names[i].style;
+
+        if (json_object_get_boolean_member (object, style_names[i].name))
+            values |= style_names[i].style;
+    }
+
+    if (json_object_has_member (object, "retain"))
+    {
+        gint64 length = json_object_get_int_member (object, "retain");
+
+        if (length <= 0 || length > G_MAXINT)
+            goto invalid;
+
+        text_operation_format (self, (int) length, mask, values);
+        return TRUE;
+    }
+
+    if (json_object_has_member (object, "insert"))
+    {
+        const char *text = json_object_get_string_member (object, "insert");
+
+        if (!text || !g_utf8_validate (text, -1, NULL))
+            goto invalid;
+
+        _insert (self, text, mask, values);
+        return TRUE;
+    }
+
+invalid:
+    g_set_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID,
+                 "Invalid operation component");
+    return FALSE;
+}
+
+/**
+ * text_operation_new_from_string:
+ * @string: an operation serialised with text_operation_to_string()
+ * @error: return location for a #GError
+ *
+ * Parses an operation serialised with text_operation_to_string().
+ *
+ * Returns: (transfer full) (nullable): the parsed #TextOperation, or
+ *   %NULL if @string isn't a valid operation
+ */
+TextOperation *
+text_operation_new_from_string (const char  *string,
+                                GError     **error)
+{
+    g_autoptr (JsonParser) parser = NULL;
+    g_autoptr (TextOperation) self = NULL;
+    JsonArray *array;
+    JsonNode *root;
+
+    g_return_val_if_fail (string != NULL, NULL);
+
+    parser = json_parser_new ();
+
+    if (!json_parser_load_from_data (parser, string, -1, error))
+        return NULL;
+
+    root = json_parser_get_root (parser);
+
+    if (!root || !JSON_NODE_HOLDS_ARRAY (root))
+    {
+        g_set_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID,
+                     "Operation is not an array");
+        return NULL;
+    }
+
+    array = json_node_get_array (root);
+    self = text_operation_new ();
+
+    for (guint i = 0; i < json_array_get_length (array); i++)
+    {
+        if (!_parse_component (self, json_array_get_element (array, i), error))
+            return NULL;
+    }
+
+    return g_steal_pointer (&self);
+}
+
+/**
+ * text_operation_style_from_history:
+ * @style: styles recorded in the edit history
+ *
+ * Converts the styles of a #TextHistoryRecord to the styles carried
+ * by operations.
+ *
+ * Returns: the equivalent #TextOperationStyle
+ */
+TextOperationStyle
+text_operation_style_from_history (TextHistoryStyle style)
+{
+    return ((style & TEXT_HISTORY_BOLD) ? TEXT_OPERATION_BOLD : 0)
+         | ((style & TEXT_HISTORY_ITALIC) ? TEXT_OPERATION_ITALIC : 0)
+         | ((style & TEXT_HISTORY_UNDERLINE) ? TEXT_OPERATION_UNDERLINE : 0);
+}
+
+/**
+ * text_operation_style_from_fragment:
+ * @fragment: (nullable): a #TextFragment
+ *
+ * Gets the styles of @fragment as carried by operations.
+ *
+ * Returns: the styles of @fragment, or none if it is not a #TextRun
+ */
+TextOperationStyle
+text_operation_style_from_fragment (TextFragment *fragment)
+{
+    TextRun *run;
+
+    if (!TEXT_IS_RUN (fragment))
+        return 0;
+
+    run = TEXT_RUN (fragment);
+
+    return (text_run_get_style_bold (run) ? TEXT_OPERATION_BOLD : 0)
+         | (text_run_get_style_italic (run) ? TEXT_OPERATION_ITALIC : 0)
+         | (text_run_get_style_underline (run) ? TEXT_OPERATION_UNDERLINE : 0);
+}
@@ -0,0 +1,102 @@
+/* operation.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "../editor/editor.h"
+#include "../editor/history.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_OPERATION (text_operation_get_type ())
+#define TEXT_OPERATION_ERROR (text_operation_error_quark ())
+
+typedef enum
+{
+    TEXT_OPERATION_RETAIN,
+    TEXT_OPERATION_INSERT,
+    TEXT_OPERATION_DELETE
+} TextOperationType;
+
+typedef enum
+{
+    TEXT_OPERATION_BOLD      = 1 << 0,
+    TEXT_OPERATION_ITALIC    = 1 << 1,
+    TEXT_OPERATION_UNDERLINE = 1 << 2,
+
+    TEXT_OPERATION_ALL_STYLES = 0x7
+} TextOperationStyle;
+
+typedef enum
+{
+    TEXT_OPERATION_ERROR_INVALID
+} TextOperationError;
+
+typedef struct _TextOperationComponent TextOperationComponent;
+
+struct _TextOperationComponent
+{
+    TextOperationType type;
+
+    // Number of characters retained, inserted or deleted, where
+    // every paragraph break counts as a single character
+    int length;
+
+    // Inserted text, with a newline for every paragraph break
+    char *text;
+
+    // For retains, the styles changed over the retained characters.
+    // For inserts, the styles of the inserted text, or none for text
+    // which takes the style of the character before it.
+    TextOperationStyle mask;
+    TextOperationStyle values;
+};
+
+typedef struct _TextOperation TextOperation;
+
+GType          text_operation_get_type            (void) G_GNUC_CONST;
+GQuark         text_operation_error_quark         (void);
+
+TextOperation *text_operation_new                 (void);
+TextOperation *text_operation_copy                (TextOperation *self);
+void           text_operation_free                (TextOperation *self);
+
+void           text_operation_retain              (TextOperation *self, int length);
+void           text_operation_format              (TextOperation *self, int length, TextOperationStyle mask, TextOperationStyle values);
+void           text_operation_insert              (TextOperation *self, const char *text);
+void           text_operation_insert_styled       (TextOperation *self, const char *text, TextOperationStyle values);
+void           text_operation_delete              (TextOperation *self, int length);
+
+int            text_operation_get_base_length     (TextOperation *self);
+int            text_operation_get_target_length   (TextOperation *self);
+gboolean       text_operation_is_noop             (TextOperation *self);
+guint          text_operation_get_n_components    (TextOperation *self);
+const TextOperationComponent *
+               text_operation_get_component       (TextOperation *self, guint n);
+
+TextOperation *text_operation_compose             (TextOperation *a, TextOperation *b);
+gboolean       text_operation_transform           (TextOperation *a, TextOperation *b, TextOperation **a_prime, TextOperation **b_prime);
+gboolean       text_operation_apply               (TextOperation *self, TextEditor *editor, GError **error);
+char          *text_operation_apply_to_text       (TextOperation *self, const char *text);
+
+char          *text_operation_to_string           (TextOperation *self);
+TextOperation *text_operation_new_from_string     (const char *string, GError **error);
+
+TextOperationStyle
+               text_operation_style_from_history  (TextHistoryStyle style);
+TextOperationStyle
+               text_operation_style_from_fragment (TextFragment *fragment);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextOperation, text_operation_free)
+
+G_END_DECLS
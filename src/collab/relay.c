@@ -0,0 +1,208 @@
+/* relay.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "relay.h"
+
+/*
+ * An in-process server for a set of #TextCollabClient. Operations sent
+ * by the clients are queued until text_collab_relay_flush() is called,
+ * so that tests can decide which edits are concurrent.
+ */
+
+struct _TextCollabRelay
+{
+    GObject parent_instance;
+
+    GPtrArray *clients;
+
+    // Every operation put in order, the index being the
+    // revision it was made against
+    GPtrArray *history;
+
+    // Messages sent by the clients and not yet put in order
+    GQueue *pending;
+};
+
+typedef struct
+{
+    TextCollabClient *client;
+    int revision;
+    TextOperation *operation;
+} Message;
+
+G_DEFINE_FINAL_TYPE (TextCollabRelay, text_collab_relay, G_TYPE_OBJECT)
+
+static void
+_message_free (Message *message)
+{
+    text_operation_free (message->operation);
+    g_free (message);
+}
+
+/**
+ * text_collab_relay_new:
+ *
+ * Creates a relay which passes operations between the clients added to
+ * it, as a server would.
+ *
+ * Returns: (transfer full): a new #TextCollabRelay
+ */
+TextCollabRelay *
+text_collab_relay_new (void)
+{
+    return g_object_new (TEXT_TYPE_COLLAB_RELAY, NULL);
+}
+
+static void
+text_collab_relay_finalize (GObject *object)
+{
+    TextCollabRelay *self = (TextCollabRelay *)object;
+
+    g_queue_free_full (self->pending, (GDestroyNotify) _message_free);
+    g_ptr_array_unref (self->history);
+    g_ptr_array_unref (self->clients);
+
+    G_OBJECT_CLASS (text_collab_relay_parent_class)->finalize (object);
+}
+
+static void
+text_collab_relay_class_init (TextCollabRelayClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = text_collab_relay_finalize;
+}
+
+static void
+text_collab_relay_init (TextCollabRelay *self)
+{
+    self->clients = g_ptr_array_new_with_free_func (g_object_unref);
+    self->history = g_ptr_array_new_with_free_func ((GDestroyNotify) text_operation_free);
+    self->pending = g_queue_new ();
+}
+
+static void
+_send (TextCollabRelay  *self,
+       int               revision,
+       TextOperation    *operation,
+       TextCollabClient *client)
+{
+    Message *message;
+
+    message = g_new0 (Message, 1);
+    message->client = client;
+    message->revision = revision;
+    message->operation = text_operation_copy (operation);
+
+    g_queue_push_tail (self->pending, message);
+}
+
+/**
+ * text_collab_relay_add_client:
+ * @self: a #TextCollabRelay
+ * @client: a #TextCollabClient
+ *
+ * Adds @client to @self. The document of @client must be the same as
+ * that of the other clients at the current revision of @self.
+ */
+void
+text_collab_relay_add_client (TextCollabRelay  *self,
+                              TextCollabClient *client)
+{
+    g_return_if_fail (TEXT_IS_COLLAB_RELAY (self));
+    g_return_if_fail (TEXT_IS_COLLAB_CLIENT (client));
+    g_return_if_fail (text_collab_client_get_revision (client) == (int) self->history->len);
+
+    g_ptr_array_add (self->clients, g_object_ref (client));
+    g_signal_connect_object (client, "send", G_CALLBACK (_send), self, G_CONNECT_SWAPPED);
+}
+
+int
+text_collab_relay_get_revision (TextCollabRelay *self)
+{
+    g_return_val_if_fail (TEXT_IS_COLLAB_RELAY (self), 0);
+
+    return self->history->len;
+}
+
+/**
+ * text_collab_relay_flush:
+ * @self: a #TextCollabRelay
+ *
+ * Puts every queued operation in order, transforming it against the
+ * operations its client hadn't seen when it was made, and passes it
+ * on to the other clients. This includes operations sent while
+ * flushing, so every client is synchronised afterwards.
+ *
+ * Returns: the number of operations put in order
+ */
+guint
+text_collab_relay_flush (TextCollabRelay *self)
+{
+    Message *message;
+    guint n_operations = 0;
+
+    g_return_val_if_fail (TEXT_IS_COLLAB_RELAY (self), 0);
+
+    while ((message = g_queue_pop_head (self->pending)))
+    {
+        TextOperation *operation;
+
+        if (message->revision < 0 || message->revision > (int) self->history->len)
+        {
+            g_critical ("Operation made against unknown revision %d", message->revision);
+            _message_free (message);
+            continue;
+        }
+
+        operation = g_steal_pointer (&message->operation);
+
+        for (guint i = message->revision; i < self->history->len; i++)
+        {
+            TextOperation *transformed;
+
+            if (!text_operation_transform (operation, g_ptr_array_index (self->history, i),
+                                           &transformed, NULL))
+            {
+                g_critical ("Operation does not apply to revision %d", message->revision);
+                g_clear_pointer (&operation, text_operation_free);
+                break;
+            }
+
+            text_operation_free (operation);
+            operation = transformed;
+        }
+
+        if (operation)
+        {
+            g_ptr_array_add (self->history, operation);
+            n_operations++;
+
+            // Acknowledging may send the next operation of the
+            // client, which is queued and handled in this loop
+            for (guint i = 0; i < self->clients->len; i++)
+            {
+                TextCollabClient *client = g_ptr_array_index (self->clients, i);
+                g_autoptr (GError) error = NULL;
+
+                if (client == message->client)
+                    text_collab_client_acknowledge (client);
+                else if (!text_collab_client_receive (client, operation, &error))
+                    g_critical ("Client could not apply revision %u: %s",
+                                self->history->len - 1, error->message);
+            }
+        }
+
+        g_free (message);
+    }
+
+    return n_operations;
+}
@@ -0,0 +1,30 @@
+/* relay.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "client.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_COLLAB_RELAY (text_collab_relay_get_type())
+
+G_DECLARE_FINAL_TYPE (TextCollabRelay, text_collab_relay, TEXT, COLLAB_RELAY, GObject)
+
+TextCollabRelay *text_collab_relay_new             (void);
+
+void             text_collab_relay_add_client      (TextCollabRelay *self, TextCollabClient *client);
+int              text_collab_relay_get_revision    (TextCollabRelay *self);
+guint            text_collab_relay_flush           (TextCollabRelay *self);
+
+G_END_DECLS
@@ -0,0 +1,476 @@
+/* autosave.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "autosave.h"
+
+struct _TextAutosave
+{
+    GObject parent_instance;
+
+    TextDocument *document;
+    GFile *file;
+    FormatWriteFunc write_func;
+
+    guint interval;
+    guint timeout_id;
+
+    // Document generation of the last snapshot written
+    // successfully, which is clean until it changes
+    guint saved_generation;
+
+    // Set while a snapshot is being written on a worker
+    // thread, as only one write may be in flight at once
+    gboolean saving;
+    GCancellable *cancellable;
+};
+
+G_DEFINE_FINAL_TYPE (TextAutosave, text_autosave, G_TYPE_OBJECT)
+
+enum {
+    PROP_0,
+    PROP_DOCUMENT,
+    PROP_FILE,
+    PROP_INTERVAL,
+    N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+enum {
+    SAVED,
+    FAILED,
+    N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+typedef struct
+{
+    GFile *file;
+    TextSnapshot *snapshot;
+    FormatWriteFunc write_func;
+    guint generation;
+} SaveData;
+
+static void
+_save_data_free (SaveData *data)
+{
+    g_object_unref (data->file);
+    text_snapshot_unref (data->snapshot);
+    g_free (data);
+}
+
+/**
+ * text_autosave_new:
+ * @document: the #TextDocument to save
+ * @file: the #GFile to save @document to
+ *
+ * Creates an autosave service which writes @document to @file every
+ * few seconds while it has unsaved changes. The document is snapshotted
+ * on the main thread and written on a worker thread, so edits can
+ * continue while the file is being written.
+ *
+ * Returns: (transfer full): a new #TextAutosave
+ */
+TextAutosave *
+text_autosave_new (TextDocument *document,
+                   GFile        *file)
+{
+    return g_object_new (TEXT_TYPE_AUTOSAVE,
+                         "document", document,
+                         "file", file,
+                         NULL);
+}
+
+static void
+text_autosave_dispose (GObject *object)
+{
+    TextAutosave *self = (TextAutosave *)object;
+
+    g_clear_handle_id (&self->timeout_id, g_source_remove);
+    g_cancellable_cancel (self->cancellable);
+
+    G_OBJECT_CLASS (text_autosave_parent_class)->dispose (object);
+}
+
+static void
+text_autosave_finalize (GObject *object)
+{
+    TextAutosave *self = (TextAutosave *)object;
+
+    g_clear_object (&self->document);
+    g_clear_object (&self->file);
+    g_clear_object (&self->cancellable);
+
+    G_OBJECT_CLASS (text_autosave_parent_class)->finalize (object);
+}
+
+static void
+text_autosave_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+    TextAutosave *self = TEXT_AUTOSAVE (object);
+
+    switch (prop_id)
+    {
+    case PROP_DOCUMENT:
+        g_value_set_object (value, self->document);
+        break;
+    case PROP_FILE:
+        g_value_set_object (value, self->file);
+        break;
+    case PROP_INTERVAL:
+        g_value_set_uint (value, self->interval);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_autosave_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+    TextAutosave *self = TEXT_AUTOSAVE (object);
+
+    switch (prop_id)
+    {
+    case PROP_DOCUMENT:
+        self->document = g_value_dup_object (value);
+        self->saved_generation = text_document_get_generation (self->document);
+        break;
+    case PROP_FILE:
+        self->file = g_value_dup_object (value);
+        break;
+    case PROP_INTERVAL:
+        text_autosave_set_interval (self, g_value_get_uint (value));
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+text_autosave_class_init (TextAutosaveClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = text_autosave_dispose;
+    object_class->finalize = text_autosave_finalize;
+    object_class->get_property = text_autosave_get_property;
+    object_class->set_property = text_autosave_set_property;
+
+    properties [PROP_DOCUMENT]
+        = g_param_spec_object ("document",
+                               "Document",
+                               "Document",
+                               TEXT_TYPE_DOCUMENT,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties [PROP_FILE]
+        = g_param_spec_object ("file",
+                               "File",
+                               "File",
+                               G_TYPE_FILE,
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+    properties [PROP_INTERVAL]
+        = g_param_spec_uint ("interval",
+                             "Interval",
+                             "Seconds between saves, or zero to only save on request",
+                             0, G_MAXUINT, 5,
+                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_EXPLICIT_NOTIFY);
+
+    g_object_class_install_properties (object_class, N_PROPS, properties);
+
+    /**
+     * TextAutosave::saved:
+     * @self: the #TextAutosave
+     * @generation: the document generation which was saved
+     *
+     * Emitted on the main thread once a snapshot of the document has
+     * been written to the file.
+     */
+    signals [SAVED] =
+        g_signal_new ("saved",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 1, G_TYPE_UINT);
+
+    /**
+     * TextAutosave::failed:
+     * @self: the #TextAutosave
+     * @error: the #GError the write failed with
+     *
+     * Emitted on the main thread when a snapshot could not be written.
+     * The previous contents of the file are left in place and the
+     * document stays dirty, so the next save will try again.
+     */
+    signals [FAILED] =
+        g_signal_new ("failed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 1, G_TYPE_ERROR);
+}
+
+static void
+text_autosave_init (TextAutosave *self)
+{
+    self->write_func = format_write_plain_text;
+    self->cancellable = g_cancellable_new ();
+}
+
+/**
+ * text_autosave_get_document:
+ * @self: a #TextAutosave
+ *
+ * Returns: (transfer none): the #TextDocument being saved
+ */
+TextDocument *
+text_autosave_get_document (TextAutosave *self)
+{
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), NULL);
+
+    return self->document;
+}
+
+/**
+ * text_autosave_get_file:
+ * @self: a #TextAutosave
+ *
+ * Returns: (transfer none): the #GFile the document is saved to
+ */
+GFile *
+text_autosave_get_file (TextAutosave *self)
+{
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), NULL);
+
+    return self->file;
+}
+
+/**
+ * text_autosave_get_interval:
+ * @self: a #TextAutosave
+ *
+ * Returns: the number of seconds between saves, or zero if the
+ *   document is only saved by text_autosave_save()
+ */
+guint
+text_autosave_get_interval (TextAutosave *self)
+{
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), 0);
+
+    return self->interval;
+}
+
+static gboolean
+_tick (TextAutosave *self)
+{
+    text_autosave_save (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * text_autosave_set_interval:
+ * @self: a #TextAutosave
+ * @seconds: the number of seconds between saves
+ *
+ * Sets how often the document is checked for changes and saved. When
+ * @seconds is zero, the document is only saved by text_autosave_save().
+ *
+ * Checking a clean document only compares its generation, so a short
+ * interval costs nothing while the user is not typing.
+ */
+void
+text_autosave_set_interval (TextAutosave *self,
+                            guint         seconds)
+{
+    g_return_if_fail (TEXT_IS_AUTOSAVE (self));
+
+    g_clear_handle_id (&self->timeout_id, g_source_remove);
+
+    if (seconds > 0)
+        self->timeout_id = g_timeout_add_seconds (seconds, G_SOURCE_FUNC (_tick), self);
+
+    if (self->interval != seconds)
+    {
+        self->interval = seconds;
+        g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_INTERVAL]);
+    }
+}
+
+/**
+ * text_autosave_set_write_func:
+ * @self: a #TextAutosave
+ * @write_func: the #FormatWriteFunc to serialise the document with
+ *
+ * Sets the format the document is saved in. This defaults to
+ * format_write_plain_text(). @write_func is called on a worker thread.
+ */
+void
+text_autosave_set_write_func (TextAutosave    *self,
+                              FormatWriteFunc  write_func)
+{
+    g_return_if_fail (TEXT_IS_AUTOSAVE (self));
+    g_return_if_fail (write_func != NULL);
+
+    self->write_func = write_func;
+}
+
+/**
+ * text_autosave_is_dirty:
+ * @self: a #TextAutosave
+ *
+ * Determines whether the document has changed since it was last
+ * saved. A save which is still in flight does not count.
+ *
+ * Returns: %TRUE if the document has unsaved changes
+ */
+gboolean
+text_autosave_is_dirty (TextAutosave *self)
+{
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), FALSE);
+
+    return text_document_get_generation (self->document) != self->saved_generation;
+}
+
+/**
+ * text_autosave_is_saving:
+ * @self: a #TextAutosave
+ *
+ * Returns: %TRUE if a snapshot is being written to the file
+ */
+gboolean
+text_autosave_is_saving (TextAutosave *self)
+{
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), FALSE);
+
+    return self->saving;
+}
+
+static void
+_save_thread (GTask        *task,
+              gpointer      source_object,
+              gpointer      task_data,
+              GCancellable *cancellable)
+{
+    SaveData *data = task_data;
+    g_autoptr (GFileOutputStream) file_stream = NULL;
+    g_autoptr (GOutputStream) stream = NULL;
+    GError *error = NULL;
+
+    // The contents are written to a temporary file which only
+    // replaces the destination once the stream is closed
+    file_stream = g_file_replace (data->file, NULL, FALSE,
+                                  G_FILE_CREATE_REPLACE_DESTINATION,
+                                  cancellable, &error);
+
+    if (!file_stream)
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    stream = g_buffered_output_stream_new (G_OUTPUT_STREAM (file_stream));
+
+    if (!data->write_func (data->snapshot, stream, cancellable, &error) ||
+        !g_output_stream_flush (stream, cancellable, &error))
+    {
+        g_autoptr (GCancellable) abort = g_cancellable_new ();
+
+        // Closing with a cancelled cancellable discards the temporary
+        // file rather than replacing the last good save with it
+        g_cancellable_cancel (abort);
+        g_output_stream_close (G_OUTPUT_STREAM (file_stream), abort, NULL);
+
+        g_task_return_error (task, error);
+        return;
+    }
+
+    if (!g_output_stream_close (stream, cancellable, &error))
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+_save_done (GObject      *source_object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+    TextAutosave *self = TEXT_AUTOSAVE (source_object);
+    SaveData *data = g_task_get_task_data (G_TASK (result));
+    g_autoptr (GError) error = NULL;
+
+    self->saving = FALSE;
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_signal_emit (self, signals [FAILED], 0, error);
+        return;
+    }
+
+    self->saved_generation = data->generation;
+    g_signal_emit (self, signals [SAVED], 0, data->generation);
+}
+
+/**
+ * text_autosave_save:
+ * @self: a #TextAutosave
+ *
+ * Saves the document now if it has unsaved changes. Only taking the
+ * snapshot happens on the calling thread; it is serialised and written
+ * on a worker thread, and #TextAutosave::saved or #TextAutosave::failed
+ * is emitted once it completes.
+ *
+ * Nothing is done while a previous save is still in flight. Any edits
+ * made in the meantime keep the document dirty, so they are picked up
+ * by the next save.
+ *
+ * Returns: %TRUE if a save was started
+ */
+gboolean
+text_autosave_save (TextAutosave *self)
+{
+    g_autoptr (GTask) task = NULL;
+    SaveData *data;
+
+    g_return_val_if_fail (TEXT_IS_AUTOSAVE (self), FALSE);
+
+    if (self->saving || !text_autosave_is_dirty (self))
+        return FALSE;
+
+    data = g_new0 (SaveData, 1);
+    data->file = g_object_ref (self->file);
+    data->snapshot = text_document_snapshot (self->document);
+    data->write_func = self->write_func;
+    data->generation = text_document_get_generation (self->document);
+
+    task = g_task_new (self, self->cancellable, _save_done, NULL);
+    g_task_set_source_tag (task, text_autosave_save);
+    g_task_set_task_data (task, data, (GDestroyNotify) _save_data_free);
+
+    self->saving = TRUE;
+    g_task_run_in_thread (task, _save_thread);
+
+    return TRUE;
+}
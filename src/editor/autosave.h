@@ -0,0 +1,38 @@
+/* autosave.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "../model/document.h"
+#include "../format/export.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_AUTOSAVE (text_autosave_get_type())
+
+G_DECLARE_FINAL_TYPE (TextAutosave, text_autosave, TEXT, AUTOSAVE, GObject)
+
+TextAutosave *text_autosave_new             (TextDocument *document, GFile *file);
+
+TextDocument *text_autosave_get_document    (TextAutosave *self);
+GFile        *text_autosave_get_file        (TextAutosave *self);
+
+guint         text_autosave_get_interval    (TextAutosave *self);
+void          text_autosave_set_interval    (TextAutosave *self, guint seconds);
+void          text_autosave_set_write_func  (TextAutosave *self, FormatWriteFunc write_func);
+
+gboolean      text_autosave_is_dirty        (TextAutosave *self);
+gboolean      text_autosave_is_saving       (TextAutosave *self);
+gboolean      text_autosave_save            (TextAutosave *self);
+
+G_END_DECLS
@@ -14,15 +14,44 @@
 #include "../model/paragraph.h"
 #include "../model/opaque.h"
 
+#include "history.h"
+
 struct _TextEditor
 {
     GObject parent_instance;
 
     TextDocument *document;
+
+    // Number of open transactions
+    int n_transactions;
+
+    // Depth of nested edits, which are recorded
+    // as a single undo step once they all end
+    int n_edits;
+
+    TextHistory *history;
+
+    // Records of the edit being made
+    GPtrArray *records;
+
+    // Set while undoing or redoing, as the edits
+    // being replayed must not be recorded again
+    gboolean replaying;
+
+    // Set while applying edits made by someone else,
+    // which the history is moved past instead
+    gboolean remote;
 };
 
 G_DEFINE_FINAL_TYPE (TextEditor, text_editor, G_TYPE_OBJECT)
 
+enum {
+    EDITED,
+    N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
 enum {
     PROP_0,
     PROP_DOCUMENT,
@@ -44,6 +73,18 @@ text_editor_finalize (GObject *object)
 {
     TextEditor *self = (TextEditor *)object;
 
+    // Don't leave the journal collecting changes forever
+    if (self->n_transactions > 0)
+    {
+        g_critical ("Editor finalized with %d open transaction(s)", self->n_transactions);
+
+        while (self->n_transactions > 0)
+            text_editor_commit_transaction (self);
+    }
+
+    g_clear_pointer (&self->history, text_history_free);
+    g_clear_pointer (&self->records, g_ptr_array_unref);
+
     G_OBJECT_CLASS (text_editor_parent_class)->finalize (object);
 }
 
@@ -100,6 +141,304 @@ text_editor_class_init (TextEditorClass *klass)
                                G_PARAM_READWRITE);
 
     g_object_class_install_properties (object_class, N_PROPS, properties);
+
+    /**
+     * TextEditor::edited:
+     * @self: the #TextEditor
+     * @records: (type GPtrArray) (element-type TextHistoryRecord): the
+     *   records of the edit, in the order they were made
+     *
+     * Emitted at the end of every edit made through @self, including
+     * undoing and redoing, with offset-based records of what changed.
+     * This is used to share edits with other editors and isn't part
+     * of the public API.
+     */
+    signals [EDITED] =
+        g_signal_new ("edited",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 1, G_TYPE_POINTER);
+}
+
+static void
+_begin_edit (TextEditor *self)
+{
+    // Collect the changes so they are reported once per edit
+    text_journal_begin (text_document_get_journal (self->document));
+    self->n_edits++;
+}
+
+static void
+_end_edit (TextEditor *self)
+{
+    if (--self->n_edits == 0 && self->records)
+    {
+        GPtrArray *records = g_steal_pointer (&self->records);
+
+        g_signal_emit (self, signals [EDITED], 0, records);
+
+        if (self->replaying)
+            g_ptr_array_unref (records);
+        else if (self->remote)
+            text_history_rebase (self->history, records);
+        else
+            text_history_push (self->history, records);
+    }
+
+    if (self->n_edits == 0)
+        self->remote = FALSE;
+
+    text_journal_end (text_document_get_journal (self->document));
+}
+
+/**
+ * text_editor_begin_transaction:
+ * @self: a #TextEditor
+ *
+ * Starts a batch of edits. Until the matching call to
+ * text_editor_commit_transaction(), the changes made through @self are
+ * collected instead of being reported, so that views update their
+ * layout and redraw once for the whole batch.
+ *
+ * Marks are still kept up to date after every edit, so positions
+ * may be queried and used as normal inside a transaction.
+ *
+ * Transactions may be nested, in which case the changes are reported
+ * when the outermost one is committed.
+ */
+void
+text_editor_begin_transaction (TextEditor *self)
+{
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+    g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
+
+    self->n_transactions++;
+    _begin_edit (self);
+}
+
+/**
+ * text_editor_begin_remote_transaction:
+ * @self: a #TextEditor
+ *
+ * Starts a batch of edits made by someone else, such as a collaborator,
+ * which is committed with text_editor_commit_transaction() like any
+ * other transaction.
+ *
+ * The edits aren't added to the undo history. Instead, the steps in it
+ * are moved past them so that local edits can still be undone. Steps
+ * which touch the same characters are discarded, along with every step
+ * before them.
+ *
+ * If another edit is already open, the changes become part of it.
+ */
+void
+text_editor_begin_remote_transaction (TextEditor *self)
+{
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+    g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
+
+    if (self->n_edits == 0)
+        self->remote = TRUE;
+
+    text_editor_begin_transaction (self);
+}
+
+/**
+ * text_editor_commit_transaction:
+ * @self: a #TextEditor
+ *
+ * Ends a batch of edits started with text_editor_begin_transaction().
+ * If this was the outermost transaction, every change made since it
+ * began is reported in a single #TextJournal::changed emission.
+ */
+void
+text_editor_commit_transaction (TextEditor *self)
+{
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+    g_return_if_fail (self->n_transactions > 0);
+
+    self->n_transactions--;
+    _end_edit (self);
+}
+
+/**
+ * text_editor_in_transaction:
+ * @self: a #TextEditor
+ *
+ * Returns: whether a transaction is open on @self
+ */
+gboolean
+text_editor_in_transaction (TextEditor *self)
+{
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), FALSE);
+
+    return self->n_transactions > 0;
+}
+
+typedef void (*RangeFunc) (TextFragment *fragment,
+                           int           index,
+                           int           length,
+                           int           n_chars,
+                           gpointer      user_data);
+
+// Visits the @n_chars characters starting at @index in @paragraph,
+// calling @func with the byte range covered in each fragment, or with
+// %NULL for every paragraph break. Returns the number of characters
+// visited, which is smaller at the end of the document.
+static int
+_visit_range (TextParagraph *paragraph,
+              int            index,
+              int            n_chars,
+              RangeFunc      func,
+              gpointer       user_data)
+{
+    int visited = 0;
+
+    while (visited < n_chars)
+    {
+        TextFragment *item;
+        TextParagraph *next;
+        int item_start;
+        int take;
+
+        take = text_paragraph_get_length (paragraph)
+             - text_paragraph_get_offset_at_index (paragraph, index);
+        take = MIN (take, n_chars - visited);
+
+        item = text_paragraph_get_item_at_index (paragraph, index, &item_start);
+
+        while (item && take > 0)
+        {
+            int start;
+            int offset;
+            int n;
+
+            start = index - item_start;
+            offset = text_fragment_get_offset_at_index (item, start);
+            n = MIN (take, text_fragment_get_length (item) - offset);
+
+            if (n > 0)
+            {
+                int end = text_fragment_get_index_at_offset (item, offset + n);
+
+                func (item, start, end - start, n, user_data);
+                take -= n;
+                visited += n;
+            }
+
+            item_start += text_fragment_get_size_bytes (item);
+            index = item_start;
+            item = (TextFragment *) text_node_get_next (TEXT_NODE (item));
+        }
+
+        if (visited == n_chars)
+            break;
+
+        next = text_editor_next_paragraph (paragraph);
+
+        if (!next)
+            break;
+
+        func (NULL, 0, 0, 1, user_data);
+        visited++;
+
+        paragraph = next;
+        index = 0;
+    }
+
+    return visited;
+}
+
+// Edits being undone or redone aren't recorded again,
+// unless someone is following the edits made to the document
+static gboolean
+_is_recording (TextEditor *self)
+{
+    return !self->replaying ||
+           g_signal_has_handler_pending (self, signals [EDITED], 0, TRUE);
+}
+
+static void
+_add_record (TextEditor        *self,
+             TextHistoryRecord *record)
+{
+    if (!self->records)
+        self->records = text_history_records_new ();
+
+    g_ptr_array_add (self->records, record);
+}
+
+static void
+_collect_content (TextFragment *fragment,
+                  int           index,
+                  int           length,
+                  int           n_chars,
+                  GPtrArray    *content)
+{
+    TextRun *copy;
+    char *text;
+
+    if (!TEXT_IS_RUN (fragment))
+    {
+        text_history_content_append (content, fragment ? g_object_ref (fragment) : NULL);
+        return;
+    }
+
+    text = text_run_copy_text (TEXT_RUN (fragment), index, length);
+    copy = text_run_new (text);
+    g_free (text);
+
+    // Copy formatting
+    text_run_set_style_bold (copy, text_run_get_style_bold (TEXT_RUN (fragment)));
+    text_run_set_style_italic (copy, text_run_get_style_italic (TEXT_RUN (fragment)));
+    text_run_set_style_underline (copy, text_run_get_style_underline (TEXT_RUN (fragment)));
+
+    text_history_content_append (content, TEXT_FRAGMENT (copy));
+}
+
+// Records the content about to be deleted, so it can be restored
+static void
+_record_delete (TextEditor *self,
+                TextMark   *start,
+                int         length)
+{
+    TextHistoryRecord *record;
+
+    record = text_history_record_new (TEXT_HISTORY_DELETE,
+                                      text_document_get_char_offset (self->document, start),
+                                      0);
+    record->content = text_history_content_new ();
+    record->length = _visit_range (start->paragraph, start->index, length,
+                                   (RangeFunc) _collect_content, record->content);
+
+    if (record->length == 0)
+    {
+        text_history_record_free (record);
+        return;
+    }
+
+    _add_record (self, record);
+}
+
+static void
+_record_text_change (TextRun    *run,
+                     gboolean    inserted,
+                     int         index,
+                     const char *text)
+{
+    TextJournal *journal;
+
+    // Runs outside of the document tree are not observed
+    journal = text_journal_find (TEXT_NODE (run));
+
+    if (!journal)
+        return;
+
+    if (inserted)
+        text_journal_record_text_inserted (journal, TEXT_FRAGMENT (run), index, text);
+    else
+        text_journal_record_text_deleted (journal, TEXT_FRAGMENT (run), index, text);
 }
 
 static int
@@ -107,9 +446,7 @@ _get_offset (TextParagraph *paragraph,
              int            byte_index)
 {
     // NOTE: byte_index must be within bounds!
-    const char *text;
-    text = text_paragraph_get_text (paragraph);
-    return (int) g_utf8_pointer_to_offset (text, text + byte_index);
+    return text_paragraph_get_offset_at_index (paragraph, byte_index);
 }
 
 static TextItem *
@@ -318,27 +655,6 @@ text_editor_get_item_at_mark (TextEditor *self,
                                              NULL);
 }
 
-static void
-move_n_chars_to_byte_index (const gchar *text,
-                            int         *byte_index,
-                            int          amount)
-{
-    // NOTE: Not bounds checked! Make sure to check the
-    // string length with g_utf8_strlen() or similar before
-    // calling.
-
-    const char *new_ptr;
-
-    g_return_if_fail (text != NULL);
-    g_return_if_fail (byte_index != NULL);
-
-    // Go 'amount' characters forwards and find address
-    new_ptr = g_utf8_offset_to_pointer (text + *byte_index, amount);
-
-    // Calculate new byte offset
-    *byte_index = (int)(new_ptr - text);
-}
-
 /**
  * _try_move_mark_left:
  *
@@ -356,7 +672,6 @@ _try_move_mark_left (TextMark   *mark,
                      int         amount)
 {
     TextParagraph *iter;
-    const gchar *text;
     int amount_moved;
     int mark_char_offset;
 
@@ -369,16 +684,14 @@ _try_move_mark_left (TextMark   *mark,
     iter = mark->paragraph;
     amount_moved = 0;
 
-    text = text_paragraph_get_text (iter);
-
     // Calculate how many characters into the paragraph the mark is
-    mark_char_offset = (int) g_utf8_strlen (text, mark->index);
+    mark_char_offset = text_paragraph_get_offset_at_index (iter, mark->index);
 
     // Simple case: The movement is contained entirely
     // within the current paragraph.
     if (mark_char_offset - amount >= 0)
     {
-        move_n_chars_to_byte_index (text, &mark->index, -amount);
+        mark->index = text_paragraph_get_index_at_offset (iter, mark_char_offset - amount);
         return 0;
     }
 
@@ -411,9 +724,7 @@ _try_move_mark_left (TextMark   *mark,
         // Move partially through the paragraph by
         // the amount to move remaining
         // TODO: Check if this actually works
-        text = text_paragraph_get_text (iter);
-        mark->index = (int) (g_utf8_offset_to_pointer (text, num_indices - (amount - amount_moved)) - text);
-        mark->paragraph = iter;
+        text_mark_set_position (mark, iter, text_paragraph_get_index_at_offset (iter, num_indices - (amount - amount_moved)));
         return 0;
     }
 
@@ -457,7 +768,6 @@ _try_move_mark_right (TextMark   *mark,
                       int         amount)
 {
     TextParagraph *iter;
-    gchar *text;
     int amount_moved;
     int last_index;
     int mark_char_offset;
@@ -471,17 +781,15 @@ _try_move_mark_right (TextMark   *mark,
     iter = mark->paragraph;
     amount_moved = 0;
 
-    text = text_paragraph_get_text (iter);
-
     // Calculate how many characters into the paragraph the mark is
-    mark_char_offset = (int) g_utf8_strlen (text, mark->index);
+    mark_char_offset = text_paragraph_get_offset_at_index (iter, mark->index);
 
     // Simple case: The movement is contained entirely
     // within the current paragraph.
     last_index = text_paragraph_get_length (iter);
     if (mark_char_offset + amount <= last_index)
     {
-        move_n_chars_to_byte_index (text, &mark->index, amount);
+        mark->index = text_paragraph_get_index_at_offset (iter, mark_char_offset + amount);
         return 0;
     }
 
@@ -514,9 +822,7 @@ _try_move_mark_right (TextMark   *mark,
         // Move partially through the paragraph by
         // the amount to move remaining
         // TODO: Check if this actually works
-        text = text_paragraph_get_text (iter);
-        mark->index = (int) (g_utf8_offset_to_pointer (text, (amount - amount_moved) - 1) - text);
-        mark->paragraph = iter;
+        text_mark_set_position (mark, iter, text_paragraph_get_index_at_offset (iter, (amount - amount_moved) - 1));
         return 0;
     }
 
@@ -556,8 +862,7 @@ text_editor_move_mark_first (TextMark *mark)
     g_return_if_fail (mark != NULL);
     g_return_if_fail (TEXT_IS_DOCUMENT (mark->document));
 
-    mark->paragraph = walk_until_next_paragraph (TEXT_ITEM (mark->document->frame));
-    mark->index = 0;
+    text_mark_set_position (mark, walk_until_next_paragraph (TEXT_ITEM (mark->document->frame)), 0);
 }
 
 /**
@@ -573,13 +878,10 @@ text_editor_move_mark_last (TextMark *mark)
     g_return_if_fail (mark != NULL);
     g_return_if_fail (TEXT_IS_DOCUMENT (mark->document));
 
-    mark->paragraph = walk_until_previous_paragraph (TEXT_ITEM (mark->document->frame));
-    mark->index = 0;
+    TextParagraph *last;
 
-    if (mark->paragraph)
-    {
-        mark->index = text_paragraph_get_size_bytes (mark->paragraph);
-    }
+    last = walk_until_previous_paragraph (TEXT_ITEM (mark->document->frame));
+    text_mark_set_position (mark, last, last ? text_paragraph_get_size_bytes (last) : 0);
 }
 
 static void
@@ -631,22 +933,18 @@ _erase_text (TextRun *run,
              int      num_chars,
              int     *bytes_deleted)
 {
-    GString *modified;
-    const char *text;
+    char *erased;
     int length_bytes;
 
-    text = text_fragment_get_text (TEXT_FRAGMENT (run));
-
     // Calculate length (in bytes) to erase
-    length_bytes = (int) (g_utf8_offset_to_pointer (text + index, num_chars) - (text + index));
-
-    g_assert (index + length_bytes <= strlen (text));
+    length_bytes = text_run_get_index_at_offset (run, index, num_chars) - index;
 
     // Assumes index and length are within range
-    modified = g_string_new (text);
-    modified = g_string_erase (modified, index, length_bytes);
-    g_object_set (run, "text", modified->str, NULL);
-    g_string_free (modified, TRUE);
+    erased = text_run_copy_text (run, index, length_bytes);
+    text_run_erase_text (run, index, length_bytes);
+
+    _record_text_change (run, FALSE, index, erased);
+    g_free (erased);
 
     if (bytes_deleted)
         *bytes_deleted = length_bytes;
@@ -736,12 +1034,10 @@ _delete_within_paragraph (TextParagraph *paragraph,
     int end_index;
     int start_run_offset;
     gboolean is_only;
-    const char *text;
 
     if (deletion_length == 0)
         return FALSE;
 
-    text = text_paragraph_get_text (paragraph);
     paragraph_length = text_paragraph_get_length (paragraph);
     paragraph_size = text_paragraph_get_size_bytes(paragraph);
 
@@ -750,7 +1046,9 @@ _delete_within_paragraph (TextParagraph *paragraph,
     // Check run immediately after the start_index
     // (as start_index may be the final index of a run)
     start = text_paragraph_get_item_at_index (paragraph, start_index + 1, &start_run_offset);
-    end_index = (int) (g_utf8_offset_to_pointer (text + start_index, deletion_length) - text);
+    end_index = text_paragraph_get_index_at_offset (paragraph,
+                                                    text_paragraph_get_offset_at_index (paragraph, start_index)
+                                                    + deletion_length);
 
     g_return_val_if_fail (bytes_deleted != NULL, -1);
     g_assert (0 <= start_index && start_index <= paragraph_size);
@@ -858,13 +1156,37 @@ _distribute_mark (TextMark      *mark,
 {
     if (mark->gravity == TEXT_GRAVITY_LEFT)
     {
-        mark->paragraph = start_para;
-        mark->index = start_index;
+        text_mark_set_position (mark, start_para, start_index);
         return;
     }
 
-    mark->paragraph = end_para;
-    mark->index = end_index;
+    text_mark_set_position (mark, end_para, end_index);
+}
+
+// Gathers the marks in @paragraph which may need adjusting after
+// it is edited, without visiting the rest of the document
+static GPtrArray *
+_get_marks (TextEditor    *self,
+            TextParagraph *paragraph)
+{
+    GPtrArray *marks;
+
+    marks = g_ptr_array_new ();
+    text_document_append_marks (self->document, paragraph, marks);
+
+    return marks;
+}
+
+// The cursor and selection are not kept in the document's buckets.
+// They go last, as they are usually the mark being edited at.
+static void
+_append_cursor_marks (TextEditor *self,
+                      GPtrArray  *marks)
+{
+    g_ptr_array_add (marks, self->document->cursor);
+
+    if (self->document->selection)
+        g_ptr_array_add (marks, self->document->selection);
 }
 
 static void
@@ -882,13 +1204,15 @@ text_editor_delete_at_mark (TextEditor *self,
     TextParagraph *paragraph;
     int num_indices;
     int start_char_offset;
-    const char *text;
 
     g_return_if_fail (TEXT_IS_EDITOR (self));
     g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
     g_return_if_fail (TEXT_IS_PARAGRAPH (start->paragraph));
     g_return_if_fail (start != NULL);
 
+    text_document_bump_generation (self->document);
+    _begin_edit (self);
+
     paragraph = start->paragraph;
 
     if (length < 0)
@@ -900,13 +1224,15 @@ text_editor_delete_at_mark (TextEditor *self,
         // TODO: Should this refer to cursor directly?
         remaining = _try_move_mark_left  (self->document->cursor, -length);
         text_editor_delete_at_mark (self, start, (-length - remaining));
+        _end_edit (self);
         return;
     }
 
-    text = text_paragraph_get_text (start->paragraph);
+    if (_is_recording (self) && length > 0)
+        _record_delete (self, start, length);
 
     // Calculate how many characters into the paragraph the mark is
-    start_char_offset = (int) g_utf8_strlen (text, start->index);
+    start_char_offset = text_paragraph_get_offset_at_index (start->paragraph, start->index);
 
     // Account for final index at the end of a paragraph
     num_indices = text_paragraph_get_length (start->paragraph) + 1;
@@ -942,16 +1268,15 @@ text_editor_delete_at_mark (TextEditor *self,
 
         // Adjust marks - we can ignore gravity as
         // marks will converge on the same point
-        GSList *marks;
-        marks = text_document_get_all_marks (self->document);
+        GPtrArray *marks;
+        marks = _get_marks (self, start->paragraph);
+        _append_cursor_marks (self, marks);
 
-        for (GSList *mark_iter = marks;
-             mark_iter != NULL;
-             mark_iter = mark_iter->next)
+        for (guint i = 0; i < marks->len; i++)
         {
             TextMark *mark;
 
-            mark = (TextMark *)mark_iter->data;
+            mark = g_ptr_array_index (marks, i);
 
             // Marks within affected area
             if (mark->paragraph == start->paragraph &&
@@ -970,8 +1295,9 @@ text_editor_delete_at_mark (TextEditor *self,
             }
         }
 
-        g_slist_free (marks);
+        g_ptr_array_unref (marks);
 
+        _end_edit (self);
         return;
     }
 
@@ -1026,17 +1352,23 @@ text_editor_delete_at_mark (TextEditor *self,
 
         // Adjust marks - we can ignore gravity as
         // marks will converge on the same point
-        GSList *marks;
-        marks = text_document_get_all_marks (self->document);
+        GPtrArray *marks;
+        marks = _get_marks (self, paragraph);
+
+        for (GSList *dirty_iter = dirty; dirty_iter != NULL; dirty_iter = dirty_iter->next)
+            text_document_append_marks (self->document, dirty_iter->data, marks);
 
-        for (GSList *mark_iter = marks;
-             mark_iter != NULL;
-             mark_iter = mark_iter->next)
+        if (iter)
+            text_document_append_marks (self->document, iter, marks);
+
+        _append_cursor_marks (self, marks);
+
+        for (guint i = 0; i < marks->len; i++)
         {
             TextMark *mark;
             gboolean affected;
 
-            mark = (TextMark *)mark_iter->data;
+            mark = g_ptr_array_index (marks, i);
             affected = FALSE;
 
             // In starting paragraph
@@ -1070,7 +1402,7 @@ text_editor_delete_at_mark (TextEditor *self,
 
                 // Will now index into the starting paragraph
                 // as we join them (see below)
-                mark->paragraph = start->paragraph;
+                text_mark_set_position (mark, start->paragraph, mark->index);
 
                 // TODO: Does this actually work?
                 offset = text_paragraph_get_size_bytes (start->paragraph);
@@ -1078,7 +1410,7 @@ text_editor_delete_at_mark (TextEditor *self,
             }
         }
 
-        g_slist_free (marks);
+        g_ptr_array_unref (marks);
 
         // Perform lazy deletion
         g_slist_free_full (dirty, (GDestroyNotify)text_node_delete);
@@ -1087,6 +1419,8 @@ text_editor_delete_at_mark (TextEditor *self,
         if (iter != NULL)
             _join_paragraphs (start->paragraph, &iter);
     }
+
+    _end_edit (self);
 }
 
 /**
@@ -1134,33 +1468,26 @@ _relate_nodes (TextNode *start,
         {
             TextNode *child;
 
+            g_slist_free (ancestors);
+
             // Return the lowest common ancestor
             if (in_order == NULL)
                 return parent;
 
-            // Otherwise find which node comes first
-            for (child = text_node_get_first_child (parent);
-                 child != NULL;
-                 child = text_node_get_next (child))
-            {
-                if (child == start) {
-                    *in_order = TRUE;
-                    return parent;
-                }
-
-                if (child == end) {
-                    *in_order = FALSE;
-                    return parent;
-                }
-            }
+            // Otherwise compare the positions of the children of the
+            // common ancestor which contain each node
+            for (child = start;
+                 text_node_get_parent (child) != parent;
+                 child = text_node_get_parent (child));
 
-            // Should not be reached
-            g_assert ("Tree structure is malformed");
+            *in_order = text_node_get_index (child) <= text_node_get_index (iter);
+            return parent;
         }
 
         iter = parent;
     }
 
+    g_slist_free (ancestors);
     return NULL;
 }
 
@@ -1168,35 +1495,11 @@ int
 _length_between_marks (TextMark *start,
                        TextMark *end)
 {
-    TextParagraph *iter;
-    const char *text;
-    int length;
-
     g_return_val_if_fail (start != NULL, 0);
     g_return_val_if_fail (end != NULL, 0);
 
-    if (start->paragraph == end->paragraph)
-    {
-        text = text_paragraph_get_text (start->paragraph);
-        return (int) (g_utf8_pointer_to_offset (text + start->index, text + end->index));
-    }
-
-    iter = start->paragraph;
-    length = text_paragraph_get_length (iter) + 1 - _get_offset (start->paragraph, start->index);
-
-    while ((iter = walk_until_next_paragraph (TEXT_ITEM (iter))) != NULL)
-    {
-        if (iter == end->paragraph)
-        {
-            text = text_paragraph_get_text (end->paragraph);
-            length += (int) g_utf8_strlen (text, end->index);
-            break;
-        }
-
-        length += text_paragraph_get_length (iter) + 1;
-    }
-
-    return length;
+    return text_document_get_char_offset (end->document, end)
+         - text_document_get_char_offset (start->document, start);
 }
 
 void
@@ -1237,20 +1540,23 @@ split_run_at_offset (TextRun  *run,
                      TextRun **new,
                      int offset)
 {
-    char *first_text;
     char *second_text;
+    int index;
 
     g_return_if_fail (TEXT_IS_RUN (run));
     g_return_if_fail (new != NULL);
 
-    g_object_get (run, "text", &first_text, NULL);
-
-    second_text = g_utf8_substring (first_text, offset, -1);
-    first_text = g_utf8_substring (first_text, 0, offset);
+    index = text_run_get_index_at_offset (run, 0, offset);
 
-    g_object_set (run, "text", first_text, NULL);
+    second_text = text_run_copy_text (run, index, -1);
+    text_run_erase_text (run, index, (int) strlen (second_text));
     *new = text_run_new (second_text);
 
+    // The new run is recorded once it is inserted into the tree
+    _record_text_change (run, FALSE, index, second_text);
+
+    g_free (second_text);
+
     // Copy formatting
     text_run_set_style_bold (*new, text_run_get_style_bold (run));
     text_run_set_style_italic (*new, text_run_get_style_italic (run));
@@ -1285,6 +1591,17 @@ text_editor_split_at_mark (TextEditor *self,
     g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
     g_return_if_fail (TEXT_IS_PARAGRAPH (split->paragraph));
 
+    text_document_bump_generation (self->document);
+    _begin_edit (self);
+
+    if (_is_recording (self))
+    {
+        _add_record (self,
+                     text_history_record_new (TEXT_HISTORY_SPLIT,
+                                              text_document_get_char_offset (self->document, split),
+                                              1));
+    }
+
     current = split->paragraph;
 
     // Case 1: Split is happening on the last index
@@ -1361,16 +1678,15 @@ text_editor_split_at_mark (TextEditor *self,
     }
 
     // Adjust marks according to gravity
-    GSList *marks;
-    marks = text_document_get_all_marks (self->document);
+    GPtrArray *marks;
+    marks = _get_marks (self, current);
+    _append_cursor_marks (self, marks);
 
-    for (GSList *mark_iter = marks;
-         mark_iter != NULL;
-         mark_iter = mark_iter->next)
+    for (guint i = 0; i < marks->len; i++)
     {
         TextMark *mark;
 
-        mark = (TextMark *)mark_iter->data;
+        mark = g_ptr_array_index (marks, i);
 
         // Mark is on split point
         if (mark->paragraph == current &&
@@ -1384,12 +1700,14 @@ text_editor_split_at_mark (TextEditor *self,
         if (mark->paragraph == current &&
             mark->index > split->index)
         {
-            mark->paragraph = new;
+            text_mark_set_position (mark, new, mark->index);
             _offset_mark (mark, -split->index);
         }
     }
 
-    g_slist_free (marks);
+    g_ptr_array_unref (marks);
+
+    _end_edit (self);
 }
 
 void
@@ -1406,8 +1724,12 @@ text_editor_replace_at_mark (TextEditor *self,
     _ensure_ordered (&start, &end);
 
     length = _length_between_marks (start, end);
+
+    // Report the deletion and insertion as a single edit
+    _begin_edit (self);
     text_editor_delete_at_mark (self, start, length);
     text_editor_insert_text_at_mark(self, start, text);
+    _end_edit (self);
 }
 
 void
@@ -1419,9 +1741,7 @@ text_editor_insert_text_at_mark (TextEditor *self,
     // This should accept user input in the form of Operational
     // Transformation commands. This will aid with undo/redo.
 
-    GSList *marks;
-    char *text;
-    GString *modified;
+    GPtrArray *marks;
     TextFragment *item;
     TextRun *run;
     int run_start_index;
@@ -1432,6 +1752,9 @@ text_editor_insert_text_at_mark (TextEditor *self,
     g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
     g_return_if_fail (TEXT_IS_PARAGRAPH (start->paragraph));
 
+    text_document_bump_generation (self->document);
+    _begin_edit (self);
+
     item = text_paragraph_get_item_at_index (start->paragraph, start->index, &run_start_index);
 
     index_within_run = start->index - run_start_index;
@@ -1452,6 +1775,7 @@ text_editor_insert_text_at_mark (TextEditor *self,
         else
         {
             g_info ("Not supported: Inserting into non-text run\n");
+            _end_edit (self);
             return;
         }
     }
@@ -1460,26 +1784,38 @@ text_editor_insert_text_at_mark (TextEditor *self,
         run = TEXT_RUN (item);
     }
 
-    // TODO: Replace with hybrid tree/piece-table structure?
-    // Textual data is stored in buffers and indexed by the tree
-    g_object_get (run, "text", &text, NULL);
-    modified = g_string_new (text);
-    modified = g_string_insert (modified, index_within_run, str);
-    g_object_set (run, "text", modified->str, NULL);
-    g_string_free (modified, TRUE);
+    // Textual data is stored in a piece table per run, so
+    // this does not copy the rest of the run's text
+    text_run_insert_text (run, index_within_run, str);
+
+    _record_text_change (run, TRUE, index_within_run, str);
+
+    // Nothing before @start has moved yet
+    if (_is_recording (self) && *str)
+    {
+        TextHistoryRecord *record;
+
+        record = text_history_record_new (TEXT_HISTORY_INSERT,
+                                          text_document_get_char_offset (self->document, start),
+                                          (int) g_utf8_strlen (str, -1));
+        record->text = g_string_new (str);
+        record->style = (text_run_get_style_bold (run) ? TEXT_HISTORY_BOLD : 0)
+                      | (text_run_get_style_italic (run) ? TEXT_HISTORY_ITALIC : 0)
+                      | (text_run_get_style_underline (run) ? TEXT_HISTORY_UNDERLINE : 0);
+        _add_record (self, record);
+    }
 
     length = (int) strlen (str);
 
     // Adjust marks according to gravity
-    marks = text_document_get_all_marks (self->document);
+    marks = _get_marks (self, start->paragraph);
+    _append_cursor_marks (self, marks);
 
-    for (GSList *mark_iter = marks;
-         mark_iter != NULL;
-         mark_iter = mark_iter->next)
+    for (guint i = 0; i < marks->len; i++)
     {
         TextMark *mark;
 
-        mark = (TextMark *)mark_iter->data;
+        mark = g_ptr_array_index (marks, i);
 
         // Mark is on insertion point
         if (mark->paragraph == start->paragraph &&
@@ -1499,7 +1835,9 @@ text_editor_insert_text_at_mark (TextEditor *self,
         }
     }
 
-    g_slist_free (marks);
+    g_ptr_array_unref (marks);
+
+    _end_edit (self);
 }
 
 void
@@ -1511,7 +1849,7 @@ text_editor_insert_fragment_at_mark (TextEditor   *self,
     // This should accept user input in the form of Operational
     // Transformation commands. This will aid with undo/redo.
 
-    GSList *marks;
+    GPtrArray *marks;
     TextFragment *item;
     int run_start_index;
     int index_within_run;
@@ -1521,6 +1859,9 @@ text_editor_insert_fragment_at_mark (TextEditor   *self,
     g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
     g_return_if_fail (TEXT_IS_PARAGRAPH (start->paragraph));
 
+    text_document_bump_generation (self->document);
+    _begin_edit (self);
+
     item = text_paragraph_get_item_at_index (start->paragraph, start->index, &run_start_index);
 
     index_within_run = start->index - run_start_index;
@@ -1536,32 +1877,42 @@ text_editor_insert_fragment_at_mark (TextEditor   *self,
     else if (TEXT_IS_RUN (item))
     {
         TextRun *new_run;
-        const char *text;
         int offset_within_run;
 
-        text = text_fragment_get_text (TEXT_FRAGMENT (item));
-        offset_within_run = (int) g_utf8_pointer_to_offset (text, text + index_within_run);
+        offset_within_run = text_fragment_get_offset_at_index (item, index_within_run);
         split_run_in_place (TEXT_RUN (item), &new_run, offset_within_run);
         text_node_insert_child_before (TEXT_NODE (start->paragraph), TEXT_NODE (fragment), TEXT_NODE (new_run));
     }
     else
     {
         g_info ("Cannot split opaque inline element!\n");
+        _end_edit (self);
         return;
     }
 
+    if (_is_recording (self))
+    {
+        TextHistoryRecord *record;
+
+        record = text_history_record_new (TEXT_HISTORY_FRAGMENT,
+                                          text_document_get_char_offset (self->document, start),
+                                          text_fragment_get_length (fragment));
+        record->content = text_history_content_new ();
+        text_history_content_append (record->content, text_history_copy_fragment (fragment));
+        _add_record (self, record);
+    }
+
     size = text_fragment_get_size_bytes (fragment);
 
     // Adjust marks according to gravity
-    marks = text_document_get_all_marks (self->document);
+    marks = _get_marks (self, start->paragraph);
+    _append_cursor_marks (self, marks);
 
-    for (GSList *mark_iter = marks;
-         mark_iter != NULL;
-         mark_iter = mark_iter->next)
+    for (guint i = 0; i < marks->len; i++)
     {
         TextMark *mark;
 
-        mark = (TextMark *)mark_iter->data;
+        mark = g_ptr_array_index (marks, i);
 
         // Mark is on insertion point
         if (mark->paragraph == start->paragraph &&
@@ -1581,7 +1932,9 @@ text_editor_insert_fragment_at_mark (TextEditor   *self,
         }
     }
 
-    g_slist_free (marks);
+    g_ptr_array_unref (marks);
+
+    _end_edit (self);
 }
 
 // TODO: Decouple format from run when we introduce the stylesheet
@@ -1597,18 +1950,141 @@ set_run_format (TextRun *run,
                 Format   format,
                 gboolean in_use)
 {
+    TextJournal *journal;
+    const char *property;
+
     switch (format)
     {
         case FORMAT_BOLD:
             text_run_set_style_bold (run, in_use);
+            property = "bold";
             break;
         case FORMAT_ITALIC:
             text_run_set_style_italic (run, in_use);
+            property = "italic";
             break;
         case FORMAT_UNDERLINE:
             text_run_set_style_underline (run, in_use);
+            property = "underline";
             break;
+        default:
+            g_assert_not_reached ();
+    }
+
+    journal = text_journal_find (TEXT_NODE (run));
+
+    if (journal)
+        text_journal_record_style_changed (journal, TEXT_FRAGMENT (run), property);
+}
+
+static TextHistoryStyle
+_style_from_format (Format format)
+{
+    switch (format)
+    {
+        case FORMAT_BOLD:
+            return TEXT_HISTORY_BOLD;
+        case FORMAT_ITALIC:
+            return TEXT_HISTORY_ITALIC;
+        case FORMAT_UNDERLINE:
+            return TEXT_HISTORY_UNDERLINE;
+        default:
+            g_assert_not_reached ();
+    }
+
+    return TEXT_HISTORY_BOLD;
+}
+
+static Format
+_format_from_style (TextHistoryStyle style)
+{
+    switch (style)
+    {
+        case TEXT_HISTORY_BOLD:
+            return FORMAT_BOLD;
+        case TEXT_HISTORY_ITALIC:
+            return FORMAT_ITALIC;
+        case TEXT_HISTORY_UNDERLINE:
+            return FORMAT_UNDERLINE;
+        default:
+            g_assert_not_reached ();
     }
+
+    return FORMAT_BOLD;
+}
+
+static gboolean
+get_run_format (TextRun *run,
+                Format   format)
+{
+    switch (format)
+    {
+        case FORMAT_BOLD:
+            return text_run_get_style_bold (run);
+        case FORMAT_ITALIC:
+            return text_run_get_style_italic (run);
+        case FORMAT_UNDERLINE:
+            return text_run_get_style_underline (run);
+        default:
+            g_assert_not_reached ();
+    }
+
+    return FALSE;
+}
+
+static void
+_collect_spans (TextFragment      *fragment,
+                int                index,
+                int                length,
+                int                n_chars,
+                TextHistoryRecord *record)
+{
+    TextHistorySpan span = { n_chars, FALSE };
+    GArray *spans = record->spans;
+
+    // Paragraph breaks and inline objects aren't formatted, so they
+    // join whichever span precedes them
+    if (TEXT_IS_RUN (fragment))
+        span.in_use = get_run_format (TEXT_RUN (fragment), _format_from_style (record->format));
+    else if (spans->len > 0)
+        span.in_use = g_array_index (spans, TextHistorySpan, spans->len - 1).in_use;
+
+    if (spans->len > 0 &&
+        g_array_index (spans, TextHistorySpan, spans->len - 1).in_use == span.in_use)
+    {
+        g_array_index (spans, TextHistorySpan, spans->len - 1).length += n_chars;
+        return;
+    }
+
+    g_array_append_val (spans, span);
+}
+
+// Records the formatting about to be replaced, so it can be restored
+static void
+_record_format (TextEditor *self,
+                TextMark   *start,
+                TextMark   *end,
+                Format      format,
+                gboolean    in_use)
+{
+    TextHistoryRecord *record;
+    int offset;
+    int length;
+
+    offset = text_document_get_char_offset (self->document, start);
+    length = text_document_get_char_offset (self->document, end) - offset;
+
+    if (length <= 0)
+        return;
+
+    record = text_history_record_new (TEXT_HISTORY_FORMAT, offset, length);
+    record->format = _style_from_format (format);
+    record->in_use = in_use;
+    record->spans = g_array_new (FALSE, FALSE, sizeof (TextHistorySpan));
+    _visit_range (start->paragraph, start->index, length,
+                  (RangeFunc) _collect_spans, record);
+
+    _add_record (self, record);
 }
 
 static void
@@ -1623,8 +2099,17 @@ text_editor_apply_format (TextEditor *self,
     int start_run_index;
     int end_run_index;
 
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+    g_return_if_fail (TEXT_IS_DOCUMENT (self->document));
+
+    text_document_bump_generation (self->document);
+    _begin_edit (self);
+
     _ensure_ordered (&start, &end);
 
+    if (_is_recording (self))
+        _record_format (self, start, end, format, in_use);
+
     iter = text_paragraph_get_item_at_index (start->paragraph, start->index, &start_run_index);
     last = text_paragraph_get_item_at_index (end->paragraph, end->index, &end_run_index);
 
@@ -1650,6 +2135,7 @@ text_editor_apply_format (TextEditor *self,
 
         // Apply format to middle run
         set_run_format (first_split, format, in_use);
+        _end_edit (self);
         return;
     }
 
@@ -1683,6 +2169,8 @@ text_editor_apply_format (TextEditor *self,
 
         iter = walk_until_next_fragment(TEXT_ITEM(iter));
     }
+
+    _end_edit (self);
 }
 
 void
@@ -1751,6 +2239,294 @@ text_editor_get_format_underline_at_mark (TextEditor *self,
     return FALSE;
 }
 
+// Creates a temporary mark for replaying an edit, which isn't
+// registered with the document and so is never adjusted
+static TextMark *
+_mark_at_offset (TextEditor *self,
+                 int         offset)
+{
+    TextParagraph *paragraph;
+    int index;
+
+    if (!text_document_get_position_at_char_offset (self->document, offset, &paragraph, &index))
+    {
+        g_critical ("History is out of sync with the document");
+        return NULL;
+    }
+
+    return text_mark_new (self->document, paragraph, index, TEXT_GRAVITY_RIGHT);
+}
+
+static void
+_place_cursor (TextEditor *self,
+               int         offset)
+{
+    TextParagraph *paragraph;
+    int index;
+
+    if (self->document->cursor &&
+        text_document_get_position_at_char_offset (self->document, offset, &paragraph, &index))
+        text_mark_set_position (self->document->cursor, paragraph, index);
+}
+
+static void
+_delete_at_offset (TextEditor *self,
+                   int         offset,
+                   int         length)
+{
+    g_autoptr (TextMark) mark = _mark_at_offset (self, offset);
+
+    if (mark)
+        text_editor_delete_at_mark (self, mark, length);
+}
+
+static void
+_insert_content_at_offset (TextEditor *self,
+                           int         offset,
+                           GPtrArray  *content)
+{
+    for (guint i = 0; i < content->len; i++)
+    {
+        TextFragment *fragment = g_ptr_array_index (content, i);
+        g_autoptr (TextMark) mark = _mark_at_offset (self, offset);
+
+        if (!mark)
+            return;
+
+        if (!fragment)
+        {
+            text_editor_split_at_mark (self, mark);
+            offset++;
+            continue;
+        }
+
+        // The document keeps its own reference
+        fragment = text_history_copy_fragment (fragment);
+        text_editor_insert_fragment_at_mark (self, mark, fragment);
+        offset += text_fragment_get_length (fragment);
+        g_object_unref (fragment);
+    }
+}
+
+static void
+_format_at_offset (TextEditor *self,
+                   int         offset,
+                   int         length,
+                   Format      format,
+                   gboolean    in_use)
+{
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+
+    start = _mark_at_offset (self, offset);
+    end = _mark_at_offset (self, offset + length);
+
+    if (start && end)
+        text_editor_apply_format (self, start, end, format, in_use);
+}
+
+static void
+_undo_record (TextEditor        *self,
+              TextHistoryRecord *record)
+{
+    int offset;
+
+    switch (record->type)
+    {
+    case TEXT_HISTORY_INSERT:
+    case TEXT_HISTORY_SPLIT:
+    case TEXT_HISTORY_FRAGMENT:
+        _delete_at_offset (self, record->offset, record->length);
+        _place_cursor (self, record->offset);
+        break;
+
+    case TEXT_HISTORY_DELETE:
+        _insert_content_at_offset (self, record->offset, record->content);
+        _place_cursor (self, record->offset + record->length);
+        break;
+
+    case TEXT_HISTORY_FORMAT:
+        offset = record->offset;
+
+        for (guint i = 0; i < record->spans->len; i++)
+        {
+            TextHistorySpan *span = &g_array_index (record->spans, TextHistorySpan, i);
+
+            _format_at_offset (self, offset, span->length,
+                               _format_from_style (record->format), span->in_use);
+            offset += span->length;
+        }
+        break;
+    }
+}
+
+static void
+_redo_record (TextEditor        *self,
+              TextHistoryRecord *record)
+{
+    g_autoptr (TextMark) mark = NULL;
+
+    switch (record->type)
+    {
+    case TEXT_HISTORY_INSERT:
+        if ((mark = _mark_at_offset (self, record->offset)))
+            text_editor_insert_text_at_mark (self, mark, record->text->str);
+        _place_cursor (self, record->offset + record->length);
+        break;
+
+    case TEXT_HISTORY_SPLIT:
+        if ((mark = _mark_at_offset (self, record->offset)))
+            text_editor_split_at_mark (self, mark);
+        _place_cursor (self, record->offset + 1);
+        break;
+
+    case TEXT_HISTORY_FRAGMENT:
+        _insert_content_at_offset (self, record->offset, record->content);
+        _place_cursor (self, record->offset + record->length);
+        break;
+
+    case TEXT_HISTORY_DELETE:
+        _delete_at_offset (self, record->offset, record->length);
+        _place_cursor (self, record->offset);
+        break;
+
+    case TEXT_HISTORY_FORMAT:
+        _format_at_offset (self, record->offset, record->length,
+                           _format_from_style (record->format), record->in_use);
+        break;
+    }
+}
+
+/**
+ * text_editor_undo:
+ * @self: a #TextEditor
+ *
+ * Reverts the most recent step in the history of @self, placing the
+ * cursor where the change was made. Typing or deleting at the same
+ * position is reverted a word at a time, and a transaction is reverted
+ * as a whole.
+ *
+ * Returns: %TRUE if there was anything to undo
+ */
+gboolean
+text_editor_undo (TextEditor *self)
+{
+    GPtrArray *records;
+
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), FALSE);
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (self->document), FALSE);
+    g_return_val_if_fail (!text_editor_in_transaction (self), FALSE);
+
+    records = text_history_undo (self->history);
+
+    if (!records)
+        return FALSE;
+
+    // Records are inverted newest first
+    self->replaying = TRUE;
+    _begin_edit (self);
+
+    for (guint i = records->len; i > 0; i--)
+        _undo_record (self, g_ptr_array_index (records, i - 1));
+
+    _end_edit (self);
+    self->replaying = FALSE;
+
+    return TRUE;
+}
+
+/**
+ * text_editor_redo:
+ * @self: a #TextEditor
+ *
+ * Reapplies the step most recently reverted by text_editor_undo().
+ * Making any other edit discards the steps which could be redone.
+ *
+ * Returns: %TRUE if there was anything to redo
+ */
+gboolean
+text_editor_redo (TextEditor *self)
+{
+    GPtrArray *records;
+
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), FALSE);
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (self->document), FALSE);
+    g_return_val_if_fail (!text_editor_in_transaction (self), FALSE);
+
+    records = text_history_redo (self->history);
+
+    if (!records)
+        return FALSE;
+
+    self->replaying = TRUE;
+    _begin_edit (self);
+
+    for (guint i = 0; i < records->len; i++)
+        _redo_record (self, g_ptr_array_index (records, i));
+
+    _end_edit (self);
+    self->replaying = FALSE;
+
+    return TRUE;
+}
+
+gboolean
+text_editor_can_undo (TextEditor *self)
+{
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), FALSE);
+
+    return text_history_can_undo (self->history);
+}
+
+gboolean
+text_editor_can_redo (TextEditor *self)
+{
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), FALSE);
+
+    return text_history_can_redo (self->history);
+}
+
+/**
+ * text_editor_clear_history:
+ * @self: a #TextEditor
+ *
+ * Discards every step which could be undone or redone, for example
+ * after loading a new document.
+ */
+void
+text_editor_clear_history (TextEditor *self)
+{
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+
+    text_history_clear (self->history);
+}
+
+/**
+ * text_editor_set_history_limit:
+ * @self: a #TextEditor
+ * @limit: the memory limit in bytes
+ *
+ * Sets how much memory the undo history of @self may use. Once the
+ * limit is exceeded, the oldest steps are discarded first. The most
+ * recent step is always kept, however large it is.
+ */
+void
+text_editor_set_history_limit (TextEditor *self,
+                               gsize       limit)
+{
+    g_return_if_fail (TEXT_IS_EDITOR (self));
+
+    text_history_set_limit (self->history, limit);
+}
+
+gsize
+text_editor_get_history_limit (TextEditor *self)
+{
+    g_return_val_if_fail (TEXT_IS_EDITOR (self), 0);
+
+    return text_history_get_limit (self->history);
+}
+
 TextMark *
 _get_mark (TextEditor         *self,
            TextEditorMarkType  type)
@@ -1884,13 +2660,9 @@ text_editor_dump_plain_text (TextEditor *self)
 
     while ((iter = TEXT_ITEM (walk_until_next_paragraph (iter))) != NULL)
     {
-        char *text;
-
         g_assert (TEXT_IS_ITEM (iter));
-        text = text_paragraph_get_text (TEXT_PARAGRAPH (iter));
-        g_string_append (string_builder, text);
+        text_paragraph_append_text (TEXT_PARAGRAPH (iter), string_builder);
         g_string_append (string_builder, "\n");
-        g_free (text);
     }
 
     return g_string_free (string_builder, FALSE);
@@ -1899,4 +2671,5 @@ text_editor_dump_plain_text (TextEditor *self)
 static void
 text_editor_init (TextEditor *self)
 {
+    self->history = text_history_new ();
 }
@@ -29,6 +29,19 @@ typedef enum
 
 TextEditor *text_editor_new        (TextDocument *document);
 
+void        text_editor_begin_transaction       (TextEditor *self);
+void        text_editor_begin_remote_transaction (TextEditor *self);
+void        text_editor_commit_transaction      (TextEditor *self);
+gboolean    text_editor_in_transaction          (TextEditor *self);
+
+gboolean    text_editor_undo                    (TextEditor *self);
+gboolean    text_editor_redo                    (TextEditor *self);
+gboolean    text_editor_can_undo                (TextEditor *self);
+gboolean    text_editor_can_redo                (TextEditor *self);
+void        text_editor_clear_history           (TextEditor *self);
+void        text_editor_set_history_limit       (TextEditor *self, gsize limit);
+gsize       text_editor_get_history_limit       (TextEditor *self);
+
 // TODO: Refactor into TextMark
 void        text_editor_move_mark_first         (TextMark *mark);
 void        text_editor_move_mark_last          (TextMark *mark);
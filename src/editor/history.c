@@ -0,0 +1,825 @@
+/* history.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "history.h"
+
+#include "../model/run.h"
+
+/*
+ * The undo history of an editor. Rather than keeping snapshots of the
+ * document, every edit is stored as a record describing how to invert
+ * it, so a step only costs as much memory as the text it touched.
+ *
+ * Records are addressed by character offsets from the start of the
+ * document instead of by node, since the nodes an edit touched may no
+ * longer exist by the time it is undone.
+ *
+ * The records made by one edit (or one transaction) form a step. Steps
+ * made by typing or deleting at the same position are coalesced into
+ * a single step, and the oldest steps are evicted once the history
+ * grows past its memory limit.
+ */
+
+// Enough for a long editing session without holding on to every
+// deleted image forever
+#define DEFAULT_LIMIT (4 * 1024 * 1024)
+
+// Typing or deleting without a word boundary (or holding down a key)
+// is still undone in steps of at most this many characters
+#define MAX_COALESCED_LENGTH 256
+
+typedef struct
+{
+    GPtrArray *records;
+    gsize size;
+} Step;
+
+struct _TextHistory
+{
+    // Steps with the most recent at the tail
+    GQueue *undo;
+    GQueue *redo;
+
+    // Whether the next step may be merged into the previous one
+    gboolean coalesce;
+
+    gsize size;
+    gsize limit;
+};
+
+static void
+_step_free (Step *step)
+{
+    g_ptr_array_unref (step->records);
+    g_slice_free (Step, step);
+}
+
+static gsize
+_content_size (GPtrArray *content)
+{
+    gsize size;
+
+    if (!content)
+        return 0;
+
+    size = content->len * sizeof (gpointer);
+
+    for (guint i = 0; i < content->len; i++)
+    {
+        TextFragment *fragment = g_ptr_array_index (content, i);
+
+        if (fragment)
+            size += sizeof (TextFragment) + text_fragment_get_size_bytes (fragment);
+    }
+
+    return size;
+}
+
+static gsize
+_record_size (TextHistoryRecord *record)
+{
+    gsize size;
+
+    size = sizeof (TextHistoryRecord);
+
+    if (record->text)
+        size += record->text->len;
+
+    if (record->spans)
+        size += record->spans->len * sizeof (TextHistorySpan);
+
+    return size + _content_size (record->content);
+}
+
+TextHistory *
+text_history_new (void)
+{
+    TextHistory *self;
+
+    self = g_slice_new0 (TextHistory);
+    self->undo = g_queue_new ();
+    self->redo = g_queue_new ();
+    self->limit = DEFAULT_LIMIT;
+
+    return self;
+}
+
+void
+text_history_free (TextHistory *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_queue_free_full (self->undo, (GDestroyNotify) _step_free);
+    g_queue_free_full (self->redo, (GDestroyNotify) _step_free);
+
+    g_slice_free (TextHistory, self);
+}
+
+TextHistoryRecord *
+text_history_record_new (TextHistoryRecordType type,
+                         int                   offset,
+                         int                   length)
+{
+    TextHistoryRecord *self;
+
+    self = g_slice_new0 (TextHistoryRecord);
+    self->type = type;
+    self->offset = offset;
+    self->length = length;
+
+    return self;
+}
+
+void
+text_history_record_free (TextHistoryRecord *self)
+{
+    g_return_if_fail (self != NULL);
+
+    if (self->text)
+        g_string_free (self->text, TRUE);
+
+    g_clear_pointer (&self->content, g_ptr_array_unref);
+    g_clear_pointer (&self->spans, g_array_unref);
+
+    g_slice_free (TextHistoryRecord, self);
+}
+
+/**
+ * text_history_record_get_delta:
+ * @self: a #TextHistoryRecord
+ *
+ * Gets the change in the length of the document made by @self.
+ *
+ * Returns: the number of characters added, or negative if removed
+ */
+int
+text_history_record_get_delta (TextHistoryRecord *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    switch (self->type)
+    {
+    case TEXT_HISTORY_INSERT:
+    case TEXT_HISTORY_SPLIT:
+    case TEXT_HISTORY_FRAGMENT:
+        return self->length;
+    case TEXT_HISTORY_DELETE:
+        return -self->length;
+    case TEXT_HISTORY_FORMAT:
+        return 0;
+    }
+
+    return 0;
+}
+
+/**
+ * text_history_records_new:
+ *
+ * Creates an empty array to collect the records of an edit.
+ *
+ * Returns: (transfer full): a new #GPtrArray
+ */
+GPtrArray *
+text_history_records_new (void)
+{
+    return g_ptr_array_new_with_free_func ((GDestroyNotify) text_history_record_free);
+}
+
+static gboolean
+_same_style (TextRun *a,
+             TextRun *b)
+{
+    return text_run_get_style_bold (a) == text_run_get_style_bold (b)
+        && text_run_get_style_italic (a) == text_run_get_style_italic (b)
+        && text_run_get_style_underline (a) == text_run_get_style_underline (b);
+}
+
+/**
+ * text_history_copy_fragment:
+ * @fragment: a #TextFragment
+ *
+ * Copies @fragment so it can be inserted into the document. Runs are
+ * copied along with their style, while other fragments are shared
+ * since they are never modified once created.
+ *
+ * Returns: (transfer full): a copy of @fragment
+ */
+TextFragment *
+text_history_copy_fragment (TextFragment *fragment)
+{
+    TextRun *run;
+    TextRun *copy;
+
+    g_return_val_if_fail (TEXT_IS_FRAGMENT (fragment), NULL);
+
+    if (!TEXT_IS_RUN (fragment))
+        return g_object_ref (fragment);
+
+    run = TEXT_RUN (fragment);
+    copy = text_run_new (text_fragment_get_text (fragment));
+    text_run_set_style_bold (copy, text_run_get_style_bold (run));
+    text_run_set_style_italic (copy, text_run_get_style_italic (run));
+    text_run_set_style_underline (copy, text_run_get_style_underline (run));
+
+    return TEXT_FRAGMENT (copy);
+}
+
+static void
+_content_item_free (gpointer data)
+{
+    if (data)
+        g_object_unref (data);
+}
+
+/**
+ * text_history_content_new:
+ *
+ * Creates an empty array to hold deleted content.
+ *
+ * Returns: (transfer full): a new #GPtrArray
+ */
+GPtrArray *
+text_history_content_new (void)
+{
+    return g_ptr_array_new_with_free_func (_content_item_free);
+}
+
+/**
+ * text_history_content_append:
+ * @content: deleted content
+ * @fragment: (transfer full) (nullable): a fragment, or %NULL for a
+ *   paragraph break
+ *
+ * Appends @fragment to @content, merging it into the last run if both
+ * are runs with the same style.
+ */
+void
+text_history_content_append (GPtrArray    *content,
+                             TextFragment *fragment)
+{
+    TextFragment *last;
+
+    last = content->len > 0
+        ? g_ptr_array_index (content, content->len - 1)
+        : NULL;
+
+    if (TEXT_IS_RUN (last) && TEXT_IS_RUN (fragment) &&
+        _same_style (TEXT_RUN (last), TEXT_RUN (fragment)))
+    {
+        text_run_insert_text (TEXT_RUN (last),
+                              text_fragment_get_size_bytes (last),
+                              text_fragment_get_text (fragment));
+        g_object_unref (fragment);
+        return;
+    }
+
+    g_ptr_array_add (content, fragment);
+}
+
+static void
+_content_extend (GPtrArray *content,
+                 GPtrArray *other)
+{
+    for (guint i = 0; i < other->len; i++)
+    {
+        TextFragment *fragment = g_ptr_array_index (other, i);
+
+        text_history_content_append (content, fragment ? g_object_ref (fragment) : NULL);
+    }
+}
+
+// Prepends @other to @content, merging the last run of @other into the
+// first run of @content. Deleting backwards only ever grows the start
+// of the step's content, so the text deleted before is never copied.
+static void
+_content_prepend (GPtrArray *content,
+                  GPtrArray *other)
+{
+    TextFragment *first;
+    TextFragment *last;
+    guint n_items;
+
+    n_items = other->len;
+    first = content->len > 0 ? g_ptr_array_index (content, 0) : NULL;
+    last = n_items > 0 ? g_ptr_array_index (other, n_items - 1) : NULL;
+
+    if (TEXT_IS_RUN (first) && TEXT_IS_RUN (last) &&
+        _same_style (TEXT_RUN (first), TEXT_RUN (last)))
+    {
+        text_run_insert_text (TEXT_RUN (first), 0, text_fragment_get_text (last));
+        n_items--;
+    }
+
+    for (guint i = n_items; i > 0; i--)
+    {
+        TextFragment *fragment = g_ptr_array_index (other, i - 1);
+
+        g_ptr_array_insert (content, 0, fragment ? g_object_ref (fragment) : NULL);
+    }
+}
+
+// Gets the first or last character of deleted content without
+// flattening it. Paragraph breaks read as newlines.
+static gunichar
+_content_get_char (GPtrArray *content,
+                   gboolean   last)
+{
+    TextFragment *fragment;
+    const char *slice;
+    gsize length;
+    guint n_slices;
+
+    if (content->len == 0)
+        return 0;
+
+    fragment = g_ptr_array_index (content, last ? content->len - 1 : 0);
+
+    if (!fragment)
+        return '\n';
+
+    if (!TEXT_IS_RUN (fragment))
+        return 0xFFFC;
+
+    n_slices = text_run_get_n_slices (TEXT_RUN (fragment));
+
+    if (n_slices == 0)
+        return 0;
+
+    slice = text_run_get_slice (TEXT_RUN (fragment), last ? n_slices - 1 : 0, &length);
+
+    if (length == 0)
+        return 0;
+
+    return g_utf8_get_char (last ? g_utf8_prev_char (slice + length) : slice);
+}
+
+// Whether a new word starts between @before and @after
+static gboolean
+_is_word_boundary (gunichar before,
+                   gunichar after)
+{
+    return g_unichar_isspace (before) && !g_unichar_isspace (after);
+}
+
+// Merges @record into @prev if they were made by typing or deleting
+// at the same position, which is what users expect to undo at once
+static gboolean
+_try_coalesce (TextHistoryRecord *prev,
+               TextHistoryRecord *record)
+{
+    if (prev->type != record->type)
+        return FALSE;
+
+    if (prev->length + record->length > MAX_COALESCED_LENGTH)
+        return FALSE;
+
+    if (record->type == TEXT_HISTORY_INSERT)
+    {
+        gunichar last;
+
+        if (prev->offset + prev->length != record->offset ||
+            prev->style != record->style)
+            return FALSE;
+
+        // Words are undone one at a time
+        last = g_utf8_get_char (g_utf8_prev_char (prev->text->str + prev->text->len));
+
+        if (_is_word_boundary (last, g_utf8_get_char (record->text->str)))
+            return FALSE;
+
+        g_string_append_len (prev->text, record->text->str, record->text->len);
+        prev->length += record->length;
+        return TRUE;
+    }
+
+    if (record->type == TEXT_HISTORY_DELETE)
+    {
+        // Forward deletion
+        if (record->offset == prev->offset)
+        {
+            if (_is_word_boundary (_content_get_char (prev->content, TRUE),
+                                   _content_get_char (record->content, FALSE)))
+                return FALSE;
+
+            _content_extend (prev->content, record->content);
+            prev->length += record->length;
+            return TRUE;
+        }
+
+        // Backspace
+        if (record->offset + record->length == prev->offset)
+        {
+            // Mirrors typing, so the space before a word goes with it
+            if (_is_word_boundary (_content_get_char (prev->content, FALSE),
+                                   _content_get_char (record->content, TRUE)))
+                return FALSE;
+
+            _content_prepend (prev->content, record->content);
+            prev->offset = record->offset;
+            prev->length += record->length;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_evict (TextHistory *self)
+{
+    // Always keep the most recent step, so the last edit can be
+    // undone even if it is larger than the limit
+    while (self->size > self->limit &&
+           g_queue_get_length (self->undo) > 1)
+    {
+        Step *step = g_queue_pop_head (self->undo);
+
+        self->size -= step->size;
+        _step_free (step);
+    }
+
+    while (self->size > self->limit &&
+           !g_queue_is_empty (self->redo) &&
+           g_queue_get_length (self->undo) + g_queue_get_length (self->redo) > 1)
+    {
+        Step *step = g_queue_pop_head (self->redo);
+
+        self->size -= step->size;
+        _step_free (step);
+    }
+}
+
+static void
+_clear_redo (TextHistory *self)
+{
+    Step *step;
+
+    while ((step = g_queue_pop_head (self->redo)))
+    {
+        self->size -= step->size;
+        _step_free (step);
+    }
+}
+
+/**
+ * text_history_push:
+ * @self: a #TextHistory
+ * @records: (transfer full) (element-type TextHistoryRecord): the
+ *   records made by one edit, in order
+ *
+ * Stores @records as a single step, merging it into the previous step
+ * where possible.
+ */
+void
+text_history_push (TextHistory *self,
+                   GPtrArray   *records)
+{
+    Step *step;
+    Step *prev;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (records != NULL);
+
+    if (records->len == 0)
+    {
+        g_ptr_array_unref (records);
+        return;
+    }
+
+    // Any new edit makes the undone steps unreachable
+    _clear_redo (self);
+
+    prev = g_queue_peek_tail (self->undo);
+
+    if (self->coalesce && prev &&
+        prev->records->len == 1 && records->len == 1 &&
+        _try_coalesce (g_ptr_array_index (prev->records, 0),
+                       g_ptr_array_index (records, 0)))
+    {
+        g_ptr_array_unref (records);
+
+        self->size -= prev->size;
+        prev->size = _record_size (g_ptr_array_index (prev->records, 0));
+        self->size += prev->size;
+    }
+    else
+    {
+        step = g_slice_new0 (Step);
+        step->records = records;
+
+        for (guint i = 0; i < records->len; i++)
+            step->size += _record_size (g_ptr_array_index (records, i));
+
+        self->size += step->size;
+        g_queue_push_tail (self->undo, step);
+    }
+
+    self->coalesce = TRUE;
+    _evict (self);
+}
+
+// A change made to the document by someone else, in the
+// coordinates of the document after the step being rebased
+typedef struct
+{
+    int offset;
+
+    // Number of characters deleted or formatted, which is
+    // zero for insertions
+    int length;
+
+    // Change in the length of the document
+    int delta;
+
+    TextHistoryRecordType type;
+} Change;
+
+// The end of the characters @record left behind, which
+// are only a position for deletions
+static int
+_get_end (TextHistoryRecord *record)
+{
+    if (record->type == TEXT_HISTORY_DELETE)
+        return record->offset;
+
+    return record->offset + record->length;
+}
+
+// Whether undoing @record would no longer do the same thing
+// once @change has been made
+static gboolean
+_conflicts (Change            *change,
+            TextHistoryRecord *record)
+{
+    int start = record->offset;
+    int end = _get_end (record);
+
+    // Formatting only conflicts with formatting, as restoring
+    // deleted content or deleting inserted text ignores it
+    if (change->type == TEXT_HISTORY_FORMAT && record->type != TEXT_HISTORY_FORMAT)
+        return FALSE;
+
+    if (change->length == 0)
+        return start < change->offset && change->offset < end;
+
+    return change->offset < end && start < change->offset + change->length;
+}
+
+// Moves the records of @step past @change, which is mapped to the
+// document before @step as it goes. When @apply is %FALSE, nothing
+// is changed and only whether @step can be moved is checked.
+static gboolean
+_rebase_step (Step     *step,
+              Change   *change,
+              gboolean  apply)
+{
+    // Each record is in the coordinates left by the ones before it
+    for (guint i = step->records->len; i > 0; i--)
+    {
+        TextHistoryRecord *record = g_ptr_array_index (step->records, i - 1);
+        int start = record->offset;
+        int end = _get_end (record);
+        int change_end = change->offset + change->length;
+
+        if (_conflicts (change, record))
+            return FALSE;
+
+        if (change_end <= start)
+        {
+            if (apply)
+                record->offset += change->delta;
+        }
+        else if (change->offset >= end)
+        {
+            change->offset -= text_history_record_get_delta (record);
+        }
+        else
+        {
+            // Formatting around the record, which only
+            // keeps the characters outside of it
+            change_end = change_end >= end ? change_end - text_history_record_get_delta (record) : start;
+            change->offset = MIN (change->offset, start);
+            change->length = change_end - change->offset;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+_rebase (TextHistory       *self,
+         TextHistoryRecord *record)
+{
+    Change change;
+
+    change.offset = record->offset;
+    change.type = record->type;
+    change.delta = text_history_record_get_delta (record);
+    change.length = change.delta > 0 ? 0 : record->length;
+
+    for (GList *l = self->undo->tail; l != NULL; l = l->prev)
+    {
+        Step *step = l->data;
+        Change check = change;
+
+        if (_rebase_step (step, &check, FALSE))
+        {
+            _rebase_step (step, &change, TRUE);
+            continue;
+        }
+
+        // Older steps can only be undone after this one,
+        // so they are discarded along with it
+        while (TRUE)
+        {
+            Step *oldest = g_queue_pop_head (self->undo);
+            gboolean done = oldest == step;
+
+            self->size -= oldest->size;
+            _step_free (oldest);
+
+            if (done)
+                break;
+        }
+
+        break;
+    }
+}
+
+/**
+ * text_history_rebase:
+ * @self: a #TextHistory
+ * @records: (transfer full) (element-type TextHistoryRecord): the
+ *   records of an edit made by someone else, in order
+ *
+ * Moves the stored steps past an edit which isn't part of the history,
+ * such as one received from a collaborator, so that they can still be
+ * undone. A step which touches the same characters as the edit can no
+ * longer be undone, and is discarded along with every step before it.
+ *
+ * The steps which could be redone are always discarded.
+ */
+void
+text_history_rebase (TextHistory *self,
+                     GPtrArray   *records)
+{
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (records != NULL);
+
+    _clear_redo (self);
+
+    for (guint i = 0; i < records->len; i++)
+        _rebase (self, g_ptr_array_index (records, i));
+
+    g_ptr_array_unref (records);
+}
+
+/**
+ * text_history_break_coalescing:
+ * @self: a #TextHistory
+ *
+ * Ensures the next step is stored separately from the previous one.
+ */
+void
+text_history_break_coalescing (TextHistory *self)
+{
+    g_return_if_fail (self != NULL);
+
+    self->coalesce = FALSE;
+}
+
+/**
+ * text_history_undo:
+ * @self: a #TextHistory
+ *
+ * Moves the most recent step onto the redo stack. The caller is
+ * expected to invert its records, in reverse order.
+ *
+ * Returns: (transfer none) (nullable): the records of the undone
+ *   step, or %NULL if there is nothing to undo
+ */
+GPtrArray *
+text_history_undo (TextHistory *self)
+{
+    Step *step;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    step = g_queue_pop_tail (self->undo);
+
+    if (!step)
+        return NULL;
+
+    g_queue_push_tail (self->redo, step);
+    self->coalesce = FALSE;
+
+    return step->records;
+}
+
+/**
+ * text_history_redo:
+ * @self: a #TextHistory
+ *
+ * Moves the most recently undone step back onto the undo stack. The
+ * caller is expected to reapply its records, in order.
+ *
+ * Returns: (transfer none) (nullable): the records of the redone
+ *   step, or %NULL if there is nothing to redo
+ */
+GPtrArray *
+text_history_redo (TextHistory *self)
+{
+    Step *step;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    step = g_queue_pop_tail (self->redo);
+
+    if (!step)
+        return NULL;
+
+    g_queue_push_tail (self->undo, step);
+    self->coalesce = FALSE;
+
+    return step->records;
+}
+
+gboolean
+text_history_can_undo (TextHistory *self)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    return !g_queue_is_empty (self->undo);
+}
+
+gboolean
+text_history_can_redo (TextHistory *self)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    return !g_queue_is_empty (self->redo);
+}
+
+void
+text_history_clear (TextHistory *self)
+{
+    Step *step;
+
+    g_return_if_fail (self != NULL);
+
+    while ((step = g_queue_pop_head (self->undo)))
+        _step_free (step);
+
+    _clear_redo (self);
+
+    self->size = 0;
+    self->coalesce = FALSE;
+}
+
+/**
+ * text_history_set_limit:
+ * @self: a #TextHistory
+ * @limit: the memory limit in bytes
+ *
+ * Sets how much memory the stored steps may use before the oldest
+ * are discarded.
+ */
+void
+text_history_set_limit (TextHistory *self,
+                        gsize        limit)
+{
+    g_return_if_fail (self != NULL);
+
+    self->limit = limit;
+    _evict (self);
+}
+
+gsize
+text_history_get_limit (TextHistory *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->limit;
+}
+
+/**
+ * text_history_get_size:
+ * @self: a #TextHistory
+ *
+ * Returns: the approximate memory used by the stored steps, in bytes
+ */
+gsize
+text_history_get_size (TextHistory *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->size;
+}
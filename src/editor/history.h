@@ -0,0 +1,98 @@
+/* history.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "../model/fragment.h"
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    TEXT_HISTORY_INSERT,
+    TEXT_HISTORY_DELETE,
+    TEXT_HISTORY_SPLIT,
+    TEXT_HISTORY_FRAGMENT,
+    TEXT_HISTORY_FORMAT
+} TextHistoryRecordType;
+
+typedef enum
+{
+    TEXT_HISTORY_BOLD      = 1 << 0,
+    TEXT_HISTORY_ITALIC    = 1 << 1,
+    TEXT_HISTORY_UNDERLINE = 1 << 2
+} TextHistoryStyle;
+
+typedef struct
+{
+    int length;
+    gboolean in_use;
+} TextHistorySpan;
+
+typedef struct _TextHistoryRecord TextHistoryRecord;
+
+struct _TextHistoryRecord
+{
+    TextHistoryRecordType type;
+
+    // Character offset from the start of the document, in which every
+    // paragraph boundary counts as one character, and the number of
+    // characters the edit covers
+    int offset;
+    int length;
+
+    // Inserted text, which typing appends to, and the style it took on
+    GString *text;
+    TextHistoryStyle style;
+
+    // Deleted content or the inserted fragment. Deleted content is
+    // a sequence of fragments with %NULL for every paragraph break.
+    GPtrArray *content;
+
+    // The changed style, its new value and the previous values as a
+    // sequence of spans
+    TextHistoryStyle format;
+    gboolean in_use;
+    GArray *spans;
+};
+
+typedef struct _TextHistory TextHistory;
+
+TextHistory       *text_history_new              (void);
+void               text_history_free             (TextHistory *self);
+
+TextHistoryRecord *text_history_record_new       (TextHistoryRecordType type, int offset, int length);
+void               text_history_record_free      (TextHistoryRecord *self);
+int                text_history_record_get_delta (TextHistoryRecord *self);
+TextFragment      *text_history_copy_fragment    (TextFragment *fragment);
+GPtrArray         *text_history_content_new      (void);
+void               text_history_content_append   (GPtrArray *content, TextFragment *fragment);
+
+GPtrArray         *text_history_records_new      (void);
+void               text_history_push             (TextHistory *self, GPtrArray *records);
+void               text_history_rebase           (TextHistory *self, GPtrArray *records);
+void               text_history_break_coalescing (TextHistory *self);
+
+GPtrArray         *text_history_undo             (TextHistory *self);
+GPtrArray         *text_history_redo             (TextHistory *self);
+gboolean           text_history_can_undo         (TextHistory *self);
+gboolean           text_history_can_redo         (TextHistory *self);
+void               text_history_clear            (TextHistory *self);
+
+void               text_history_set_limit        (TextHistory *self, gsize limit);
+gsize              text_history_get_limit        (TextHistory *self);
+gsize              text_history_get_size         (TextHistory *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextHistory, text_history_free)
+
+G_END_DECLS
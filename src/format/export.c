@@ -0,0 +1,131 @@
+/* export.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "export.h"
+
+/**
+ * format_write_plain_text:
+ * @snapshot: the #TextSnapshot to write
+ * @stream: the #GOutputStream to write to
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Writes the text of @snapshot to @stream, with every paragraph
+ * followed by a newline. This may be called on any thread.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+format_write_plain_text (TextSnapshot   *snapshot,
+                         GOutputStream  *stream,
+                         GCancellable   *cancellable,
+                         GError        **error)
+{
+    g_return_val_if_fail (snapshot != NULL, FALSE);
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+    for (guint i = 0; i < text_snapshot_get_n_paragraphs (snapshot); i++)
+    {
+        TextSnapshotParagraph *paragraph = text_snapshot_get_paragraph (snapshot, i);
+
+        if (!g_output_stream_write_all (stream,
+                                        text_snapshot_paragraph_get_text (paragraph),
+                                        text_snapshot_paragraph_get_size_bytes (paragraph),
+                                        NULL, cancellable, error))
+            return FALSE;
+
+        if (!g_output_stream_write_all (stream, "\n", 1, NULL, cancellable, error))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+_append_fragment (GString                    *html,
+                  const char                 *text,
+                  const TextSnapshotFragment *fragment)
+{
+    g_autofree char *escaped = NULL;
+
+    // Inline objects can't be exported yet
+    if (fragment->type != TEXT_SNAPSHOT_RUN || fragment->size == 0)
+        return;
+
+    escaped = g_markup_escape_text (text + fragment->index, fragment->size);
+
+    if (fragment->is_bold)
+        g_string_append (html, "<b>");
+    if (fragment->is_italic)
+        g_string_append (html, "<i>");
+    if (fragment->is_underline)
+        g_string_append (html, "<u>");
+
+    g_string_append (html, escaped);
+
+    if (fragment->is_underline)
+        g_string_append (html, "</u>");
+    if (fragment->is_italic)
+        g_string_append (html, "</i>");
+    if (fragment->is_bold)
+        g_string_append (html, "</b>");
+}
+
+/**
+ * format_write_html:
+ * @snapshot: the #TextSnapshot to write
+ * @stream: the #GOutputStream to write to
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Writes @snapshot to @stream as HTML which format_parse_html() can
+ * read back, with a `<p>` element for every paragraph. This may be
+ * called on any thread.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+format_write_html (TextSnapshot   *snapshot,
+                   GOutputStream  *stream,
+                   GCancellable   *cancellable,
+                   GError        **error)
+{
+    g_autoptr (GString) html = NULL;
+
+    g_return_val_if_fail (snapshot != NULL, FALSE);
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+    html = g_string_new ("<html>\n<body>\n");
+
+    for (guint i = 0; i < text_snapshot_get_n_paragraphs (snapshot); i++)
+    {
+        TextSnapshotParagraph *paragraph = text_snapshot_get_paragraph (snapshot, i);
+        const char *text = text_snapshot_paragraph_get_text (paragraph);
+
+        g_string_append (html, "<p>");
+
+        for (guint j = 0; j < text_snapshot_paragraph_get_n_fragments (paragraph); j++)
+            _append_fragment (html, text, text_snapshot_paragraph_get_fragment (paragraph, j));
+
+        g_string_append (html, "</p>\n");
+
+        // Write a paragraph at a time, so that large
+        // documents are not held in memory twice
+        if (!g_output_stream_write_all (stream, html->str, html->len, NULL, cancellable, error))
+            return FALSE;
+
+        g_string_truncate (html, 0);
+    }
+
+    g_string_append (html, "</body>\n</html>\n");
+
+    return g_output_stream_write_all (stream, html->str, html->len, NULL, cancellable, error);
+}
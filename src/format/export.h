@@ -0,0 +1,40 @@
+/* export.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "../model/snapshot.h"
+
+G_BEGIN_DECLS
+
+/**
+ * FormatWriteFunc:
+ * @snapshot: the #TextSnapshot to write
+ * @stream: the #GOutputStream to write to
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Serialises @snapshot to @stream. As snapshots are immutable, this
+ * may be called on any thread.
+ *
+ * Returns: %TRUE on success
+ */
+typedef gboolean (*FormatWriteFunc) (TextSnapshot   *snapshot,
+                                     GOutputStream  *stream,
+                                     GCancellable   *cancellable,
+                                     GError        **error);
+
+gboolean format_write_plain_text (TextSnapshot *snapshot, GOutputStream *stream, GCancellable *cancellable, GError **error);
+gboolean format_write_html       (TextSnapshot *snapshot, GOutputStream *stream, GCancellable *cancellable, GError **error);
+
+G_END_DECLS
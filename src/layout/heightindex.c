@@ -0,0 +1,260 @@
+/* heightindex.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "heightindex.h"
+
+#include <string.h>
+
+/*
+ * A Fenwick (binary indexed) tree over the heights of a sequence of
+ * vertically stacked boxes. Both the offset of the k-th box and the
+ * box containing a given offset are found in O(log n), as is updating
+ * the height of a single box.
+ */
+struct _TextHeightIndex
+{
+    // Heights of each entry
+    int *heights;
+
+    // 1-based Fenwick tree, tree[i] holds the sum of
+    // the (i & -i) heights ending at entry i-1
+    int *tree;
+
+    int n_entries;
+    int capacity;
+};
+
+/**
+ * text_height_index_new:
+ *
+ * Creates a new, empty height index.
+ *
+ * Returns: (transfer full): a new #TextHeightIndex
+ */
+TextHeightIndex *
+text_height_index_new (void)
+{
+    return g_new0 (TextHeightIndex, 1);
+}
+
+/**
+ * text_height_index_free:
+ * @self: a #TextHeightIndex
+ *
+ * Frees @self.
+ */
+void
+text_height_index_free (TextHeightIndex *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_free (self->heights);
+    g_free (self->tree);
+    g_free (self);
+}
+
+/**
+ * text_height_index_resize:
+ * @self: a #TextHeightIndex
+ * @n_entries: the new number of entries
+ *
+ * Sets the number of entries in the index. Entries which remain keep
+ * their heights, and new entries have a height of zero. Shrinking the
+ * index is O(1), while growing it is O(n).
+ */
+void
+text_height_index_resize (TextHeightIndex *self,
+                          int              n_entries)
+{
+    int old_n_entries;
+    int i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (n_entries >= 0);
+
+    old_n_entries = self->n_entries;
+    self->n_entries = n_entries;
+
+    // Each node only sums entries before it, so
+    // a prefix of the tree is still a valid tree
+    if (n_entries <= old_n_entries)
+        return;
+
+    if (n_entries > self->capacity)
+    {
+        self->capacity = MAX (n_entries, self->capacity * 2);
+        self->heights = g_renew (int, self->heights, self->capacity);
+        self->tree = g_renew (int, self->tree, self->capacity + 1);
+    }
+
+    memset (self->heights + old_n_entries, 0, sizeof (int) * (n_entries - old_n_entries));
+
+    // Nodes past the old end may cover old entries, so
+    // rebuild the tree bottom-up in linear time
+    for (i = 1; i <= n_entries; i++)
+        self->tree[i] = self->heights[i - 1];
+
+    for (i = 1; i <= n_entries; i++)
+    {
+        int parent = i + (i & -i);
+
+        if (parent <= n_entries)
+            self->tree[parent] += self->tree[i];
+    }
+}
+
+/**
+ * text_height_index_get_size:
+ * @self: a #TextHeightIndex
+ *
+ * Returns: the number of entries in the index
+ */
+int
+text_height_index_get_size (TextHeightIndex *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->n_entries;
+}
+
+/**
+ * text_height_index_set:
+ * @self: a #TextHeightIndex
+ * @index: the entry to update
+ * @height: the new height of the entry
+ *
+ * Sets the height of the entry at @index in O(log n).
+ */
+void
+text_height_index_set (TextHeightIndex *self,
+                       int              index,
+                       int              height)
+{
+    int delta;
+    int i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (index >= 0 && index < self->n_entries);
+
+    delta = height - self->heights[index];
+    self->heights[index] = height;
+
+    if (delta == 0)
+        return;
+
+    for (i = index + 1; i <= self->n_entries; i += i & -i)
+        self->tree[i] += delta;
+}
+
+/**
+ * text_height_index_get:
+ * @self: a #TextHeightIndex
+ * @index: the entry to look up
+ *
+ * Returns: the height of the entry at @index
+ */
+int
+text_height_index_get (TextHeightIndex *self,
+                       int              index)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (index >= 0 && index < self->n_entries, 0);
+
+    return self->heights[index];
+}
+
+/**
+ * text_height_index_get_offset:
+ * @self: a #TextHeightIndex
+ * @index: an entry, or the number of entries
+ *
+ * Gets the sum of the heights of all entries before @index, i.e. the
+ * offset of the top of the entry from the top of the first one.
+ *
+ * Returns: the offset of the entry at @index
+ */
+int
+text_height_index_get_offset (TextHeightIndex *self,
+                              int              index)
+{
+    int offset;
+    int i;
+
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (index >= 0 && index <= self->n_entries, 0);
+
+    offset = 0;
+
+    for (i = index; i > 0; i -= i & -i)
+        offset += self->tree[i];
+
+    return offset;
+}
+
+/**
+ * text_height_index_get_total:
+ * @self: a #TextHeightIndex
+ *
+ * Returns: the sum of the heights of all entries
+ */
+int
+text_height_index_get_total (TextHeightIndex *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return text_height_index_get_offset (self, self->n_entries);
+}
+
+/**
+ * text_height_index_find:
+ * @self: a #TextHeightIndex
+ * @y: an offset from the top of the first entry
+ *
+ * Finds the entry which contains the offset @y. Offsets before the
+ * first entry or past the last entry are clamped to the first and
+ * last entries respectively.
+ *
+ * Returns: the index of the entry containing @y, or -1 if empty
+ */
+int
+text_height_index_find (TextHeightIndex *self,
+                        int              y)
+{
+    int position;
+    int step;
+
+    g_return_val_if_fail (self != NULL, -1);
+
+    if (self->n_entries == 0)
+        return -1;
+
+    if (y < 0)
+        return 0;
+
+    // Descend the implicit tree to find the largest position
+    // whose prefix sum is still less than or equal to y
+    position = 0;
+
+    for (step = 1; step * 2 <= self->n_entries; step *= 2);
+
+    for (; step > 0; step /= 2)
+    {
+        if (position + step <= self->n_entries &&
+            self->tree[position + step] <= y)
+        {
+            position += step;
+            y -= self->tree[position];
+        }
+    }
+
+    // Offsets past the end belong to the last entry
+    return MIN (position, self->n_entries - 1);
+}
@@ -0,0 +1,35 @@
+/* heightindex.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TextHeightIndex TextHeightIndex;
+
+TextHeightIndex *text_height_index_new        (void);
+void             text_height_index_free       (TextHeightIndex *self);
+
+void             text_height_index_resize     (TextHeightIndex *self, int n_entries);
+int              text_height_index_get_size   (TextHeightIndex *self);
+
+void             text_height_index_set        (TextHeightIndex *self, int index, int height);
+int              text_height_index_get        (TextHeightIndex *self, int index);
+
+int              text_height_index_get_offset (TextHeightIndex *self, int index);
+int              text_height_index_get_total  (TextHeightIndex *self);
+int              text_height_index_find       (TextHeightIndex *self, int y);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextHeightIndex, text_height_index_free)
+
+G_END_DECLS
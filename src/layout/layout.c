@@ -13,13 +13,30 @@
 
 typedef struct
 {
-    int padding;
+    // Shape paragraphs on worker threads
+    gboolean parallel;
+
+    // Lazy shaping
+    gboolean lazy;
+    double viewport_y;
+    double viewport_height;
+
+    // Time budget for each pass in milliseconds
+    int budget;
+
+    // Results of previous passes
+    double anchor_shift;
+    int n_estimated;
+    int n_deferred;
 } TextLayoutPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (TextLayout, text_layout, G_TYPE_OBJECT)
 
 enum {
     PROP_0,
+    PROP_LAZY,
+    PROP_PARALLEL,
+    PROP_BUDGET,
     N_PROPS
 };
 
@@ -49,6 +66,18 @@ text_layout_get_property (GObject    *object,
 
     switch (prop_id)
     {
+    case PROP_LAZY:
+        g_value_set_boolean (value, text_layout_get_lazy (self));
+        break;
+
+    case PROP_PARALLEL:
+        g_value_set_boolean (value, text_layout_get_parallel (self));
+        break;
+
+    case PROP_BUDGET:
+        g_value_set_int (value, text_layout_get_budget (self));
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -64,40 +93,167 @@ text_layout_set_property (GObject      *object,
 
     switch (prop_id)
     {
+    case PROP_LAZY:
+        text_layout_set_lazy (self, g_value_get_boolean (value));
+        break;
+
+    case PROP_PARALLEL:
+        text_layout_set_parallel (self, g_value_get_boolean (value));
+        break;
+
+    case PROP_BUDGET:
+        text_layout_set_budget (self, g_value_get_int (value));
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
 }
 
+static void
+_layout_root (TextLayout    *self,
+              PangoContext  *context,
+              TextLayoutBox *root,
+              int            width)
+{
+    TextLayoutPrivate *priv;
+    TextLayoutPass pass = { 0 };
+
+    priv = text_layout_get_instance_private (self);
+
+    pass.parallel = priv->parallel;
+    pass.lazy = priv->lazy;
+    pass.viewport_y = priv->viewport_y;
+    pass.viewport_height = priv->viewport_height;
+
+    // Shape one screen above and below the viewport
+    pass.margin = priv->viewport_height;
+
+    if (priv->budget > 0)
+        pass.deadline = g_get_monotonic_time () + (gint64) priv->budget * G_TIME_SPAN_MILLISECOND;
+
+    // Needed to estimate the heights of unshaped blocks
+    if (priv->lazy || priv->budget > 0)
+    {
+        PangoFontMetrics *metrics;
+
+        metrics = pango_context_get_metrics (context, NULL, NULL);
+        pass.char_width = pango_font_metrics_get_approximate_char_width (metrics) / PANGO_SCALE;
+        pass.line_height = pango_font_metrics_get_height (metrics) / PANGO_SCALE;
+        pango_font_metrics_unref (metrics);
+    }
+
+    text_layout_box_set_pass (root, &pass);
+
+    if (pass.deadline)
+    {
+        double margins[] = { 0, pass.margin, G_MAXDOUBLE };
+        int n_steps;
+        int i;
+
+        // Spend the budget on what is visible first, whatever it
+        // costs, then on the margin and finally, unless lazy, on
+        // everything else. Each step is a full pass, but blocks
+        // shaped by an earlier step are only moved.
+        n_steps = pass.lazy ? 2 : 3;
+
+        for (i = 0; i < n_steps; i++)
+        {
+            pass.margin = margins[i];
+            pass.n_estimated = 0;
+            pass.n_deferred = 0;
+            text_layout_box_layout (root, context, width, 0, 0);
+
+            if (pass.n_estimated == 0)
+                break;
+
+            // Out of time, so the remaining steps are left to a later pass
+            if (i + 1 < n_steps && g_get_monotonic_time () > pass.deadline)
+            {
+                pass.n_deferred += pass.n_estimated;
+                pass.n_estimated = 0;
+                break;
+            }
+        }
+    }
+    else
+    {
+        text_layout_box_layout (root, context, width, 0, 0);
+    }
+
+    text_layout_box_set_pass (root, NULL);
+
+    priv->anchor_shift += pass.anchor_shift;
+    priv->n_estimated = pass.n_estimated;
+    priv->n_deferred = pass.n_deferred;
+}
+
+// Whether @child no longer belongs under the box of @item, because
+// its own item was freed, removed or moved to another parent
+static gboolean
+_is_stale (TextLayoutBox *child,
+           TextItem      *item)
+{
+    TextItem *child_item;
+
+    child_item = text_layout_box_get_item (child);
+
+    return !child_item ||
+           text_node_get_parent (TEXT_NODE (child_item)) != TEXT_NODE (item) ||
+           text_item_get_attachment (child_item) != TEXT_NODE (child);
+}
+
 TextLayoutBox *
 build_layout_tree_recursive (TextLayout    *self,
                              PangoContext  *context,
                              TextItem      *item)
 {
     TextLayoutBox *box;
+    TextNode *attachment;
     TextNode *iter;
+    TextNode *expected;
+    gboolean changed;
 
     g_return_val_if_fail (TEXT_IS_LAYOUT (self), NULL);
     g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
     g_return_val_if_fail (TEXT_IS_ITEM (item), NULL);
 
-    // Construct a layout item for this node using the item factory
-    // Subclasses can override this to add and use their own items
-    box = TEXT_LAYOUT_GET_CLASS (self)->item_factory (TEXT_ITEM (item));
+    attachment = text_item_get_attachment (item);
 
-    // For now, if a node does not provide a LayoutBox then we assume
-    // it and its children are invisible. Perhaps we want to introduce
-    // some kind of LayoutAnonymousBox which is transparently skipped by
-    // the layout engine.
-    if (!TEXT_IS_LAYOUT_BOX (box))
-        return NULL;
+    if (TEXT_IS_LAYOUT_BOX (attachment))
+    {
+        // Reuse the box from the previous build, which keeps its
+        // shaped PangoLayout until it is explicitly marked dirty
+        box = TEXT_LAYOUT_BOX (attachment);
+    }
+    else
+    {
+        // Construct a layout item for this node using the item factory
+        // Subclasses can override this to add and use their own items
+        box = TEXT_LAYOUT_GET_CLASS (self)->item_factory (TEXT_ITEM (item));
+
+        // For now, if a node does not provide a LayoutBox then we assume
+        // it and its children are invisible. Perhaps we want to introduce
+        // some kind of LayoutAnonymousBox which is transparently skipped by
+        // the layout engine.
+        if (!TEXT_IS_LAYOUT_BOX (box))
+            return NULL;
+
+        // Setup Box
+        text_layout_box_set_item (box, item);
+        text_item_detach (TEXT_ITEM (item));
+        text_item_attach (TEXT_ITEM (item), TEXT_NODE (box));
+
+        // The attachment now owns the box
+        g_object_unref (box);
+    }
 
-    // Setup Box
-    text_layout_box_set_item (box, item);
-    text_item_detach (TEXT_ITEM (item)); // TODO: Move to a 'cleanup_tree' function?
-    text_item_attach (TEXT_ITEM (item), TEXT_NODE (box));
+    // Reconcile children: walk the model in order and compare against
+    // the existing child boxes. Boxes are only moved, created or
+    // destroyed where the model differs from the previous build.
+    changed = FALSE;
+    expected = text_node_get_first_child (TEXT_NODE (box));
 
-    // Append children
     for (iter = text_node_get_first_child (TEXT_NODE (item));
          iter != NULL;
          iter = text_node_get_next (iter))
@@ -108,12 +264,68 @@ build_layout_tree_recursive (TextLayout    *self,
 
         child_box = build_layout_tree_recursive (self, context, TEXT_ITEM (iter));
 
-        if (TEXT_IS_LAYOUT_BOX (child_box))
+        if (!TEXT_IS_LAYOUT_BOX (child_box))
+            continue;
+
+        // Drop the boxes of removed items as soon as they are reached,
+        // so the boxes after them still line up with the model and
+        // don't have to be moved back past them one by one
+        while (expected && _is_stale (TEXT_LAYOUT_BOX (expected), item))
         {
-            text_node_append_child (TEXT_NODE (box), TEXT_NODE (child_box));
+            TextNode *next;
+
+            next = text_node_get_next (expected);
+            text_node_delete_child (TEXT_NODE (box), expected);
+            expected = next;
+            changed = TRUE;
         }
+
+        // Unchanged
+        if (TEXT_NODE (child_box) == expected)
+        {
+            expected = text_node_get_next (expected);
+            continue;
+        }
+
+        // Inserted or moved
+        changed = TRUE;
+
+        if (text_node_get_parent (TEXT_NODE (child_box)))
+        {
+            // The box it was moved out of must be re-shaped too
+            text_layout_box_mark_dirty (TEXT_LAYOUT_BOX (text_node_get_parent (TEXT_NODE (child_box))));
+
+            // Takes over the old parent's reference
+            text_node_unparent (TEXT_NODE (child_box));
+        }
+        else
+        {
+            // Parents hold their own reference to each child,
+            // alongside the one held by the item's attachment
+            g_object_ref (child_box);
+        }
+
+        if (expected)
+            text_node_insert_child_before (TEXT_NODE (box), TEXT_NODE (child_box), expected);
+        else
+            text_node_append_child (TEXT_NODE (box), TEXT_NODE (child_box));
+    }
+
+    // Any remaining boxes belong to items which were removed
+    while (expected != NULL)
+    {
+        TextNode *next;
+
+        next = text_node_get_next (expected);
+        text_node_delete_child (TEXT_NODE (box), expected);
+        expected = next;
+        changed = TRUE;
     }
 
+    // Inline children affect how the block is shaped
+    if (changed)
+        text_layout_box_mark_dirty (box);
+
     return box;
 }
 
@@ -151,6 +363,21 @@ text_layout_default_item_factory (TextItem *item)
     return NULL;
 }
 
+/**
+ * text_layout_build_layout_tree:
+ * @self: a #TextLayout
+ * @context: the #PangoContext to shape text with
+ * @frame: the #TextFrame to lay out
+ * @width: the available width
+ *
+ * Builds the layout tree for @frame and lays it out. Boxes from a
+ * previous build (which remain attached to their items) are reused,
+ * so only inserted items get new boxes and only boxes belonging to
+ * removed items are destroyed. Reused boxes are only re-shaped if
+ * they were marked dirty or @width has changed.
+ *
+ * Returns: (transfer full): the root of the layout tree
+ */
 TextLayoutBox *
 text_layout_build_layout_tree (TextLayout   *self,
                                PangoContext *context,
@@ -163,8 +390,60 @@ text_layout_build_layout_tree (TextLayout   *self,
     g_return_val_if_fail (TEXT_IS_FRAME (frame), NULL);
 
     root = build_layout_tree_recursive (self, context, TEXT_ITEM (frame));
-    text_layout_box_layout (root, context, width, 0, 0);
-    return root;
+    _layout_root (self, context, root, width);
+    return g_object_ref (root);
+}
+
+/**
+ * text_layout_relayout:
+ * @self: a #TextLayout
+ * @context: the #PangoContext to shape text with
+ * @root: the root of a layout tree built by text_layout_build_layout_tree()
+ * @width: the available width
+ *
+ * Lays out an existing layout tree again without rebuilding it. Only
+ * blocks which have been marked with text_layout_mark_dirty() (or all
+ * blocks, if @width has changed) are re-shaped. Every other block keeps
+ * its #PangoLayout and is simply moved to its new position.
+ *
+ * This must only be used when the structure of the document has not
+ * changed since the tree was built. Otherwise, build a new tree.
+ */
+void
+text_layout_relayout (TextLayout    *self,
+                      PangoContext  *context,
+                      TextLayoutBox *root,
+                      int            width)
+{
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+    g_return_if_fail (PANGO_IS_CONTEXT (context));
+    g_return_if_fail (TEXT_IS_LAYOUT_BOX (root));
+
+    _layout_root (self, context, root, width);
+}
+
+/**
+ * text_layout_mark_dirty:
+ * @self: a #TextLayout
+ * @item: the #TextItem which has changed
+ *
+ * Marks the layout box attached to @item as dirty, so that it is
+ * re-shaped during the next call to text_layout_relayout(). Items
+ * without an attached layout box are ignored.
+ */
+void
+text_layout_mark_dirty (TextLayout *self,
+                        TextItem   *item)
+{
+    TextNode *box;
+
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+    g_return_if_fail (TEXT_IS_ITEM (item));
+
+    box = text_item_get_attachment (item);
+
+    if (TEXT_IS_LAYOUT_BOX (box))
+        text_layout_box_mark_dirty (TEXT_LAYOUT_BOX (box));
 }
 
 TextLayoutBox *
@@ -191,9 +470,51 @@ text_layout_pick_internal (TextLayoutBox  *root,
     // Note: 'x' and 'y' are relative to the document origin
     TextNode *child;
     TextNode *found;
+    int index;
 
     g_return_val_if_fail (TEXT_IS_LAYOUT_BOX (root), NULL);
 
+    // Block children are stacked vertically, so at most one of them
+    // can contain 'y' and the height index finds it directly
+    if (TEXT_IS_LAYOUT_BLOCK (root) &&
+        (index = text_layout_block_get_child_at_y (TEXT_LAYOUT_BLOCK (root), y)) != -1)
+    {
+        TextLayoutBox *layout_item;
+        const TextDimensions *bbox;
+        double dist_to_y;
+
+        layout_item = text_layout_block_get_nth_child (TEXT_LAYOUT_BLOCK (root), index);
+        bbox = text_layout_box_get_bbox (layout_item);
+
+        found = TEXT_NODE (text_layout_pick_internal (layout_item, x - bbox->x, y - bbox->y, min_y_distance, min_y_layout));
+
+        if (found)
+            return TEXT_LAYOUT_BOX (found);
+
+        if (x >= bbox->x &&
+            y >= bbox->y &&
+            x <= bbox->x + bbox->width &&
+            y <= bbox->y + bbox->height)
+        {
+            return layout_item;
+        }
+
+        // Otherwise this is the closest block vertically
+        if (y >= bbox->y && y <= bbox->y + bbox->height)
+            dist_to_y = 0;
+        else
+            dist_to_y = (y < bbox->y)
+                    ? bbox->y - y
+                    : y - bbox->y;
+
+        if (dist_to_y < *min_y_distance) {
+            *min_y_distance = dist_to_y;
+            *min_y_layout = layout_item;
+        }
+
+        return NULL;
+    }
+
     for (child = text_node_get_first_child (TEXT_NODE (root));
          child != NULL;
          child = text_node_get_next (child))
@@ -264,6 +585,218 @@ text_layout_pick (TextLayoutBox *root,
     return min_y_layout;
 }
 
+/**
+ * text_layout_set_lazy:
+ * @self: a #TextLayout
+ * @lazy: whether to shape lazily
+ *
+ * Sets whether blocks are shaped lazily. In lazy mode, only blocks
+ * near the viewport (see text_layout_set_viewport()) are shaped. The
+ * remaining blocks are given a height estimated from their character
+ * count and the average font metrics, and are shaped once they come
+ * close to the viewport in a later pass.
+ */
+void
+text_layout_set_lazy (TextLayout *self,
+                      gboolean    lazy)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+
+    priv = text_layout_get_instance_private (self);
+
+    lazy = !!lazy;
+
+    if (priv->lazy == lazy)
+        return;
+
+    priv->lazy = lazy;
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_LAZY]);
+}
+
+gboolean
+text_layout_get_lazy (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), FALSE);
+
+    priv = text_layout_get_instance_private (self);
+    return priv->lazy;
+}
+
+/**
+ * text_layout_set_parallel:
+ * @self: a #TextLayout
+ * @parallel: whether to shape in parallel
+ *
+ * Sets whether paragraphs are shaped on a pool of worker threads. Each
+ * thread shapes with its own #PangoContext, created from the same font
+ * map and settings as the context passed to the layout functions. Only
+ * the assignment of positions then happens serially.
+ *
+ * This requires the font map of the context to be usable from several
+ * threads at once.
+ */
+void
+text_layout_set_parallel (TextLayout *self,
+                          gboolean    parallel)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+
+    priv = text_layout_get_instance_private (self);
+
+    parallel = !!parallel;
+
+    if (priv->parallel == parallel)
+        return;
+
+    priv->parallel = parallel;
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PARALLEL]);
+}
+
+gboolean
+text_layout_get_parallel (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), FALSE);
+
+    priv = text_layout_get_instance_private (self);
+    return priv->parallel;
+}
+
+/**
+ * text_layout_set_viewport:
+ * @self: a #TextLayout
+ * @y: the top of the visible area, in layout coordinates
+ * @height: the height of the visible area
+ *
+ * Sets the area of the layout which is currently visible. This is
+ * used to decide which blocks to shape in lazy mode.
+ */
+void
+text_layout_set_viewport (TextLayout *self,
+                          double      y,
+                          double      height)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+
+    priv = text_layout_get_instance_private (self);
+    priv->viewport_y = y;
+    priv->viewport_height = height;
+}
+
+/**
+ * text_layout_take_anchor_shift:
+ * @self: a #TextLayout
+ *
+ * Gets how far the content at the top of the viewport has moved since
+ * this was last called, because estimated heights above it have been
+ * replaced by real ones. Adding this to the scroll position keeps the
+ * visible content still.
+ *
+ * Returns: the vertical shift in pixels
+ */
+double
+text_layout_take_anchor_shift (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+    double shift;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), 0);
+
+    priv = text_layout_get_instance_private (self);
+
+    shift = priv->anchor_shift;
+    priv->anchor_shift = 0;
+
+    return shift;
+}
+
+/**
+ * text_layout_has_estimates:
+ * @self: a #TextLayout
+ *
+ * Returns: %TRUE if the last pass left blocks with estimated heights
+ */
+gboolean
+text_layout_has_estimates (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), FALSE);
+
+    priv = text_layout_get_instance_private (self);
+    return priv->n_estimated > 0 || priv->n_deferred > 0;
+}
+
+/**
+ * text_layout_set_budget:
+ * @self: a #TextLayout
+ * @budget: the time budget in milliseconds, or 0 for no limit
+ *
+ * Sets how long a single layout pass may spend shaping. Blocks in
+ * the viewport are always shaped first, then the budget is spent on
+ * the blocks around it and finally on the rest of the document. Once
+ * the budget is used up, the remaining blocks are given estimated
+ * heights and left for later passes, which continue where the
+ * previous one stopped. Use
+ * text_layout_has_pending_work() to find out whether another pass is
+ * needed, e.g. on the next frame clock tick.
+ */
+void
+text_layout_set_budget (TextLayout *self,
+                        int         budget)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT (self));
+    g_return_if_fail (budget >= 0);
+
+    priv = text_layout_get_instance_private (self);
+
+    if (priv->budget == budget)
+        return;
+
+    priv->budget = budget;
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUDGET]);
+}
+
+int
+text_layout_get_budget (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), 0);
+
+    priv = text_layout_get_instance_private (self);
+    return priv->budget;
+}
+
+/**
+ * text_layout_has_pending_work:
+ * @self: a #TextLayout
+ *
+ * Returns: %TRUE if the last pass ran out of time before shaping
+ *   every block, see text_layout_set_budget()
+ */
+gboolean
+text_layout_has_pending_work (TextLayout *self)
+{
+    TextLayoutPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT (self), FALSE);
+
+    priv = text_layout_get_instance_private (self);
+    return priv->n_deferred > 0;
+}
+
 static void
 text_layout_class_init (TextLayoutClass *klass)
 {
@@ -274,6 +807,29 @@ text_layout_class_init (TextLayoutClass *klass)
     object_class->finalize = text_layout_finalize;
     object_class->get_property = text_layout_get_property;
     object_class->set_property = text_layout_set_property;
+
+    properties [PROP_LAZY]
+        = g_param_spec_boolean ("lazy",
+                                "Lazy",
+                                "Only shape blocks near the viewport",
+                                FALSE,
+                                G_PARAM_READWRITE|G_PARAM_EXPLICIT_NOTIFY);
+
+    properties [PROP_PARALLEL]
+        = g_param_spec_boolean ("parallel",
+                                "Parallel",
+                                "Shape paragraphs on worker threads",
+                                FALSE,
+                                G_PARAM_READWRITE|G_PARAM_EXPLICIT_NOTIFY);
+
+    properties [PROP_BUDGET]
+        = g_param_spec_int ("budget",
+                            "Budget",
+                            "Time budget for a layout pass in milliseconds, or 0 for no limit",
+                            0, G_MAXINT, 0,
+                            G_PARAM_READWRITE|G_PARAM_EXPLICIT_NOTIFY);
+
+    g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
 static void
@@ -44,6 +44,51 @@ text_layout_build_layout_tree (TextLayout   *self,
                                TextFrame    *frame,
                                int           width);
 
+void
+text_layout_relayout (TextLayout    *self,
+                      PangoContext  *context,
+                      TextLayoutBox *root,
+                      int            width);
+
+void
+text_layout_mark_dirty (TextLayout *self,
+                        TextItem   *item);
+
+void
+text_layout_set_lazy (TextLayout *self,
+                      gboolean    lazy);
+
+gboolean
+text_layout_get_lazy (TextLayout *self);
+
+void
+text_layout_set_parallel (TextLayout *self,
+                          gboolean    parallel);
+
+gboolean
+text_layout_get_parallel (TextLayout *self);
+
+void
+text_layout_set_viewport (TextLayout *self,
+                          double      y,
+                          double      height);
+
+double
+text_layout_take_anchor_shift (TextLayout *self);
+
+gboolean
+text_layout_has_estimates (TextLayout *self);
+
+void
+text_layout_set_budget (TextLayout *self,
+                        int         budget);
+
+int
+text_layout_get_budget (TextLayout *self);
+
+gboolean
+text_layout_has_pending_work (TextLayout *self);
+
 TextLayoutBox *
 text_layout_pick (TextLayoutBox *root,
                   int            x,
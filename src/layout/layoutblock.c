@@ -11,14 +11,39 @@
 
 #include "layoutblock.h"
 
+#include <pango/pangocairo.h>
+
 #include "../model/paragraph.h"
 #include "../model/image.h"
 
 #include "layoutinline.h"
+#include "heightindex.h"
 
 typedef struct
 {
     PangoLayout *layout;
+
+    // Results of the last shaping pass, reused
+    // while the block is clean
+    int layout_width;
+    int layout_height;
+
+    // Set while the height is only an estimate (see lazy layout)
+    gboolean estimated;
+
+    // Set once shaped by a worker thread, until positioned
+    gboolean prepared;
+
+    // Generation of the paragraph when it was last shaped
+    guint shaped_generation;
+
+    // Drawing data owned by the display, dropped when re-shaped
+    gpointer render_cache;
+    GDestroyNotify render_cache_destroy;
+
+    // Index of the heights of block children, updated in place
+    // whenever the block is laid out
+    TextHeightIndex *heights;
 } TextLayoutBlockPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (TextLayoutBlock, text_layout_block, TEXT_TYPE_LAYOUT_BOX)
@@ -36,12 +61,26 @@ text_layout_block_new ()
     return TEXT_LAYOUT_BLOCK (g_object_new (TEXT_TYPE_LAYOUT_BLOCK, NULL));
 }
 
+static void
+_clear_render_cache (TextLayoutBlockPrivate *priv)
+{
+    if (priv->render_cache && priv->render_cache_destroy)
+        priv->render_cache_destroy (priv->render_cache);
+
+    priv->render_cache = NULL;
+    priv->render_cache_destroy = NULL;
+}
+
 static void
 text_layout_block_finalize (GObject *object)
 {
     TextLayoutBlock *self = (TextLayoutBlock *)object;
     TextLayoutBlockPrivate *priv = text_layout_block_get_instance_private (self);
 
+    _clear_render_cache (priv);
+    g_clear_object (&priv->layout);
+    g_clear_pointer (&priv->heights, text_height_index_free);
+
     G_OBJECT_CLASS (text_layout_block_parent_class)->finalize (object);
 }
 
@@ -146,9 +185,8 @@ _set_run_attribute (TextRun       *run,
     }
 }
 
-void
-_set_attributes (TextParagraph *paragraph,
-                 PangoLayout   *pango_layout)
+static PangoAttrList *
+_create_attributes (TextParagraph *paragraph)
 {
     TextNode *fragment;
     PangoAttrList *list;
@@ -156,9 +194,6 @@ _set_attributes (TextParagraph *paragraph,
     int start_index;
 
     list = pango_attr_list_new();
-
-    g_return_if_fail (TEXT_IS_PARAGRAPH (paragraph));
-
     start_index = 0;
 
     for (fragment = text_node_get_first_child (TEXT_NODE (paragraph));
@@ -177,9 +212,16 @@ _set_attributes (TextParagraph *paragraph,
         start_index += run_length;
     }
 
-    pango_layout_set_attributes (pango_layout, list);
+    return list;
 }
 
+static void
+_shape_children_parallel (TextLayoutBox  *self,
+                          PangoContext   *context,
+                          TextLayoutPass *pass,
+                          int             width,
+                          int             offset_y);
+
 static void
 do_block_layout (TextLayoutBox *self,
                  PangoContext  *context,
@@ -189,15 +231,32 @@ do_block_layout (TextLayoutBox *self,
 {
     TextNode *iter;
     TextDimensions *bbox;
+    TextLayoutBlockPrivate *priv;
+    TextLayoutPass *pass;
 
     int child_offset_y;
     int height;
+    int index;
+    int n_children;
 
     height = 0;
     child_offset_y = 0;
     bbox = text_layout_box_get_mutable_bbox (self);
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+    pass = text_layout_box_get_pass (self);
+
+    // Shape paragraphs on worker threads first, which leaves
+    // only positioning the children to the serial pass below
+    if (pass && pass->parallel)
+        _shape_children_parallel (self, context, pass, width, offset_y);
+
+    // Entries are only updated where the child or its height changed,
+    // so a pass over an unchanged block doesn't touch the index
+    n_children = text_node_get_num_children (TEXT_NODE (self));
+    text_height_index_resize (priv->heights, n_children);
 
     // Recompute child element offset
+    index = 0;
     for (iter = text_node_get_first_child (TEXT_NODE (self));
          iter != NULL;
          iter = text_node_get_next (TEXT_NODE (iter)))
@@ -211,6 +270,10 @@ do_block_layout (TextLayoutBox *self,
 
         child_bbox = text_layout_box_get_bbox (child_box);
         child_offset_y += (int) child_bbox->height;
+
+        // Index the child's height for lookups by position
+        text_height_index_set (priv->heights, index, (int) child_bbox->height);
+        index++;
     }
 
     height += child_offset_y;
@@ -219,26 +282,109 @@ do_block_layout (TextLayoutBox *self,
     bbox->y = offset_y;
     bbox->width = width;
     bbox->height = height;
+
+    text_layout_box_clear_dirty (self);
 }
 
-static void
-do_inline_layout (TextLayoutBox *self,
-                  PangoContext  *context,
-                  int            width,
-                  int            offset_x,
-                  int            offset_y)
+static int
+_estimate_height (TextLayoutBox  *self,
+                  TextLayoutPass *pass,
+                  int             width)
 {
-    TextNode *iter;
     TextItem *item;
-    TextDimensions *bbox;
+    int n_chars;
+    int chars_per_line;
+    int n_lines;
+
+    item = text_layout_box_get_item (self);
+
+    if (!TEXT_IS_PARAGRAPH (item))
+        return 0;
+
+    // Assume every character has the average width
+    n_chars = text_paragraph_get_length (TEXT_PARAGRAPH (item));
+    chars_per_line = MAX (1, width / MAX (1, pass->char_width));
+    n_lines = MAX (1, (n_chars + chars_per_line - 1) / chars_per_line);
+
+    return n_lines * pass->line_height;
+}
+
+// The height of the last shaping at this width is a better guess than
+// an estimate, even when the paragraph has changed or the layout has
+// been dropped since then
+static int
+_get_height_hint (TextLayoutBox  *self,
+                  TextLayoutPass *pass,
+                  int             width)
+{
     TextLayoutBlockPrivate *priv;
 
-    int height;
-    int byte_offset;
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+
+    if (priv->layout_width == width)
+        return priv->layout_height;
+
+    return _estimate_height (self, pass, width);
+}
+
+static gboolean
+_intersects_viewport (TextLayoutPass *pass,
+                      int             offset_y,
+                      int             height,
+                      double          margin)
+{
+    double top;
+    double bottom;
+
+    // Content above the viewport may already have moved
+    top = pass->viewport_y + pass->anchor_shift - margin;
+    bottom = pass->viewport_y + pass->anchor_shift + pass->viewport_height + margin;
+
+    return (offset_y + height >= top) && (offset_y <= bottom);
+}
 
+static gboolean
+_is_near_viewport (TextLayoutPass *pass,
+                   int             offset_y,
+                   int             height)
+{
+    return _intersects_viewport (pass, offset_y, height, pass->margin);
+}
+
+// Whether the paragraph has changed since it was shaped. Edits made
+// through the editor mark the box as dirty, but runs can also be
+// restyled directly, which only shows up in the paragraph's generation.
+static gboolean
+_is_changed (TextLayoutBox *self)
+{
+    TextLayoutBlockPrivate *priv;
+    TextItem *item;
+
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
     item = text_layout_box_get_item (self);
+
+    if (text_layout_box_is_dirty (self))
+        return TRUE;
+
+    return item && text_node_get_generation (TEXT_NODE (item)) != priv->shaped_generation;
+}
+
+static void
+_prepare_shaping (TextLayoutBox *self,
+                  PangoContext  *context)
+{
+    TextNode *iter;
+    TextItem *item;
+    TextLayoutBlockPrivate *priv;
+
     priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
-    bbox = text_layout_box_get_mutable_bbox (self);
+    item = text_layout_box_get_item (self);
+
+    // Anything drawn from the old layout is now stale
+    _clear_render_cache (priv);
+
+    if (item)
+        priv->shaped_generation = text_node_get_generation (TEXT_NODE (item));
 
     // Precompute inline children requested size
     for (iter = text_node_get_first_child (TEXT_NODE (self));
@@ -249,29 +395,423 @@ do_inline_layout (TextLayoutBox *self,
         g_assert (TEXT_IS_LAYOUT_INLINE (iter));
         text_layout_box_layout (TEXT_LAYOUT_BOX (iter), context, 0, 0, 0);
     }
+}
+
+static gboolean
+_matrices_equal (const PangoMatrix *a,
+                 const PangoMatrix *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return a->xx == b->xx && a->xy == b->xy &&
+           a->yx == b->yx && a->yy == b->yy &&
+           a->x0 == b->x0 && a->y0 == b->y0;
+}
+
+static gboolean
+_font_options_equal (const cairo_font_options_t *a,
+                     const cairo_font_options_t *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return cairo_font_options_equal (a, b);
+}
+
+// Whether text shaped with @a comes out the same as with @b
+static gboolean
+_contexts_match (PangoContext *a,
+                 PangoContext *b)
+{
+    if (a == b)
+        return TRUE;
+
+    return pango_context_get_font_map (a) == pango_context_get_font_map (b) &&
+           pango_font_description_equal (pango_context_get_font_description (a),
+                                         pango_context_get_font_description (b)) &&
+           pango_context_get_language (a) == pango_context_get_language (b) &&
+           pango_context_get_base_dir (a) == pango_context_get_base_dir (b) &&
+           pango_context_get_base_gravity (a) == pango_context_get_base_gravity (b) &&
+           pango_context_get_gravity_hint (a) == pango_context_get_gravity_hint (b) &&
+           pango_context_get_round_glyph_positions (a) == pango_context_get_round_glyph_positions (b) &&
+           _matrices_equal (pango_context_get_matrix (a), pango_context_get_matrix (b)) &&
+           _font_options_equal (pango_cairo_context_get_font_options (a),
+                                pango_cairo_context_get_font_options (b)) &&
+           pango_cairo_context_get_resolution (a) == pango_cairo_context_get_resolution (b);
+}
 
-    // Setup pango layout
-    if (item && TEXT_IS_PARAGRAPH (item))
+/*
+ * Shapes @text with @attrs into the layout of a block and returns its
+ * height. This doesn't touch the model, so it can run on a worker
+ * thread as long as @context is not used by any other thread at the
+ * same time. The text and attributes are gathered on the main thread.
+ *
+ * Layouts are bound to the context they were created with. On the main
+ * thread, a layout made with any context that has the same settings is
+ * kept. Workers only keep layouts made with their own context, as the
+ * others may be in use on another thread.
+ */
+static int
+_shape_layout (TextLayoutBox *self,
+               PangoContext  *context,
+               gboolean       worker,
+               int            width,
+               const char    *text,
+               int            length,
+               PangoAttrList *attrs)
+{
+    TextLayoutBlockPrivate *priv;
+    PangoContext *layout_context;
+    int height;
+
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+
+    if (priv->layout)
     {
-        gchar *text;
-        text = text_paragraph_get_text (TEXT_PARAGRAPH (item));
-
-        if (!priv->layout)
-            priv->layout = pango_layout_new (context);
-
-        // Set style information
-        // TODO: Matching from ruleset
-        _set_attributes (TEXT_PARAGRAPH (item), priv->layout);
-
-        // Set basic layout properties
-        pango_layout_set_text (priv->layout, text, -1);
-        pango_layout_set_wrap (priv->layout, PANGO_WRAP_WORD_CHAR);
-        pango_layout_set_width (priv->layout, PANGO_SCALE * width);
-        pango_layout_get_pixel_size (priv->layout, NULL, &height);
-        g_free (text);
+        layout_context = pango_layout_get_context (priv->layout);
+
+        if (worker ? layout_context != context : !_contexts_match (layout_context, context))
+            g_clear_object (&priv->layout);
     }
 
-    // Recompute x/y offsets of inline children
+    if (!priv->layout)
+        priv->layout = pango_layout_new (context);
+
+    // Set style information
+    // TODO: Matching from ruleset
+    pango_layout_set_attributes (priv->layout, attrs);
+
+    // Set basic layout properties
+    pango_layout_set_text (priv->layout, text, length);
+    pango_layout_set_wrap (priv->layout, PANGO_WRAP_WORD_CHAR);
+    pango_layout_set_width (priv->layout, PANGO_SCALE * width);
+    pango_layout_get_pixel_size (priv->layout, NULL, &height);
+
+    priv->layout_width = width;
+    priv->layout_height = height;
+
+    return height;
+}
+
+/*
+ * Shapes the paragraph of a block on the main thread and returns
+ * its height.
+ */
+static int
+_shape_paragraph (TextLayoutBox *self,
+                  PangoContext  *context,
+                  int            width)
+{
+    TextItem *item;
+    TextLayoutBlockPrivate *priv;
+    TextParagraphIter iter;
+    PangoAttrList *attrs;
+    const char *text;
+    const char *slice;
+    gsize slice_length;
+    int length;
+    int height;
+
+    item = text_layout_box_get_item (self);
+
+    if (!item || !TEXT_IS_PARAGRAPH (item))
+    {
+        priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+        priv->layout_width = width;
+        priv->layout_height = 0;
+        return 0;
+    }
+
+    length = -1;
+
+    // Text stored in a single slice is shaped in place,
+    // otherwise it must be made contiguous for pango
+    text_paragraph_iter_init (&iter, TEXT_PARAGRAPH (item));
+
+    if (!text_paragraph_iter_next (&iter, &slice, &slice_length))
+    {
+        text = "";
+    }
+    else if (!text_paragraph_iter_next (&iter, NULL, NULL))
+    {
+        text = slice;
+        length = (int) slice_length;
+    }
+    else
+    {
+        text = text_paragraph_peek_text (TEXT_PARAGRAPH (item));
+    }
+
+    attrs = _create_attributes (TEXT_PARAGRAPH (item));
+    height = _shape_layout (self, context, FALSE, width, text, length, attrs);
+    pango_attr_list_unref (attrs);
+
+    return height;
+}
+
+typedef struct
+{
+    GMutex mutex;
+    GCond cond;
+    int n_pending;
+} ShapingJob;
+
+typedef struct
+{
+    ShapingJob *job;
+    PangoContext *context;
+    TextLayoutBox **blocks;
+    char **texts;
+    PangoAttrList **attrs;
+    int n_blocks;
+    int width;
+} ShapingTask;
+
+// Don't bother with threads for fewer blocks than this
+#define MIN_BLOCKS_PER_TASK 8
+
+static void
+_shaping_task_run (gpointer data,
+                   gpointer user_data)
+{
+    ShapingTask *task = data;
+    int i;
+
+    for (i = 0; i < task->n_blocks; i++)
+        _shape_layout (task->blocks[i], task->context, TRUE, task->width,
+                       task->texts[i], -1, task->attrs[i]);
+
+    g_mutex_lock (&task->job->mutex);
+    task->job->n_pending--;
+    g_cond_signal (&task->job->cond);
+    g_mutex_unlock (&task->job->mutex);
+}
+
+static GThreadPool *
+_get_shaping_pool (void)
+{
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter (&pool))
+    {
+        GThreadPool *new_pool;
+
+        new_pool = g_thread_pool_new (_shaping_task_run, NULL,
+                                      (int) g_get_num_processors (),
+                                      FALSE, NULL);
+
+        g_once_init_leave (&pool, new_pool);
+    }
+
+    return pool;
+}
+
+static PangoContext *
+_create_thread_context (PangoContext *context)
+{
+    PangoContext *copy;
+
+    // Share the font map so fonts resolve identically on every thread
+    copy = pango_font_map_create_context (pango_context_get_font_map (context));
+
+    pango_context_set_font_description (copy, pango_context_get_font_description (context));
+    pango_context_set_language (copy, pango_context_get_language (context));
+    pango_context_set_base_dir (copy, pango_context_get_base_dir (context));
+    pango_context_set_base_gravity (copy, pango_context_get_base_gravity (context));
+    pango_context_set_gravity_hint (copy, pango_context_get_gravity_hint (context));
+    pango_context_set_matrix (copy, pango_context_get_matrix (context));
+    pango_context_set_round_glyph_positions (copy, pango_context_get_round_glyph_positions (context));
+    pango_cairo_context_set_font_options (copy, pango_cairo_context_get_font_options (context));
+    pango_cairo_context_set_resolution (copy, pango_cairo_context_get_resolution (context));
+
+    return copy;
+}
+
+// Contexts for the tasks of parallel passes, one per task so that
+// no two threads ever share one. They are kept across passes, so a
+// task can reshape the layouts it made before, and only replaced
+// when the settings of the main context change. These are only
+// touched on the main thread, between passes.
+static GPtrArray *task_contexts = NULL;
+
+static PangoContext *
+_get_task_context (PangoContext *context,
+                   int           index)
+{
+    PangoContext *task_context;
+
+    if (!task_contexts)
+        task_contexts = g_ptr_array_new_with_free_func (g_object_unref);
+
+    if ((int) task_contexts->len <= index)
+        g_ptr_array_set_size (task_contexts, index + 1);
+
+    task_context = g_ptr_array_index (task_contexts, index);
+
+    if (!task_context || !_contexts_match (task_context, context))
+    {
+        // Layouts keep their own reference to the old context
+        g_clear_object (&task_context);
+        task_context = _create_thread_context (context);
+        g_ptr_array_index (task_contexts, index) = task_context;
+    }
+
+    return task_context;
+}
+
+static gboolean
+_needs_shaping (TextLayoutBox  *self,
+                TextLayoutPass *pass,
+                int             width,
+                int             offset_y,
+                int            *height)
+{
+    TextLayoutBlockPrivate *priv;
+    gboolean shaped;
+
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+    shaped = priv->layout && priv->layout_width == width;
+
+    // Mirrors the decisions made by do_inline_layout()
+    *height = _get_height_hint (self, pass, width);
+
+    if (shaped && !_is_changed (self))
+        return FALSE;
+
+    // Time-sliced passes only shape the viewport up front, and leave
+    // the rest to the serial pass, which checks the deadline
+    if (pass->deadline && !_intersects_viewport (pass, offset_y, *height, 0))
+        return FALSE;
+
+    if (pass->lazy && !_is_near_viewport (pass, offset_y, *height))
+        return FALSE;
+
+    return TRUE;
+}
+
+static void
+_shape_children_parallel (TextLayoutBox  *self,
+                          PangoContext   *context,
+                          TextLayoutPass *pass,
+                          int             width,
+                          int             offset_y)
+{
+    GPtrArray *blocks;
+    GPtrArray *texts;
+    GPtrArray *attrs;
+    ShapingJob job;
+    ShapingTask *tasks;
+    TextNode *iter;
+    int n_tasks;
+    int child_offset_y;
+    int i;
+
+    blocks = g_ptr_array_new ();
+    texts = g_ptr_array_new_with_free_func (g_free);
+    attrs = g_ptr_array_new_with_free_func ((GDestroyNotify) pango_attr_list_unref);
+    child_offset_y = 0;
+
+    // Find the paragraphs to shape. Their text and attributes are
+    // gathered here, so the workers never have to touch the model
+    for (iter = text_node_get_first_child (TEXT_NODE (self));
+         iter != NULL;
+         iter = text_node_get_next (iter))
+    {
+        TextItem *item;
+        int height;
+
+        item = text_layout_box_get_item (TEXT_LAYOUT_BOX (iter));
+
+        if (!TEXT_IS_PARAGRAPH (item) ||
+            TEXT_IS_LAYOUT_BLOCK (text_node_get_first_child (iter)))
+        {
+            child_offset_y += (int) text_layout_box_get_bbox (TEXT_LAYOUT_BOX (iter))->height;
+            continue;
+        }
+
+        if (_needs_shaping (TEXT_LAYOUT_BOX (iter), pass, width, offset_y + child_offset_y, &height))
+        {
+            // Inline children are sized before the attributes are built
+            _prepare_shaping (TEXT_LAYOUT_BOX (iter), context);
+            g_ptr_array_add (blocks, iter);
+            g_ptr_array_add (texts, text_paragraph_get_text (TEXT_PARAGRAPH (item)));
+            g_ptr_array_add (attrs, _create_attributes (TEXT_PARAGRAPH (item)));
+        }
+
+        child_offset_y += height;
+    }
+
+    n_tasks = MIN ((int) g_get_num_processors (), (int) blocks->len / MIN_BLOCKS_PER_TASK);
+
+    // Leave small amounts of work to the serial pass
+    if (n_tasks < 2)
+    {
+        g_ptr_array_unref (blocks);
+        g_ptr_array_unref (texts);
+        g_ptr_array_unref (attrs);
+        return;
+    }
+
+    g_mutex_init (&job.mutex);
+    g_cond_init (&job.cond);
+    job.n_pending = n_tasks;
+
+    tasks = g_new0 (ShapingTask, n_tasks);
+
+    // Split into contiguous ranges, one per thread
+    for (i = 0; i < n_tasks; i++)
+    {
+        int start = (int) blocks->len * i / n_tasks;
+        int end = (int) blocks->len * (i + 1) / n_tasks;
+
+        tasks[i].job = &job;
+        tasks[i].context = _get_task_context (context, i);
+        tasks[i].blocks = (TextLayoutBox **) blocks->pdata + start;
+        tasks[i].texts = (char **) texts->pdata + start;
+        tasks[i].attrs = (PangoAttrList **) attrs->pdata + start;
+        tasks[i].n_blocks = end - start;
+        tasks[i].width = width;
+
+        g_thread_pool_push (_get_shaping_pool (), &tasks[i], NULL);
+    }
+
+    g_mutex_lock (&job.mutex);
+    while (job.n_pending > 0)
+        g_cond_wait (&job.cond, &job.mutex);
+    g_mutex_unlock (&job.mutex);
+
+    // The serial pass only needs to position the shaped blocks
+    for (i = 0; i < (int) blocks->len; i++)
+    {
+        TextLayoutBlockPrivate *child_priv;
+
+        child_priv = text_layout_block_get_instance_private (g_ptr_array_index (blocks, i));
+        child_priv->prepared = TRUE;
+    }
+
+    g_mutex_clear (&job.mutex);
+    g_cond_clear (&job.cond);
+    g_free (tasks);
+    g_ptr_array_unref (blocks);
+    g_ptr_array_unref (texts);
+    g_ptr_array_unref (attrs);
+}
+
+static void
+_position_inline_children (TextLayoutBox *self,
+                           PangoContext  *context)
+{
+    TextNode *iter;
+    TextItem *item;
+    TextLayoutBlockPrivate *priv;
+    int byte_offset;
+
+    item = text_layout_box_get_item (self);
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+
+    if (!item || !priv->layout)
+        return;
 
     byte_offset = 0;
     for (iter = text_node_get_first_child (TEXT_NODE (item));
@@ -298,11 +838,123 @@ do_inline_layout (TextLayoutBox *self,
         // Increase byte offset into the paragraph
         byte_offset += text_fragment_get_size_bytes (TEXT_FRAGMENT (iter));
     }
+}
+
+static gboolean
+_is_over_budget (TextLayoutPass *pass)
+{
+    return pass->deadline != 0 && g_get_monotonic_time () > pass->deadline;
+}
+
+static void
+do_inline_layout (TextLayoutBox *self,
+                  PangoContext  *context,
+                  int            width,
+                  int            offset_x,
+                  int            offset_y)
+{
+    TextDimensions *bbox;
+    TextLayoutBlockPrivate *priv;
+    TextLayoutPass *pass;
+    gboolean shaped;
+
+    int height;
+
+    height = 0;
+    priv = text_layout_block_get_instance_private (TEXT_LAYOUT_BLOCK (self));
+    bbox = text_layout_box_get_mutable_bbox (self);
+
+    // Inline children are not indexed
+    text_height_index_resize (priv->heights, 0);
+
+    pass = text_layout_box_get_pass (self);
+
+    // Blocks may already have been shaped in parallel by our parent
+    shaped = priv->prepared;
+    priv->prepared = FALSE;
+
+    if (shaped)
+        height = priv->layout_height;
+
+    // Clean blocks keep their shaped PangoLayout and inline children
+    // as-is, so only the position of the block needs updating
+    if (!shaped &&
+        priv->layout &&
+        !_is_changed (self) &&
+        priv->layout_width == width)
+    {
+        if (pass && priv->estimated && offset_y < pass->viewport_y + pass->anchor_shift)
+            pass->anchor_shift += priv->layout_height - bbox->height;
+
+        priv->estimated = FALSE;
+
+        bbox->x = offset_x;
+        bbox->y = offset_y;
+        bbox->width = width;
+        bbox->height = priv->layout_height;
+        return;
+    }
+
+    // Blocks outside the margin are only estimated and stay dirty
+    // until they come close to the viewport. Within the margin, blocks
+    // reached after the deadline are deferred to a later pass instead.
+    // Blocks intersecting the viewport are always shaped.
+    if (!shaped && pass && (pass->lazy || pass->deadline))
+    {
+        gboolean near;
+        int estimate;
+
+        estimate = _get_height_hint (self, pass, width);
+        near = _is_near_viewport (pass, offset_y, estimate);
+
+        if (!_intersects_viewport (pass, offset_y, estimate, 0) &&
+            (!near || _is_over_budget (pass)))
+        {
+            // The old layout no longer matches the paragraph or the
+            // box, so drop it rather than let it be drawn or queried.
+            // Callers shape the block on demand in the meantime.
+            _clear_render_cache (priv);
+            g_clear_object (&priv->layout);
+
+            bbox->x = offset_x;
+            bbox->y = offset_y;
+            bbox->width = width;
+            bbox->height = estimate;
+
+            priv->estimated = TRUE;
+
+            if (near)
+                pass->n_deferred++;
+            else
+                pass->n_estimated++;
+
+            return;
+        }
+    }
+
+    if (!shaped)
+    {
+        _prepare_shaping (self, context);
+        height = _shape_paragraph (self, context, width);
+    }
+
+    // Recompute x/y offsets of inline children
+    _position_inline_children (self, context);
+
+    // Keep the visible content still when an estimate
+    // above the viewport is replaced by the real height
+    if (pass && priv->estimated && offset_y < pass->viewport_y + pass->anchor_shift)
+        pass->anchor_shift += height - bbox->height;
 
     bbox->x = offset_x;
     bbox->y = offset_y;
     bbox->width = width;
     bbox->height = height;
+
+    priv->layout_width = width;
+    priv->layout_height = height;
+    priv->estimated = FALSE;
+    text_layout_box_clear_dirty (self);
 }
 
 static void
@@ -333,6 +985,219 @@ text_layout_block_get_pango_layout (TextLayoutBlock *self)
     return priv->layout;
 }
 
+/**
+ * text_layout_block_is_shaped:
+ * @self: a #TextLayoutBlock
+ *
+ * Checks whether the #PangoLayout of @self matches its paragraph and
+ * width. Blocks which are only estimated (see lazy layout) have no
+ * layout until they are shaped.
+ *
+ * Returns: %TRUE if the layout of @self is up to date
+ */
+gboolean
+text_layout_block_is_shaped (TextLayoutBlock *self)
+{
+    TextLayoutBlockPrivate *priv;
+    const TextDimensions *bbox;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), FALSE);
+
+    priv = text_layout_block_get_instance_private (self);
+    bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self));
+
+    if (!TEXT_IS_PARAGRAPH (text_layout_box_get_item (TEXT_LAYOUT_BOX (self))))
+        return TRUE;
+
+    return priv->layout &&
+           !_is_changed (TEXT_LAYOUT_BOX (self)) &&
+           priv->layout_width == (int) bbox->width;
+}
+
+/**
+ * text_layout_block_ensure_pango_layout:
+ * @self: a #TextLayoutBlock
+ * @context: the #PangoContext of the layout pass
+ *
+ * Gets the #PangoLayout of @self like text_layout_block_get_pango_layout(),
+ * shaping the paragraph first if text_layout_block_is_shaped() is %FALSE.
+ * The bounding box of @self keeps its estimated height until the next
+ * layout pass, which the caller should queue.
+ *
+ * Returns: (nullable) (transfer none): the layout of @self
+ */
+PangoLayout *
+text_layout_block_ensure_pango_layout (TextLayoutBlock *self,
+                                       PangoContext    *context)
+{
+    TextLayoutBlockPrivate *priv;
+    const TextDimensions *bbox;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), NULL);
+    g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
+
+    priv = text_layout_block_get_instance_private (self);
+
+    if (text_layout_block_is_shaped (self))
+        return priv->layout;
+
+    bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self));
+
+    _prepare_shaping (TEXT_LAYOUT_BOX (self), context);
+    _shape_paragraph (TEXT_LAYOUT_BOX (self), context, (int) bbox->width);
+    _position_inline_children (TEXT_LAYOUT_BOX (self), context);
+
+    // The next pass sees a clean block and only has to replace
+    // the estimated height (see do_inline_layout)
+    text_layout_box_clear_dirty (TEXT_LAYOUT_BOX (self));
+
+    return priv->layout;
+}
+
+/**
+ * text_layout_block_get_child_at_y:
+ * @self: a #TextLayoutBlock
+ * @y: a vertical position, in the same coordinates as the bounding
+ *   boxes of the children
+ *
+ * Finds the block child of @self which contains @y in O(log n).
+ * Positions above the first child or below the last child resolve
+ * to the first and last child respectively.
+ *
+ * Returns: the index of the child, or -1 if @self has no block children
+ */
+int
+text_layout_block_get_child_at_y (TextLayoutBlock *self,
+                                  double           y)
+{
+    TextLayoutBlockPrivate *priv;
+    const TextDimensions *bbox;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), -1);
+
+    priv = text_layout_block_get_instance_private (self);
+    bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self));
+
+    return text_height_index_find (priv->heights, (int) (y - bbox->y));
+}
+
+/**
+ * text_layout_block_get_child_y:
+ * @self: a #TextLayoutBlock
+ * @index: the index of a block child
+ *
+ * Gets the vertical position of the block child at @index in O(log n).
+ *
+ * Returns: the y coordinate of the top of the child
+ */
+double
+text_layout_block_get_child_y (TextLayoutBlock *self,
+                               int              index)
+{
+    TextLayoutBlockPrivate *priv;
+    const TextDimensions *bbox;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), 0);
+
+    priv = text_layout_block_get_instance_private (self);
+    bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self));
+
+    return bbox->y + text_height_index_get_offset (priv->heights, index);
+}
+
+/**
+ * text_layout_block_get_nth_child:
+ * @self: a #TextLayoutBlock
+ * @index: the index of a block child
+ *
+ * Gets the block child at @index in O(log n).
+ *
+ * Returns: (nullable) (transfer none): the child at @index
+ */
+TextLayoutBox *
+text_layout_block_get_nth_child (TextLayoutBlock *self,
+                                 int              index)
+{
+    TextNode *child;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), NULL);
+
+    child = text_node_get_nth_child (TEXT_NODE (self), index);
+
+    if (!TEXT_IS_LAYOUT_BLOCK (child))
+        return NULL;
+
+    return TEXT_LAYOUT_BOX (child);
+}
+
+/**
+ * text_layout_block_get_child_index:
+ * @self: a #TextLayoutBlock
+ *
+ * Gets the position of @self among the block children of its parent
+ * in O(log n).
+ *
+ * Returns: the index of @self, or -1 if it is not a block child
+ */
+int
+text_layout_block_get_child_index (TextLayoutBlock *self)
+{
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), -1);
+
+    if (!TEXT_IS_LAYOUT_BLOCK (text_node_get_parent (TEXT_NODE (self))))
+        return -1;
+
+    return text_node_get_index (TEXT_NODE (self));
+}
+
+/**
+ * text_layout_block_set_render_cache:
+ * @self: a #TextLayoutBlock
+ * @data: (nullable): data to cache
+ * @destroy: (nullable): function to free @data
+ *
+ * Stores drawing data derived from the block's #PangoLayout, such as
+ * a render node. The cache is freed automatically whenever the block
+ * is re-shaped (which includes changes to its width), so a non-%NULL
+ * cache always matches the current layout.
+ */
+void
+text_layout_block_set_render_cache (TextLayoutBlock *self,
+                                    gpointer         data,
+                                    GDestroyNotify   destroy)
+{
+    TextLayoutBlockPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT_BLOCK (self));
+
+    priv = text_layout_block_get_instance_private (self);
+
+    _clear_render_cache (priv);
+
+    priv->render_cache = data;
+    priv->render_cache_destroy = destroy;
+}
+
+/**
+ * text_layout_block_get_render_cache:
+ * @self: a #TextLayoutBlock
+ *
+ * Gets the data stored with text_layout_block_set_render_cache().
+ *
+ * Returns: (nullable) (transfer none): the cached data
+ */
+gpointer
+text_layout_block_get_render_cache (TextLayoutBlock *self)
+{
+    TextLayoutBlockPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BLOCK (self), NULL);
+
+    priv = text_layout_block_get_instance_private (self);
+
+    return priv->render_cache;
+}
+
 static void
 text_layout_block_class_init (TextLayoutBlockClass *klass)
 {
@@ -351,4 +1216,6 @@ static void
 text_layout_block_init (TextLayoutBlock *self)
 {
     TextLayoutBlockPrivate *priv = text_layout_block_get_instance_private (self);
+
+    priv->heights = text_height_index_new ();
 }
@@ -35,4 +35,34 @@ TextLayoutBlock *text_layout_block_new (void);
 PangoLayout *
 text_layout_block_get_pango_layout (TextLayoutBlock *self);
 
+gboolean
+text_layout_block_is_shaped (TextLayoutBlock *self);
+
+PangoLayout *
+text_layout_block_ensure_pango_layout (TextLayoutBlock *self,
+                                       PangoContext    *context);
+
+int
+text_layout_block_get_child_at_y (TextLayoutBlock *self,
+                                  double           y);
+
+double
+text_layout_block_get_child_y (TextLayoutBlock *self,
+                               int              index);
+
+TextLayoutBox *
+text_layout_block_get_nth_child (TextLayoutBlock *self,
+                                 int              index);
+
+int
+text_layout_block_get_child_index (TextLayoutBlock *self);
+
+void
+text_layout_block_set_render_cache (TextLayoutBlock *self,
+                                    gpointer         data,
+                                    GDestroyNotify   destroy);
+
+gpointer
+text_layout_block_get_render_cache (TextLayoutBlock *self);
+
 G_END_DECLS
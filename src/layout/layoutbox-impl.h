@@ -15,7 +15,50 @@
 
 G_BEGIN_DECLS
 
+/*
+ * Parameters and results of a single layout pass. These are set on the
+ * root of the layout tree by #TextLayout for the duration of the pass,
+ * so boxes can look them up with text_layout_box_get_pass().
+ */
+typedef struct
+{
+    // Lazy shaping: blocks far away from the viewport are given an
+    // estimated height instead of being shaped
+    gboolean lazy;
+    double viewport_y;
+    double viewport_height;
+    double margin;
+
+    // Approximate font metrics (in pixels) for estimating heights
+    int char_width;
+    int line_height;
+
+    // Shape the paragraphs of each block on a thread pool
+    gboolean parallel;
+
+    // Monotonic time after which blocks away from the viewport are
+    // deferred to a later pass, or zero for no time limit
+    gint64 deadline;
+
+    // Results: total change in height above the viewport caused by
+    // estimates being replaced, the number of blocks estimated in
+    // lazy mode and the number deferred because of the deadline
+    double anchor_shift;
+    int n_estimated;
+    int n_deferred;
+} TextLayoutPass;
+
+void
+text_layout_box_set_pass (TextLayoutBox  *self,
+                          TextLayoutPass *pass);
+
+TextLayoutPass *
+text_layout_box_get_pass (TextLayoutBox *self);
+
 TextDimensions *
 text_layout_box_get_mutable_bbox (TextLayoutBox *self);
 
+void
+text_layout_box_clear_dirty (TextLayoutBox *self);
+
 G_END_DECLS
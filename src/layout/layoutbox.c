@@ -14,8 +14,13 @@
 
 typedef struct
 {
+    // Weak, as the item owns the box through its attachment
     TextItem *item;
     TextDimensions bbox;
+    gboolean dirty;
+
+    // Only set on the root box during a layout pass
+    TextLayoutPass *pass;
 } TextLayoutBoxPrivate;
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (TextLayoutBox, text_layout_box, TEXT_TYPE_NODE)
@@ -46,6 +51,8 @@ text_layout_box_finalize (GObject *object)
     TextLayoutBox *self = (TextLayoutBox *)object;
     TextLayoutBoxPrivate *priv = text_layout_box_get_instance_private (self);
 
+    text_layout_box_set_item (self, NULL);
+
     // TODO: Dispose of children
 
     G_OBJECT_CLASS (text_layout_box_parent_class)->finalize (object);
@@ -113,12 +120,30 @@ text_layout_box_real_layout (TextLayoutBox *self,
                g_type_name_from_instance ((GTypeInstance *) self));
 }
 
+/**
+ * text_layout_box_set_item:
+ * @self: a #TextLayoutBox
+ * @item: (nullable): the #TextItem laid out by @self
+ *
+ * Sets the item @self lays out. Only a weak pointer is kept, which is
+ * cleared if @item is freed while @self is still part of a layout tree.
+ */
 void
 text_layout_box_set_item (TextLayoutBox *self,
                           TextItem      *item)
 {
     TextLayoutBoxPrivate *priv = text_layout_box_get_instance_private (self);
+
+    if (priv->item == item)
+        return;
+
+    if (priv->item)
+        g_object_remove_weak_pointer (G_OBJECT (priv->item), (gpointer *) &priv->item);
+
     priv->item = item;
+
+    if (priv->item)
+        g_object_add_weak_pointer (G_OBJECT (priv->item), (gpointer *) &priv->item);
 }
 
 TextItem *
@@ -141,6 +166,70 @@ text_layout_box_get_bbox (TextLayoutBox *self)
     return text_layout_box_get_mutable_bbox (self);
 }
 
+/**
+ * text_layout_box_mark_dirty:
+ * @self: a #TextLayoutBox
+ *
+ * Marks the box as needing to be recomputed on the next layout
+ * pass. Boxes which are not dirty may reuse the results of the
+ * previous pass if their width has not changed.
+ */
+void
+text_layout_box_mark_dirty (TextLayoutBox *self)
+{
+    TextLayoutBoxPrivate *priv;
+
+    g_return_if_fail (TEXT_IS_LAYOUT_BOX (self));
+
+    priv = text_layout_box_get_instance_private (self);
+    priv->dirty = TRUE;
+}
+
+gboolean
+text_layout_box_is_dirty (TextLayoutBox *self)
+{
+    TextLayoutBoxPrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_LAYOUT_BOX (self), TRUE);
+
+    priv = text_layout_box_get_instance_private (self);
+    return priv->dirty;
+}
+
+void
+text_layout_box_clear_dirty (TextLayoutBox *self)
+{
+    TextLayoutBoxPrivate *priv = text_layout_box_get_instance_private (self);
+    priv->dirty = FALSE;
+}
+
+void
+text_layout_box_set_pass (TextLayoutBox  *self,
+                          TextLayoutPass *pass)
+{
+    TextLayoutBoxPrivate *priv = text_layout_box_get_instance_private (self);
+    priv->pass = pass;
+}
+
+TextLayoutPass *
+text_layout_box_get_pass (TextLayoutBox *self)
+{
+    TextNode *iter;
+
+    // The pass is stored on the root of the tree
+    for (iter = TEXT_NODE (self); iter != NULL; iter = text_node_get_parent (iter))
+    {
+        TextLayoutBoxPrivate *priv;
+
+        priv = text_layout_box_get_instance_private (TEXT_LAYOUT_BOX (iter));
+
+        if (priv->pass)
+            return priv->pass;
+    }
+
+    return NULL;
+}
+
 static void
 text_layout_box_class_init (TextLayoutBoxClass *klass)
 {
@@ -157,4 +246,7 @@ static void
 text_layout_box_init (TextLayoutBox *self)
 {
     TextLayoutBoxPrivate *priv = text_layout_box_get_instance_private (self);
+
+    // New boxes have never been laid out
+    priv->dirty = TRUE;
 }
@@ -48,4 +48,10 @@ text_layout_box_layout (TextLayoutBox *self,
 const TextDimensions *
 text_layout_box_get_bbox (TextLayoutBox *self);
 
+void
+text_layout_box_mark_dirty (TextLayoutBox *self);
+
+gboolean
+text_layout_box_is_dirty (TextLayoutBox *self);
+
 G_END_DECLS
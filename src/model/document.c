@@ -31,6 +31,11 @@ text_document_finalize (GObject *object)
 {
     TextDocument *self = (TextDocument *)object;
 
+    g_clear_object (&self->journal);
+    g_clear_pointer (&self->marks, g_hash_table_unref);
+    g_clear_pointer (&self->snapshot, text_snapshot_unref);
+    g_clear_object (&self->snapshot_frame);
+
     G_OBJECT_CLASS (text_document_parent_class)->finalize (object);
 }
 
@@ -74,20 +79,154 @@ text_document_class_init (TextDocumentClass *klass)
     object_class->set_property = text_document_set_property;
 }
 
+static void
+_add_to_bucket (TextDocument *doc,
+                TextMark     *mark)
+{
+    GPtrArray *bucket;
+
+    bucket = g_hash_table_lookup (doc->marks, mark->paragraph);
+
+    if (!bucket)
+    {
+        bucket = g_ptr_array_new ();
+        g_hash_table_insert (doc->marks, mark->paragraph, bucket);
+    }
+
+    g_ptr_array_add (bucket, mark);
+    mark->bucket = mark->paragraph;
+}
+
+static void
+_remove_from_bucket (TextDocument *doc,
+                     TextMark     *mark)
+{
+    TextParagraph *key;
+    GPtrArray *bucket;
+
+    key = mark->bucket;
+    mark->bucket = NULL;
+
+    bucket = g_hash_table_lookup (doc->marks, key);
+
+    // Keep the remaining marks in the order they were added
+    if (!bucket || !g_ptr_array_remove (bucket, mark))
+        return;
+
+    if (bucket->len == 0)
+        g_hash_table_remove (doc->marks, key);
+}
+
+static int
+_compare_serials (gconstpointer a,
+                  gconstpointer b)
+{
+    const TextMark *mark_a = *(TextMark **) a;
+    const TextMark *mark_b = *(TextMark **) b;
+
+    return (mark_a->serial > mark_b->serial) - (mark_a->serial < mark_b->serial);
+}
+
+/**
+ * text_document_get_all_marks:
+ * @doc: a #TextDocument
+ *
+ * Gets every mark in @doc in the order they were created, followed
+ * by the cursor and selection. This sorts the marks of the whole
+ * document, so prefer text_document_append_marks() where only the
+ * marks in a particular paragraph are needed.
+ *
+ * Returns: (transfer container) (element-type TextMark): the marks
+ */
 GSList *
 text_document_get_all_marks (TextDocument *doc)
 {
+    GHashTableIter iter;
+    GPtrArray *bucket;
+    GPtrArray *sorted;
     GSList *marks;
 
-    marks = g_slist_copy (doc->marks);
-    marks = g_slist_append (marks, doc->cursor);
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), NULL);
+
+    sorted = g_ptr_array_new ();
+    g_hash_table_iter_init (&iter, doc->marks);
+
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &bucket))
+    {
+        for (guint i = 0; i < bucket->len; i++)
+            g_ptr_array_add (sorted, g_ptr_array_index (bucket, i));
+    }
+
+    // Buckets are visited in hash table order
+    g_ptr_array_sort (sorted, _compare_serials);
+
+    marks = NULL;
 
     if (doc->selection)
-        marks = g_slist_append (marks, doc->selection);
+        marks = g_slist_prepend (marks, doc->selection);
+
+    marks = g_slist_prepend (marks, doc->cursor);
+
+    for (guint i = sorted->len; i > 0; i--)
+        marks = g_slist_prepend (marks, g_ptr_array_index (sorted, i - 1));
+
+    g_ptr_array_unref (sorted);
 
     return marks;
 }
 
+/**
+ * text_document_append_marks:
+ * @doc: a #TextDocument
+ * @paragraph: a #TextParagraph
+ * @marks: (element-type TextMark): array to append to
+ *
+ * Appends the marks created through @doc which lie in @paragraph to
+ * @marks. This does not include the cursor or selection. It takes
+ * time proportional to the number of marks in @paragraph, rather
+ * than in the whole document.
+ */
+void
+text_document_append_marks (TextDocument  *doc,
+                            TextParagraph *paragraph,
+                            GPtrArray     *marks)
+{
+    GPtrArray *bucket;
+
+    g_return_if_fail (TEXT_IS_DOCUMENT (doc));
+    g_return_if_fail (marks != NULL);
+
+    bucket = g_hash_table_lookup (doc->marks, paragraph);
+
+    if (!bucket)
+        return;
+
+    for (guint i = 0; i < bucket->len; i++)
+        g_ptr_array_add (marks, g_ptr_array_index (bucket, i));
+}
+
+/**
+ * text_document_update_mark:
+ * @doc: a #TextDocument
+ * @mark: a #TextMark created through @doc
+ *
+ * Moves @mark into the bucket of the paragraph it now lies in. This
+ * is called by text_mark_set_position().
+ */
+void
+text_document_update_mark (TextDocument *doc,
+                           TextMark     *mark)
+{
+    g_return_if_fail (TEXT_IS_DOCUMENT (doc));
+    g_return_if_fail (mark != NULL);
+
+    if (!mark->bucket || mark->bucket == mark->paragraph)
+        return;
+
+    _remove_from_bucket (doc, mark);
+    _add_to_bucket (doc, mark);
+}
+
 TextMark *
 text_document_create_mark (TextDocument  *doc,
                            TextParagraph *paragraph,
@@ -100,7 +239,8 @@ text_document_create_mark (TextDocument  *doc,
     g_return_val_if_fail (TEXT_IS_PARAGRAPH (paragraph), NULL);
 
     new = text_mark_new (doc, paragraph, index, gravity);
-    doc->marks = g_slist_append (doc->marks, new);
+    new->serial = doc->next_mark_serial++;
+    _add_to_bucket (doc, new);
 
     return new;
 }
@@ -115,7 +255,8 @@ text_document_copy_mark (TextDocument *doc,
     g_return_val_if_fail (mark != NULL, NULL);
 
     new = text_mark_copy (mark);
-    doc->marks = g_slist_append (doc->marks, new);
+    new->serial = doc->next_mark_serial++;
+    _add_to_bucket (doc, new);
 
     return new;
 }
@@ -127,7 +268,8 @@ text_document_delete_mark (TextDocument *doc,
     g_return_if_fail (TEXT_IS_DOCUMENT (doc));
     g_return_if_fail (mark != NULL);
 
-    doc->marks = g_slist_remove (doc->marks, mark);
+    if (mark->bucket)
+        _remove_from_bucket (doc, mark);
 }
 
 void
@@ -137,12 +279,348 @@ text_document_clear_mark (TextDocument *doc,
     g_return_if_fail (TEXT_IS_DOCUMENT (doc));
     g_return_if_fail (mark != NULL);
 
-    doc->marks = g_slist_remove (doc->marks, *mark);
+    if (*mark && (*mark)->bucket)
+        _remove_from_bucket (doc, *mark);
+
     *mark = NULL;
 }
 
+/**
+ * text_document_get_generation:
+ * @doc: a #TextDocument
+ *
+ * Gets the generation of @doc. This is a counter which changes every
+ * time the contents of the document are modified, so it can be used
+ * to tell whether anything derived from the document is out of date.
+ *
+ * Returns: the current generation
+ */
+guint
+text_document_get_generation (TextDocument *doc)
+{
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), 0);
+
+    return doc->generation;
+}
+
+/**
+ * text_document_bump_generation:
+ * @doc: a #TextDocument
+ *
+ * Marks the contents of @doc as modified. This is called by
+ * #TextEditor for every change it makes to the document.
+ */
+void
+text_document_bump_generation (TextDocument *doc)
+{
+    g_return_if_fail (TEXT_IS_DOCUMENT (doc));
+
+    doc->generation++;
+}
+
+/**
+ * text_document_get_journal:
+ * @doc: a #TextDocument
+ *
+ * Gets the journal which records the changes made to the contents of
+ * @doc. Connect to #TextJournal::changed to be notified of them.
+ *
+ * Returns: (transfer none): the #TextJournal of @doc
+ */
+TextJournal *
+text_document_get_journal (TextDocument *doc)
+{
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), NULL);
+
+    // The frame is a public field, so it may have been
+    // replaced since the journal was last attached
+    text_journal_attach (doc->journal, TEXT_NODE (doc->frame));
+
+    return doc->journal;
+}
+
+static void
+_snapshot_paragraphs (TextNode  *node,
+                      GPtrArray *paragraphs)
+{
+    TextNode *child;
+
+    if (TEXT_IS_PARAGRAPH (node))
+    {
+        g_ptr_array_add (paragraphs, text_paragraph_snapshot (TEXT_PARAGRAPH (node)));
+        return;
+    }
+
+    // Descend through any nested frames
+    for (child = text_node_get_first_child (node); child; child = text_node_get_next (child))
+        _snapshot_paragraphs (child, paragraphs);
+}
+
+/**
+ * text_document_snapshot:
+ * @doc: a #TextDocument
+ *
+ * Takes an immutable snapshot of the contents of @doc, which stays the
+ * same as @doc is edited. The snapshot may be read from any thread,
+ * so that work such as saving or searching can be moved off the main
+ * thread.
+ *
+ * Snapshots share the copies of paragraphs which haven't changed, so
+ * this only copies the paragraphs changed since the last snapshot, and
+ * doesn't copy anything if @doc hasn't changed at all. This must be
+ * called on the thread which owns @doc.
+ *
+ * Returns: (transfer full): a snapshot of @doc
+ */
+TextSnapshot *
+text_document_snapshot (TextDocument *doc)
+{
+    GPtrArray *paragraphs;
+    guint generation;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), NULL);
+    g_return_val_if_fail (TEXT_IS_FRAME (doc->frame), NULL);
+
+    generation = text_node_get_generation (TEXT_NODE (doc->frame));
+
+    if (doc->snapshot &&
+        doc->snapshot_frame == doc->frame &&
+        doc->snapshot_generation == generation)
+        return text_snapshot_ref (doc->snapshot);
+
+    paragraphs = g_ptr_array_new_with_free_func ((GDestroyNotify) text_snapshot_paragraph_unref);
+    _snapshot_paragraphs (TEXT_NODE (doc->frame), paragraphs);
+
+    g_clear_pointer (&doc->snapshot, text_snapshot_unref);
+    doc->snapshot = text_snapshot_new (paragraphs, doc->generation);
+    g_set_object (&doc->snapshot_frame, doc->frame);
+    doc->snapshot_generation = generation;
+
+    return text_snapshot_ref (doc->snapshot);
+}
+
+// Global offsets count every paragraph boundary as a single
+// character (or byte), as if paragraphs were separated by '\n'
+static const int char_weights [TEXT_NODE_N_AGGREGATES] = {
+    [TEXT_ITEM_AGGREGATE_CHARS] = 1,
+    [TEXT_ITEM_AGGREGATE_PARAGRAPHS] = 1,
+};
+
+static const int byte_weights [TEXT_NODE_N_AGGREGATES] = {
+    [TEXT_ITEM_AGGREGATE_BYTES] = 1,
+    [TEXT_ITEM_AGGREGATE_PARAGRAPHS] = 1,
+};
+
+/**
+ * text_document_get_length:
+ * @doc: a #TextDocument
+ *
+ * Gets the number of characters in @doc, in which every paragraph
+ * boundary counts as a single character. This is also the offset of
+ * the end of @doc.
+ *
+ * Returns: the length of @doc
+ */
+int
+text_document_get_length (TextDocument *doc)
+{
+    TextNode *frame;
+    int n_paragraphs;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), 0);
+
+    if (!doc->frame)
+        return 0;
+
+    frame = TEXT_NODE (doc->frame);
+    n_paragraphs = text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_PARAGRAPHS);
+
+    return text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_CHARS)
+         + MAX (n_paragraphs - 1, 0);
+}
+
+/**
+ * text_document_get_char_offset:
+ * @doc: a #TextDocument
+ * @mark: a #TextMark in @doc
+ *
+ * Gets the position of @mark as a character offset from the start of
+ * the document, in which every paragraph boundary counts as a single
+ * character. This takes O(log n) time in the size of the document.
+ *
+ * Returns: the character offset of @mark
+ */
+int
+text_document_get_char_offset (TextDocument *doc,
+                               TextMark     *mark)
+{
+    TextNode *paragraph;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), 0);
+    g_return_val_if_fail (mark != NULL, 0);
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (mark->paragraph), 0);
+
+    paragraph = TEXT_NODE (mark->paragraph);
+
+    return text_node_get_offset (paragraph, TEXT_ITEM_AGGREGATE_CHARS)
+         + text_node_get_offset (paragraph, TEXT_ITEM_AGGREGATE_PARAGRAPHS)
+         + text_paragraph_get_offset_at_index (mark->paragraph, mark->index);
+}
+
+/**
+ * text_document_get_byte_offset:
+ * @doc: a #TextDocument
+ * @mark: a #TextMark in @doc
+ *
+ * Gets the position of @mark as a byte offset from the start of the
+ * document, in which every paragraph boundary counts as a single
+ * byte. This takes O(log n) time in the size of the document.
+ *
+ * Returns: the byte offset of @mark
+ */
+int
+text_document_get_byte_offset (TextDocument *doc,
+                               TextMark     *mark)
+{
+    TextNode *paragraph;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), 0);
+    g_return_val_if_fail (mark != NULL, 0);
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (mark->paragraph), 0);
+
+    paragraph = TEXT_NODE (mark->paragraph);
+
+    return text_node_get_offset (paragraph, TEXT_ITEM_AGGREGATE_BYTES)
+         + text_node_get_offset (paragraph, TEXT_ITEM_AGGREGATE_PARAGRAPHS)
+         + mark->index;
+}
+
+static TextParagraph *
+_find_paragraph (TextDocument *doc,
+                 const int    *weights,
+                 int          *offset)
+{
+    TextNode *node;
+
+    node = TEXT_NODE (doc->frame);
+
+    // Descend through any nested frames
+    while (node != NULL && !TEXT_IS_PARAGRAPH (node))
+        node = text_node_find_child (node, weights, offset, NULL);
+
+    return node ? TEXT_PARAGRAPH (node) : NULL;
+}
+
+/**
+ * text_document_get_position_at_char_offset:
+ * @doc: a #TextDocument
+ * @offset: a character offset, as returned by
+ *   text_document_get_char_offset()
+ * @paragraph: (out) (optional): the paragraph containing @offset
+ * @index: (out) (optional): the byte index of @offset within @paragraph
+ *
+ * Converts a character offset into a position in the document. This
+ * takes O(log n) time in the size of the document.
+ *
+ * Returns: %TRUE if @offset is within the document
+ */
+gboolean
+text_document_get_position_at_char_offset (TextDocument   *doc,
+                                           int             offset,
+                                           TextParagraph **paragraph,
+                                           int            *index)
+{
+    TextParagraph *found;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), FALSE);
+    g_return_val_if_fail (TEXT_IS_FRAME (doc->frame), FALSE);
+
+    found = _find_paragraph (doc, char_weights, &offset);
+
+    if (!found)
+        return FALSE;
+
+    if (paragraph)
+        *paragraph = found;
+
+    if (index)
+        *index = text_paragraph_get_index_at_offset (found, offset);
+
+    return TRUE;
+}
+
+/**
+ * text_document_get_position_at_byte_offset:
+ * @doc: a #TextDocument
+ * @offset: a byte offset, as returned by
+ *   text_document_get_byte_offset()
+ * @paragraph: (out) (optional): the paragraph containing @offset
+ * @index: (out) (optional): the byte index of @offset within @paragraph
+ *
+ * Converts a byte offset into a position in the document. This takes
+ * O(log n) time in the size of the document. The offset must not
+ * point into the middle of a character.
+ *
+ * Returns: %TRUE if @offset is within the document
+ */
+gboolean
+text_document_get_position_at_byte_offset (TextDocument   *doc,
+                                           int             offset,
+                                           TextParagraph **paragraph,
+                                           int            *index)
+{
+    TextParagraph *found;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), FALSE);
+    g_return_val_if_fail (TEXT_IS_FRAME (doc->frame), FALSE);
+
+    found = _find_paragraph (doc, byte_weights, &offset);
+
+    if (!found)
+        return FALSE;
+
+    if (paragraph)
+        *paragraph = found;
+
+    if (index)
+        *index = offset;
+
+    return TRUE;
+}
+
+/**
+ * text_document_create_mark_at_offset:
+ * @doc: a #TextDocument
+ * @offset: a character offset, as returned by
+ *   text_document_get_char_offset()
+ * @gravity: the gravity of the new mark
+ *
+ * Creates a mark at the given character offset.
+ *
+ * Returns: (transfer none) (nullable): a new #TextMark owned by @doc,
+ *   or %NULL if @offset is out of range
+ */
+TextMark *
+text_document_create_mark_at_offset (TextDocument *doc,
+                                     int           offset,
+                                     TextGravity   gravity)
+{
+    TextParagraph *paragraph;
+    int index;
+
+    g_return_val_if_fail (TEXT_IS_DOCUMENT (doc), NULL);
+
+    if (!text_document_get_position_at_char_offset (doc, offset, &paragraph, &index))
+        return NULL;
+
+    return text_document_create_mark (doc, paragraph, index, gravity);
+}
+
 static void
 text_document_init (TextDocument *self)
 {
     self->cursor = text_mark_new (self, NULL, 0, TEXT_GRAVITY_RIGHT);
+    self->marks = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify) g_ptr_array_unref);
+    self->journal = text_journal_new ();
 }
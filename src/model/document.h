@@ -15,6 +15,8 @@
 
 #include "frame.h"
 #include "mark.h"
+#include "journal.h"
+#include "snapshot.h"
 
 struct _TextDocument
 {
@@ -23,7 +25,21 @@ struct _TextDocument
     TextFrame *frame;
     TextMark *cursor;
     TextMark *selection;
-    GSList *marks;
+
+    // Marks created through the document, bucketed by paragraph
+    GHashTable *marks;
+    guint next_mark_serial;
+
+    // Incremented whenever the contents of the document change
+    guint generation;
+
+    // Records the changes made to the document tree
+    TextJournal *journal;
+
+    // Last snapshot taken, shared until the frame changes
+    TextSnapshot *snapshot;
+    TextFrame *snapshot_frame;
+    guint snapshot_generation;
 };
 
 G_BEGIN_DECLS
@@ -39,7 +55,23 @@ TextMark     *text_document_copy_mark       (TextDocument *doc, TextMark *mark);
 void          text_document_delete_mark     (TextDocument *doc, TextMark *mark);
 void          text_document_clear_mark      (TextDocument *doc, TextMark **mark);
 
+guint         text_document_get_generation  (TextDocument *doc);
+void          text_document_bump_generation (TextDocument *doc);
+
+TextJournal  *text_document_get_journal     (TextDocument *doc);
+
+TextSnapshot *text_document_snapshot        (TextDocument *doc);
+
+int           text_document_get_length                  (TextDocument *doc);
+int           text_document_get_char_offset             (TextDocument *doc, TextMark *mark);
+int           text_document_get_byte_offset             (TextDocument *doc, TextMark *mark);
+gboolean      text_document_get_position_at_char_offset (TextDocument *doc, int offset, TextParagraph **paragraph, int *index);
+gboolean      text_document_get_position_at_byte_offset (TextDocument *doc, int offset, TextParagraph **paragraph, int *index);
+TextMark     *text_document_create_mark_at_offset       (TextDocument *doc, int offset, TextGravity gravity);
+
 // TODO: Make private
 GSList       *text_document_get_all_marks   (TextDocument *doc);
+void          text_document_append_marks    (TextDocument *doc, TextParagraph *paragraph, GPtrArray *marks);
+void          text_document_update_mark     (TextDocument *doc, TextMark *mark);
 
 G_END_DECLS
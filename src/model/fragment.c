@@ -73,28 +73,40 @@ text_fragment_real_get_text (TextFragment *self)
     return "";
 }
 
+// Fragments other than runs hold short, immutable text,
+// which can be read directly to convert between units
+static int
+text_fragment_real_get_offset_at_index (TextFragment *self,
+                                        int           byte_index)
+{
+    const char *text = text_fragment_get_text (self);
+
+    return (int) g_utf8_strlen (text, byte_index);
+}
+
+static int
+text_fragment_real_get_index_at_offset (TextFragment *self,
+                                        int           offset)
+{
+    const char *text = text_fragment_get_text (self);
+
+    return (int) (g_utf8_offset_to_pointer (text, offset) - text);
+}
+
 int
 text_fragment_get_length (TextFragment *self)
 {
-    const char *text;
-
     g_return_val_if_fail (TEXT_IS_FRAGMENT (self), -1);
 
-    text = text_fragment_get_text (self);
-    // g_print ("Length of %s is %d\n", g_type_name_from_instance (self), (int) g_utf8_strlen (text, -1));
-    return (int) g_utf8_strlen (text, -1);
+    return text_node_get_aggregate (TEXT_NODE (self), TEXT_ITEM_AGGREGATE_CHARS);
 }
 
 int
 text_fragment_get_size_bytes (TextFragment *self)
 {
-    const char *text;
-
     g_return_val_if_fail (TEXT_IS_FRAGMENT (self), -1);
 
-    text = text_fragment_get_text (self);
-    // g_print ("Size of %s is %d\n", g_type_name_from_instance (self), (int) strlen (text));
-    return (int) strlen (text);
+    return text_node_get_aggregate (TEXT_NODE (self), TEXT_ITEM_AGGREGATE_BYTES);
 }
 
 const char *
@@ -103,10 +115,104 @@ text_fragment_get_text (TextFragment *self)
     return TEXT_FRAGMENT_CLASS (G_OBJECT_GET_CLASS (self))->get_text (self);
 }
 
+/**
+ * text_fragment_is_ascii:
+ * @self: a #TextFragment
+ *
+ * Checks whether the text of @self is pure ASCII, in which case byte
+ * indices and character offsets are the same. Every other character
+ * takes more than one byte in UTF-8, so this is read straight from the
+ * cached lengths.
+ *
+ * Returns: %TRUE if @self only contains ASCII characters
+ */
+gboolean
+text_fragment_is_ascii (TextFragment *self)
+{
+    TextNode *node;
+
+    g_return_val_if_fail (TEXT_IS_FRAGMENT (self), FALSE);
+
+    node = TEXT_NODE (self);
+
+    return text_node_get_aggregate (node, TEXT_ITEM_AGGREGATE_BYTES)
+        == text_node_get_aggregate (node, TEXT_ITEM_AGGREGATE_CHARS);
+}
+
+/**
+ * text_fragment_get_offset_at_index:
+ * @self: a #TextFragment
+ * @byte_index: a byte index within @self
+ *
+ * Converts a byte index into a character offset within @self. Runs
+ * count the characters piece by piece, so their text is never
+ * flattened.
+ *
+ * Returns: the character offset of @byte_index
+ */
+int
+text_fragment_get_offset_at_index (TextFragment *self,
+                                   int           byte_index)
+{
+    g_return_val_if_fail (TEXT_IS_FRAGMENT (self), 0);
+    g_return_val_if_fail (byte_index >= 0, 0);
+
+    if (text_fragment_is_ascii (self))
+        return byte_index;
+
+    return TEXT_FRAGMENT_GET_CLASS (self)->get_offset_at_index (self, byte_index);
+}
+
+/**
+ * text_fragment_get_index_at_offset:
+ * @self: a #TextFragment
+ * @offset: a character offset within @self
+ *
+ * Converts a character offset into a byte index within @self. Offsets
+ * past the end of @self give the size of @self. Like
+ * text_fragment_get_offset_at_index(), this never flattens a run.
+ *
+ * Returns: the byte index of @offset
+ */
+int
+text_fragment_get_index_at_offset (TextFragment *self,
+                                   int           offset)
+{
+    g_return_val_if_fail (TEXT_IS_FRAGMENT (self), 0);
+    g_return_val_if_fail (offset >= 0, 0);
+
+    if (offset >= text_fragment_get_length (self))
+        return text_fragment_get_size_bytes (self);
+
+    if (text_fragment_is_ascii (self))
+        return offset;
+
+    return TEXT_FRAGMENT_GET_CLASS (self)->get_index_at_offset (self, offset);
+}
+
+static void
+text_fragment_measure (TextNode *node,
+                       int      *aggregates)
+{
+    const char *text;
+
+    text = text_fragment_get_text (TEXT_FRAGMENT (node));
+
+    if (!text)
+        return;
+
+    aggregates [TEXT_ITEM_AGGREGATE_BYTES] += (int) strlen (text);
+    aggregates [TEXT_ITEM_AGGREGATE_CHARS] += (int) g_utf8_strlen (text, -1);
+}
+
 static void
 text_fragment_class_init (TextFragmentClass *klass)
 {
     klass->get_text = text_fragment_real_get_text;
+    klass->get_offset_at_index = text_fragment_real_get_offset_at_index;
+    klass->get_index_at_offset = text_fragment_real_get_index_at_offset;
+
+    TEXT_NODE_CLASS (klass)->measure = text_fragment_measure;
 
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
@@ -25,10 +25,16 @@ struct _TextFragmentClass
 {
     TextNodeClass parent_class;
     const char *(*get_text)(TextFragment *self);
+    int (*get_offset_at_index)(TextFragment *self, int byte_index);
+    int (*get_index_at_offset)(TextFragment *self, int offset);
 };
 
 int         text_fragment_get_length        (TextFragment *self);
 const char* text_fragment_get_text          (TextFragment *self);
 int         text_fragment_get_size_bytes    (TextFragment *self);
+gboolean    text_fragment_is_ascii          (TextFragment *self);
+
+int         text_fragment_get_offset_at_index (TextFragment *self, int byte_index);
+int         text_fragment_get_index_at_offset (TextFragment *self, int offset);
 
 G_END_DECLS
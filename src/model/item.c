@@ -64,6 +64,16 @@ text_item_detach (TextItem *self)
         g_clear_object (&priv->renderer);
 }
 
+static void
+text_item_dispose (GObject *object)
+{
+    TextItem *self = (TextItem *)object;
+
+    text_item_detach (self);
+
+    G_OBJECT_CLASS (text_item_parent_class)->dispose (object);
+}
+
 static void
 text_item_finalize (GObject *object)
 {
@@ -107,6 +117,7 @@ text_item_class_init (TextItemClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+    object_class->dispose = text_item_dispose;
     object_class->finalize = text_item_finalize;
     object_class->get_property = text_item_get_property;
     object_class->set_property = text_item_set_property;
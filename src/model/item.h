@@ -20,6 +20,14 @@ G_BEGIN_DECLS
 
 G_DECLARE_DERIVABLE_TYPE (TextItem, text_item, TEXT, ITEM, TextNode)
 
+// Aggregates maintained for every subtree of the document
+typedef enum
+{
+    TEXT_ITEM_AGGREGATE_BYTES,
+    TEXT_ITEM_AGGREGATE_CHARS,
+    TEXT_ITEM_AGGREGATE_PARAGRAPHS,
+} TextItemAggregate;
+
 struct _TextItemClass
 {
     TextNodeClass parent_class;
@@ -0,0 +1,377 @@
+/* journal.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "journal.h"
+
+struct _TextJournal
+{
+    GObject parent_instance;
+
+    TextNode *root;
+
+    // Changes recorded since the outermost begin
+    GPtrArray *pending;
+    int depth;
+};
+
+G_DEFINE_BOXED_TYPE (TextChange, text_change, text_change_copy, text_change_free)
+
+G_DEFINE_FINAL_TYPE (TextJournal, text_journal, G_TYPE_OBJECT)
+
+enum {
+    CHANGED,
+    N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+#define JOURNAL_QUARK (text_journal_quark ())
+
+static GQuark
+text_journal_quark (void)
+{
+    return g_quark_from_static_string ("text-journal");
+}
+
+static TextChange *
+_change_new (TextChangeType  type,
+             TextNode       *parent,
+             TextNode       *node,
+             int             index)
+{
+    TextChange *self;
+
+    self = g_slice_new0 (TextChange);
+    self->type = type;
+    self->parent = parent ? g_object_ref (parent) : NULL;
+    self->node = node ? g_object_ref (node) : NULL;
+    self->index = index;
+
+    return self;
+}
+
+/**
+ * text_change_copy:
+ * @self: a #TextChange
+ *
+ * Makes a copy of a #TextChange.
+ *
+ * Returns: (transfer full): A newly created #TextChange with the same
+ *   contents as @self
+ */
+TextChange *
+text_change_copy (TextChange *self)
+{
+    TextChange *copy;
+
+    g_return_val_if_fail (self, NULL);
+
+    copy = _change_new (self->type, self->parent, self->node, self->index);
+    copy->text = g_strdup (self->text);
+    copy->property = self->property;
+
+    return copy;
+}
+
+/**
+ * text_change_free:
+ * @self: a #TextChange
+ *
+ * Frees a #TextChange.
+ */
+void
+text_change_free (TextChange *self)
+{
+    g_return_if_fail (self);
+
+    g_clear_object (&self->parent);
+    g_clear_object (&self->node);
+    g_free (self->text);
+
+    g_slice_free (TextChange, self);
+}
+
+/**
+ * text_journal_new:
+ *
+ * Creates a new #TextJournal, which collects the changes made to a
+ * document tree and reports them through the #TextJournal::changed
+ * signal.
+ *
+ * Returns: (transfer full): a newly created #TextJournal
+ */
+TextJournal *
+text_journal_new (void)
+{
+    return g_object_new (TEXT_TYPE_JOURNAL, NULL);
+}
+
+static void
+_detach (TextJournal *self)
+{
+    if (!self->root)
+        return;
+
+    text_node_set_observer (self->root, NULL, NULL);
+    g_object_set_qdata (G_OBJECT (self->root), JOURNAL_QUARK, NULL);
+    g_object_remove_weak_pointer (G_OBJECT (self->root), (gpointer *) &self->root);
+    self->root = NULL;
+}
+
+static void
+text_journal_finalize (GObject *object)
+{
+    TextJournal *self = (TextJournal *)object;
+
+    _detach (self);
+    g_ptr_array_unref (self->pending);
+
+    G_OBJECT_CLASS (text_journal_parent_class)->finalize (object);
+}
+
+static void
+text_journal_class_init (TextJournalClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = text_journal_finalize;
+
+    /**
+     * TextJournal::changed:
+     * @self: the #TextJournal
+     * @changes: (element-type TextChange): the changes, in the order
+     *   they were made
+     *
+     * Emitted once at the end of every edit with all the changes the
+     * edit made to the tree.
+     */
+    signals [CHANGED] =
+        g_signal_new ("changed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL,
+                      G_TYPE_NONE, 1, G_TYPE_PTR_ARRAY);
+}
+
+static void
+_flush (TextJournal *self)
+{
+    GPtrArray *changes;
+
+    if (self->pending->len == 0)
+        return;
+
+    // Handlers may start new edits of their own
+    changes = self->pending;
+    self->pending = g_ptr_array_new_with_free_func ((GDestroyNotify) text_change_free);
+
+    g_signal_emit (self, signals [CHANGED], 0, changes);
+    g_ptr_array_unref (changes);
+}
+
+static void
+_record (TextJournal *self,
+         TextChange  *change)
+{
+    g_ptr_array_add (self->pending, change);
+
+    // Changes made outside of an edit are reported straight away
+    if (self->depth == 0)
+        _flush (self);
+}
+
+static void
+_observe_tree (TextNode *parent,
+               TextNode *child,
+               int       index,
+               gboolean  inserted,
+               gpointer  user_data)
+{
+    TextJournal *self = TEXT_JOURNAL (user_data);
+
+    _record (self, _change_new (inserted ? TEXT_CHANGE_CHILD_INSERTED : TEXT_CHANGE_CHILD_REMOVED,
+                                parent, child, index));
+}
+
+/**
+ * text_journal_attach:
+ * @self: a #TextJournal
+ * @root: (nullable): the root of the tree to observe
+ *
+ * Starts recording the children inserted into and removed from
+ * @root and its descendants. Any previously attached tree is
+ * no longer observed.
+ */
+void
+text_journal_attach (TextJournal *self,
+                     TextNode    *root)
+{
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+    g_return_if_fail (root == NULL || TEXT_IS_NODE (root));
+
+    if (self->root == root)
+        return;
+
+    _detach (self);
+
+    if (!root)
+        return;
+
+    self->root = root;
+    g_object_add_weak_pointer (G_OBJECT (root), (gpointer *) &self->root);
+    g_object_set_qdata (G_OBJECT (root), JOURNAL_QUARK, self);
+    text_node_set_observer (root, _observe_tree, self);
+}
+
+/**
+ * text_journal_find:
+ * @node: a #TextNode
+ *
+ * Finds the journal attached to the tree containing @node.
+ *
+ * Returns: (transfer none) (nullable): the #TextJournal observing
+ *   @node, or %NULL if the tree is not observed
+ */
+TextJournal *
+text_journal_find (TextNode *node)
+{
+    g_return_val_if_fail (TEXT_IS_NODE (node), NULL);
+
+    return g_object_get_qdata (G_OBJECT (text_node_get_root (node)), JOURNAL_QUARK);
+}
+
+/**
+ * text_journal_begin:
+ * @self: a #TextJournal
+ *
+ * Starts an edit. Changes are collected until the matching call to
+ * text_journal_end(), so that they are reported together. Edits may
+ * be nested, in which case they are reported at the end of the
+ * outermost edit.
+ */
+void
+text_journal_begin (TextJournal *self)
+{
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+
+    self->depth++;
+}
+
+/**
+ * text_journal_end:
+ * @self: a #TextJournal
+ *
+ * Ends an edit started with text_journal_begin(), emitting
+ * #TextJournal::changed if this was the outermost edit and any
+ * changes were made.
+ */
+void
+text_journal_end (TextJournal *self)
+{
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+    g_return_if_fail (self->depth > 0);
+
+    if (--self->depth == 0)
+        _flush (self);
+}
+
+static void
+_record_text (TextJournal    *self,
+              TextChangeType  type,
+              TextFragment   *fragment,
+              int             index,
+              const char     *text)
+{
+    TextChange *change;
+
+    change = _change_new (type,
+                          text_node_get_parent (TEXT_NODE (fragment)),
+                          TEXT_NODE (fragment),
+                          index);
+    change->text = g_strdup (text);
+
+    _record (self, change);
+}
+
+/**
+ * text_journal_record_text_inserted:
+ * @self: a #TextJournal
+ * @fragment: the #TextFragment which was modified
+ * @index: byte index within @fragment where @text was inserted
+ * @text: the inserted text
+ *
+ * Records that @text was inserted into @fragment.
+ */
+void
+text_journal_record_text_inserted (TextJournal  *self,
+                                   TextFragment *fragment,
+                                   int           index,
+                                   const char   *text)
+{
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+    g_return_if_fail (TEXT_IS_FRAGMENT (fragment));
+
+    _record_text (self, TEXT_CHANGE_TEXT_INSERTED, fragment, index, text);
+}
+
+/**
+ * text_journal_record_text_deleted:
+ * @self: a #TextJournal
+ * @fragment: the #TextFragment which was modified
+ * @index: byte index within @fragment where @text was removed
+ * @text: the deleted text
+ *
+ * Records that @text was removed from @fragment.
+ */
+void
+text_journal_record_text_deleted (TextJournal  *self,
+                                  TextFragment *fragment,
+                                  int           index,
+                                  const char   *text)
+{
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+    g_return_if_fail (TEXT_IS_FRAGMENT (fragment));
+
+    _record_text (self, TEXT_CHANGE_TEXT_DELETED, fragment, index, text);
+}
+
+/**
+ * text_journal_record_style_changed:
+ * @self: a #TextJournal
+ * @fragment: the #TextFragment which was modified
+ * @property: name of the style property which changed
+ *
+ * Records that the style of @fragment changed.
+ */
+void
+text_journal_record_style_changed (TextJournal  *self,
+                                   TextFragment *fragment,
+                                   const char   *property)
+{
+    TextChange *change;
+
+    g_return_if_fail (TEXT_IS_JOURNAL (self));
+    g_return_if_fail (TEXT_IS_FRAGMENT (fragment));
+
+    change = _change_new (TEXT_CHANGE_STYLE_CHANGED,
+                          text_node_get_parent (TEXT_NODE (fragment)),
+                          TEXT_NODE (fragment),
+                          0);
+    change->property = g_intern_string (property);
+
+    _record (self, change);
+}
+
+static void
+text_journal_init (TextJournal *self)
+{
+    self->pending = g_ptr_array_new_with_free_func ((GDestroyNotify) text_change_free);
+}
@@ -0,0 +1,74 @@
+/* journal.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "../tree/node.h"
+#include "fragment.h"
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_CHANGE (text_change_get_type ())
+#define TEXT_TYPE_JOURNAL (text_journal_get_type())
+
+typedef enum
+{
+    TEXT_CHANGE_TEXT_INSERTED,
+    TEXT_CHANGE_TEXT_DELETED,
+    TEXT_CHANGE_CHILD_INSERTED,
+    TEXT_CHANGE_CHILD_REMOVED,
+    TEXT_CHANGE_STYLE_CHANGED,
+} TextChangeType;
+
+typedef struct _TextChange TextChange;
+
+struct _TextChange
+{
+    TextChangeType type;
+
+    // For text and style changes, @node is the fragment and @parent
+    // is its paragraph. For child changes, @node is the child.
+    TextNode *parent;
+    TextNode *node;
+
+    // Byte index within the fragment, or the index of the child
+    int index;
+
+    // Inserted or deleted text
+    char *text;
+
+    // Name of the changed style property
+    const char *property;
+};
+
+GType       text_change_get_type (void) G_GNUC_CONST;
+TextChange *text_change_copy     (TextChange *self);
+void        text_change_free     (TextChange *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextChange, text_change_free)
+
+G_DECLARE_FINAL_TYPE (TextJournal, text_journal, TEXT, JOURNAL, GObject)
+
+TextJournal *text_journal_new                   (void);
+
+void         text_journal_attach                (TextJournal *self, TextNode *root);
+TextJournal *text_journal_find                  (TextNode *node);
+
+void         text_journal_begin                 (TextJournal *self);
+void         text_journal_end                   (TextJournal *self);
+
+void         text_journal_record_text_inserted  (TextJournal *self, TextFragment *fragment, int index, const char *text);
+void         text_journal_record_text_deleted   (TextJournal *self, TextFragment *fragment, int index, const char *text);
+void         text_journal_record_style_changed  (TextJournal *self, TextFragment *fragment, const char *property);
+
+G_END_DECLS
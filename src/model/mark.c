@@ -11,6 +11,8 @@
 
 #include "mark.h"
 
+#include "document.h"
+
 G_DEFINE_BOXED_TYPE (TextMark, text_mark, text_mark_copy, text_mark_free)
 
 /**
@@ -74,3 +76,27 @@ text_mark_free (TextMark *self)
 
     g_slice_free (TextMark, self);
 }
+
+/**
+ * text_mark_set_position:
+ * @self: a #TextMark
+ * @paragraph: (nullable): the new paragraph
+ * @index: the new byte index within @paragraph
+ *
+ * Moves @self to @index within @paragraph. Marks belonging to a
+ * document are kept in per-paragraph buckets, so this must be used
+ * rather than assigning to #TextMark.paragraph directly.
+ */
+void
+text_mark_set_position (TextMark      *self,
+                        TextParagraph *paragraph,
+                        int            index)
+{
+    g_return_if_fail (self);
+
+    self->paragraph = paragraph;
+    self->index = index;
+
+    if (self->bucket && self->bucket != paragraph)
+        text_document_update_mark (self->document, self);
+}
@@ -34,6 +34,13 @@ struct _TextMark
     TextParagraph *paragraph;
     int index; // byte index (i.e. NOT unicode)
     TextGravity gravity;
+
+    // Paragraph whose bucket holds this mark, if it was
+    // created through the document (see text_mark_set_position)
+    TextParagraph *bucket;
+
+    // Order in which marks were created through the document
+    guint serial;
 };
 
 GType         text_mark_get_type (void) G_GNUC_CONST;
@@ -41,6 +48,8 @@ TextMark     *text_mark_new      (struct _TextDocument *document, TextParagraph
 TextMark     *text_mark_copy     (TextMark *self);
 void          text_mark_free     (TextMark *self);
 
+void          text_mark_set_position (TextMark *self, TextParagraph *paragraph, int index);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextMark, text_mark_free)
 
 G_END_DECLS
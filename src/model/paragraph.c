@@ -14,6 +14,17 @@
 struct _TextParagraph
 {
     TextBlock parent_instance;
+
+    // Flattened text, valid while the generation matches. Only the
+    // most recently peeked paragraphs keep theirs, linked through
+    // text_link while they do
+    char *text;
+    guint text_generation;
+    GList text_link;
+
+    // Immutable copy for snapshots, valid while the generation matches
+    TextSnapshotParagraph *snapshot;
+    guint snapshot_generation;
 };
 
 G_DEFINE_FINAL_TYPE (TextParagraph, text_paragraph, TEXT_TYPE_BLOCK)
@@ -25,6 +36,12 @@ enum {
 
 static GParamSpec *properties [N_PROPS];
 
+// Paragraphs holding flattened text, most recently peeked first. This
+// bounds the number of copies of the document kept alive at once.
+#define MAX_PEEKED_TEXTS 32
+
+static GQueue peeked_texts = G_QUEUE_INIT;
+
 TextParagraph *
 text_paragraph_new (void)
 {
@@ -36,6 +53,12 @@ text_paragraph_finalize (GObject *object)
 {
     TextParagraph *self = (TextParagraph *)object;
 
+    if (self->text)
+        g_queue_unlink (&peeked_texts, &self->text_link);
+
+    g_free (self->text);
+    g_clear_pointer (&self->snapshot, text_snapshot_paragraph_unref);
+
     G_OBJECT_CLASS (text_paragraph_parent_class)->finalize (object);
 }
 
@@ -79,6 +102,17 @@ text_paragraph_append_fragment (TextParagraph *self,
     text_node_append_child (TEXT_NODE (self), TEXT_NODE (fragment));
 }
 
+static char *
+_build_text (TextParagraph *self)
+{
+    GString *str;
+
+    str = g_string_sized_new (text_paragraph_get_size_bytes (self) + 1);
+    text_paragraph_append_text (self, str);
+
+    return g_string_free (str, FALSE);
+}
+
 /**
  * text_paragraph_get_text:
  *
@@ -87,6 +121,11 @@ text_paragraph_append_fragment (TextParagraph *self,
  * the method is called and will not be updated. It is the
  * caller's responsibility to free the returned string.
  *
+ * Prefer text_paragraph_iter_init() where the text does
+ * not need to be contiguous, as it does not allocate, or
+ * text_paragraph_peek_text() where it does not need to
+ * be kept.
+ *
  * @self: The `TextParagraph` instance.
  *
  * Returns: A pointer to the text content of this paragraph
@@ -94,66 +133,196 @@ text_paragraph_append_fragment (TextParagraph *self,
 char *
 text_paragraph_get_text (TextParagraph *self)
 {
-    TextNode *child;
-    GString *str;
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), NULL);
+
+    // Reuse the peeked text, but don't cache a copy of our own
+    if (self->text && self->text_generation == text_node_get_generation (TEXT_NODE (self)))
+        return g_strdup (self->text);
+
+    return _build_text (self);
+}
+
+/**
+ * text_paragraph_peek_text:
+ * @self: a #TextParagraph
+ *
+ * Gets the contents of @self as a single string. The string is built
+ * the first time it is asked for and kept until the contents of @self
+ * change, so repeated calls between edits do not copy the text again.
+ *
+ * Only the most recently peeked paragraphs keep their text, so the
+ * string may also be freed by peeking at many other paragraphs. Use
+ * text_paragraph_get_text() to hold on to the text of several
+ * paragraphs at once. This must only be called from the thread which
+ * owns the document.
+ *
+ * Returns: (transfer none): the text of @self, valid until @self is
+ *   next modified or the text of other paragraphs is peeked
+ */
+const char *
+text_paragraph_peek_text (TextParagraph *self)
+{
+    guint generation;
 
     g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), NULL);
 
-    str = g_string_new ("");
+    generation = text_node_get_generation (TEXT_NODE (self));
 
-    for (child = text_node_get_first_child (TEXT_NODE (self));
-         child != NULL;
-         child = text_node_get_next (child))
+    if (self->text)
     {
-        const gchar *run_text;
+        g_queue_unlink (&peeked_texts, &self->text_link);
 
-        g_assert (TEXT_IS_FRAGMENT (child));
+        if (self->text_generation != generation)
+            g_clear_pointer (&self->text, g_free);
+    }
 
-        run_text = text_fragment_get_text (TEXT_FRAGMENT (child));
-        g_string_append (str, run_text);
+    if (!self->text)
+    {
+        self->text = _build_text (self);
+        self->text_generation = generation;
     }
 
-    return g_string_free (str, FALSE);
+    g_queue_push_head_link (&peeked_texts, &self->text_link);
+
+    // Evict the least recently peeked text
+    if (peeked_texts.length > MAX_PEEKED_TEXTS)
+    {
+        TextParagraph *oldest;
+
+        oldest = g_queue_pop_tail_link (&peeked_texts)->data;
+        g_clear_pointer (&oldest->text, g_free);
+    }
+
+    return self->text;
+}
+
+/**
+ * text_paragraph_append_text:
+ * @self: a #TextParagraph
+ * @string: a #GString
+ *
+ * Appends the contents of @self to @string, without creating any
+ * intermediate copies.
+ */
+void
+text_paragraph_append_text (TextParagraph *self,
+                            GString       *string)
+{
+    TextParagraphIter iter;
+    const char *slice;
+    gsize length;
+
+    g_return_if_fail (TEXT_IS_PARAGRAPH (self));
+    g_return_if_fail (string != NULL);
+
+    text_paragraph_iter_init (&iter, self);
+
+    while (text_paragraph_iter_next (&iter, &slice, &length))
+        g_string_append_len (string, slice, length);
 }
 
 int
 text_paragraph_get_length (TextParagraph *self)
 {
-    TextNode *child;
-    int length;
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), -1);
+
+    return text_node_get_aggregate (TEXT_NODE (self), TEXT_ITEM_AGGREGATE_CHARS);
+}
 
+int
+text_paragraph_get_size_bytes (TextParagraph *self)
+{
     g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), -1);
 
-    length = 0;
+    return text_node_get_aggregate (TEXT_NODE (self), TEXT_ITEM_AGGREGATE_BYTES);
+}
 
-    for (child = text_node_get_first_child (TEXT_NODE (self));
-         child != NULL;
-         child = text_node_get_next (child))
-    {
-        length += text_fragment_get_length (TEXT_FRAGMENT (child));
-    }
+static const int byte_weights [TEXT_NODE_N_AGGREGATES] = {
+    [TEXT_ITEM_AGGREGATE_BYTES] = 1,
+};
+
+static const int char_weights [TEXT_NODE_N_AGGREGATES] = {
+    [TEXT_ITEM_AGGREGATE_CHARS] = 1,
+};
 
-    return length;
+/**
+ * text_paragraph_is_ascii:
+ * @self: a #TextParagraph
+ *
+ * Checks whether the text of @self is pure ASCII, in which case byte
+ * indices and character offsets are the same.
+ *
+ * Returns: %TRUE if @self only contains ASCII characters
+ */
+gboolean
+text_paragraph_is_ascii (TextParagraph *self)
+{
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), FALSE);
+
+    return text_paragraph_get_size_bytes (self) == text_paragraph_get_length (self);
 }
 
+/**
+ * text_paragraph_get_offset_at_index:
+ * @self: a #TextParagraph
+ * @byte_index: a byte index within @self
+ *
+ * Converts a byte index into a character offset within @self. Only the
+ * fragment containing @byte_index is examined, and not even that for
+ * ASCII text.
+ *
+ * Returns: the character offset of @byte_index
+ */
 int
-text_paragraph_get_size_bytes (TextParagraph *self)
+text_paragraph_get_offset_at_index (TextParagraph *self,
+                                    int            byte_index)
 {
-    TextNode *child;
-    int length;
+    TextNode *fragment;
+    int preceding [TEXT_NODE_N_AGGREGATES];
 
-    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), -1);
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), 0);
 
-    length = 0;
+    if (text_paragraph_is_ascii (self))
+        return CLAMP (byte_index, 0, text_paragraph_get_size_bytes (self));
 
-    for (child = text_node_get_first_child (TEXT_NODE (self));
-         child != NULL;
-         child = text_node_get_next (child))
-    {
-        length += (int) strlen (text_fragment_get_text ((TEXT_FRAGMENT (child))));
-    }
+    fragment = text_node_find_child (TEXT_NODE (self), byte_weights, &byte_index, preceding);
+
+    if (!fragment)
+        return byte_index < 0 ? 0 : text_paragraph_get_length (self);
+
+    return preceding [TEXT_ITEM_AGGREGATE_CHARS]
+         + text_fragment_get_offset_at_index (TEXT_FRAGMENT (fragment), byte_index);
+}
+
+/**
+ * text_paragraph_get_index_at_offset:
+ * @self: a #TextParagraph
+ * @offset: a character offset within @self
+ *
+ * Converts a character offset into a byte index within @self. Offsets
+ * past the end of @self give the size of @self.
+ *
+ * Returns: the byte index of @offset
+ */
+int
+text_paragraph_get_index_at_offset (TextParagraph *self,
+                                    int            offset)
+{
+    TextNode *fragment;
+    int preceding [TEXT_NODE_N_AGGREGATES];
+
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), 0);
+
+    if (text_paragraph_is_ascii (self))
+        return CLAMP (offset, 0, text_paragraph_get_size_bytes (self));
+
+    fragment = text_node_find_child (TEXT_NODE (self), char_weights, &offset, preceding);
+
+    if (!fragment)
+        return offset < 0 ? 0 : text_paragraph_get_size_bytes (self);
 
-    return length;
+    return preceding [TEXT_ITEM_AGGREGATE_BYTES]
+         + text_fragment_get_index_at_offset (TEXT_FRAGMENT (fragment), offset);
 }
 
 TextFragment *
@@ -211,11 +380,207 @@ text_paragraph_get_item_at_index (TextParagraph *self,
     return NULL;
 }
 
+/**
+ * text_paragraph_iter_init:
+ * @iter: an uninitialized #TextParagraphIter
+ * @paragraph: a #TextParagraph
+ *
+ * Initializes @iter to walk the text of @paragraph as a sequence of
+ * borrowed slices. See text_paragraph_iter_next().
+ */
+void
+text_paragraph_iter_init (TextParagraphIter *iter,
+                          TextParagraph     *paragraph)
+{
+    text_paragraph_iter_init_range (iter, paragraph, 0, -1);
+}
+
+/**
+ * text_paragraph_iter_init_range:
+ * @iter: an uninitialized #TextParagraphIter
+ * @paragraph: a #TextParagraph
+ * @start_index: byte index to start at
+ * @end_index: byte index to stop at, or -1 for the end of @paragraph
+ *
+ * Initializes @iter to walk the text of @paragraph between
+ * @start_index and @end_index as a sequence of borrowed slices. The
+ * fragment containing @start_index is found in O(log n) time.
+ */
+void
+text_paragraph_iter_init_range (TextParagraphIter *iter,
+                                TextParagraph     *paragraph,
+                                int                start_index,
+                                int                end_index)
+{
+    int preceding [TEXT_NODE_N_AGGREGATES];
+    int size;
+    int offset;
+
+    g_return_if_fail (iter != NULL);
+    g_return_if_fail (TEXT_IS_PARAGRAPH (paragraph));
+
+    size = text_paragraph_get_size_bytes (paragraph);
+
+    if (end_index < 0 || end_index > size)
+        end_index = size;
+
+    start_index = CLAMP (start_index, 0, end_index);
+
+    offset = start_index;
+    iter->fragment = text_node_find_child (TEXT_NODE (paragraph), byte_weights, &offset, preceding);
+    iter->slice = 0;
+    iter->position = iter->fragment ? preceding [TEXT_ITEM_AGGREGATE_BYTES] : size;
+    iter->start = start_index;
+    iter->end = end_index;
+}
+
+/**
+ * text_paragraph_iter_next:
+ * @iter: a #TextParagraphIter
+ * @text: (out) (optional) (transfer none): the next slice
+ * @length: (out) (optional): the length of @text in bytes
+ *
+ * Advances @iter to the next slice of text. Slices point directly
+ * into the storage of each fragment, so they are not nul-terminated
+ * and are only valid until the paragraph is next modified. Empty
+ * slices are skipped.
+ *
+ * Returns: %FALSE once the end of the range has been reached
+ */
+gboolean
+text_paragraph_iter_next (TextParagraphIter  *iter,
+                          const char        **text,
+                          gsize              *length)
+{
+    g_return_val_if_fail (iter != NULL, FALSE);
+
+    while (iter->fragment && iter->position < iter->end)
+    {
+        const char *slice;
+        gsize slice_length;
+        int slice_start;
+        int slice_end;
+
+        if (TEXT_IS_RUN (iter->fragment) &&
+            iter->slice < text_run_get_n_slices (TEXT_RUN (iter->fragment)))
+        {
+            slice = text_run_get_slice (TEXT_RUN (iter->fragment), iter->slice, &slice_length);
+        }
+        else if (!TEXT_IS_RUN (iter->fragment) && iter->slice == 0)
+        {
+            slice = text_fragment_get_text (TEXT_FRAGMENT (iter->fragment));
+            slice_length = text_fragment_get_size_bytes (TEXT_FRAGMENT (iter->fragment));
+        }
+        else
+        {
+            iter->fragment = text_node_get_next (iter->fragment);
+            iter->slice = 0;
+            continue;
+        }
+
+        iter->slice++;
+
+        slice_start = iter->position;
+        slice_end = iter->position + (int) slice_length;
+        iter->position = slice_end;
+
+        // Clip to the requested range
+        slice_start = MAX (slice_start, iter->start);
+        slice_end = MIN (slice_end, iter->end);
+
+        if (slice_start >= slice_end)
+            continue;
+
+        if (text)
+            *text = slice + (slice_start - (iter->position - (int) slice_length));
+
+        if (length)
+            *length = slice_end - slice_start;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * text_paragraph_snapshot:
+ * @self: a #TextParagraph
+ *
+ * Gets an immutable copy of @self, for use in a #TextSnapshot. The copy
+ * is made the first time it is asked for and shared until the contents
+ * or formatting of @self change.
+ *
+ * Returns: (transfer full): a copy of @self
+ */
+TextSnapshotParagraph *
+text_paragraph_snapshot (TextParagraph *self)
+{
+    g_autofree char *text = NULL;
+    TextNode *child;
+    GArray *fragments;
+    guint generation;
+    int index = 0;
+
+    g_return_val_if_fail (TEXT_IS_PARAGRAPH (self), NULL);
+
+    generation = text_node_get_generation (TEXT_NODE (self));
+
+    if (self->snapshot && self->snapshot_generation == generation)
+        return text_snapshot_paragraph_ref (self->snapshot);
+
+    fragments = g_array_new (FALSE, FALSE, sizeof (TextSnapshotFragment));
+
+    for (child = text_node_get_first_child (TEXT_NODE (self));
+         child != NULL;
+         child = text_node_get_next (child))
+    {
+        TextSnapshotFragment fragment = { 0 };
+
+        fragment.index = index;
+        fragment.size = text_fragment_get_size_bytes (TEXT_FRAGMENT (child));
+
+        if (TEXT_IS_RUN (child))
+        {
+            fragment.type = TEXT_SNAPSHOT_RUN;
+            fragment.is_bold = text_run_get_style_bold (TEXT_RUN (child));
+            fragment.is_italic = text_run_get_style_italic (TEXT_RUN (child));
+            fragment.is_underline = text_run_get_style_underline (TEXT_RUN (child));
+        }
+        else
+        {
+            fragment.type = TEXT_SNAPSHOT_OPAQUE;
+        }
+
+        index += fragment.size;
+        g_array_append_val (fragments, fragment);
+    }
+
+    text = text_paragraph_get_text (self);
+
+    g_clear_pointer (&self->snapshot, text_snapshot_paragraph_unref);
+    self->snapshot = text_snapshot_paragraph_new (text,
+                                                  text_paragraph_get_length (self),
+                                                  fragments);
+    self->snapshot_generation = generation;
+
+    return text_snapshot_paragraph_ref (self->snapshot);
+}
+
+static void
+text_paragraph_measure (TextNode *node,
+                        int      *aggregates)
+{
+    aggregates [TEXT_ITEM_AGGREGATE_PARAGRAPHS] += 1;
+}
+
 static void
 text_paragraph_class_init (TextParagraphClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+    TEXT_NODE_CLASS (klass)->measure = text_paragraph_measure;
+
     object_class->finalize = text_paragraph_finalize;
     object_class->get_property = text_paragraph_get_property;
     object_class->set_property = text_paragraph_set_property;
@@ -224,4 +589,5 @@ text_paragraph_class_init (TextParagraphClass *klass)
 static void
 text_paragraph_init (TextParagraph *self)
 {
+    self->text_link.data = self;
 }
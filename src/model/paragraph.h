@@ -16,6 +16,7 @@
 #include "item.h"
 #include "block.h"
 #include "run.h"
+#include "snapshot.h"
 
 G_BEGIN_DECLS
 
@@ -23,11 +24,32 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (TextParagraph, text_paragraph, TEXT, PARAGRAPH, TextBlock)
 
+typedef struct
+{
+    /*< private >*/
+    TextNode *fragment;
+    guint slice;
+    int position;
+    int start;
+    int end;
+} TextParagraphIter;
+
 TextParagraph  *text_paragraph_new                  (void);
 void            text_paragraph_append_fragment      (TextParagraph *self, TextFragment *fragment);
 TextFragment   *text_paragraph_get_item_at_index    (TextParagraph *self, int byte_index, int *starting_index);
 int             text_paragraph_get_length           (TextParagraph *self);
 int             text_paragraph_get_size_bytes       (TextParagraph *self);
 char           *text_paragraph_get_text             (TextParagraph *self);
+const char     *text_paragraph_peek_text            (TextParagraph *self);
+void            text_paragraph_append_text          (TextParagraph *self, GString *string);
+gboolean        text_paragraph_is_ascii             (TextParagraph *self);
+int             text_paragraph_get_offset_at_index  (TextParagraph *self, int byte_index);
+int             text_paragraph_get_index_at_offset  (TextParagraph *self, int offset);
+TextSnapshotParagraph *
+                text_paragraph_snapshot             (TextParagraph *self);
+
+void            text_paragraph_iter_init            (TextParagraphIter *iter, TextParagraph *paragraph);
+void            text_paragraph_iter_init_range      (TextParagraphIter *iter, TextParagraph *paragraph, int start_index, int end_index);
+gboolean        text_paragraph_iter_next            (TextParagraphIter *iter, const char **text, gsize *length);
 
 G_END_DECLS
@@ -0,0 +1,733 @@
+/* piecetable.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "piecetable.h"
+
+#include <string.h>
+
+/*
+ * A piece table holding the text of a single run. The text is never
+ * modified in place: the original text is kept in a read-only buffer,
+ * inserted text is appended to an add buffer, and the run's text is
+ * described by a sequence of pieces referencing either buffer.
+ *
+ * Edits only touch the pieces around the edited index. Consecutive
+ * insertions at the same position (i.e. typing) extend the last
+ * piece in place, so they cost no more than appending to the add
+ * buffer, regardless of how long the text is.
+ *
+ * The end of the add buffer doubles as a gap at the caret: erasing
+ * text from the end of the most recently added piece hands the bytes
+ * back to the add buffer, so typing and backspacing at the same
+ * position only ever moves bytes within that gap.
+ *
+ * Reading never changes the pieces. Readers which need contiguous text
+ * get a flattened copy owned by the table, which is kept until the next
+ * edit. Instead, edits compact the table into a single piece once it
+ * has been split into too many of them.
+ */
+
+// Edits scattered across a run split it into more and more pieces,
+// which makes lookups slower. Past this, the next edit compacts them.
+#define MAX_PIECES 64
+
+typedef enum
+{
+    BUFFER_ORIGINAL,
+    BUFFER_ADD
+} Buffer;
+
+typedef struct
+{
+    gsize start;
+    gsize length;
+    guint buffer : 1;
+
+    // Set if the piece is known to only contain ASCII, in which
+    // case byte and character counts are the same
+    guint ascii : 1;
+} Piece;
+
+struct _TextPieceTable
+{
+    char *original;
+    gsize original_size;
+    GString *add;
+
+    GArray *pieces;
+
+    // Size in bytes and length in characters
+    gsize size;
+    gsize length;
+
+    // The piece last looked up and the index it starts at
+    guint hint;
+    gsize hint_start;
+
+    // Contiguous copy of the text handed out by get_text(),
+    // dropped whenever the text changes
+    char *flat;
+};
+
+static gboolean
+_is_ascii (const char *text,
+           gsize       length)
+{
+    for (gsize i = 0; i < length; i++)
+    {
+        if ((guchar) text[i] >= 0x80)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gsize
+_count_chars (const char *text,
+              gsize       length,
+              gboolean    ascii)
+{
+    if (ascii)
+        return length;
+
+    return (gsize) g_utf8_strlen (text, (gssize) length);
+}
+
+static const char *
+_get_piece_data (TextPieceTable *self,
+                 Piece          *piece)
+{
+    if (piece->buffer == BUFFER_ADD)
+        return self->add->str + piece->start;
+
+    return self->original + piece->start;
+}
+
+// Copies every piece into a new nul-terminated string. This walks the
+// pieces directly rather than through _find(), so that it doesn't write
+// to the table and concurrent readers can't race on the lookup hint.
+static char *
+_flatten (TextPieceTable *self)
+{
+    char *text;
+    gsize written = 0;
+
+    text = g_malloc (self->size + 1);
+
+    for (guint i = 0; i < self->pieces->len; i++)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+
+        memcpy (text + written, _get_piece_data (self, piece), piece->length);
+        written += piece->length;
+    }
+
+    text[written] = '\0';
+    return text;
+}
+
+static void
+_reset (TextPieceTable *self,
+        char           *original,
+        gsize           size)
+{
+    Piece piece;
+
+    g_clear_pointer (&self->flat, g_free);
+    g_free (self->original);
+    self->original = original;
+    self->original_size = size;
+
+    g_string_truncate (self->add, 0);
+    g_array_set_size (self->pieces, 0);
+
+    self->size = size;
+    self->hint = 0;
+    self->hint_start = 0;
+
+    if (size == 0)
+        return;
+
+    piece.buffer = BUFFER_ORIGINAL;
+    piece.start = 0;
+    piece.length = size;
+    piece.ascii = (self->length == size);
+    g_array_append_val (self->pieces, piece);
+}
+
+/**
+ * text_piece_table_new:
+ * @text: (nullable): the initial text
+ *
+ * Creates a new piece table containing a copy of @text.
+ *
+ * Returns: (transfer full): a new #TextPieceTable
+ */
+TextPieceTable *
+text_piece_table_new (const char *text)
+{
+    TextPieceTable *self;
+
+    self = g_new0 (TextPieceTable, 1);
+    self->add = g_string_new (NULL);
+    self->pieces = g_array_new (FALSE, FALSE, sizeof (Piece));
+
+    text_piece_table_set_text (self, text);
+
+    return self;
+}
+
+/**
+ * text_piece_table_free:
+ * @self: a #TextPieceTable
+ *
+ * Frees @self.
+ */
+void
+text_piece_table_free (TextPieceTable *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_free (self->original);
+    g_free (self->flat);
+    g_string_free (self->add, TRUE);
+    g_array_unref (self->pieces);
+    g_free (self);
+}
+
+/**
+ * text_piece_table_set_text:
+ * @self: a #TextPieceTable
+ * @text: (nullable): the new text
+ *
+ * Replaces the contents of @self with a copy of @text.
+ */
+void
+text_piece_table_set_text (TextPieceTable *self,
+                           const char     *text)
+{
+    gsize size;
+
+    g_return_if_fail (self != NULL);
+
+    if (!text)
+        text = "";
+
+    size = strlen (text);
+    self->length = (gsize) g_utf8_strlen (text, (gssize) size);
+
+    _reset (self, g_strndup (text, size), size);
+}
+
+// Finds the piece containing @index, or the number of pieces if
+// @index is the end of the text. Edits tend to happen close to
+// one another, so the search starts from the last piece looked
+// up where possible.
+static guint
+_find (TextPieceTable *self,
+       gsize           index,
+       gsize          *piece_start)
+{
+    guint i = 0;
+    gsize start = 0;
+
+    if (self->hint < self->pieces->len && self->hint_start <= index)
+    {
+        i = self->hint;
+        start = self->hint_start;
+    }
+
+    for (; i < self->pieces->len; i++)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+
+        if (index < start + piece->length)
+            break;
+
+        start += piece->length;
+    }
+
+    if (i < self->pieces->len)
+    {
+        self->hint = i;
+        self->hint_start = start;
+    }
+
+    *piece_start = start;
+    return i;
+}
+
+// Called by every edit, after the pieces have been updated
+static void
+_changed (TextPieceTable *self)
+{
+    g_clear_pointer (&self->flat, g_free);
+
+    if (self->pieces->len > MAX_PIECES)
+        _reset (self, _flatten (self), self->size);
+}
+
+/**
+ * text_piece_table_get_text:
+ * @self: a #TextPieceTable
+ *
+ * Gets the contents of @self as a single nul-terminated string.
+ *
+ * If the text is spread over several pieces, it is copied once and the
+ * copy is kept until @self is next modified. The pieces themselves are
+ * left alone, so slices from text_piece_table_get_piece() stay valid.
+ * Readers which can work with pieces should prefer those, as they are
+ * never copied.
+ *
+ * Returns: (transfer none): the text, valid until @self is next modified
+ */
+const char *
+text_piece_table_get_text (TextPieceTable *self)
+{
+    Piece *piece;
+    char *text;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    if (self->pieces->len == 0)
+        return "";
+
+    // A single piece running up to the end of its buffer
+    // is already nul-terminated
+    if (self->pieces->len == 1)
+    {
+        piece = &g_array_index (self->pieces, Piece, 0);
+
+        if (piece->buffer == BUFFER_ORIGINAL &&
+            piece->start + piece->length == self->original_size)
+            return self->original + piece->start;
+
+        if (piece->buffer == BUFFER_ADD &&
+            piece->start + piece->length == self->add->len)
+            return self->add->str + piece->start;
+    }
+
+    text = g_atomic_pointer_get (&self->flat);
+
+    if (text)
+        return text;
+
+    // Two readers may flatten at once, in which
+    // case the first copy to be stored wins
+    text = _flatten (self);
+
+    if (!g_atomic_pointer_compare_and_exchange (&self->flat, NULL, text))
+    {
+        g_free (text);
+        text = g_atomic_pointer_get (&self->flat);
+    }
+
+    return text;
+}
+
+/**
+ * text_piece_table_copy:
+ * @self: a #TextPieceTable
+ * @index: byte index to start copying from
+ * @length: number of bytes to copy
+ *
+ * Copies part of the text of @self.
+ *
+ * Returns: (transfer full): a newly allocated nul-terminated string
+ */
+char *
+text_piece_table_copy (TextPieceTable *self,
+                       gsize           index,
+                       gsize           length)
+{
+    char *copy;
+    gsize written;
+    gsize offset;
+    gsize start;
+    guint i;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (index <= self->size, NULL);
+
+    length = MIN (length, self->size - index);
+    copy = g_malloc (length + 1);
+    written = 0;
+
+    i = _find (self, index, &start);
+    offset = index - start;
+
+    for (; i < self->pieces->len && written < length; i++)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+        gsize count = MIN (piece->length - offset, length - written);
+
+        memcpy (copy + written, _get_piece_data (self, piece) + offset, count);
+        written += count;
+        offset = 0;
+    }
+
+    copy[written] = '\0';
+    return copy;
+}
+
+/**
+ * text_piece_table_get_size:
+ * @self: a #TextPieceTable
+ *
+ * Returns: the size of the text in bytes
+ */
+gsize
+text_piece_table_get_size (TextPieceTable *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->size;
+}
+
+/**
+ * text_piece_table_get_length:
+ * @self: a #TextPieceTable
+ *
+ * Returns: the length of the text in unicode characters
+ */
+gsize
+text_piece_table_get_length (TextPieceTable *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->length;
+}
+
+/**
+ * text_piece_table_skip_chars:
+ * @self: a #TextPieceTable
+ * @index: byte index to start from
+ * @n_chars: number of characters to skip
+ *
+ * Finds the byte index @n_chars characters after @index, stopping at
+ * the end of the text.
+ *
+ * Returns: the resulting byte index
+ */
+gsize
+text_piece_table_skip_chars (TextPieceTable *self,
+                             gsize           index,
+                             gsize           n_chars)
+{
+    gsize offset;
+    gsize start;
+    guint i;
+
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (index <= self->size, self->size);
+
+    i = _find (self, index, &start);
+    offset = index - start;
+
+    for (; i < self->pieces->len && n_chars > 0; i++)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+        gsize available = piece->length - offset;
+
+        if (piece->ascii)
+        {
+            gsize count = MIN (available, n_chars);
+
+            index += count;
+            n_chars -= count;
+        }
+        else
+        {
+            const char *data = _get_piece_data (self, piece) + offset;
+            const char *ptr = data;
+
+            while (ptr < data + available && n_chars > 0)
+            {
+                ptr = g_utf8_next_char (ptr);
+                n_chars--;
+            }
+
+            index += ptr - data;
+        }
+
+        offset = 0;
+    }
+
+    return index;
+}
+
+/**
+ * text_piece_table_count_chars:
+ * @self: a #TextPieceTable
+ * @index: byte index to start from
+ * @length: number of bytes to count over
+ *
+ * Counts the characters in the @length bytes starting at @index, which
+ * is the reverse of text_piece_table_skip_chars(). The range is clamped
+ * to the end of the text. Pieces known to be ASCII are counted without
+ * reading them.
+ *
+ * Returns: the number of characters
+ */
+gsize
+text_piece_table_count_chars (TextPieceTable *self,
+                              gsize           index,
+                              gsize           length)
+{
+    gsize n_chars = 0;
+    gsize offset;
+    gsize start;
+    guint i;
+
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (index <= self->size, 0);
+
+    length = MIN (length, self->size - index);
+
+    i = _find (self, index, &start);
+    offset = index - start;
+
+    for (; i < self->pieces->len && length > 0; i++)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+        gsize count = MIN (piece->length - offset, length);
+
+        n_chars += _count_chars (_get_piece_data (self, piece) + offset, count, piece->ascii);
+        length -= count;
+        offset = 0;
+    }
+
+    return n_chars;
+}
+
+/**
+ * text_piece_table_insert:
+ * @self: a #TextPieceTable
+ * @index: byte index to insert at
+ * @text: the text to insert
+ * @length: length of @text in bytes, or -1 if it is nul-terminated
+ *
+ * Inserts @text at @index, which must lie on a character boundary.
+ */
+void
+text_piece_table_insert (TextPieceTable *self,
+                         gsize           index,
+                         const char     *text,
+                         gssize          length)
+{
+    Piece piece;
+    gsize start;
+    guint i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (index <= self->size);
+    g_return_if_fail (text != NULL || length == 0);
+
+    if (length < 0)
+        length = (gssize) strlen (text);
+
+    if (length == 0)
+        return;
+
+    piece.buffer = BUFFER_ADD;
+    piece.start = self->add->len;
+    piece.length = (gsize) length;
+    piece.ascii = _is_ascii (text, piece.length);
+
+    g_string_append_len (self->add, text, length);
+    self->size += piece.length;
+    self->length += _count_chars (text, piece.length, piece.ascii);
+
+    i = _find (self, index, &start);
+
+    if (index == start && i > 0)
+    {
+        Piece *prev = &g_array_index (self->pieces, Piece, i - 1);
+
+        // When typing, the previous insertion ends right where
+        // this one begins, so the piece can simply be extended
+        if (prev->buffer == BUFFER_ADD &&
+            prev->start + prev->length == piece.start)
+        {
+            self->hint = i - 1;
+            self->hint_start = start - prev->length;
+
+            prev->length += piece.length;
+            prev->ascii = prev->ascii && piece.ascii;
+
+            _changed (self);
+            return;
+        }
+    }
+
+    if (index > start)
+    {
+        Piece *split = &g_array_index (self->pieces, Piece, i);
+        Piece right = *split;
+        gsize offset = index - start;
+
+        split->length = offset;
+        right.start += offset;
+        right.length -= offset;
+
+        g_array_insert_val (self->pieces, i + 1, right);
+
+        i++;
+        start = index;
+    }
+
+    g_array_insert_val (self->pieces, i, piece);
+
+    self->hint = i;
+    self->hint_start = start;
+
+    _changed (self);
+}
+
+/**
+ * text_piece_table_erase:
+ * @self: a #TextPieceTable
+ * @index: byte index to erase from
+ * @length: number of bytes to erase
+ *
+ * Removes @length bytes starting at @index. Both ends of the range
+ * must lie on a character boundary.
+ */
+void
+text_piece_table_erase (TextPieceTable *self,
+                        gsize           index,
+                        gsize           length)
+{
+    gsize offset;
+    gsize start;
+    guint i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (index <= self->size && length <= self->size - index);
+
+    if (length == 0)
+        return;
+
+    // The piece found is left starting at the same index
+    // whatever happens to it, so the hint remains valid
+    i = _find (self, index, &start);
+    offset = index - start;
+
+    self->size -= length;
+
+    while (length > 0)
+    {
+        Piece *piece = &g_array_index (self->pieces, Piece, i);
+        gsize count = MIN (piece->length - offset, length);
+
+        self->length -= _count_chars (_get_piece_data (self, piece) + offset, count, piece->ascii);
+        length -= count;
+
+        // No other piece refers to the end of the add buffer,
+        // so it can be reused by the next insertion
+        if (piece->buffer == BUFFER_ADD &&
+            offset + count == piece->length &&
+            piece->start + piece->length == self->add->len)
+            g_string_truncate (self->add, piece->start + offset);
+
+        if (offset == 0 && count == piece->length)
+        {
+            g_array_remove_index (self->pieces, i);
+        }
+        else if (offset == 0)
+        {
+            piece->start += count;
+            piece->length -= count;
+            i++;
+        }
+        else if (offset + count == piece->length)
+        {
+            piece->length = offset;
+            i++;
+        }
+        else
+        {
+            Piece right = *piece;
+
+            right.start += offset + count;
+            right.length -= offset + count;
+            piece->length = offset;
+
+            g_array_insert_val (self->pieces, i + 1, right);
+            i += 2;
+        }
+
+        offset = 0;
+    }
+
+    _changed (self);
+}
+
+/**
+ * text_piece_table_get_n_pieces:
+ * @self: a #TextPieceTable
+ *
+ * Returns: the number of pieces making up the text
+ */
+guint
+text_piece_table_get_n_pieces (TextPieceTable *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->pieces->len;
+}
+
+/**
+ * text_piece_table_get_piece:
+ * @self: a #TextPieceTable
+ * @n: index of the piece
+ * @length: (out): length of the piece in bytes
+ *
+ * Gets the @n-th piece of the text without copying it. Pieces are not
+ * nul-terminated.
+ *
+ * Returns: (transfer none): the start of the piece, valid until @self
+ *   is next modified
+ */
+const char *
+text_piece_table_get_piece (TextPieceTable *self,
+                            guint           n,
+                            gsize          *length)
+{
+    Piece *piece;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (n < self->pieces->len, NULL);
+    g_return_val_if_fail (length != NULL, NULL);
+
+    piece = &g_array_index (self->pieces, Piece, n);
+    *length = piece->length;
+
+    return _get_piece_data (self, piece);
+}
+
+/**
+ * text_piece_table_get_add_size:
+ * @self: a #TextPieceTable
+ *
+ * Gets the size of the buffer holding inserted text. This includes
+ * text which has since been erased but is still referenced by the add
+ * buffer, and not the space handed back by erasing at the caret.
+ *
+ * Returns: the size of the add buffer in bytes
+ */
+gsize
+text_piece_table_get_add_size (TextPieceTable *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->add->len;
+}
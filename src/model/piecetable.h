@@ -0,0 +1,41 @@
+/* piecetable.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TextPieceTable TextPieceTable;
+
+TextPieceTable *text_piece_table_new        (const char *text);
+void            text_piece_table_free       (TextPieceTable *self);
+
+void            text_piece_table_set_text   (TextPieceTable *self, const char *text);
+const char     *text_piece_table_get_text   (TextPieceTable *self);
+char           *text_piece_table_copy       (TextPieceTable *self, gsize index, gsize length);
+
+gsize           text_piece_table_get_size   (TextPieceTable *self);
+gsize           text_piece_table_get_length (TextPieceTable *self);
+gsize           text_piece_table_skip_chars (TextPieceTable *self, gsize index, gsize n_chars);
+gsize           text_piece_table_count_chars (TextPieceTable *self, gsize index, gsize length);
+
+void            text_piece_table_insert     (TextPieceTable *self, gsize index, const char *text, gssize length);
+void            text_piece_table_erase      (TextPieceTable *self, gsize index, gsize length);
+
+guint           text_piece_table_get_n_pieces (TextPieceTable *self);
+const char     *text_piece_table_get_piece    (TextPieceTable *self, guint n, gsize *length);
+gsize           text_piece_table_get_add_size (TextPieceTable *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextPieceTable, text_piece_table_free)
+
+G_END_DECLS
@@ -11,10 +11,12 @@
 
 #include "run.h"
 
+#include "piecetable.h"
+
 struct _TextRun
 {
     TextFragment parent_instance;
-    char *text;
+    TextPieceTable *text;
     gboolean is_bold;
     gboolean is_italic;
     gboolean is_underline;
@@ -44,6 +46,8 @@ text_run_finalize (GObject *object)
 {
     TextRun *self = (TextRun *)object;
 
+    g_clear_pointer (&self->text, text_piece_table_free);
+
     G_OBJECT_CLASS (text_run_parent_class)->finalize (object);
 }
 
@@ -58,7 +62,7 @@ text_run_get_property (GObject    *object,
     switch (prop_id)
     {
         case PROP_TEXT:
-            g_value_set_string (value, self->text);
+            g_value_set_string (value, text_piece_table_get_text (self->text));
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -76,9 +80,8 @@ text_run_set_property (GObject      *object,
     switch (prop_id)
     {
         case PROP_TEXT:
-            if (self->text)
-                g_free (self->text);
-            self->text = g_value_dup_string (value);
+            text_piece_table_set_text (self->text, g_value_get_string (value));
+            text_node_update_aggregates (TEXT_NODE (self));
             break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -95,7 +98,11 @@ void
 text_run_set_style_bold (TextRun  *self,
                          gboolean  is_bold)
 {
+    if (self->is_bold == is_bold)
+        return;
+
     self->is_bold = is_bold;
+    text_node_update_aggregates (TEXT_NODE (self));
 }
 
 gboolean
@@ -108,7 +115,11 @@ void
 text_run_set_style_italic (TextRun  *self,
                            gboolean  is_italic)
 {
+    if (self->is_italic == is_italic)
+        return;
+
     self->is_italic = is_italic;
+    text_node_update_aggregates (TEXT_NODE (self));
 }
 
 gboolean
@@ -121,13 +132,187 @@ void
 text_run_set_style_underline (TextRun  *self,
                               gboolean  is_underline)
 {
+    if (self->is_underline == is_underline)
+        return;
+
     self->is_underline = is_underline;
+    text_node_update_aggregates (TEXT_NODE (self));
 }
 
 const char*
 text_run_get_text (TextFragment *self)
 {
-    return (TEXT_RUN (self))->text;
+    return text_piece_table_get_text ((TEXT_RUN (self))->text);
+}
+
+/**
+ * text_run_insert_text:
+ * @self: a #TextRun
+ * @index: byte index to insert at
+ * @text: the text to insert
+ *
+ * Inserts @text into the run at @index without copying the rest of
+ * the run's text.
+ */
+void
+text_run_insert_text (TextRun    *self,
+                      int         index,
+                      const char *text)
+{
+    g_return_if_fail (TEXT_IS_RUN (self));
+    g_return_if_fail (index >= 0 && (gsize) index <= text_piece_table_get_size (self->text));
+    g_return_if_fail (text != NULL);
+
+    text_piece_table_insert (self->text, index, text, -1);
+    text_node_update_aggregates (TEXT_NODE (self));
+}
+
+/**
+ * text_run_erase_text:
+ * @self: a #TextRun
+ * @index: byte index to erase from
+ * @length: number of bytes to erase
+ *
+ * Removes @length bytes of text from the run, starting at @index.
+ */
+void
+text_run_erase_text (TextRun *self,
+                     int      index,
+                     int      length)
+{
+    g_return_if_fail (TEXT_IS_RUN (self));
+    g_return_if_fail (index >= 0 && length >= 0);
+    g_return_if_fail ((gsize) index + length <= text_piece_table_get_size (self->text));
+
+    text_piece_table_erase (self->text, index, length);
+    text_node_update_aggregates (TEXT_NODE (self));
+}
+
+/**
+ * text_run_copy_text:
+ * @self: a #TextRun
+ * @index: byte index to copy from
+ * @length: number of bytes to copy, or -1 to copy to the end of the run
+ *
+ * Copies part of the run's text.
+ *
+ * Returns: (transfer full): a newly allocated string
+ */
+char *
+text_run_copy_text (TextRun *self,
+                    int      index,
+                    int      length)
+{
+    g_return_val_if_fail (TEXT_IS_RUN (self), NULL);
+    g_return_val_if_fail (index >= 0 && (gsize) index <= text_piece_table_get_size (self->text), NULL);
+
+    return text_piece_table_copy (self->text, index, length < 0 ? G_MAXSIZE : (gsize) length);
+}
+
+/**
+ * text_run_get_index_at_offset:
+ * @self: a #TextRun
+ * @index: byte index to start from
+ * @n_chars: number of characters to move forward by
+ *
+ * Finds the byte index @n_chars characters after @index, stopping at
+ * the end of the run.
+ *
+ * Returns: the resulting byte index
+ */
+int
+text_run_get_index_at_offset (TextRun *self,
+                              int      index,
+                              int      n_chars)
+{
+    g_return_val_if_fail (TEXT_IS_RUN (self), 0);
+    g_return_val_if_fail (index >= 0 && n_chars >= 0, index);
+
+    return (int) text_piece_table_skip_chars (self->text, index, n_chars);
+}
+
+/**
+ * text_run_get_offset_at_index:
+ * @self: a #TextRun
+ * @index: a byte index within the run
+ *
+ * Counts the characters before @index, without flattening the run.
+ *
+ * Returns: the character offset of @index
+ */
+int
+text_run_get_offset_at_index (TextRun *self,
+                              int      index)
+{
+    g_return_val_if_fail (TEXT_IS_RUN (self), 0);
+    g_return_val_if_fail (index >= 0, 0);
+
+    return (int) text_piece_table_count_chars (self->text, 0, index);
+}
+
+static int
+text_run_fragment_get_offset_at_index (TextFragment *fragment,
+                                       int           byte_index)
+{
+    return text_run_get_offset_at_index (TEXT_RUN (fragment), byte_index);
+}
+
+static int
+text_run_fragment_get_index_at_offset (TextFragment *fragment,
+                                       int           offset)
+{
+    return text_run_get_index_at_offset (TEXT_RUN (fragment), 0, offset);
+}
+
+/**
+ * text_run_get_n_slices:
+ * @self: a #TextRun
+ *
+ * Gets the number of slices the run's text is stored in. Together, in
+ * order, the slices form the text of the run.
+ *
+ * Returns: the number of slices
+ */
+guint
+text_run_get_n_slices (TextRun *self)
+{
+    g_return_val_if_fail (TEXT_IS_RUN (self), 0);
+
+    return text_piece_table_get_n_pieces (self->text);
+}
+
+/**
+ * text_run_get_slice:
+ * @self: a #TextRun
+ * @n: index of the slice
+ * @length: (out): length of the slice in bytes
+ *
+ * Gets a slice of the run's text without copying or flattening it.
+ * The slice is not nul-terminated.
+ *
+ * Returns: (transfer none): the start of the slice, valid until the
+ *   run is next modified
+ */
+const char *
+text_run_get_slice (TextRun *self,
+                    guint    n,
+                    gsize   *length)
+{
+    g_return_val_if_fail (TEXT_IS_RUN (self), NULL);
+
+    return text_piece_table_get_piece (self->text, n, length);
+}
+
+static void
+text_run_measure (TextNode *node,
+                  int      *aggregates)
+{
+    TextRun *self = TEXT_RUN (node);
+
+    // Counts are kept by the piece table, so the
+    // text never needs to be flattened to measure it
+    aggregates [TEXT_ITEM_AGGREGATE_BYTES] += (int) text_piece_table_get_size (self->text);
+    aggregates [TEXT_ITEM_AGGREGATE_CHARS] += (int) text_piece_table_get_length (self->text);
 }
 
 static void
@@ -151,9 +336,14 @@ text_run_class_init (TextRunClass *klass)
     TextFragmentClass *fragment_class = TEXT_FRAGMENT_CLASS (klass);
 
     fragment_class->get_text = text_run_get_text;
+    fragment_class->get_offset_at_index = text_run_fragment_get_offset_at_index;
+    fragment_class->get_index_at_offset = text_run_fragment_get_index_at_offset;
+
+    TEXT_NODE_CLASS (klass)->measure = text_run_measure;
 }
 
 static void
 text_run_init (TextRun *self)
 {
+    self->text = text_piece_table_new (NULL);
 }
@@ -33,4 +33,13 @@ void     text_run_set_style_italic (TextRun *self, gboolean is_italic);
 gboolean text_run_get_style_underline (TextRun *self);
 void     text_run_set_style_underline (TextRun *self, gboolean is_underline);
 
+void        text_run_insert_text         (TextRun *self, int index, const char *text);
+void        text_run_erase_text          (TextRun *self, int index, int length);
+char       *text_run_copy_text           (TextRun *self, int index, int length);
+int         text_run_get_index_at_offset (TextRun *self, int index, int n_chars);
+int         text_run_get_offset_at_index (TextRun *self, int index);
+
+guint       text_run_get_n_slices        (TextRun *self);
+const char *text_run_get_slice           (TextRun *self, guint n, gsize *length);
+
 G_END_DECLS
@@ -0,0 +1,294 @@
+/* snapshot.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include "snapshot.h"
+
+#include <string.h>
+
+/*
+ * Snapshots are immutable copies of the document, taken with
+ * text_document_snapshot(). Each paragraph is copied once and
+ * shared by every snapshot taken until the paragraph changes,
+ * so taking a snapshot only copies the paragraphs edited since
+ * the last one.
+ *
+ * Nothing in a snapshot refers back to the document tree, and
+ * reference counts are atomic, so snapshots may be read and
+ * released on any thread.
+ */
+
+struct _TextSnapshot
+{
+    int ref_count;
+
+    guint generation;
+    GPtrArray *paragraphs;
+    int length;
+};
+
+struct _TextSnapshotParagraph
+{
+    int ref_count;
+
+    char *text;
+    int size;
+    int length;
+    GArray *fragments;
+};
+
+G_DEFINE_BOXED_TYPE (TextSnapshot, text_snapshot,
+                     text_snapshot_ref, text_snapshot_unref)
+
+G_DEFINE_BOXED_TYPE (TextSnapshotParagraph, text_snapshot_paragraph,
+                     text_snapshot_paragraph_ref, text_snapshot_paragraph_unref)
+
+/**
+ * text_snapshot_new:
+ * @paragraphs: (transfer full) (element-type TextSnapshotParagraph): the
+ *   paragraphs of the snapshot, freed with text_snapshot_paragraph_unref()
+ * @generation: generation of the document the snapshot was taken at
+ *
+ * Creates a snapshot. Use text_document_snapshot() instead.
+ *
+ * Returns: (transfer full): a new #TextSnapshot
+ */
+TextSnapshot *
+text_snapshot_new (GPtrArray *paragraphs,
+                   guint      generation)
+{
+    TextSnapshot *self;
+
+    g_return_val_if_fail (paragraphs != NULL, NULL);
+
+    self = g_new0 (TextSnapshot, 1);
+    self->ref_count = 1;
+    self->generation = generation;
+    self->paragraphs = paragraphs;
+
+    // Paragraph breaks count as a single character
+    for (guint i = 0; i < paragraphs->len; i++)
+        self->length += text_snapshot_paragraph_get_length (g_ptr_array_index (paragraphs, i));
+
+    self->length += MAX ((int) paragraphs->len - 1, 0);
+
+    return self;
+}
+
+TextSnapshot *
+text_snapshot_ref (TextSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+
+    g_atomic_int_inc (&self->ref_count);
+
+    return self;
+}
+
+void
+text_snapshot_unref (TextSnapshot *self)
+{
+    g_return_if_fail (self != NULL);
+
+    if (!g_atomic_int_dec_and_test (&self->ref_count))
+        return;
+
+    g_ptr_array_unref (self->paragraphs);
+    g_free (self);
+}
+
+/**
+ * text_snapshot_get_generation:
+ * @self: a #TextSnapshot
+ *
+ * Gets the generation of the document at the time @self was taken,
+ * as returned by text_document_get_generation().
+ *
+ * Returns: the generation of the document
+ */
+guint
+text_snapshot_get_generation (TextSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->generation;
+}
+
+guint
+text_snapshot_get_n_paragraphs (TextSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->paragraphs->len;
+}
+
+/**
+ * text_snapshot_get_paragraph:
+ * @self: a #TextSnapshot
+ * @n: index of the paragraph
+ *
+ * Gets a paragraph of @self. Paragraphs which are the same in two
+ * snapshots are usually shared between them, so they can be compared
+ * by address to find what changed.
+ *
+ * Returns: (transfer none): the paragraph at @n
+ */
+TextSnapshotParagraph *
+text_snapshot_get_paragraph (TextSnapshot *self,
+                             guint         n)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (n < self->paragraphs->len, NULL);
+
+    return g_ptr_array_index (self->paragraphs, n);
+}
+
+/**
+ * text_snapshot_get_length:
+ * @self: a #TextSnapshot
+ *
+ * Gets the length of @self in characters, where each paragraph break
+ * counts as a single character, as with text_document_get_length().
+ *
+ * Returns: the length of @self
+ */
+int
+text_snapshot_get_length (TextSnapshot *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->length;
+}
+
+/**
+ * text_snapshot_dump_plain_text:
+ * @self: a #TextSnapshot
+ *
+ * Gets the text of @self, with every paragraph followed by a newline,
+ * in the same form as text_editor_dump_plain_text().
+ *
+ * Returns: (transfer full): the text of @self
+ */
+char *
+text_snapshot_dump_plain_text (TextSnapshot *self)
+{
+    GString *string;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    string = g_string_sized_new (self->length + 2);
+
+    for (guint i = 0; i < self->paragraphs->len; i++)
+    {
+        TextSnapshotParagraph *paragraph = g_ptr_array_index (self->paragraphs, i);
+
+        g_string_append_len (string, paragraph->text, paragraph->size);
+        g_string_append_c (string, '\n');
+    }
+
+    return g_string_free (string, FALSE);
+}
+
+/**
+ * text_snapshot_paragraph_new:
+ * @text: the text of the paragraph
+ * @length: the length of @text in characters
+ * @fragments: (transfer full) (element-type TextSnapshotFragment): the
+ *   fragments making up @text
+ *
+ * Creates a paragraph for a snapshot. Use text_document_snapshot()
+ * instead.
+ *
+ * Returns: (transfer full): a new #TextSnapshotParagraph
+ */
+TextSnapshotParagraph *
+text_snapshot_paragraph_new (const char *text,
+                             int         length,
+                             GArray     *fragments)
+{
+    TextSnapshotParagraph *self;
+
+    g_return_val_if_fail (text != NULL, NULL);
+    g_return_val_if_fail (fragments != NULL, NULL);
+
+    self = g_new0 (TextSnapshotParagraph, 1);
+    self->ref_count = 1;
+    self->text = g_strdup (text);
+    self->size = (int) strlen (text);
+    self->length = length;
+    self->fragments = fragments;
+
+    return self;
+}
+
+TextSnapshotParagraph *
+text_snapshot_paragraph_ref (TextSnapshotParagraph *self)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+
+    g_atomic_int_inc (&self->ref_count);
+
+    return self;
+}
+
+void
+text_snapshot_paragraph_unref (TextSnapshotParagraph *self)
+{
+    g_return_if_fail (self != NULL);
+
+    if (!g_atomic_int_dec_and_test (&self->ref_count))
+        return;
+
+    g_free (self->text);
+    g_array_unref (self->fragments);
+    g_free (self);
+}
+
+const char *
+text_snapshot_paragraph_get_text (TextSnapshotParagraph *self)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+
+    return self->text;
+}
+
+int
+text_snapshot_paragraph_get_length (TextSnapshotParagraph *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->length;
+}
+
+int
+text_snapshot_paragraph_get_size_bytes (TextSnapshotParagraph *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->size;
+}
+
+guint
+text_snapshot_paragraph_get_n_fragments (TextSnapshotParagraph *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->fragments->len;
+}
+
+const TextSnapshotFragment *
+text_snapshot_paragraph_get_fragment (TextSnapshotParagraph *self,
+                                      guint                  n)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (n < self->fragments->len, NULL);
+
+    return &g_array_index (self->fragments, TextSnapshotFragment, n);
+}
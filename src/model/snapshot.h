@@ -0,0 +1,75 @@
+/* snapshot.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TEXT_TYPE_SNAPSHOT (text_snapshot_get_type ())
+#define TEXT_TYPE_SNAPSHOT_PARAGRAPH (text_snapshot_paragraph_get_type ())
+
+typedef enum
+{
+    TEXT_SNAPSHOT_RUN,
+    TEXT_SNAPSHOT_OPAQUE
+} TextSnapshotFragmentType;
+
+typedef struct _TextSnapshotFragment TextSnapshotFragment;
+
+struct _TextSnapshotFragment
+{
+    TextSnapshotFragmentType type;
+
+    // Position of the fragment within the text of its paragraph,
+    // where inline objects are a replacement character
+    int index;
+    int size;
+
+    gboolean is_bold;
+    gboolean is_italic;
+    gboolean is_underline;
+};
+
+typedef struct _TextSnapshot TextSnapshot;
+typedef struct _TextSnapshotParagraph TextSnapshotParagraph;
+
+GType                  text_snapshot_get_type                   (void) G_GNUC_CONST;
+GType                  text_snapshot_paragraph_get_type         (void) G_GNUC_CONST;
+
+TextSnapshot          *text_snapshot_ref                        (TextSnapshot *self);
+void                   text_snapshot_unref                      (TextSnapshot *self);
+
+guint                  text_snapshot_get_generation             (TextSnapshot *self);
+guint                  text_snapshot_get_n_paragraphs           (TextSnapshot *self);
+TextSnapshotParagraph *text_snapshot_get_paragraph              (TextSnapshot *self, guint n);
+int                    text_snapshot_get_length                 (TextSnapshot *self);
+char                  *text_snapshot_dump_plain_text            (TextSnapshot *self);
+
+TextSnapshotParagraph *text_snapshot_paragraph_ref              (TextSnapshotParagraph *self);
+void                   text_snapshot_paragraph_unref            (TextSnapshotParagraph *self);
+
+const char            *text_snapshot_paragraph_get_text         (TextSnapshotParagraph *self);
+int                    text_snapshot_paragraph_get_length       (TextSnapshotParagraph *self);
+int                    text_snapshot_paragraph_get_size_bytes   (TextSnapshotParagraph *self);
+guint                  text_snapshot_paragraph_get_n_fragments  (TextSnapshotParagraph *self);
+const TextSnapshotFragment *
+                       text_snapshot_paragraph_get_fragment     (TextSnapshotParagraph *self, guint n);
+
+// Implementors Only
+TextSnapshot          *text_snapshot_new                        (GPtrArray *paragraphs, guint generation);
+TextSnapshotParagraph *text_snapshot_paragraph_new              (const char *text, int length, GArray *fragments);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextSnapshot, text_snapshot_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (TextSnapshotParagraph, text_snapshot_paragraph_unref)
+
+G_END_DECLS
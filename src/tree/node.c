@@ -11,6 +11,8 @@
 
 #include "node.h"
 
+#include <string.h>
+
 typedef struct
 {
     TextNode *parent;
@@ -20,6 +22,29 @@ typedef struct
     TextNode *first_child;
     TextNode *last_child;
     int n_children;
+
+    // The children are also kept in an implicit treap ordered by
+    // position, so that they can be found by index (and vice versa)
+    // in O(log n). The linked list above remains authoritative for
+    // iteration, while the treap only tracks subtree sizes.
+    TextNode *index_root;
+    TextNode *index_left;
+    TextNode *index_right;
+    TextNode *index_up;
+    guint32 index_priority;
+    int index_size;
+
+    // Aggregates of the subtree rooted at this node, and their sum
+    // over the treap subtree (i.e. this node and some siblings)
+    int aggregates[TEXT_NODE_N_AGGREGATES];
+    int index_sums[TEXT_NODE_N_AGGREGATES];
+
+    // Bumped whenever anything in the subtree changes
+    guint generation;
+
+    // Only set on the root of an observed tree
+    TextNodeObserverFunc observer;
+    gpointer observer_data;
 } TextNodePrivate;
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (TextNode, text_node, G_TYPE_OBJECT)
@@ -48,19 +73,31 @@ static void
 text_node_dispose (GObject *object)
 {
     TextNode *iter;
+    TextNode *next;
 
     TextNode *self = (TextNode *)object;
     TextNodePrivate *priv = text_node_get_instance_private (self);
 
     for (iter = text_node_get_first_child (self);
          iter != NULL;
-         iter = text_node_get_next (iter))
+         iter = next)
     {
+        TextNodePrivate *iter_priv = text_node_get_instance_private (iter);
+
+        // Children may outlive us if referenced elsewhere (e.g. layout
+        // boxes held by their item), so sever the links before unref
+        next = iter_priv->next;
+        iter_priv->parent = NULL;
+        iter_priv->prev = NULL;
+        iter_priv->next = NULL;
+
         g_object_unref (iter);
     }
 
     priv->first_child = NULL;
     priv->last_child = NULL;
+    priv->index_root = NULL;
+    priv->n_children = 0;
 
     G_OBJECT_CLASS (text_node_parent_class)->dispose (object);
 }
@@ -146,6 +183,644 @@ text_node_get_num_children (TextNode *self)
     return priv->n_children;
 }
 
+/**
+ * text_node_get_root:
+ * @self: a #TextNode
+ *
+ * Walks up the tree to find the topmost ancestor of @self.
+ *
+ * Returns: (transfer none): the root of the tree, which is @self
+ *   if it has no parent
+ */
+TextNode *
+text_node_get_root (TextNode *self)
+{
+    TextNode *parent;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), NULL);
+
+    while ((parent = text_node_get_parent (self)) != NULL)
+        self = parent;
+
+    return self;
+}
+
+/**
+ * text_node_set_observer:
+ * @self: the root #TextNode of a tree
+ * @func: (nullable): function to call when the tree changes
+ * @user_data: data to pass to @func
+ *
+ * Installs @func to be notified whenever a child is inserted into or
+ * removed from a node anywhere below @self. Only one observer can be
+ * installed per tree; passing %NULL removes it.
+ */
+void
+text_node_set_observer (TextNode             *self,
+                        TextNodeObserverFunc  func,
+                        gpointer              user_data)
+{
+    TextNodePrivate *priv;
+
+    g_return_if_fail (TEXT_IS_NODE (self));
+
+    priv = text_node_get_instance_private (self);
+    priv->observer = func;
+    priv->observer_data = user_data;
+}
+
+static inline int
+_index_size (TextNode *node)
+{
+    if (!node)
+        return 0;
+
+    return ((TextNodePrivate *) text_node_get_instance_private (node))->index_size;
+}
+
+static inline int
+_index_sum (TextNode *node,
+            int       aggregate)
+{
+    if (!node)
+        return 0;
+
+    return ((TextNodePrivate *) text_node_get_instance_private (node))->index_sums[aggregate];
+}
+
+static void
+_index_update (TextNode *node)
+{
+    TextNodePrivate *priv;
+    int i;
+
+    priv = text_node_get_instance_private (node);
+    priv->index_size = 1 + _index_size (priv->index_left) + _index_size (priv->index_right);
+
+    for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+    {
+        priv->index_sums[i] = priv->aggregates[i]
+                            + _index_sum (priv->index_left, i)
+                            + _index_sum (priv->index_right, i);
+    }
+
+    if (priv->index_left)
+        ((TextNodePrivate *) text_node_get_instance_private (priv->index_left))->index_up = node;
+
+    if (priv->index_right)
+        ((TextNodePrivate *) text_node_get_instance_private (priv->index_right))->index_up = node;
+}
+
+// Splits the treap rooted at @node into the first @count nodes
+// and the remainder
+static void
+_index_split (TextNode  *node,
+              int        count,
+              TextNode **left,
+              TextNode **right)
+{
+    TextNodePrivate *priv;
+    int left_size;
+
+    if (!node)
+    {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+
+    priv = text_node_get_instance_private (node);
+    left_size = _index_size (priv->index_left);
+
+    if (left_size < count)
+    {
+        _index_split (priv->index_right, count - left_size - 1, &priv->index_right, right);
+        _index_update (node);
+        *left = node;
+    }
+    else
+    {
+        _index_split (priv->index_left, count, left, &priv->index_left);
+        _index_update (node);
+        *right = node;
+    }
+}
+
+static TextNode *
+_index_merge (TextNode *left,
+              TextNode *right)
+{
+    TextNodePrivate *left_priv;
+    TextNodePrivate *right_priv;
+
+    if (!left)
+        return right;
+
+    if (!right)
+        return left;
+
+    left_priv = text_node_get_instance_private (left);
+    right_priv = text_node_get_instance_private (right);
+
+    if (left_priv->index_priority > right_priv->index_priority)
+    {
+        left_priv->index_right = _index_merge (left_priv->index_right, right);
+        _index_update (left);
+        return left;
+    }
+
+    right_priv->index_left = _index_merge (left, right_priv->index_left);
+    _index_update (right);
+    return right;
+}
+
+static void
+_index_insert (TextNode *self,
+               TextNode *child,
+               int       index)
+{
+    TextNodePrivate *priv;
+    TextNodePrivate *child_priv;
+    TextNode *left;
+    TextNode *right;
+
+    priv = text_node_get_instance_private (self);
+    child_priv = text_node_get_instance_private (child);
+
+    child_priv->index_left = NULL;
+    child_priv->index_right = NULL;
+    child_priv->index_up = NULL;
+    child_priv->index_size = 1;
+    child_priv->index_priority = g_random_int ();
+    memcpy (child_priv->index_sums, child_priv->aggregates, sizeof (child_priv->aggregates));
+
+    _index_split (priv->index_root, index, &left, &right);
+    priv->index_root = _index_merge (_index_merge (left, child), right);
+
+    ((TextNodePrivate *) text_node_get_instance_private (priv->index_root))->index_up = NULL;
+}
+
+static void
+_index_remove (TextNode *self,
+               TextNode *child)
+{
+    TextNodePrivate *priv;
+    TextNodePrivate *child_priv;
+    TextNodePrivate *up_priv;
+    TextNode *merged;
+    TextNode *iter;
+    int i;
+
+    priv = text_node_get_instance_private (self);
+    child_priv = text_node_get_instance_private (child);
+
+    // Replace the child with its merged subtrees
+    merged = _index_merge (child_priv->index_left, child_priv->index_right);
+
+    if (merged)
+        ((TextNodePrivate *) text_node_get_instance_private (merged))->index_up = child_priv->index_up;
+
+    if (!child_priv->index_up)
+    {
+        priv->index_root = merged;
+    }
+    else
+    {
+        up_priv = text_node_get_instance_private (child_priv->index_up);
+
+        if (up_priv->index_left == child)
+            up_priv->index_left = merged;
+        else
+            up_priv->index_right = merged;
+    }
+
+    for (iter = child_priv->index_up; iter != NULL; iter = up_priv->index_up)
+    {
+        up_priv = text_node_get_instance_private (iter);
+        up_priv->index_size--;
+
+        for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+            up_priv->index_sums[i] -= child_priv->aggregates[i];
+    }
+
+    child_priv->index_left = NULL;
+    child_priv->index_right = NULL;
+    child_priv->index_up = NULL;
+    child_priv->index_size = 1;
+    memcpy (child_priv->index_sums, child_priv->aggregates, sizeof (child_priv->aggregates));
+}
+
+static int
+_index_rank (TextNode *child)
+{
+    TextNodePrivate *priv;
+    TextNodePrivate *up_priv;
+    TextNode *iter;
+    int rank;
+
+    priv = text_node_get_instance_private (child);
+    rank = _index_size (priv->index_left);
+
+    for (iter = child; priv->index_up != NULL; iter = priv->index_up, priv = up_priv)
+    {
+        up_priv = text_node_get_instance_private (priv->index_up);
+
+        if (up_priv->index_right == iter)
+            rank += _index_size (up_priv->index_left) + 1;
+    }
+
+    return rank;
+}
+
+static TextNode *
+_index_nth (TextNode *self,
+            int       index)
+{
+    TextNodePrivate *priv;
+    TextNode *node;
+    int left_size;
+
+    priv = text_node_get_instance_private (self);
+    node = priv->index_root;
+
+    while (node)
+    {
+        priv = text_node_get_instance_private (node);
+        left_size = _index_size (priv->index_left);
+
+        if (index < left_size)
+        {
+            node = priv->index_left;
+        }
+        else if (index == left_size)
+        {
+            return node;
+        }
+        else
+        {
+            index -= left_size + 1;
+            node = priv->index_right;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * text_node_get_nth_child:
+ * @self: a #TextNode
+ * @index: position of the child
+ *
+ * Gets the child of @self at @index in O(log n).
+ *
+ * Returns: (transfer none) (nullable): the child at @index, or %NULL
+ *   if @index is out of range
+ */
+TextNode *
+text_node_get_nth_child (TextNode *self,
+                         int       index)
+{
+    TextNodePrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), NULL);
+
+    priv = text_node_get_instance_private (self);
+
+    if (index < 0 || index >= priv->n_children)
+        return NULL;
+
+    return _index_nth (self, index);
+}
+
+/**
+ * text_node_get_index:
+ * @self: a #TextNode
+ *
+ * Gets the position of @self among its siblings in O(log n).
+ *
+ * Returns: the index of @self within its parent, or -1 if it
+ *   has no parent
+ */
+int
+text_node_get_index (TextNode *self)
+{
+    g_return_val_if_fail (TEXT_IS_NODE (self), -1);
+
+    if (text_node_get_parent (self) == NULL)
+        return -1;
+
+    return _index_rank (self);
+}
+
+// Marks @node and all of its ancestors as changed
+static void
+_bump_generation (TextNode *node)
+{
+    TextNodePrivate *priv;
+
+    for (; node != NULL; node = priv->parent)
+    {
+        priv = text_node_get_instance_private (node);
+        priv->generation++;
+    }
+}
+
+// Adds @delta to the aggregates of @node and all of its ancestors
+static void
+_propagate_aggregates (TextNode  *node,
+                       const int *delta)
+{
+    TextNodePrivate *priv;
+    TextNode *iter;
+    int i;
+
+    for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+    {
+        if (delta[i] != 0)
+            break;
+    }
+
+    if (i == TEXT_NODE_N_AGGREGATES)
+        return;
+
+    for (; node != NULL; node = priv->parent)
+    {
+        priv = text_node_get_instance_private (node);
+
+        for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+        {
+            priv->aggregates[i] += delta[i];
+            priv->index_sums[i] += delta[i];
+        }
+
+        // The sums of the siblings above us in the treap also change
+        for (iter = priv->index_up; iter != NULL; )
+        {
+            TextNodePrivate *iter_priv = text_node_get_instance_private (iter);
+
+            for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+                iter_priv->index_sums[i] += delta[i];
+
+            iter = iter_priv->index_up;
+        }
+    }
+}
+
+/**
+ * text_node_update_aggregates:
+ * @self: a #TextNode
+ *
+ * Re-measures the contribution of @self to its aggregates, using
+ * the #TextNodeClass.measure virtual function, and updates all of
+ * its ancestors accordingly. Subclasses must call this whenever
+ * their own contribution changes, for example when text is modified.
+ * This also bumps the generation of @self and its ancestors, so it
+ * should be called on any change to the content of @self even if its
+ * measurements stay the same. This takes O(depth * log n) time.
+ */
+void
+text_node_update_aggregates (TextNode *self)
+{
+    TextNodeClass *klass;
+    TextNodePrivate *priv;
+    TextNode *child;
+    int own[TEXT_NODE_N_AGGREGATES] = { 0 };
+    int delta[TEXT_NODE_N_AGGREGATES];
+    int i;
+
+    g_return_if_fail (TEXT_IS_NODE (self));
+
+    _bump_generation (self);
+
+    klass = TEXT_NODE_GET_CLASS (self);
+
+    if (!klass->measure)
+        return;
+
+    priv = text_node_get_instance_private (self);
+    klass->measure (self, own);
+
+    // Our previous contribution is whatever the children do not account for
+    for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+        delta[i] = own[i] - priv->aggregates[i];
+
+    for (child = priv->first_child; child != NULL; child = text_node_get_next (child))
+    {
+        TextNodePrivate *child_priv = text_node_get_instance_private (child);
+
+        for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+            delta[i] += child_priv->aggregates[i];
+    }
+
+    _propagate_aggregates (self, delta);
+}
+
+/**
+ * text_node_get_aggregate:
+ * @self: a #TextNode
+ * @aggregate: index of the aggregate
+ *
+ * Gets the value of @aggregate summed over the subtree rooted at
+ * @self, in O(1). The meaning of each aggregate is defined by the
+ * subclasses supplying it.
+ *
+ * Returns: the value of the aggregate
+ */
+int
+text_node_get_aggregate (TextNode *self,
+                         int       aggregate)
+{
+    TextNodePrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), 0);
+    g_return_val_if_fail (aggregate >= 0 && aggregate < TEXT_NODE_N_AGGREGATES, 0);
+
+    priv = text_node_get_instance_private (self);
+    return priv->aggregates[aggregate];
+}
+
+/**
+ * text_node_get_generation:
+ * @self: a #TextNode
+ *
+ * Gets a counter which changes whenever @self or any of its
+ * descendants is modified, or children are inserted or removed
+ * anywhere in the subtree. Caches derived from the contents of
+ * @self can compare it against the value they were built with.
+ *
+ * Returns: the generation of @self
+ */
+guint
+text_node_get_generation (TextNode *self)
+{
+    TextNodePrivate *priv;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), 0);
+
+    priv = text_node_get_instance_private (self);
+    return priv->generation;
+}
+
+/**
+ * text_node_get_offset:
+ * @self: a #TextNode
+ * @aggregate: index of the aggregate
+ *
+ * Gets the sum of @aggregate over every node which comes before
+ * @self in the tree, not counting its ancestors. For example, this
+ * is the position of @self in the text when the aggregate counts
+ * characters. This takes O(depth * log n) time.
+ *
+ * Returns: the offset of @self
+ */
+int
+text_node_get_offset (TextNode *self,
+                      int       aggregate)
+{
+    TextNodePrivate *priv;
+    TextNodePrivate *up_priv;
+    TextNode *node;
+    TextNode *iter;
+    int offset;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), 0);
+    g_return_val_if_fail (aggregate >= 0 && aggregate < TEXT_NODE_N_AGGREGATES, 0);
+
+    offset = 0;
+
+    for (node = self; text_node_get_parent (node) != NULL; node = text_node_get_parent (node))
+    {
+        // Sum the preceding siblings using the treap
+        priv = text_node_get_instance_private (node);
+        offset += _index_sum (priv->index_left, aggregate);
+
+        for (iter = node; priv->index_up != NULL; iter = priv->index_up, priv = up_priv)
+        {
+            up_priv = text_node_get_instance_private (priv->index_up);
+
+            if (up_priv->index_right == iter)
+                offset += up_priv->aggregates[aggregate] + _index_sum (up_priv->index_left, aggregate);
+        }
+    }
+
+    return offset;
+}
+
+static inline int
+_weigh (const int *values,
+        const int *weights)
+{
+    int total;
+    int i;
+
+    total = 0;
+
+    for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+        total += values[i] * weights[i];
+
+    return total;
+}
+
+/**
+ * text_node_find_child:
+ * @self: a #TextNode
+ * @weights: weight of each aggregate
+ * @offset: (inout): offset to search for, which is replaced by the
+ *   offset relative to the start of the returned child
+ * @preceding: (out caller-allocates) (optional): array which receives
+ *   the aggregates of the siblings before the returned child
+ *
+ * Finds the child of @self which contains @offset, where offsets are
+ * measured as the weighted sum of the aggregates. For example, giving
+ * a weight of one to a character count searches by character offset.
+ * This takes O(log n) time.
+ *
+ * Returns: (transfer none) (nullable): the child containing @offset,
+ *   or %NULL if @offset is out of range
+ */
+TextNode *
+text_node_find_child (TextNode  *self,
+                      const int *weights,
+                      int       *offset,
+                      int       *preceding)
+{
+    TextNodePrivate *priv;
+    TextNode *node;
+    int before[TEXT_NODE_N_AGGREGATES] = { 0 };
+    int remaining;
+    int weight;
+    int i;
+
+    g_return_val_if_fail (TEXT_IS_NODE (self), NULL);
+    g_return_val_if_fail (weights != NULL, NULL);
+    g_return_val_if_fail (offset != NULL, NULL);
+
+    priv = text_node_get_instance_private (self);
+    node = priv->index_root;
+    remaining = *offset;
+
+    if (remaining < 0)
+        return NULL;
+
+    while (node)
+    {
+        priv = text_node_get_instance_private (node);
+
+        if (priv->index_left)
+        {
+            TextNodePrivate *left_priv = text_node_get_instance_private (priv->index_left);
+
+            weight = _weigh (left_priv->index_sums, weights);
+
+            if (remaining < weight)
+            {
+                node = priv->index_left;
+                continue;
+            }
+
+            remaining -= weight;
+
+            for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+                before[i] += left_priv->index_sums[i];
+        }
+
+        weight = _weigh (priv->aggregates, weights);
+
+        if (remaining < weight)
+        {
+            *offset = remaining;
+
+            if (preceding)
+                memcpy (preceding, before, sizeof (before));
+
+            return node;
+        }
+
+        remaining -= weight;
+
+        for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+            before[i] += priv->aggregates[i];
+
+        node = priv->index_right;
+    }
+
+    return NULL;
+}
+
+static void
+_notify_observer (TextNode *parent,
+                  TextNode *child,
+                  int       index,
+                  gboolean  inserted)
+{
+    TextNodePrivate *root_priv;
+
+    root_priv = text_node_get_instance_private (text_node_get_root (parent));
+
+    if (root_priv->observer)
+        root_priv->observer (parent, child, index, inserted, root_priv->observer_data);
+}
+
 static void
 _insert_between (TextNode *parent,
                  TextNode *node,
@@ -178,22 +853,10 @@ static int
 _get_index_of (TextNode *self,
                TextNode *child)
 {
-    TextNode *iter;
-    int index;
-
-    index = 0;
-
-    for (iter = text_node_get_first_child (self);
-         iter != NULL;
-         iter = text_node_get_next (iter))
-    {
-        if (iter == child)
-            return index;
+    if (text_node_get_parent (child) != self)
+        return -1;
 
-        index++;
-    }
-
-    return -1;
+    return _index_rank (child);
 }
 
 void
@@ -201,7 +864,6 @@ text_node_insert_child (TextNode *self,
                         TextNode *child,
                         int       index)
 {
-    int cmp_index;
     TextNode *before, *after, *iter;
     TextNodePrivate *priv, *child_priv, *before_priv, *after_priv;
 
@@ -212,6 +874,10 @@ text_node_insert_child (TextNode *self,
 
     g_object_ref_sink (child);
 
+    _index_insert (self, child, index);
+    _propagate_aggregates (self, child_priv->aggregates);
+    _bump_generation (self);
+
     // No children
     if (priv->n_children == 0)
     {
@@ -221,6 +887,7 @@ text_node_insert_child (TextNode *self,
 
         // TODO: Weak reference?
         child_priv->parent = self;
+        _notify_observer (self, child, index, TRUE);
         return;
     }
 
@@ -240,6 +907,7 @@ text_node_insert_child (TextNode *self,
 
         // TODO: Weak reference?
         child_priv->parent = self;
+        _notify_observer (self, child, index, TRUE);
         return;
     }
 
@@ -259,20 +927,17 @@ text_node_insert_child (TextNode *self,
 
         // TODO: Weak reference?
         child_priv->parent = self;
+        _notify_observer (self, child, index, TRUE);
         return;
     }
 
     // Insert (At Index)
-    cmp_index = 0;
-    iter = text_node_get_first_child (self);
-
-    while (++cmp_index < index) {
-        iter = text_node_get_next (iter);
-        g_assert (iter != NULL);
-    }
+    iter = _index_nth (self, index - 1);
+    g_assert (iter != NULL);
 
     // Insert between index-1 and index
     _insert_between (self, child, iter, text_node_get_next (iter));
+    _notify_observer (self, child, index, TRUE);
 }
 
 void
@@ -305,13 +970,6 @@ text_node_insert_child_before (TextNode *self,
         return;
     }
 
-    if ((index - 1) == 0)
-    {
-        g_object_ref_sink (child);
-        text_node_prepend_child (self, child);
-        return;
-    }
-
     text_node_insert_child (self, child, index);
 }
 
@@ -337,47 +995,58 @@ TextNode *
 text_node_unparent_child (TextNode *self,
                           TextNode *child)
 {
-    TextNode *iter;
-    TextNodePrivate *iter_priv;
+    TextNodePrivate *child_priv;
     TextNodePrivate *other_priv;
     TextNodePrivate *parent_priv;
+    int removed[TEXT_NODE_N_AGGREGATES];
+    int index;
+    int i;
 
     g_return_val_if_fail (child != NULL, NULL);
     g_return_val_if_fail (TEXT_IS_NODE (child), NULL);
     g_return_val_if_fail (TEXT_IS_NODE (self), NULL);
 
-    for (iter = text_node_get_first_child (self);
-         iter != NULL;
-         iter = text_node_get_next (iter))
-    {
-        if (iter != child)
-            continue;
-
-        iter_priv = text_node_get_instance_private (iter);
-        parent_priv = text_node_get_instance_private (self);
-
-        if (iter_priv->prev) {
-            other_priv = text_node_get_instance_private (iter_priv->prev);
-            other_priv->next = iter_priv->next;
-        } else {
-            // we are the first child
-            parent_priv->first_child = iter_priv->next;
-        }
+    child_priv = text_node_get_instance_private (child);
+    parent_priv = text_node_get_instance_private (self);
 
-        if (iter_priv->next) {
-            other_priv = text_node_get_instance_private (iter_priv->next);
-            other_priv->prev = iter_priv->prev;
-        } else {
-            // we are the last child
-            parent_priv->last_child = iter_priv->prev;
-        }
+    if (child_priv->parent != self)
+        return NULL;
+
+    index = _index_rank (child);
+    _index_remove (self, child);
 
-        parent_priv->n_children--;
+    for (i = 0; i < TEXT_NODE_N_AGGREGATES; i++)
+        removed[i] = -child_priv->aggregates[i];
 
-        return iter;
+    _propagate_aggregates (self, removed);
+    _bump_generation (self);
+
+    if (child_priv->prev) {
+        other_priv = text_node_get_instance_private (child_priv->prev);
+        other_priv->next = child_priv->next;
+    } else {
+        // we are the first child
+        parent_priv->first_child = child_priv->next;
     }
 
-    return NULL;
+    if (child_priv->next) {
+        other_priv = text_node_get_instance_private (child_priv->next);
+        other_priv->prev = child_priv->prev;
+    } else {
+        // we are the last child
+        parent_priv->last_child = child_priv->prev;
+    }
+
+    parent_priv->n_children--;
+
+    // The node is no longer part of the tree
+    child_priv->parent = NULL;
+    child_priv->prev = NULL;
+    child_priv->next = NULL;
+
+    _notify_observer (self, child, index, FALSE);
+
+    return child;
 }
 
 TextNode *
@@ -442,11 +1111,21 @@ text_node_clear (TextNode **self)
     *self = NULL;
 }
 
+static void
+text_node_constructed (GObject *object)
+{
+    // Measure nodes which have no construct properties to do so
+    text_node_update_aggregates (TEXT_NODE (object));
+
+    G_OBJECT_CLASS (text_node_parent_class)->constructed (object);
+}
+
 static void
 text_node_class_init (TextNodeClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+    object_class->constructed = text_node_constructed;
     object_class->finalize = text_node_finalize;
     object_class->dispose = text_node_dispose;
     object_class->get_property = text_node_get_property;
@@ -460,4 +1139,5 @@ text_node_init (TextNode *self)
     priv->first_child = NULL;
     priv->last_child = NULL;
     priv->n_children = 0;
+    priv->index_size = 1;
 }
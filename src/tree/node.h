@@ -19,11 +19,37 @@ G_BEGIN_DECLS
 
 G_DECLARE_DERIVABLE_TYPE (TextNode, text_node, TEXT, NODE, GObject)
 
+// Number of aggregate slots kept for every subtree. The meaning
+// of each slot is assigned by the subclasses which supply them.
+#define TEXT_NODE_N_AGGREGATES 4
+
 struct _TextNodeClass
 {
     GObjectClass parent_class;
+
+    // Adds the node's own contribution to each aggregate (not
+    // including its children) to @aggregates
+    void (*measure) (TextNode *self,
+                     int      *aggregates);
 };
 
+/**
+ * TextNodeObserverFunc:
+ * @parent: the node whose children changed
+ * @child: the inserted or removed child
+ * @index: position of @child within @parent
+ * @inserted: %TRUE if @child was inserted, %FALSE if it was removed
+ * @user_data: data passed to text_node_set_observer()
+ *
+ * Called after a child is inserted into or removed from any node in
+ * the tree the observer is installed on.
+ */
+typedef void (*TextNodeObserverFunc) (TextNode *parent,
+                                      TextNode *child,
+                                      int       index,
+                                      gboolean  inserted,
+                                      gpointer  user_data);
+
 // Implementors Only
 TextNode *text_node_get_parent          (TextNode *self);
 TextNode *text_node_get_next            (TextNode *self);
@@ -31,6 +57,9 @@ TextNode *text_node_get_previous        (TextNode *self);
 TextNode *text_node_get_first_child     (TextNode *self);
 TextNode *text_node_get_last_child      (TextNode *self);
 int       text_node_get_num_children    (TextNode *self);
+TextNode *text_node_get_root            (TextNode *self);
+TextNode *text_node_get_nth_child       (TextNode *self, int index);
+int       text_node_get_index           (TextNode *self);
 
 void      text_node_insert_child        (TextNode *self, TextNode *child, int index);
 void      text_node_prepend_child       (TextNode *self, TextNode *child);
@@ -45,4 +74,12 @@ void      text_node_delete_child        (TextNode *self, TextNode *child);
 void      text_node_clear               (TextNode **self);
 void      text_node_clear_child         (TextNode *self, TextNode **child);
 
+void      text_node_set_observer        (TextNode *self, TextNodeObserverFunc func, gpointer user_data);
+
+int       text_node_get_aggregate       (TextNode *self, int aggregate);
+int       text_node_get_offset          (TextNode *self, int aggregate);
+TextNode *text_node_find_child          (TextNode *self, const int *weights, int *offset, int *preceding);
+void      text_node_update_aggregates   (TextNode *self);
+guint     text_node_get_generation      (TextNode *self);
+
 G_END_DECLS
@@ -13,10 +13,19 @@
 
 #include "../model/mark.h"
 #include "../model/paragraph.h"
+#include "../model/opaque.h"
 #include "../layout/layout.h"
 #include "../model/document.h"
 #include "../editor/editor.h"
 
+#define MEASURE_CACHE_SIZE 4
+
+typedef struct
+{
+    int width;
+    int height;
+} MeasureEntry;
+
 struct _TextDisplay
 {
     GtkWidget parent_instance;
@@ -26,6 +35,44 @@ struct _TextDisplay
     TextLayout *layout;
     TextNode *layout_tree;
 
+    // Set when the structure of the document has changed
+    // and the layout tree must be reconciled with it
+    gboolean layout_tree_invalid;
+
+    // Set when paragraphs have been marked as dirty
+    gboolean layout_tree_dirty;
+
+    // Width and document generation the layout tree was last laid
+    // out for. Reused as-is while neither of them changes.
+    int layout_width;
+    guint layout_generation;
+
+    // Generation of the document's tree, which also changes when
+    // runs are restyled without going through the editor
+    guint layout_style_generation;
+
+    // Serial of the pango context the tree was shaped with, which
+    // changes along with the font, resolution and font options
+    guint layout_context_serial;
+
+    // Viewport the layout tree was last laid out for, which
+    // matters while lazy layout has left blocks unshaped
+    double layout_viewport_y;
+    double layout_viewport_height;
+
+    // Tick callback continuing a time-sliced layout
+    guint layout_tick_id;
+
+    // Heights measured for recent widths. Valid while the document
+    // generation, the styles of its runs and the font all match.
+    MeasureEntry measure_cache[MEASURE_CACHE_SIZE];
+    int n_measured;
+    int next_measured;
+    guint measure_generation;
+    guint measure_style_generation;
+    guint measure_context_serial;
+    PangoFontDescription *measure_font;
+
     GtkIMContext *context;
 
     TextMark *cursor;
@@ -36,6 +83,13 @@ struct _TextDisplay
     int margin_top;
     int margin_bottom;
 
+    // Extra distance around the viewport which is still drawn
+    int overscan;
+
+    // Set when the cursor should be scrolled into view
+    // during the next allocation
+    gboolean scroll_to_cursor;
+
     // Scrollable
     GtkAdjustment *hadjustment;
     GtkAdjustment *vadjustment;
@@ -53,6 +107,7 @@ enum {
     PROP_MARGIN_END,
     PROP_MARGIN_TOP,
     PROP_MARGIN_BOTTOM,
+    PROP_OVERSCAN,
     N_PROPS,
 
     // Overridden Properties
@@ -64,6 +119,8 @@ enum {
 
 static GParamSpec *properties [N_PROPS];
 
+static void _document_changed (TextDisplay *self, GPtrArray *changes);
+
 /**
  * text_display_new:
  * @document: The #TextDocument to display or %NULL
@@ -81,11 +138,40 @@ text_display_new (TextDocument *document)
                          NULL);
 }
 
+/**
+ * text_display_get_layout:
+ * @self: a #TextDisplay
+ *
+ * Gets the #TextLayout used to lay out the document, which can be used
+ * to configure layout behaviour such as lazy shaping.
+ *
+ * Returns: (transfer none): the #TextLayout of @self
+ */
+TextLayout *
+text_display_get_layout (TextDisplay *self)
+{
+    g_return_val_if_fail (TEXT_IS_DISPLAY (self), NULL);
+
+    return self->layout;
+}
+
+static void
+_vadjustment_value_changed (TextDisplay *self)
+{
+    // Blocks which were only estimated may have scrolled into view
+    if (text_layout_has_estimates (self->layout))
+        gtk_widget_queue_allocate (GTK_WIDGET (self));
+
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
 static void
 text_display_finalize (GObject *object)
 {
     TextDisplay *self = (TextDisplay *)object;
 
+    g_clear_pointer (&self->measure_font, pango_font_description_free);
+
     G_OBJECT_CLASS (text_display_parent_class)->finalize (object);
 }
 
@@ -119,6 +205,10 @@ text_display_get_property (GObject    *object,
         g_value_set_int (value, self->margin_bottom);
         break;
 
+    case PROP_OVERSCAN:
+        g_value_set_int (value, self->overscan);
+        break;
+
     case PROP_HADJUSTMENT:
         g_value_set_object (value, self->hadjustment);
         break;
@@ -155,7 +245,11 @@ text_display_set_property (GObject      *object,
     case PROP_DOCUMENT:
         if (self->layout_tree)
             text_node_clear (&self->layout_tree);
+        if (self->document)
+            g_signal_handlers_disconnect_by_func (self->document->journal, _document_changed, self);
         self->document = g_value_get_object (value);
+        self->layout_tree_invalid = TRUE;
+        self->n_measured = 0;
 
         if (self->document)
         {
@@ -164,6 +258,11 @@ text_display_set_property (GObject      *object,
 
             self->editor = text_editor_new (self->document);
             text_editor_move_first (self->editor, TEXT_EDITOR_CURSOR);
+
+            // Edits are reported once they are complete, so the layout
+            // only needs to be updated for what actually changed
+            g_signal_connect_object (text_document_get_journal (self->document), "changed",
+                                     G_CALLBACK (_document_changed), self, G_CONNECT_SWAPPED);
         }
         break;
 
@@ -187,6 +286,11 @@ text_display_set_property (GObject      *object,
         gtk_widget_queue_allocate (GTK_WIDGET (self));
         break;
 
+    case PROP_OVERSCAN:
+        self->overscan = g_value_get_int (value);
+        gtk_widget_queue_draw (GTK_WIDGET (self));
+        break;
+
     case PROP_HADJUSTMENT:
         adj = g_value_get_object (value);
         if (adj)
@@ -202,7 +306,7 @@ text_display_set_property (GObject      *object,
         if (adj)
         {
             self->vadjustment = g_object_ref_sink (adj);
-            g_signal_connect_swapped (self->vadjustment, "value-changed", G_CALLBACK (gtk_widget_queue_draw), self);
+            g_signal_connect_swapped (self->vadjustment, "value-changed", G_CALLBACK (_vadjustment_value_changed), self);
         }
         gtk_widget_queue_allocate (GTK_WIDGET (self));
         break;
@@ -224,33 +328,366 @@ text_display_set_property (GObject      *object,
 static void
 _rebuild_layout_tree (TextDisplay *self, int width)
 {
+    TextNode *layout_tree;
+
     g_info ("Rebuilding layout tree\n");
 
+    // Reuses the boxes of the previous tree where possible
+    layout_tree = TEXT_NODE (text_layout_build_layout_tree (self->layout,
+                                                            gtk_widget_get_pango_context (GTK_WIDGET (self)),
+                                                            self->document->frame,
+                                                            width));
+
     if (self->layout_tree)
         text_node_clear (&self->layout_tree);
 
-    self->layout_tree = TEXT_NODE (text_layout_build_layout_tree (self->layout,
-                                                                  gtk_widget_get_pango_context (GTK_WIDGET (self)),
-                                                                  self->document->frame,
-                                                                  width));
+    self->layout_tree = layout_tree;
+    self->layout_tree_invalid = FALSE;
 }
 
 static void
-draw_box_recursive (GtkWidget     *widget,
-                    TextLayoutBox *layout_box,
-                    GtkSnapshot   *snapshot,
-                    GdkRGBA       *fg_color,
-                    int           *delta_height);
+_mark_tree_dirty (TextNode *node)
+{
+    TextNode *iter;
+
+    for (iter = text_node_get_first_child (node); iter != NULL; iter = text_node_get_next (iter))
+        _mark_tree_dirty (iter);
+
+    text_layout_box_mark_dirty (TEXT_LAYOUT_BOX (node));
+}
 
 static void
-draw_block (GtkWidget     *widget,
-            TextLayoutBox *layout_box,
-            GtkSnapshot   *snapshot,
-            GdkRGBA       *fg_color,
-            int           *delta_height)
+_update_layout_tree (TextDisplay *self, int width)
+{
+    PangoContext *context;
+    guint generation;
+    guint style_generation;
+    guint context_serial;
+    double viewport_y;
+    double viewport_height;
+    gboolean viewport_changed;
+
+    context = gtk_widget_get_pango_context (GTK_WIDGET (self));
+    generation = text_document_get_generation (self->document);
+    style_generation = text_node_get_generation (TEXT_NODE (self->document->frame));
+    context_serial = pango_context_get_serial (context);
+
+    // Every block was shaped with the old font
+    if (self->layout_tree && self->layout_context_serial != context_serial)
+    {
+        _mark_tree_dirty (self->layout_tree);
+        self->layout_tree_dirty = TRUE;
+    }
+
+    self->layout_context_serial = context_serial;
+
+    viewport_y = (self->vadjustment ? gtk_adjustment_get_value (self->vadjustment) : 0) - self->margin_top;
+    viewport_height = gtk_widget_get_height (GTK_WIDGET (self));
+
+    // Only relevant if there are unshaped blocks left to shape
+    viewport_changed = text_layout_has_estimates (self->layout) &&
+                       (self->layout_viewport_y != viewport_y ||
+                        self->layout_viewport_height != viewport_height);
+
+    // Already laid out for this width and document
+    if (self->layout_tree &&
+        !self->layout_tree_invalid &&
+        !self->layout_tree_dirty &&
+        !viewport_changed &&
+        self->layout_width == width &&
+        self->layout_generation == generation &&
+        self->layout_style_generation == style_generation)
+        return;
+
+    self->layout_width = width;
+    self->layout_generation = generation;
+    self->layout_style_generation = style_generation;
+    self->layout_tree_dirty = FALSE;
+
+    self->layout_viewport_y = viewport_y;
+    self->layout_viewport_height = viewport_height;
+    text_layout_set_viewport (self->layout, viewport_y, viewport_height);
+
+    // Structural changes require the tree to be reconciled with the
+    // document, otherwise only the paragraphs marked as dirty are
+    // re-shaped. In both cases, clean paragraphs keep their shaping.
+    if (!self->layout_tree || self->layout_tree_invalid)
+    {
+        _rebuild_layout_tree (self, width);
+        return;
+    }
+
+    text_layout_relayout (self->layout,
+                          context,
+                          TEXT_LAYOUT_BOX (self->layout_tree),
+                          width);
+}
+
+static void
+_invalidate_measure_cache (TextDisplay *self)
+{
+    self->n_measured = 0;
+    self->next_measured = 0;
+}
+
+static gboolean
+_font_equal (const PangoFontDescription *a,
+             const PangoFontDescription *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return pango_font_description_equal (a, b);
+}
+
+static gboolean
+_lookup_measure_cache (TextDisplay *self,
+                       int          width,
+                       int         *height)
+{
+    PangoContext *context;
+    const PangoFontDescription *font;
+    guint generation;
+    guint style_generation;
+    guint context_serial;
+    int i;
+
+    context = gtk_widget_get_pango_context (GTK_WIDGET (self));
+    font = pango_context_get_font_description (context);
+    generation = text_document_get_generation (self->document);
+    context_serial = pango_context_get_serial (context);
+
+    // Runs can be restyled without going through the editor, which
+    // only shows up in the generation of the tree they belong to
+    style_generation = text_node_get_generation (TEXT_NODE (self->document->frame));
+
+    if (self->measure_generation != generation ||
+        self->measure_style_generation != style_generation ||
+        self->measure_context_serial != context_serial ||
+        !_font_equal (self->measure_font, font))
+    {
+        _invalidate_measure_cache (self);
+        self->measure_generation = generation;
+        self->measure_style_generation = style_generation;
+        self->measure_context_serial = context_serial;
+
+        g_clear_pointer (&self->measure_font, pango_font_description_free);
+        self->measure_font = font ? pango_font_description_copy (font) : NULL;
+
+        return FALSE;
+    }
+
+    for (i = 0; i < self->n_measured; i++)
+    {
+        if (self->measure_cache[i].width == width)
+        {
+            *height = self->measure_cache[i].height;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_store_measure_cache (TextDisplay *self,
+                      int          width,
+                      int          height)
+{
+    // Replace the oldest entry once full
+    self->measure_cache[self->next_measured].width = width;
+    self->measure_cache[self->next_measured].height = height;
+
+    self->next_measured = (self->next_measured + 1) % MEASURE_CACHE_SIZE;
+    self->n_measured = MIN (self->n_measured + 1, MEASURE_CACHE_SIZE);
+}
+
+static void
+_invalidate_layout_tree (TextDisplay *self)
+{
+    self->layout_tree_invalid = TRUE;
+    _invalidate_measure_cache (self);
+}
+
+static gboolean
+_layout_tick (GtkWidget     *widget,
+              GdkFrameClock *frame_clock,
+              gpointer       user_data)
+{
+    TextDisplay *self = TEXT_DISPLAY (widget);
+
+    if (!text_layout_has_pending_work (self->layout))
+    {
+        self->layout_tick_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    // Continue the layout job during the next allocation, which
+    // also updates the scrollbar with the new heights
+    self->layout_tree_dirty = TRUE;
+    _invalidate_measure_cache (self);
+    gtk_widget_queue_allocate (widget);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_schedule_layout_job (TextDisplay *self)
+{
+    // Spread the remaining work over the following frames
+    if (text_layout_has_pending_work (self->layout) && !self->layout_tick_id)
+        self->layout_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (self), _layout_tick, NULL, NULL);
+}
+
+static void
+_invalidate_paragraph (TextDisplay   *self,
+                       TextParagraph *paragraph)
+{
+    if (!TEXT_IS_PARAGRAPH (paragraph) ||
+        !TEXT_IS_LAYOUT_BOX (text_item_get_attachment (TEXT_ITEM (paragraph))))
+    {
+        _invalidate_layout_tree (self);
+        return;
+    }
+
+    text_layout_mark_dirty (self->layout, TEXT_ITEM (paragraph));
+    self->layout_tree_dirty = TRUE;
+    _invalidate_measure_cache (self);
+}
+
+// Blocks away from the viewport may only have an estimated height and
+// no layout (see lazy layout). They are shaped when something needs to
+// know where their text is, then positioned on the next allocation.
+static PangoLayout *
+_ensure_pango_layout (TextDisplay     *self,
+                      TextLayoutBlock *block)
+{
+    if (!text_layout_block_is_shaped (block))
+    {
+        self->layout_tree_dirty = TRUE;
+        _invalidate_measure_cache (self);
+        gtk_widget_queue_allocate (GTK_WIDGET (self));
+    }
+
+    return text_layout_block_ensure_pango_layout (block, gtk_widget_get_pango_context (GTK_WIDGET (self)));
+}
+
+static void
+_document_changed (TextDisplay *self,
+                   GPtrArray   *changes)
+{
+    g_autoptr (GHashTable) dirty = NULL;
+    gboolean tree_invalid = FALSE;
+    guint i;
+
+    // A transaction may report many changes to the same paragraph,
+    // so each one is only invalidated once per batch
+    dirty = g_hash_table_new (NULL, NULL);
+
+    for (i = 0; i < changes->len; i++)
+    {
+        TextChange *change = g_ptr_array_index (changes, i);
+        TextParagraph *paragraph;
+
+        if (!TEXT_IS_PARAGRAPH (change->parent))
+        {
+            if (change->type == TEXT_CHANGE_CHILD_INSERTED ||
+                change->type == TEXT_CHANGE_CHILD_REMOVED)
+                tree_invalid = TRUE;
+            continue;
+        }
+
+        paragraph = TEXT_PARAGRAPH (change->parent);
+
+        switch (change->type)
+        {
+        case TEXT_CHANGE_TEXT_INSERTED:
+        case TEXT_CHANGE_TEXT_DELETED:
+        case TEXT_CHANGE_STYLE_CHANGED:
+            // Runs are shaped as part of their paragraph
+            break;
+
+        case TEXT_CHANGE_CHILD_INSERTED:
+        case TEXT_CHANGE_CHILD_REMOVED:
+            // Inline objects have their own layout box, but runs
+            // are only part of their paragraph's contents
+            if (!TEXT_IS_RUN (change->node))
+                tree_invalid = TRUE;
+            break;
+        }
+
+        if (g_hash_table_add (dirty, paragraph))
+            _invalidate_paragraph (self, paragraph);
+    }
+
+    if (tree_invalid)
+        _invalidate_layout_tree (self);
+
+    gtk_widget_queue_allocate (GTK_WIDGET (self));
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+typedef struct
+{
+    GskRenderNode *node;
+    GdkRGBA color;
+} TextRenderCache;
+
+static void
+_render_cache_free (gpointer data)
+{
+    TextRenderCache *cache = data;
+
+    g_clear_pointer (&cache->node, gsk_render_node_unref);
+    g_free (cache);
+}
+
+static GskRenderNode *
+_get_text_render_node (TextLayoutBlock *block,
+                       PangoLayout     *layout,
+                       GdkRGBA         *fg_color)
+{
+    TextRenderCache *cache;
+    GtkSnapshot *snapshot;
+
+    // The block drops the cache when re-shaped, so it only needs
+    // to be checked against the colour here
+    cache = text_layout_block_get_render_cache (block);
+
+    if (cache && gdk_rgba_equal (&cache->color, fg_color))
+        return cache->node;
+
+    snapshot = gtk_snapshot_new ();
+    gtk_snapshot_append_layout (snapshot, layout, fg_color);
+
+    cache = g_new0 (TextRenderCache, 1);
+    cache->node = gtk_snapshot_free_to_node (snapshot);
+    cache->color = *fg_color;
+
+    text_layout_block_set_render_cache (block, cache, _render_cache_free);
+
+    return cache->node;
+}
+
+static void
+draw_box_recursive (GtkWidget             *widget,
+                    TextLayoutBox         *layout_box,
+                    GtkSnapshot           *snapshot,
+                    GdkRGBA               *fg_color,
+                    const graphene_rect_t *visible,
+                    int                   *delta_height);
+
+static void
+draw_block (GtkWidget             *widget,
+            TextLayoutBox         *layout_box,
+            GtkSnapshot           *snapshot,
+            GdkRGBA               *fg_color,
+            const graphene_rect_t *visible,
+            int                   *delta_height)
 {
     int offset = 0;
     TextItem *item;
+    TextNode *first;
     const TextDimensions *bbox;
 
     // Get bounding box
@@ -258,7 +695,29 @@ draw_block (GtkWidget     *widget,
 
     // Draw children first
     gtk_snapshot_save (snapshot);
-    for (TextNode *node = text_node_get_first_child (TEXT_NODE (layout_box));
+
+    first = text_node_get_first_child (TEXT_NODE (layout_box));
+
+    // Jump straight to the first visible block child
+    if (TEXT_IS_LAYOUT_BLOCK (layout_box))
+    {
+        int index;
+
+        index = text_layout_block_get_child_at_y (TEXT_LAYOUT_BLOCK (layout_box), visible->origin.y);
+
+        if (index > 0)
+        {
+            int skipped;
+
+            skipped = (int) (text_layout_block_get_child_y (TEXT_LAYOUT_BLOCK (layout_box), index) - bbox->y);
+            gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, skipped));
+            offset += skipped;
+
+            first = TEXT_NODE (text_layout_block_get_nth_child (TEXT_LAYOUT_BLOCK (layout_box), index));
+        }
+    }
+
+    for (TextNode *node = first;
          node != NULL;
          node = text_node_get_next (node))
     {
@@ -266,7 +725,28 @@ draw_block (GtkWidget     *widget,
 
         int child_delta_height;
 
-        draw_box_recursive(widget, TEXT_LAYOUT_BOX(node), snapshot, fg_color, &child_delta_height);
+        // Cull blocks outside of the visible area. Blocks are laid
+        // out top to bottom, so nothing after this one is visible
+        // either once we are past the end.
+        if (TEXT_IS_LAYOUT_BLOCK (node))
+        {
+            const TextDimensions *child_bbox;
+
+            child_bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (node));
+
+            if (child_bbox->y > visible->origin.y + visible->size.height)
+                break;
+
+            if (child_bbox->y + child_bbox->height < visible->origin.y)
+            {
+                // Skip without emitting any render nodes
+                gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, child_bbox->height));
+                offset += (int) child_bbox->height;
+                continue;
+            }
+        }
+
+        draw_box_recursive(widget, TEXT_LAYOUT_BOX(node), snapshot, fg_color, visible, &child_delta_height);
         offset += child_delta_height;
     }
     gtk_snapshot_restore (snapshot);
@@ -275,14 +755,19 @@ draw_block (GtkWidget     *widget,
     if (TEXT_IS_LAYOUT_BLOCK (layout_box))
     {
         PangoLayout *layout;
+        GskRenderNode *node;
 
         layout = text_layout_block_get_pango_layout (TEXT_LAYOUT_BLOCK (layout_box));
 
         if (layout)
         {
+            // Replay the text from the cache, which may be empty
+            node = _get_text_render_node (TEXT_LAYOUT_BLOCK (layout_box), layout, fg_color);
+
             gtk_snapshot_save (snapshot);
             gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, offset));
-            gtk_snapshot_append_layout (snapshot, layout, fg_color);
+            if (node)
+                gtk_snapshot_append_node (snapshot, node);
             // item = text_layout_box_get_item (layout_box);
             // draw_inline_elements (snapshot, layout, item, bbox->x, bbox->y);
             gtk_snapshot_restore (snapshot);
@@ -320,11 +805,12 @@ draw_inline (GtkWidget    *widget,
 }
 
 static void
-draw_box_recursive (GtkWidget     *widget,
-                    TextLayoutBox *layout_box,
-                    GtkSnapshot   *snapshot,
-                    GdkRGBA       *fg_color,
-                    int           *delta_height)
+draw_box_recursive (GtkWidget             *widget,
+                    TextLayoutBox         *layout_box,
+                    GtkSnapshot           *snapshot,
+                    GdkRGBA               *fg_color,
+                    const graphene_rect_t *visible,
+                    int                   *delta_height)
 {
     int offset = 0;
     TextItem *item;
@@ -334,7 +820,7 @@ draw_box_recursive (GtkWidget     *widget,
 
     // For block elements, draw content and children
     if (TEXT_IS_LAYOUT_BLOCK (layout_box))
-        draw_block (widget, layout_box, snapshot, fg_color, delta_height);
+        draw_block (widget, layout_box, snapshot, fg_color, visible, delta_height);
     else if (TEXT_IS_LAYOUT_INLINE (layout_box))
         draw_inline (widget, layout_box, snapshot, fg_color);
 }
@@ -367,6 +853,10 @@ draw_cursor_snapshot (GtkSnapshot *snapshot,
         {
             layout = text_layout_block_get_pango_layout (block);
 
+            // Not shaped yet (see lazy layout)
+            if (!layout)
+                return;
+
             PangoRectangle cursor_rect;
             pango_layout_index_to_pos (layout,
                                        index,
@@ -418,6 +908,9 @@ draw_selection_partial_layout_snapshot (GtkSnapshot *snapshot,
     PangoLayoutIter *iter;
     gboolean iter_next;
 
+    if (!layout)
+        return;
+
     iter = pango_layout_get_iter (layout);
     iter_next = TRUE;
 
@@ -543,6 +1036,9 @@ draw_selection_layout_snapshot (GtkSnapshot *snapshot,
     PangoLayoutIter *iter;
     gboolean iter_next;
 
+    if (!layout)
+        return;
+
     iter = pango_layout_get_iter (layout);
     iter_next = TRUE;
 
@@ -648,6 +1144,7 @@ text_display_snapshot (GtkWidget   *widget,
 {
     double displacement;
     int delta_height;
+    graphene_rect_t visible;
     TextDisplay *self;
     GtkStyleContext *context;
     GdkRGBA fg_color;
@@ -679,6 +1176,13 @@ text_display_snapshot (GtkWidget   *widget,
 
     gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (self->margin_start, self->margin_top + displacement));
 
+    // Visible area in layout coordinates, grown by the overscan
+    graphene_rect_init (&visible,
+                        0,
+                        -(self->margin_top + displacement) - self->overscan,
+                        gtk_widget_get_width (widget),
+                        gtk_widget_get_height (widget) + 2 * self->overscan);
+
     // Draw selection
     if (self->document->selection) {
         gtk_snapshot_save (snapshot);
@@ -691,7 +1195,7 @@ text_display_snapshot (GtkWidget   *widget,
 
     // Draw layout tree
     gtk_snapshot_save (snapshot);
-    draw_box_recursive (widget, TEXT_LAYOUT_BOX (self->layout_tree), snapshot, &fg_color, &delta_height);
+    draw_box_recursive (widget, TEXT_LAYOUT_BOX (self->layout_tree), snapshot, &fg_color, &visible, &delta_height);
     gtk_snapshot_restore (snapshot);
 
     // Draw cursors
@@ -720,20 +1224,22 @@ text_display_measure (GtkWidget      *widget,
     if (orientation == GTK_ORIENTATION_VERTICAL)
     {
         TextDisplay *self = TEXT_DISPLAY (widget);
-        PangoContext *context = gtk_widget_get_pango_context (widget);
+        int height;
 
         // Account for start/end margins
         for_size -= self->margin_start + self->margin_end;
 
-        if (self->layout_tree)
-            text_node_clear (&self->layout_tree);
+        // GTK frequently asks for the same widths again
+        if (!_lookup_measure_cache (self, for_size, &height))
+        {
+            _update_layout_tree (self, for_size);
+            _schedule_layout_job (self);
 
-        self->layout_tree = TEXT_NODE (text_layout_build_layout_tree (self->layout,
-                                                                      context,
-                                                                      self->document->frame,
-                                                                      for_size));
+            height = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self->layout_tree))->height;
+            _store_measure_cache (self, for_size, height);
+        }
 
-        *minimum = *natural = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self->layout_tree))->height;
+        *minimum = *natural = height;
 
         g_debug ("Height: %d\n", *minimum);
     }
@@ -749,6 +1255,74 @@ text_display_measure (GtkWidget      *widget,
     }
 }
 
+static void
+_scroll_to_cursor (TextDisplay *self)
+{
+    TextMark *cursor;
+    TextNode *block;
+    PangoLayout *layout;
+    PangoRectangle rect;
+    double y;
+    int index;
+
+    if (!self->vadjustment || !self->document || !self->layout_tree)
+        return;
+
+    cursor = self->document->cursor;
+
+    if (!TEXT_IS_PARAGRAPH (cursor->paragraph))
+        return;
+
+    block = text_item_get_attachment (TEXT_ITEM (cursor->paragraph));
+
+    if (!TEXT_IS_LAYOUT_BLOCK (block))
+        return;
+
+    layout = text_layout_block_get_pango_layout (TEXT_LAYOUT_BLOCK (block));
+
+    // Find the paragraph through the height index of its parent
+    index = text_layout_block_get_child_index (TEXT_LAYOUT_BLOCK (block));
+
+    if (index != -1)
+        y = text_layout_block_get_child_y (TEXT_LAYOUT_BLOCK (text_node_get_parent (block)), index);
+    else
+        y = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (block))->y;
+
+    // Blocks which have not been shaped yet are scrolled into view as
+    // a whole, then shaped on the next allocation
+    if (layout)
+    {
+        pango_layout_index_to_pos (layout, cursor->index, &rect);
+    }
+    else
+    {
+        rect.x = rect.y = rect.width = 0;
+        rect.height = (int) text_layout_box_get_bbox (TEXT_LAYOUT_BOX (block))->height * PANGO_SCALE;
+    }
+
+    y += self->margin_top + (double) rect.y / PANGO_SCALE;
+
+    gtk_adjustment_clamp_page (self->vadjustment, y, y + (double) rect.height / PANGO_SCALE);
+}
+
+static void
+_queue_scroll_to_cursor (TextDisplay *self)
+{
+    // Moving the cursor doesn't change the layout, so unless an edit
+    // is waiting to be laid out the cursor can be scrolled to now,
+    // without allocating the whole widget again
+    if (self->layout_tree &&
+        !self->layout_tree_invalid &&
+        !self->layout_tree_dirty)
+    {
+        _scroll_to_cursor (self);
+        return;
+    }
+
+    self->scroll_to_cursor = TRUE;
+    gtk_widget_queue_allocate (GTK_WIDGET (self));
+}
+
 void
 text_display_size_allocate (GtkWidget *widget,
                             int        widget_width,
@@ -763,7 +1337,8 @@ text_display_size_allocate (GtkWidget *widget,
 
     self = TEXT_DISPLAY (widget);
 
-    _rebuild_layout_tree (self, widget_width - self->margin_start - self->margin_end);
+    _update_layout_tree (self, widget_width - self->margin_start - self->margin_end);
+    _schedule_layout_job (self);
 
     bbox = text_layout_box_get_bbox (TEXT_LAYOUT_BOX (self->layout_tree));
 
@@ -775,20 +1350,30 @@ text_display_size_allocate (GtkWidget *widget,
 
     if (self->vadjustment)
     {
-        cur_value = gtk_adjustment_get_value (self->vadjustment);
+        // Compensate for estimated heights above the viewport
+        // being replaced, so the visible content stays still
+        cur_value = gtk_adjustment_get_value (self->vadjustment)
+                  + text_layout_take_anchor_shift (self->layout);
 
         // only emit notify once for the whole block
         g_object_freeze_notify (G_OBJECT (self->vadjustment));
 
-        gtk_adjustment_set_value (self->vadjustment, cur_value);
         gtk_adjustment_set_upper (self->vadjustment, content_height);
         gtk_adjustment_set_step_increment (self->vadjustment, widget_height * 0.1);
         gtk_adjustment_set_page_increment (self->vadjustment, widget_height * 0.9);
         gtk_adjustment_set_page_size (self->vadjustment, widget_height);
 
+        // Set last so it is clamped against the new bounds
+        gtk_adjustment_set_value (self->vadjustment, cur_value);
+
         g_object_thaw_notify (G_OBJECT (self->vadjustment));
+
+        if (self->scroll_to_cursor)
+            _scroll_to_cursor (self);
     }
 
+    self->scroll_to_cursor = FALSE;
+
     if (self->hadjustment)
     {
         cur_value = gtk_adjustment_get_value (self->hadjustment);
@@ -855,6 +1440,13 @@ text_display_class_init (TextDisplayClass *klass)
                             0, G_MAXINT, 0,
                             G_PARAM_READWRITE|G_PARAM_CONSTRUCT);
 
+    properties [PROP_OVERSCAN]
+        = g_param_spec_int ("overscan",
+                            "Overscan",
+                            "Distance outside the visible area which is still drawn",
+                            0, G_MAXINT, 0,
+                            G_PARAM_READWRITE|G_PARAM_CONSTRUCT);
+
     g_object_class_install_properties (object_class, N_PROPS, properties);
 
     GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
@@ -898,9 +1490,10 @@ commit (GtkIMContext *context,
     if (!TEXT_IS_DOCUMENT (self->document))
         return;
 
-    self->document->selection != NULL
-        ? text_editor_replace (self->editor, TEXT_EDITOR_CURSOR, TEXT_EDITOR_SELECTION, str)
-        : text_editor_insert_text(self->editor, TEXT_EDITOR_CURSOR, str);
+    if (self->document->selection != NULL)
+        text_editor_replace (self->editor, TEXT_EDITOR_CURSOR, TEXT_EDITOR_SELECTION, str);
+    else
+        text_editor_insert_text (self->editor, TEXT_EDITOR_CURSOR, str);
 
     _unset_selection (self->document);
 
@@ -911,12 +1504,14 @@ commit (GtkIMContext *context,
     // which then causes a partial redraw - simple right?
     gtk_widget_queue_allocate (GTK_WIDGET (self));
     gtk_widget_queue_draw (GTK_WIDGET (self));
+    _queue_scroll_to_cursor (self);
 
     g_info ("commit: %s\n", str);
 }
 
 static gboolean
-_move_cursor_home (TextMark *cursor)
+_move_cursor_home (TextDisplay *self,
+                   TextMark    *cursor)
 {
     TextParagraph *para;
     TextLayoutBlock *layout;
@@ -926,7 +1521,7 @@ _move_cursor_home (TextMark *cursor)
     para = cursor->paragraph;
     layout = TEXT_LAYOUT_BLOCK (text_item_get_attachment (TEXT_ITEM (para)));
 
-    if (layout) {
+    if (layout && _ensure_pango_layout (self, layout)) {
         PangoLayout *pango;
         GSList *iter;
         pango = text_layout_block_get_pango_layout (layout);
@@ -966,7 +1561,8 @@ _move_cursor_home (TextMark *cursor)
 }
 
 static gboolean
-_move_cursor_end (TextMark *cursor)
+_move_cursor_end (TextDisplay *self,
+                  TextMark    *cursor)
 {
     TextParagraph *para;
     TextLayoutBlock *layout;
@@ -976,7 +1572,7 @@ _move_cursor_end (TextMark *cursor)
     para = cursor->paragraph;
     layout = TEXT_LAYOUT_BLOCK (text_item_get_attachment (TEXT_ITEM (para)));
 
-    if (layout) {
+    if (layout && _ensure_pango_layout (self, layout)) {
         PangoLayout *pango;
         GSList *iter;
         pango = text_layout_block_get_pango_layout (layout);
@@ -1016,8 +1612,9 @@ _move_cursor_end (TextMark *cursor)
 }
 
 static gboolean
-_move_cursor_vertically (TextMark *cursor,
-                         gboolean  up)
+_move_cursor_vertically (TextDisplay *self,
+                         TextMark    *cursor,
+                         gboolean     up)
 {
     TextParagraph *para;
     TextLayoutBlock *block_layout;
@@ -1031,7 +1628,10 @@ _move_cursor_vertically (TextMark *cursor,
     index = cursor->index;
     para = cursor->paragraph;
     block_layout = TEXT_LAYOUT_BLOCK (text_item_get_attachment (TEXT_ITEM (para)));
-    pango_layout = text_layout_block_get_pango_layout(block_layout);
+    pango_layout = _ensure_pango_layout (self, block_layout);
+
+    if (!pango_layout)
+        return FALSE;
 
     // First try move within the paragraph
     pango_layout_index_to_line_x (pango_layout, index, FALSE, &cur_line_index, &x_pos);
@@ -1055,14 +1655,21 @@ _move_cursor_vertically (TextMark *cursor,
     if (!block_layout)
         return FALSE;
 
-    pango_layout = text_layout_block_get_pango_layout (block_layout);
-    line = pango_layout_get_line(pango_layout, up ? pango_layout_get_line_count (pango_layout) - 1 : 0);
-    pango_layout_line_x_to_index (line, position.x, &index, NULL);
+    pango_layout = _ensure_pango_layout (self, block_layout);
+
+    if (pango_layout)
+    {
+        line = pango_layout_get_line(pango_layout, up ? pango_layout_get_line_count (pango_layout) - 1 : 0);
+        pango_layout_line_x_to_index (line, position.x, &index, NULL);
+    }
+    else
+    {
+        index = 0;
+    }
 
     para = TEXT_PARAGRAPH (text_layout_box_get_item (TEXT_LAYOUT_BOX (block_layout)));
 
-    cursor->index = index;
-    cursor->paragraph = para;
+    text_mark_set_position (cursor, para, index);
 
     return TRUE;
 }
@@ -1121,7 +1728,7 @@ key_pressed (GtkEventControllerKey *controller,
             text_editor_move_first (self->editor, TEXT_EDITOR_CURSOR);
             goto redraw;
         }
-        else if (_move_cursor_home (self->document->cursor)) {
+        else if (_move_cursor_home (self, self->document->cursor)) {
             goto redraw;
         }
 
@@ -1136,7 +1743,7 @@ key_pressed (GtkEventControllerKey *controller,
         if (ctrl_pressed) {
             text_editor_move_last (self->editor, TEXT_EDITOR_CURSOR);
         }
-        else if (_move_cursor_end (self->document->cursor)) {
+        else if (_move_cursor_end (self, self->document->cursor)) {
             goto redraw;
         }
 
@@ -1167,7 +1774,7 @@ key_pressed (GtkEventControllerKey *controller,
         if (!shift_pressed && selection)
             _unset_selection (self->document);
 
-        if (_move_cursor_vertically (self->document->cursor, TRUE))
+        if (_move_cursor_vertically (self, self->document->cursor, TRUE))
             goto redraw;
         return TRUE;
     }
@@ -1177,13 +1784,14 @@ key_pressed (GtkEventControllerKey *controller,
         if (!shift_pressed && selection)
             _unset_selection (self->document);
 
-        if (_move_cursor_vertically (self->document->cursor, FALSE))
+        if (_move_cursor_vertically (self, self->document->cursor, FALSE))
             goto redraw;
         return TRUE;
     }
 
     // Handle deletion
-    if (keyval == GDK_KEY_Delete)
+    if (keyval == GDK_KEY_Delete ||
+        keyval == GDK_KEY_BackSpace)
     {
         if (selection)
         {
@@ -1191,33 +1799,36 @@ key_pressed (GtkEventControllerKey *controller,
             _unset_selection (self->document);
         }
         else
-            text_editor_delete (self->editor, TEXT_EDITOR_CURSOR, 1);
+        {
+            text_editor_delete (self->editor, TEXT_EDITOR_CURSOR,
+                                keyval == GDK_KEY_Delete ? 1 : -1);
+        }
 
         goto reallocate;
     }
 
-    if (keyval == GDK_KEY_BackSpace)
+    if (keyval == GDK_KEY_Return)
     {
         if (selection)
         {
             text_editor_replace (self->editor, TEXT_EDITOR_CURSOR, TEXT_EDITOR_SELECTION, "");
             _unset_selection (self->document);
         }
-        else
-            text_editor_delete (self->editor, TEXT_EDITOR_CURSOR, -1);
 
+        text_editor_split (self->editor, TEXT_EDITOR_CURSOR);
         goto reallocate;
     }
 
-    if (keyval == GDK_KEY_Return)
+    // Undo/Redo
+    if (ctrl_pressed &&
+        (keyval == GDK_KEY_z || keyval == GDK_KEY_Z || keyval == GDK_KEY_y))
     {
-        if (selection)
-        {
-            text_editor_replace (self->editor, TEXT_EDITOR_CURSOR, TEXT_EDITOR_SELECTION, "");
-            _unset_selection (self->document);
-        }
+        if (keyval == GDK_KEY_y || shift_pressed)
+            text_editor_redo (self->editor);
+        else
+            text_editor_undo (self->editor);
 
-        text_editor_split (self->editor, TEXT_EDITOR_CURSOR);
+        _unset_selection (self->document);
         goto reallocate;
     }
 
@@ -1286,6 +1897,7 @@ reallocate:
     gtk_widget_queue_allocate (GTK_WIDGET (self));
 
 redraw:
+    _queue_scroll_to_cursor (self);
     gtk_widget_queue_draw (GTK_WIDGET (self));
     return TRUE;
 }
@@ -1320,7 +1932,12 @@ set_mark_from_cursor (TextDisplay *self,
             // TODO: Properly find the nearest leaf node
             // when we have more complex renderers
 
-            if (TEXT_IS_PARAGRAPH (item))
+            if (TEXT_IS_PARAGRAPH (item) &&
+                !_ensure_pango_layout (self, TEXT_LAYOUT_BLOCK (box)))
+            {
+                text_mark_set_position (mark, TEXT_PARAGRAPH (item), 0);
+            }
+            else if (TEXT_IS_PARAGRAPH (item))
             {
                 int index, trailing;
 
@@ -1330,16 +1947,13 @@ set_mark_from_cursor (TextDisplay *self,
                                           (int)((y - bbox->y) * (double)PANGO_SCALE),
                                           &index, &trailing);
 
-                mark->paragraph = TEXT_PARAGRAPH (item);
-                mark->index = index;
+                text_mark_set_position (mark, TEXT_PARAGRAPH (item), index);
             }
             else if (TEXT_IS_IMAGE (item))
             {
                 // Treat bounding box opaquely
-                mark->index = 0;
-                mark->paragraph = TEXT_PARAGRAPH (text_node_get_parent (TEXT_NODE (item)));
-                if ((x - bbox->x) > (bbox->width / 2))
-                    mark->index = 1;
+                text_mark_set_position (mark, TEXT_PARAGRAPH (text_node_get_parent (TEXT_NODE (item))),
+                                        (x - bbox->x) > (bbox->width / 2) ? 1 : 0);
 
             }
         }
@@ -15,6 +15,7 @@
 
 #include "../model/frame.h"
 #include "../model/document.h"
+#include "../layout/layout.h"
 
 G_BEGIN_DECLS
 
@@ -22,6 +23,7 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (TextDisplay, text_display, TEXT, DISPLAY, GtkWidget)
 
-TextDisplay *text_display_new (TextDocument *document);
+TextDisplay *text_display_new        (TextDocument *document);
+TextLayout  *text_display_get_layout (TextDisplay  *self);
 
 G_END_DECLS
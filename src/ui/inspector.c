@@ -40,7 +40,11 @@ static GParamSpec *properties [N_PROPS];
 
 #define TITLE "Text Engine"
 
+// List of children shown for an expanded item
+#define CHILDREN_KEY "text-inspector-children"
+
 static void populate_data_from_frame (TextInspector *inspector);
+static void document_changed (TextInspector *inspector, GPtrArray *changes);
 
 TextInspector *
 text_inspector_new (void)
@@ -54,6 +58,7 @@ text_inspector_finalize (GObject *object)
     TextInspector *self = (TextInspector *)object;
 
     gtk_widget_unparent (self->vbox);
+    g_clear_object (&self->document);
 
     G_OBJECT_CLASS (text_inspector_parent_class)->finalize (object);
 }
@@ -92,12 +97,24 @@ text_inspector_set_property (GObject      *object,
     case PROP_OBJECT:
         self->object = g_value_get_object (value);
 
+        if (self->document)
+        {
+            g_signal_handlers_disconnect_by_func (self->document->journal, document_changed, self);
+            g_clear_object (&self->document);
+        }
+
         if (TEXT_IS_DISPLAY (self->object))
         {
-            TextDocument *document;
-            g_object_get (self->object, "document", &document, NULL);
-            self->document = document;
+            // Keeps the reference returned by g_object_get()
+            g_object_get (self->object, "document", &self->document, NULL);
+
+            if (!self->document)
+                break;
+
             populate_data_from_frame (self);
+
+            g_signal_connect_object (text_document_get_journal (self->document), "changed",
+                                     G_CALLBACK (document_changed), self, G_CONNECT_SWAPPED);
         }
         break;
     default:
@@ -125,9 +142,56 @@ create_list_model (TextItem *item)
         g_list_store_append (store, node);
     }
 
+    // Kept so the list can be updated when the children change
+    g_object_set_data_full (G_OBJECT (item), CHILDREN_KEY,
+                            g_object_ref (store), g_object_unref);
+
     return G_LIST_MODEL (store);
 }
 
+static void
+document_changed (TextInspector *self,
+                  GPtrArray     *changes)
+{
+    guint i;
+
+    // Only lists which have been expanded need to be updated
+    for (i = 0; i < changes->len; i++)
+    {
+        TextChange *change;
+        GListStore *store;
+        guint position;
+
+        change = g_ptr_array_index (changes, i);
+
+        if (!change->parent)
+            continue;
+
+        store = g_object_get_data (G_OBJECT (change->parent), CHILDREN_KEY);
+
+        if (!store || change->index > (int) g_list_model_get_n_items (G_LIST_MODEL (store)))
+            continue;
+
+        switch (change->type)
+        {
+        case TEXT_CHANGE_CHILD_INSERTED:
+            g_list_store_insert (store, change->index, change->node);
+            break;
+
+        case TEXT_CHANGE_CHILD_REMOVED:
+            if (change->index < (int) g_list_model_get_n_items (G_LIST_MODEL (store)))
+                g_list_store_remove (store, change->index);
+            break;
+
+        default:
+            // Rebind the row so that it shows the new contents
+            if (g_list_store_find (store, change->node, &position))
+                g_list_store_splice (store, position, 1, (gpointer *) &change->node, 1);
+            break;
+        }
+    }
+}
+
 static void
 populate_data_from_frame (TextInspector *self)
 {
@@ -0,0 +1,268 @@
+/* autosave.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <model/document.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <editor/editor.h>
+#include <editor/autosave.h>
+#include <format/export.h>
+
+typedef struct {
+    TextDocument *doc;
+    TextEditor *editor;
+    TextAutosave *autosave;
+    char *dir;
+    GFile *file;
+    GMainLoop *loop;
+    GError *error;
+} AutosaveFixture;
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+
+static void
+autosave_fixture_set_up (AutosaveFixture *fixture,
+                         gconstpointer    user_data)
+{
+    TextFrame *frame;
+    TextParagraph *para1, *para2;
+    g_autofree char *path = NULL;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN2)));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    para2 = text_paragraph_new ();
+    text_paragraph_append_fragment(para2, TEXT_FRAGMENT (text_run_new (RUN3)));
+    text_frame_append_block (frame, TEXT_BLOCK (para2));
+
+    fixture->doc = text_document_new ();
+    fixture->doc->frame = frame;
+
+    fixture->editor = text_editor_new (fixture->doc);
+
+    fixture->dir = g_dir_make_tmp ("text-engine-autosave-XXXXXX", NULL);
+    g_assert_nonnull (fixture->dir);
+
+    path = g_build_filename (fixture->dir, "document.txt", NULL);
+    fixture->file = g_file_new_for_path (path);
+
+    // Only save when asked, so the tests don't depend on timing
+    fixture->autosave = text_autosave_new (fixture->doc, fixture->file);
+    text_autosave_set_interval (fixture->autosave, 0);
+
+    fixture->loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+autosave_fixture_tear_down (AutosaveFixture *fixture,
+                            gconstpointer    user_data)
+{
+    g_autofree char *path = g_file_get_path (fixture->file);
+
+    g_object_unref (fixture->autosave);
+    g_object_unref (fixture->editor);
+    g_object_unref (fixture->doc);
+    g_object_unref (fixture->file);
+    g_main_loop_unref (fixture->loop);
+    g_clear_error (&fixture->error);
+
+    g_remove (path);
+    g_rmdir (fixture->dir);
+    g_free (fixture->dir);
+}
+
+static void
+_saved (TextAutosave    *autosave,
+        guint            generation,
+        AutosaveFixture *fixture)
+{
+    g_main_loop_quit (fixture->loop);
+}
+
+static void
+_failed (TextAutosave    *autosave,
+         GError          *error,
+         AutosaveFixture *fixture)
+{
+    fixture->error = g_error_copy (error);
+    g_main_loop_quit (fixture->loop);
+}
+
+static void
+_wait (AutosaveFixture *fixture)
+{
+    g_signal_connect (fixture->autosave, "saved", G_CALLBACK (_saved), fixture);
+    g_signal_connect (fixture->autosave, "failed", G_CALLBACK (_failed), fixture);
+
+    g_main_loop_run (fixture->loop);
+
+    g_signal_handlers_disconnect_by_data (fixture->autosave, fixture);
+}
+
+static char *
+_read_file (GFile *file)
+{
+    char *contents = NULL;
+
+    g_assert_true (g_file_load_contents (file, NULL, &contents, NULL, NULL, NULL));
+
+    return contents;
+}
+
+static void
+test_autosave_save (AutosaveFixture *fixture,
+                    gconstpointer    user_data)
+{
+    // saves the document once it has changed
+
+    g_autofree char *contents = NULL;
+
+    g_assert_false (text_autosave_is_dirty (fixture->autosave));
+    g_assert_false (text_autosave_save (fixture->autosave));
+
+    text_editor_move_last (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, " Woof!");
+    g_assert_true (text_autosave_is_dirty (fixture->autosave));
+
+    g_assert_true (text_autosave_save (fixture->autosave));
+    g_assert_true (text_autosave_is_saving (fixture->autosave));
+    g_assert_false (text_autosave_save (fixture->autosave));
+
+    _wait (fixture);
+
+    g_assert_no_error (fixture->error);
+    g_assert_false (text_autosave_is_saving (fixture->autosave));
+    g_assert_false (text_autosave_is_dirty (fixture->autosave));
+
+    contents = _read_file (fixture->file);
+    g_assert_cmpstr (contents, ==, RUN1 RUN2 "\n" RUN3 " Woof!\n");
+}
+
+static void
+test_autosave_edit_while_saving (AutosaveFixture *fixture,
+                                 gconstpointer    user_data)
+{
+    // edits made during a save stay dirty and are written by the next one
+
+    g_autofree char *first = NULL;
+    g_autofree char *second = NULL;
+
+    text_editor_move_last (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, " Woof!");
+    g_assert_true (text_autosave_save (fixture->autosave));
+
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, " Woof!");
+
+    _wait (fixture);
+
+    g_assert_no_error (fixture->error);
+    g_assert_true (text_autosave_is_dirty (fixture->autosave));
+
+    first = _read_file (fixture->file);
+    g_assert_cmpstr (first, ==, RUN1 RUN2 "\n" RUN3 " Woof!\n");
+
+    g_assert_true (text_autosave_save (fixture->autosave));
+    _wait (fixture);
+
+    g_assert_no_error (fixture->error);
+    g_assert_false (text_autosave_is_dirty (fixture->autosave));
+
+    second = _read_file (fixture->file);
+    g_assert_cmpstr (second, ==, RUN1 RUN2 "\n" RUN3 " Woof! Woof!\n");
+}
+
+static void
+test_autosave_failed (AutosaveFixture *fixture,
+                      gconstpointer    user_data)
+{
+    // a file which can't be written leaves the document dirty
+
+    g_autoptr (GFile) missing = NULL;
+
+    missing = g_file_get_child (fixture->file, "missing");
+    g_clear_object (&fixture->autosave);
+
+    fixture->autosave = text_autosave_new (fixture->doc, missing);
+    text_autosave_set_interval (fixture->autosave, 0);
+
+    text_editor_move_last (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, " Woof!");
+    g_assert_true (text_autosave_save (fixture->autosave));
+
+    _wait (fixture);
+
+    g_assert_nonnull (fixture->error);
+    g_assert_true (text_autosave_is_dirty (fixture->autosave));
+}
+
+static void
+test_autosave_html (AutosaveFixture *fixture,
+                    gconstpointer    user_data)
+{
+    // snapshots can be written as html
+
+    g_autoptr (TextSnapshot) snapshot = NULL;
+    g_autoptr (GOutputStream) stream = NULL;
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+    g_autoptr (GError) error = NULL;
+
+    start = text_document_create_mark_at_offset (fixture->doc, 0, TEXT_GRAVITY_LEFT);
+    end = text_document_create_mark_at_offset (fixture->doc, 4, TEXT_GRAVITY_RIGHT);
+    text_editor_apply_format_bold (fixture->editor, start, end, TRUE);
+    text_document_delete_mark (fixture->doc, start);
+    text_document_delete_mark (fixture->doc, end);
+
+    snapshot = text_document_snapshot (fixture->doc);
+    stream = g_memory_output_stream_new_resizable ();
+
+    g_assert_true (format_write_html (snapshot, stream, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_true (g_output_stream_write_all (stream, "", 1, NULL, NULL, NULL));
+
+    g_assert_cmpstr (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (stream)), ==,
+                     "<html>\n<body>\n"
+                     "<p><b>Once</b> upon a time there was a little dög, </p>\n"
+                     "<p>and his name was Rövér.</p>\n"
+                     "</body>\n</html>\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/editor/autosave/save", AutosaveFixture, NULL,
+                autosave_fixture_set_up, test_autosave_save,
+                autosave_fixture_tear_down);
+    g_test_add ("/text-engine/editor/autosave/edit-while-saving", AutosaveFixture, NULL,
+                autosave_fixture_set_up, test_autosave_edit_while_saving,
+                autosave_fixture_tear_down);
+    g_test_add ("/text-engine/editor/autosave/failed", AutosaveFixture, NULL,
+                autosave_fixture_set_up, test_autosave_failed,
+                autosave_fixture_tear_down);
+    g_test_add ("/text-engine/editor/autosave/html", AutosaveFixture, NULL,
+                autosave_fixture_set_up, test_autosave_html,
+                autosave_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,347 @@
+/* collab.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <editor/editor.h>
+#include <collab/client.h>
+#include <collab/operation.h>
+#include <collab/relay.h>
+
+#include "fixtures.h"
+
+#define N_CLIENTS 3
+
+typedef struct {
+    TextCollabRelay *relay;
+    TextDocument *docs[N_CLIENTS];
+    TextEditor *editors[N_CLIENTS];
+    TextCollabClient *clients[N_CLIENTS];
+} CollabFixture;
+
+static void
+collab_fixture_set_up (CollabFixture *fixture,
+                       gconstpointer  user_data)
+{
+    fixture->relay = text_collab_relay_new ();
+
+    for (int i = 0; i < N_CLIENTS; i++)
+    {
+        fixture->docs[i] = create_document ();
+        fixture->editors[i] = text_editor_new (fixture->docs[i]);
+        fixture->clients[i] = text_collab_client_new (fixture->editors[i], 0);
+
+        text_editor_move_first (fixture->editors[i], TEXT_EDITOR_CURSOR);
+        text_collab_relay_add_client (fixture->relay, fixture->clients[i]);
+    }
+}
+
+static void
+collab_fixture_tear_down (CollabFixture *fixture,
+                          gconstpointer  user_data)
+{
+    g_object_unref (fixture->relay);
+
+    for (int i = 0; i < N_CLIENTS; i++)
+    {
+        g_object_unref (fixture->clients[i]);
+        g_object_unref (fixture->editors[i]);
+        g_object_unref (fixture->docs[i]);
+    }
+}
+
+static void
+assert_converged (CollabFixture *fixture,
+                  const char    *expected)
+{
+    for (int i = 0; i < N_CLIENTS; i++)
+    {
+        g_autofree char *text = NULL;
+
+        text = text_editor_dump_plain_text (fixture->editors[i]);
+        g_assert_cmpstr (text, ==, expected);
+        g_assert_true (text_collab_client_is_synchronized (fixture->clients[i]));
+        g_assert_cmpint (text_collab_client_get_revision (fixture->clients[i]), ==,
+                         text_collab_relay_get_revision (fixture->relay));
+    }
+}
+
+static gboolean
+is_bold_at_offset (TextDocument *doc,
+                   TextEditor   *editor,
+                   int           offset)
+{
+    g_autoptr (TextMark) mark = NULL;
+    gboolean is_bold;
+
+    mark = text_document_create_mark_at_offset (doc, offset, TEXT_GRAVITY_LEFT);
+    is_bold = text_editor_get_format_bold_at_mark (editor, mark);
+    text_document_delete_mark (doc, mark);
+
+    return is_bold;
+}
+
+static void
+test_transform (void)
+{
+    // both orders of applying concurrent operations give the same text
+
+    const char *base = "Hello world";
+    g_autoptr (TextOperation) a = NULL;
+    g_autoptr (TextOperation) b = NULL;
+    g_autoptr (TextOperation) a_prime = NULL;
+    g_autoptr (TextOperation) b_prime = NULL;
+    g_autofree char *ab = NULL;
+    g_autofree char *ba = NULL;
+    g_autofree char *text_a = NULL;
+    g_autofree char *text_b = NULL;
+
+    a = text_operation_new ();
+    text_operation_retain (a, 5);
+    text_operation_insert (a, ",");
+    text_operation_delete (a, 6);
+
+    b = text_operation_new ();
+    text_operation_retain (b, 6);
+    text_operation_insert (b, "big ");
+    text_operation_retain (b, 5);
+
+    g_assert_cmpint (text_operation_get_base_length (a), ==, 11);
+    g_assert_cmpint (text_operation_get_target_length (a), ==, 6);
+
+    g_assert_true (text_operation_transform (a, b, &a_prime, &b_prime));
+
+    text_a = text_operation_apply_to_text (a, base);
+    text_b = text_operation_apply_to_text (b, base);
+    ab = text_operation_apply_to_text (b_prime, text_a);
+    ba = text_operation_apply_to_text (a_prime, text_b);
+
+    g_assert_cmpstr (ab, ==, "Hello,big ");
+    g_assert_cmpstr (ab, ==, ba);
+
+    // Operations on different base lengths can't be transformed
+    text_operation_retain (a, 1);
+    g_assert_false (text_operation_transform (a, b, NULL, NULL));
+}
+
+static void
+test_compose (void)
+{
+    // composing two operations has the effect of applying both
+
+    g_autoptr (TextOperation) a = NULL;
+    g_autoptr (TextOperation) b = NULL;
+    g_autoptr (TextOperation) ab = NULL;
+    g_autofree char *text = NULL;
+
+    a = text_operation_new ();
+    text_operation_insert (a, "Abc");
+    text_operation_retain (a, 3);
+
+    b = text_operation_new ();
+    text_operation_retain (b, 1);
+    text_operation_delete (b, 3);
+    text_operation_retain (b, 2);
+
+    ab = text_operation_compose (a, b);
+    g_assert_nonnull (ab);
+
+    text = text_operation_apply_to_text (ab, "def");
+    g_assert_cmpstr (text, ==, "Aef");
+}
+
+static void
+test_serialize (void)
+{
+    // operations survive a round trip through their string form
+
+    g_autoptr (TextOperation) operation = NULL;
+    g_autoptr (TextOperation) parsed = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autofree char *string = NULL;
+    g_autofree char *reserialized = NULL;
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, 2);
+    text_operation_format (operation, 3, TEXT_OPERATION_BOLD, TEXT_OPERATION_BOLD);
+    text_operation_insert_styled (operation, "dög", TEXT_OPERATION_ITALIC);
+    text_operation_delete (operation, 4);
+
+    string = text_operation_to_string (operation);
+    parsed = text_operation_new_from_string (string, &error);
+    g_assert_no_error (error);
+
+    reserialized = text_operation_to_string (parsed);
+    g_assert_cmpstr (string, ==, reserialized);
+    g_assert_cmpuint (text_operation_get_n_components (parsed), ==, 4);
+    g_assert_cmpint (text_operation_get_component (parsed, 2)->values, ==, TEXT_OPERATION_ITALIC);
+
+    g_clear_pointer (&parsed, text_operation_free);
+    parsed = text_operation_new_from_string ("[1, {\"bogus\": 2}]", &error);
+    g_assert_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID);
+    g_assert_null (parsed);
+}
+
+static void
+test_collab_concurrent (CollabFixture *fixture,
+                        gconstpointer  user_data)
+{
+    // clients editing at the same time converge on one document
+
+    text_editor_insert_text (fixture->editors[0], TEXT_EDITOR_CURSOR, "Twice ");
+
+    text_editor_move_right (fixture->editors[1], TEXT_EDITOR_CURSOR, 5);
+    text_editor_delete (fixture->editors[1], TEXT_EDITOR_CURSOR, 5);
+
+    text_editor_move_last (fixture->editors[2], TEXT_EDITOR_CURSOR);
+    text_editor_split (fixture->editors[2], TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editors[2], TEXT_EDITOR_CURSOR, "The end.");
+
+    // Edits made while waiting for an acknowledgement
+    text_editor_insert_text (fixture->editors[0], TEXT_EDITOR_CURSOR, "or thrice ");
+
+    text_collab_relay_flush (fixture->relay);
+
+    assert_converged (fixture, "Twice or thrice Once a time " RUN2 "\n" RUN3 "\nThe end.\n");
+
+    // Local edits can still be undone past the received ones
+    g_assert_true (text_editor_undo (fixture->editors[0]));
+    g_assert_true (text_editor_undo (fixture->editors[0]));
+    g_assert_false (text_editor_can_undo (fixture->editors[0]));
+
+    text_collab_relay_flush (fixture->relay);
+
+    assert_converged (fixture, "Once a time " RUN2 "\n" RUN3 "\nThe end.\n");
+}
+
+static void
+test_collab_invalid (CollabFixture *fixture,
+                     gconstpointer  user_data)
+{
+    // an operation which doesn't apply leaves the client unchanged
+
+    g_autoptr (TextOperation) operation = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autofree char *text = NULL;
+
+    text_editor_insert_text (fixture->editors[0], TEXT_EDITOR_CURSOR, "Twice ");
+    text_editor_insert_text (fixture->editors[0], TEXT_EDITOR_CURSOR, "or thrice ");
+
+    operation = text_operation_new ();
+    text_operation_retain (operation, 3);
+    text_operation_insert (operation, "xx");
+
+    g_assert_false (text_collab_client_receive (fixture->clients[0], operation, &error));
+    g_assert_error (error, TEXT_OPERATION_ERROR, TEXT_OPERATION_ERROR_INVALID);
+    g_assert_cmpint (text_collab_client_get_revision (fixture->clients[0]), ==, 0);
+
+    text = text_editor_dump_plain_text (fixture->editors[0]);
+    g_assert_cmpstr (text, ==, "Twice or thrice " TEXT);
+
+    // The pending edits are still sent as they were made
+    text_collab_relay_flush (fixture->relay);
+
+    assert_converged (fixture, "Twice or thrice " TEXT);
+}
+
+static void
+test_collab_format (CollabFixture *fixture,
+                    gconstpointer  user_data)
+{
+    // formatting is shared, and text typed concurrently
+    // keeps the style of the client which typed it
+
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+
+    start = text_document_create_mark_at_offset (fixture->docs[0], 0, TEXT_GRAVITY_LEFT);
+    end = text_document_create_mark_at_offset (fixture->docs[0], 4, TEXT_GRAVITY_RIGHT);
+    text_editor_apply_format_bold (fixture->editors[0], start, end, TRUE);
+    text_document_delete_mark (fixture->docs[0], start);
+    text_document_delete_mark (fixture->docs[0], end);
+
+    text_editor_move_right (fixture->editors[1], TEXT_EDITOR_CURSOR, 2);
+    text_editor_insert_text (fixture->editors[1], TEXT_EDITOR_CURSOR, "xx");
+
+    text_collab_relay_flush (fixture->relay);
+
+    assert_converged (fixture, "Onxxce upon a time " RUN2 "\n" RUN3 "\n");
+
+    for (int i = 0; i < N_CLIENTS; i++)
+    {
+        g_assert_true (is_bold_at_offset (fixture->docs[i], fixture->editors[i], 1));
+        g_assert_false (is_bold_at_offset (fixture->docs[i], fixture->editors[i], 3));
+        g_assert_true (is_bold_at_offset (fixture->docs[i], fixture->editors[i], 6));
+        g_assert_false (is_bold_at_offset (fixture->docs[i], fixture->editors[i], 8));
+    }
+}
+
+static void
+test_collab_stress (CollabFixture *fixture,
+                    gconstpointer  user_data)
+{
+    // many rounds of random concurrent typing and deleting
+
+    GRand *rand = g_rand_new_with_seed (42);
+    g_autofree char *expected = NULL;
+
+    for (int round = 0; round < 50; round++)
+    {
+        for (int i = 0; i < N_CLIENTS; i++)
+        {
+            TextEditor *editor = fixture->editors[i];
+            int length = text_document_get_length (fixture->docs[i]);
+            int offset = g_rand_int_range (rand, 0, length);
+
+            text_editor_move_first (editor, TEXT_EDITOR_CURSOR);
+            text_editor_move_right (editor, TEXT_EDITOR_CURSOR, offset);
+
+            if (g_rand_boolean (rand) && offset < length - 1)
+                text_editor_delete (editor, TEXT_EDITOR_CURSOR, 1);
+            else
+                text_editor_insert_text (editor, TEXT_EDITOR_CURSOR, "ab");
+        }
+
+        text_collab_relay_flush (fixture->relay);
+
+        g_free (expected);
+        expected = text_editor_dump_plain_text (fixture->editors[0]);
+        assert_converged (fixture, expected);
+    }
+
+    g_rand_free (rand);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/text-engine/collab/operation/transform", test_transform);
+    g_test_add_func ("/text-engine/collab/operation/compose", test_compose);
+    g_test_add_func ("/text-engine/collab/operation/serialize", test_serialize);
+    g_test_add ("/text-engine/collab/client/concurrent", CollabFixture, NULL,
+                collab_fixture_set_up, test_collab_concurrent,
+                collab_fixture_tear_down);
+    g_test_add ("/text-engine/collab/client/invalid", CollabFixture, NULL,
+                collab_fixture_set_up, test_collab_invalid,
+                collab_fixture_tear_down);
+    g_test_add ("/text-engine/collab/client/format", CollabFixture, NULL,
+                collab_fixture_set_up, test_collab_format,
+                collab_fixture_tear_down);
+    g_test_add ("/text-engine/collab/client/stress", CollabFixture, NULL,
+                collab_fixture_set_up, test_collab_stress,
+                collab_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,395 @@
+/* crdt.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <editor/editor.h>
+#include <collab/crdt.h>
+
+#include "fixtures.h"
+
+#define N_REPLICAS 3
+
+typedef struct {
+    TextDocument *docs[N_REPLICAS];
+    TextEditor *editors[N_REPLICAS];
+    TextCrdt *replicas[N_REPLICAS];
+} CrdtFixture;
+
+static void
+crdt_fixture_set_up (CrdtFixture   *fixture,
+                     gconstpointer  user_data)
+{
+    for (int i = 0; i < N_REPLICAS; i++)
+    {
+        fixture->docs[i] = create_document ();
+        fixture->editors[i] = text_editor_new (fixture->docs[i]);
+        fixture->replicas[i] = text_crdt_new (fixture->editors[i], i + 1);
+
+        text_editor_move_first (fixture->editors[i], TEXT_EDITOR_CURSOR);
+    }
+}
+
+static void
+crdt_fixture_tear_down (CrdtFixture   *fixture,
+                        gconstpointer  user_data)
+{
+    for (int i = 0; i < N_REPLICAS; i++)
+    {
+        g_object_unref (fixture->replicas[i]);
+        g_object_unref (fixture->editors[i]);
+        g_object_unref (fixture->docs[i]);
+    }
+}
+
+// Sends everything @from has and @to doesn't
+static void
+sync (CrdtFixture *fixture,
+      int          from,
+      int          to)
+{
+    g_autoptr (GBytes) state_vector = NULL;
+    g_autoptr (GBytes) update = NULL;
+    g_autoptr (GError) error = NULL;
+
+    state_vector = text_crdt_encode_state_vector (fixture->replicas[to]);
+    update = text_crdt_encode_update (fixture->replicas[from], state_vector, &error);
+    g_assert_no_error (error);
+
+    g_assert_true (text_crdt_merge (fixture->replicas[to], update, &error));
+    g_assert_no_error (error);
+}
+
+static void
+assert_text (CrdtFixture *fixture,
+             int          replica,
+             const char  *expected)
+{
+    g_autofree char *text = NULL;
+
+    text = text_editor_dump_plain_text (fixture->editors[replica]);
+    g_assert_cmpstr (text, ==, expected);
+}
+
+static void
+type (TextEditor *editor,
+      const char *text)
+{
+    char str[7];
+
+    for (const char *c = text; *c; c = g_utf8_next_char (c))
+    {
+        str[g_unichar_to_utf8 (g_utf8_get_char (c), str)] = '\0';
+        text_editor_insert_text (editor, TEXT_EDITOR_CURSOR, str);
+    }
+}
+
+static gboolean
+is_bold_at_offset (CrdtFixture *fixture,
+                   int          replica,
+                   int          offset)
+{
+    g_autoptr (TextMark) mark = NULL;
+    TextDocument *doc = fixture->docs[replica];
+    gboolean is_bold;
+
+    mark = text_document_create_mark_at_offset (doc, offset, TEXT_GRAVITY_LEFT);
+    is_bold = text_editor_get_format_bold_at_mark (fixture->editors[replica], mark);
+    text_document_delete_mark (doc, mark);
+
+    return is_bold;
+}
+
+static void
+set_bold (CrdtFixture *fixture,
+          int          replica,
+          int          start_offset,
+          int          end_offset,
+          gboolean     bold)
+{
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+    TextDocument *doc = fixture->docs[replica];
+
+    start = text_document_create_mark_at_offset (doc, start_offset, TEXT_GRAVITY_LEFT);
+    end = text_document_create_mark_at_offset (doc, end_offset, TEXT_GRAVITY_RIGHT);
+    text_editor_apply_format_bold (fixture->editors[replica], start, end, bold);
+    text_document_delete_mark (doc, start);
+    text_document_delete_mark (doc, end);
+}
+
+static void
+test_crdt_concurrent (CrdtFixture   *fixture,
+                      gconstpointer  user_data)
+{
+    // replicas converge after concurrent edits, and
+    // typed text is kept in one item per run of typing
+
+    TextEditor *a = fixture->editors[0];
+    TextEditor *b = fixture->editors[1];
+
+    g_assert_cmpuint (text_crdt_get_n_items (fixture->replicas[0]), ==, 1);
+
+    text_editor_move_right (a, TEXT_EDITOR_CURSOR, 5);
+    type (a, "really ");
+
+    text_editor_move_right (b, TEXT_EDITOR_CURSOR, 5);
+    text_editor_delete (b, TEXT_EDITOR_CURSOR, 5);
+    text_editor_move_last (b, TEXT_EDITOR_CURSOR);
+    text_editor_split (b, TEXT_EDITOR_CURSOR);
+    type (b, "The end.");
+
+    sync (fixture, 0, 1);
+    sync (fixture, 1, 0);
+
+    assert_text (fixture, 0, "Once really a time " RUN2 "\n" RUN3 "\nThe end.\n");
+    assert_text (fixture, 1, "Once really a time " RUN2 "\n" RUN3 "\nThe end.\n");
+
+    g_assert_cmpuint (text_crdt_get_n_items (fixture->replicas[0]), ==, 5);
+    g_assert_cmpuint (text_crdt_get_n_items (fixture->replicas[1]), ==, 5);
+
+    // Local edits can still be undone past the merged ones
+    while (text_editor_undo (a));
+    assert_text (fixture, 0, "Once a time " RUN2 "\n" RUN3 "\nThe end.\n");
+
+    sync (fixture, 0, 1);
+    assert_text (fixture, 1, "Once a time " RUN2 "\n" RUN3 "\nThe end.\n");
+}
+
+static void
+test_crdt_undo_conflict (CrdtFixture   *fixture,
+                         gconstpointer  user_data)
+{
+    // local edits touching merged edits can no longer be undone
+
+    TextEditor *a = fixture->editors[0];
+    TextEditor *b = fixture->editors[1];
+
+    type (a, "Hello ");
+    sync (fixture, 0, 1);
+
+    // Deletes part of the text typed by the first replica,
+    // which types another word in the meantime
+    text_editor_move_first (b, TEXT_EDITOR_CURSOR);
+    text_editor_move_right (b, TEXT_EDITOR_CURSOR, 1);
+    text_editor_delete (b, TEXT_EDITOR_CURSOR, 2);
+    type (a, "world ");
+
+    sync (fixture, 1, 0);
+    assert_text (fixture, 0, "Hlo world " TEXT);
+
+    g_assert_true (text_editor_undo (a));
+    assert_text (fixture, 0, "Hlo " TEXT);
+    g_assert_false (text_editor_can_undo (a));
+}
+
+static void
+test_crdt_same_position (CrdtFixture   *fixture,
+                         gconstpointer  user_data)
+{
+    // text inserted at the same place by several
+    // replicas comes out in the same order on all of them
+
+    for (int i = 0; i < N_REPLICAS; i++)
+    {
+        char str[2] = { 'A' + i, '\0' };
+
+        text_editor_move_right (fixture->editors[i], TEXT_EDITOR_CURSOR, 4);
+        type (fixture->editors[i], str);
+    }
+
+    for (int i = 0; i < N_REPLICAS; i++)
+    {
+        for (int j = 0; j < N_REPLICAS; j++)
+        {
+            if (i != j)
+                sync (fixture, i, j);
+        }
+    }
+
+    assert_text (fixture, 0, "OnceCBA upon a time " RUN2 "\n" RUN3 "\n");
+    assert_text (fixture, 1, "OnceCBA upon a time " RUN2 "\n" RUN3 "\n");
+    assert_text (fixture, 2, "OnceCBA upon a time " RUN2 "\n" RUN3 "\n");
+}
+
+static void
+test_crdt_format (CrdtFixture   *fixture,
+                  gconstpointer  user_data)
+{
+    // concurrent formatting is resolved the same way
+    // everywhere, and leaves concurrent insertions alone
+
+    set_bold (fixture, 0, 0, 4, TRUE);
+
+    text_editor_move_right (fixture->editors[1], TEXT_EDITOR_CURSOR, 2);
+    type (fixture->editors[1], "xx");
+
+    sync (fixture, 0, 1);
+    sync (fixture, 1, 0);
+
+    assert_text (fixture, 0, "Onxxce upon a time " RUN2 "\n" RUN3 "\n");
+
+    for (int i = 0; i < 2; i++)
+    {
+        g_assert_true (is_bold_at_offset (fixture, i, 1));
+        g_assert_false (is_bold_at_offset (fixture, i, 3));
+        g_assert_true (is_bold_at_offset (fixture, i, 6));
+        g_assert_false (is_bold_at_offset (fixture, i, 8));
+    }
+
+    // The replica with the higher id wins a tie
+    set_bold (fixture, 0, 0, 2, FALSE);
+    set_bold (fixture, 1, 0, 11, TRUE);
+
+    sync (fixture, 0, 1);
+    sync (fixture, 1, 0);
+
+    for (int i = 0; i < 2; i++)
+    {
+        g_assert_true (is_bold_at_offset (fixture, i, 1));
+        g_assert_true (is_bold_at_offset (fixture, i, 3));
+        g_assert_true (is_bold_at_offset (fixture, i, 10));
+        g_assert_false (is_bold_at_offset (fixture, i, 12));
+    }
+}
+
+static void
+test_crdt_pending (CrdtFixture   *fixture,
+                   gconstpointer  user_data)
+{
+    // edits arriving before the ones they depend on are
+    // kept until those arrive, and merging is idempotent
+
+    g_autoptr (GBytes) state_vector = NULL;
+    g_autoptr (GBytes) update = NULL;
+    g_autoptr (GError) error = NULL;
+
+    type (fixture->editors[0], "Well, ");
+    sync (fixture, 0, 1);
+
+    text_editor_move_first (fixture->editors[1], TEXT_EDITOR_CURSOR);
+    text_editor_move_right (fixture->editors[1], TEXT_EDITOR_CURSOR, 6);
+    type (fixture->editors[1], "well, ");
+
+    // Only the edits made by the second replica
+    state_vector = text_crdt_encode_state_vector (fixture->replicas[0]);
+    update = text_crdt_encode_update (fixture->replicas[1], state_vector, &error);
+    g_assert_no_error (error);
+
+    g_assert_true (text_crdt_merge (fixture->replicas[2], update, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (text_crdt_get_n_pending (fixture->replicas[2]), ==, 1);
+    assert_text (fixture, 2, TEXT);
+
+    sync (fixture, 0, 2);
+    g_assert_cmpuint (text_crdt_get_n_pending (fixture->replicas[2]), ==, 0);
+    assert_text (fixture, 2, "Well, well, " TEXT);
+
+    // Merging the same update again changes nothing
+    g_assert_true (text_crdt_merge (fixture->replicas[2], update, &error));
+    g_assert_no_error (error);
+    assert_text (fixture, 2, "Well, well, " TEXT);
+}
+
+static void
+test_crdt_invalid (CrdtFixture   *fixture,
+                   gconstpointer  user_data)
+{
+    // malformed updates are rejected without changing anything
+
+    g_autoptr (GBytes) update = NULL;
+    g_autoptr (GBytes) truncated = NULL;
+    g_autoptr (GBytes) garbage = NULL;
+    g_autoptr (GError) error = NULL;
+
+    type (fixture->editors[0], "Hello ");
+
+    update = text_crdt_encode_update (fixture->replicas[0], NULL, &error);
+    g_assert_no_error (error);
+
+    truncated = g_bytes_new_from_bytes (update, 0, g_bytes_get_size (update) - 1);
+    g_assert_false (text_crdt_merge (fixture->replicas[1], truncated, &error));
+    g_assert_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID);
+    g_clear_error (&error);
+    assert_text (fixture, 1, TEXT);
+
+    garbage = g_bytes_new_static ("\xff\xff\xff", 3);
+    g_assert_null (text_crdt_encode_update (fixture->replicas[0], garbage, &error));
+    g_assert_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID);
+}
+
+static void
+test_crdt_dangling (CrdtFixture   *fixture,
+                    gconstpointer  user_data)
+{
+    // updates referring to operations as if they were
+    // items are rejected as a whole
+
+    g_autoptr (GBytes) delete = NULL;
+    g_autoptr (GBytes) insert = NULL;
+    g_autoptr (GError) error = NULL;
+
+    // The first replica's typing takes up sequence numbers
+    // 0 to 5, and formatting it takes up 6
+    type (fixture->editors[0], "Hello ");
+    set_bold (fixture, 0, 0, 5, TRUE);
+    sync (fixture, 0, 1);
+
+    // Deletes "H" and then the formatting operation
+    delete = g_bytes_new_static ("\x01\x02"
+                                 "\x01\x09\x00\x64\x01\x01\x00\x01"
+                                 "\x01\x09\x01\x65\x01\x01\x06\x01", 18);
+    g_assert_false (text_crdt_merge (fixture->replicas[1], delete, &error));
+    g_assert_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID);
+    g_clear_error (&error);
+    assert_text (fixture, 1, "Hello " TEXT);
+
+    // Continues the typing from after the formatting operation
+    insert = g_bytes_new_static ("\x01\x01"
+                                 "\x08\x01\x06\x32\x00\x02", 8);
+    g_assert_false (text_crdt_merge (fixture->replicas[1], insert, &error));
+    g_assert_error (error, TEXT_CRDT_ERROR, TEXT_CRDT_ERROR_INVALID);
+    assert_text (fixture, 1, "Hello " TEXT);
+
+    g_assert_cmpuint (text_crdt_get_n_pending (fixture->replicas[1]), ==, 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/collab/crdt/concurrent", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_concurrent,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/undo-conflict", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_undo_conflict,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/same-position", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_same_position,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/format", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_format,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/pending", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_pending,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/invalid", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_invalid,
+                crdt_fixture_tear_down);
+    g_test_add ("/text-engine/collab/crdt/dangling", CrdtFixture, NULL,
+                crdt_fixture_set_up, test_crdt_dangling,
+                crdt_fixture_tear_down);
+
+    return g_test_run ();
+}
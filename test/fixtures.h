@@ -0,0 +1,49 @@
+/* fixtures.h
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <model/document.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+
+// Sample document shared by the tests which replicate it between
+// several editors
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+
+#define TEXT RUN1 RUN2 "\n" RUN3 "\n"
+
+static TextDocument *
+create_document (void)
+{
+    TextDocument *doc;
+    TextFrame *frame;
+    TextParagraph *para1, *para2;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN2)));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    para2 = text_paragraph_new ();
+    text_paragraph_append_fragment(para2, TEXT_FRAGMENT (text_run_new (RUN3)));
+    text_frame_append_block (frame, TEXT_BLOCK (para2));
+
+    doc = text_document_new ();
+    doc->frame = frame;
+
+    return doc;
+}
@@ -0,0 +1,179 @@
+/* heightindex.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <layout/heightindex.h>
+
+static TextHeightIndex *
+_new_index (const int *heights,
+            int        n_heights)
+{
+    TextHeightIndex *index;
+    int i;
+
+    index = text_height_index_new ();
+    text_height_index_resize (index, n_heights);
+
+    for (i = 0; i < n_heights; i++)
+        text_height_index_set (index, i, heights[i]);
+
+    return index;
+}
+
+static void
+test_height_index_offset (void)
+{
+    // prefix sums give the offset of each entry
+
+    const int heights[] = { 10, 20, 0, 5, 15 };
+    g_autoptr (TextHeightIndex) index = _new_index (heights, G_N_ELEMENTS (heights));
+
+    g_assert_cmpint (text_height_index_get_size (index), ==, 5);
+    g_assert_cmpint (text_height_index_get (index, 1), ==, 20);
+
+    g_assert_cmpint (text_height_index_get_offset (index, 0), ==, 0);
+    g_assert_cmpint (text_height_index_get_offset (index, 1), ==, 10);
+    g_assert_cmpint (text_height_index_get_offset (index, 2), ==, 30);
+    g_assert_cmpint (text_height_index_get_offset (index, 3), ==, 30);
+    g_assert_cmpint (text_height_index_get_offset (index, 4), ==, 35);
+    g_assert_cmpint (text_height_index_get_offset (index, 5), ==, 50);
+    g_assert_cmpint (text_height_index_get_total (index), ==, 50);
+
+    // Updating one entry moves everything after it
+    text_height_index_set (index, 1, 25);
+    g_assert_cmpint (text_height_index_get_offset (index, 1), ==, 10);
+    g_assert_cmpint (text_height_index_get_offset (index, 4), ==, 40);
+    g_assert_cmpint (text_height_index_get_total (index), ==, 55);
+}
+
+static void
+test_height_index_find (void)
+{
+    // lookup by y returns the entry containing it
+
+    const int heights[] = { 10, 20, 0, 5, 15 };
+    g_autoptr (TextHeightIndex) empty = text_height_index_new ();
+    g_autoptr (TextHeightIndex) index = _new_index (heights, G_N_ELEMENTS (heights));
+
+    g_assert_cmpint (text_height_index_find (empty, 0), ==, -1);
+
+    g_assert_cmpint (text_height_index_find (index, 0), ==, 0);
+    g_assert_cmpint (text_height_index_find (index, 9), ==, 0);
+    g_assert_cmpint (text_height_index_find (index, 10), ==, 1);
+    g_assert_cmpint (text_height_index_find (index, 29), ==, 1);
+
+    // Empty entries never contain an offset
+    g_assert_cmpint (text_height_index_find (index, 30), ==, 3);
+    g_assert_cmpint (text_height_index_find (index, 35), ==, 4);
+    g_assert_cmpint (text_height_index_find (index, 49), ==, 4);
+
+    // Offsets outside the index are clamped
+    g_assert_cmpint (text_height_index_find (index, -5), ==, 0);
+    g_assert_cmpint (text_height_index_find (index, 50), ==, 4);
+    g_assert_cmpint (text_height_index_find (index, 1000), ==, 4);
+}
+
+static void
+test_height_index_resize (void)
+{
+    // resizing keeps the heights of remaining entries
+
+    const int heights[] = { 10, 20, 30, 40, 50, 60, 70 };
+    g_autoptr (TextHeightIndex) index = _new_index (heights, G_N_ELEMENTS (heights));
+
+    text_height_index_resize (index, 3);
+    g_assert_cmpint (text_height_index_get_size (index), ==, 3);
+    g_assert_cmpint (text_height_index_get_total (index), ==, 60);
+    g_assert_cmpint (text_height_index_find (index, 35), ==, 2);
+
+    // New entries start out empty
+    text_height_index_resize (index, 9);
+    g_assert_cmpint (text_height_index_get (index, 2), ==, 30);
+    g_assert_cmpint (text_height_index_get (index, 3), ==, 0);
+    g_assert_cmpint (text_height_index_get (index, 8), ==, 0);
+    g_assert_cmpint (text_height_index_get_offset (index, 8), ==, 60);
+    g_assert_cmpint (text_height_index_get_total (index), ==, 60);
+
+    text_height_index_set (index, 8, 5);
+    g_assert_cmpint (text_height_index_get_total (index), ==, 65);
+    g_assert_cmpint (text_height_index_find (index, 62), ==, 8);
+}
+
+static void
+test_height_index_random (void)
+{
+    // matches a linear scan over random updates and resizes
+
+    g_autoptr (TextHeightIndex) index = text_height_index_new ();
+    int heights[200] = { 0 };
+    int n_heights = 0;
+    int round;
+
+    for (round = 0; round < 2000; round++)
+    {
+        int offset;
+        int total;
+        int i;
+
+        if (g_test_rand_int_range (0, 10) == 0)
+        {
+            int n = g_test_rand_int_range (0, G_N_ELEMENTS (heights));
+
+            for (i = n_heights; i < n; i++)
+                heights[i] = 0;
+
+            n_heights = n;
+            text_height_index_resize (index, n_heights);
+        }
+        else if (n_heights > 0)
+        {
+            i = g_test_rand_int_range (0, n_heights);
+            heights[i] = g_test_rand_int_range (0, 4) * 10;
+            text_height_index_set (index, i, heights[i]);
+        }
+
+        total = 0;
+        for (i = 0; i < n_heights; i++)
+        {
+            g_assert_cmpint (text_height_index_get_offset (index, i), ==, total);
+            total += heights[i];
+        }
+
+        g_assert_cmpint (text_height_index_get_total (index), ==, total);
+
+        if (total == 0)
+            continue;
+
+        // Check the entry found for a random offset contains it
+        offset = g_test_rand_int_range (0, total);
+        i = text_height_index_find (index, offset);
+
+        g_assert_cmpint (heights[i], >, 0);
+        g_assert_cmpint (text_height_index_get_offset (index, i), <=, offset);
+        g_assert_cmpint (text_height_index_get_offset (index, i + 1), >, offset);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/text-engine/layout/height-index/offset", test_height_index_offset);
+    g_test_add_func ("/text-engine/layout/height-index/find", test_height_index_find);
+    g_test_add_func ("/text-engine/layout/height-index/resize", test_height_index_resize);
+    g_test_add_func ("/text-engine/layout/height-index/random", test_height_index_random);
+
+    return g_test_run ();
+}
@@ -0,0 +1,300 @@
+/* journal.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/document.h>
+#include <model/journal.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <editor/editor.h>
+
+typedef struct {
+    TextDocument *doc;
+    TextEditor *editor;
+
+    TextParagraph *para1;
+    TextRun *run1;
+    TextRun *run2;
+
+    // Changes reported by each emission
+    GPtrArray *emissions;
+} JournalFixture;
+
+#define RUN1 "Once upon a time there was a little dog, "
+#define RUN2 "and his name was Rover."
+
+static void
+changed_cb (TextJournal    *journal,
+            GPtrArray      *changes,
+            JournalFixture *fixture)
+{
+    g_ptr_array_add (fixture->emissions, g_ptr_array_ref (changes));
+}
+
+static void
+journal_fixture_set_up (JournalFixture *fixture,
+                        gconstpointer   user_data)
+{
+    TextFrame *frame;
+    TextParagraph *para1;
+    TextRun *run1, *run2;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    run1 = text_run_new (RUN1);
+    run2 = text_run_new (RUN2);
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (run1));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (run2));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    fixture->doc = text_document_new ();
+    fixture->doc->frame = frame;
+
+    fixture->editor = text_editor_new (fixture->doc);
+
+    text_editor_move_first (fixture->editor, TEXT_EDITOR_CURSOR);
+
+    fixture->para1 = para1;
+    fixture->run1 = run1;
+    fixture->run2 = run2;
+
+    fixture->emissions = g_ptr_array_new_with_free_func ((GDestroyNotify) g_ptr_array_unref);
+    g_signal_connect (text_document_get_journal (fixture->doc), "changed",
+                      G_CALLBACK (changed_cb), fixture);
+}
+
+static void
+journal_fixture_tear_down (JournalFixture *fixture,
+                           gconstpointer   user_data)
+{
+    g_ptr_array_unref (fixture->emissions);
+    g_object_unref (fixture->editor);
+    g_object_unref (fixture->doc);
+}
+
+static TextChange *
+get_change (JournalFixture *fixture,
+            guint           emission,
+            guint           index)
+{
+    GPtrArray *changes;
+
+    changes = g_ptr_array_index (fixture->emissions, emission);
+    g_assert_cmpuint (index, <, changes->len);
+
+    return g_ptr_array_index (changes, index);
+}
+
+static void
+test_journal_insert_text (JournalFixture *fixture,
+                          gconstpointer   user_data)
+{
+    // inserting text is reported as a single text change
+
+    TextChange *change;
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "and ");
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+
+    change = get_change (fixture, 0, 0);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_TEXT_INSERTED);
+    g_assert_true (change->node == TEXT_NODE (fixture->run1));
+    g_assert_true (change->parent == TEXT_NODE (fixture->para1));
+    g_assert_cmpint (change->index, ==, 5);
+    g_assert_cmpstr (change->text, ==, "and ");
+}
+
+static void
+test_journal_delete_text (JournalFixture *fixture,
+                          gconstpointer   user_data)
+{
+    // deleting text records the removed text
+
+    TextChange *change;
+
+    text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+
+    change = get_change (fixture, 0, 0);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_TEXT_DELETED);
+    g_assert_true (change->node == TEXT_NODE (fixture->run1));
+    g_assert_cmpint (change->index, ==, 0);
+    g_assert_cmpstr (change->text, ==, "Once ");
+}
+
+static void
+test_journal_split (JournalFixture *fixture,
+                    gconstpointer   user_data)
+{
+    // splitting a paragraph is reported once, ending with the
+    // insertion of the new paragraph into the frame
+
+    GPtrArray *changes;
+    TextChange *change;
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+    text_editor_split (fixture->editor, TEXT_EDITOR_CURSOR);
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+
+    changes = g_ptr_array_index (fixture->emissions, 0);
+    change = g_ptr_array_index (changes, changes->len - 1);
+
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_CHILD_INSERTED);
+    g_assert_true (change->parent == TEXT_NODE (fixture->doc->frame));
+    g_assert_true (TEXT_IS_PARAGRAPH (change->node));
+    g_assert_cmpint (change->index, ==, 1);
+}
+
+static void
+test_journal_replace (JournalFixture *fixture,
+                      gconstpointer   user_data)
+{
+    // the deletion and insertion of a replacement form one edit
+
+    TextChange *change;
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+    fixture->doc->selection = text_document_copy_mark (fixture->doc, fixture->doc->cursor);
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_SELECTION, 4);
+
+    text_editor_replace (fixture->editor, TEXT_EDITOR_CURSOR, TEXT_EDITOR_SELECTION, "over");
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+
+    change = get_change (fixture, 0, 0);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_TEXT_DELETED);
+    g_assert_cmpstr (change->text, ==, "upon");
+
+    change = get_change (fixture, 0, 1);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_TEXT_INSERTED);
+    g_assert_cmpstr (change->text, ==, "over");
+}
+
+static void
+test_journal_tree (JournalFixture *fixture,
+                   gconstpointer   user_data)
+{
+    // changes made to the tree outside of an edit are
+    // reported straight away
+
+    TextChange *change;
+    TextRun *run;
+
+    run = text_run_new ("");
+    text_paragraph_append_fragment (fixture->para1, TEXT_FRAGMENT (run));
+    text_node_delete (TEXT_NODE (run));
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 2);
+
+    change = get_change (fixture, 0, 0);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_CHILD_INSERTED);
+    g_assert_true (change->parent == TEXT_NODE (fixture->para1));
+    g_assert_true (change->node == TEXT_NODE (run));
+    g_assert_cmpint (change->index, ==, 2);
+
+    change = get_change (fixture, 1, 0);
+    g_assert_cmpint (change->type, ==, TEXT_CHANGE_CHILD_REMOVED);
+    g_assert_cmpint (change->index, ==, 2);
+}
+
+static void
+test_journal_nested (JournalFixture *fixture,
+                     gconstpointer   user_data)
+{
+    // nested edits are reported when the outermost one ends
+
+    TextJournal *journal;
+
+    journal = text_document_get_journal (fixture->doc);
+
+    text_journal_begin (journal);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "A");
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "B");
+    g_assert_cmpuint (fixture->emissions->len, ==, 0);
+    text_journal_end (journal);
+
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+    g_assert_cmpuint (((GPtrArray *) g_ptr_array_index (fixture->emissions, 0))->len, ==, 2);
+}
+
+static void
+test_journal_transaction (JournalFixture *fixture,
+                          gconstpointer   user_data)
+{
+    // edits inside a transaction are reported once it is
+    // committed, while marks stay up to date throughout
+
+    TextMark *cursor;
+    char *text;
+
+    cursor = fixture->doc->cursor;
+
+    text_editor_begin_transaction (fixture->editor);
+    g_assert_true (text_editor_in_transaction (fixture->editor));
+
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "A");
+    g_assert_cmpint (cursor->index, ==, 1);
+
+    text_editor_begin_transaction (fixture->editor);
+    text_editor_split (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_commit_transaction (fixture->editor);
+    g_assert_true (cursor->paragraph != fixture->para1);
+
+    text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, -1);
+    g_assert_true (cursor->paragraph == fixture->para1);
+    g_assert_cmpuint (fixture->emissions->len, ==, 0);
+
+    text_editor_commit_transaction (fixture->editor);
+    g_assert_false (text_editor_in_transaction (fixture->editor));
+    g_assert_cmpuint (fixture->emissions->len, ==, 1);
+
+    text = text_editor_dump_plain_text (fixture->editor);
+    g_assert_cmpstr (text, ==, "A" RUN1 RUN2);
+    g_free (text);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/model/journal/insert-text", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_insert_text,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/delete-text", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_delete_text,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/split", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_split,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/replace", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_replace,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/tree", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_tree,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/nested", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_nested,
+                journal_fixture_tear_down);
+    g_test_add ("/text-engine/model/journal/transaction", JournalFixture, NULL,
+                journal_fixture_set_up, test_journal_transaction,
+                journal_fixture_tear_down);
+
+    return g_test_run ();
+}
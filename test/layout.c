@@ -0,0 +1,172 @@
+/* layout.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <pango/pangocairo.h>
+#include <model/frame.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <layout/layout.h>
+
+// Enough paragraphs to be split between several shaping tasks
+#define N_PARAGRAPHS 64
+
+#define WIDTH 300
+
+typedef struct {
+    TextFrame *frame;
+    TextLayout *layout;
+    PangoContext *context;
+    TextLayoutBox *root;
+    PangoLayout *layouts[N_PARAGRAPHS];
+} LayoutFixture;
+
+static void
+layout_fixture_set_up (LayoutFixture *fixture,
+                       gconstpointer  user_data)
+{
+    fixture->frame = text_frame_new ();
+
+    for (int i = 0; i < N_PARAGRAPHS; i++)
+    {
+        TextParagraph *paragraph = text_paragraph_new ();
+
+        text_paragraph_append_fragment (paragraph, TEXT_FRAGMENT (text_run_new ("Once upon a time")));
+        text_frame_append_block (fixture->frame, TEXT_BLOCK (paragraph));
+    }
+
+    fixture->context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+    fixture->layout = text_layout_new ();
+    text_layout_set_parallel (fixture->layout, GPOINTER_TO_INT (user_data));
+}
+
+static void
+layout_fixture_tear_down (LayoutFixture *fixture,
+                          gconstpointer  user_data)
+{
+    g_clear_object (&fixture->root);
+    g_object_unref (fixture->layout);
+    g_object_unref (fixture->context);
+    g_object_unref (fixture->frame);
+}
+
+// Collects the layout of every paragraph, optionally checking they
+// are the same as the ones collected before
+static void
+collect_layouts (LayoutFixture *fixture,
+                 gboolean       same)
+{
+    TextNode *iter;
+    int i = 0;
+
+    for (iter = text_node_get_first_child (TEXT_NODE (fixture->root));
+         iter != NULL;
+         iter = text_node_get_next (iter))
+    {
+        PangoLayout *layout;
+
+        layout = text_layout_block_get_pango_layout (TEXT_LAYOUT_BLOCK (iter));
+        g_assert_nonnull (layout);
+
+        if (same)
+            g_assert_true (layout == fixture->layouts[i]);
+
+        fixture->layouts[i++] = layout;
+    }
+
+    g_assert_cmpint (i, ==, N_PARAGRAPHS);
+}
+
+static void
+mark_all_dirty (LayoutFixture *fixture)
+{
+    TextNode *iter;
+
+    for (iter = text_node_get_first_child (TEXT_NODE (fixture->frame));
+         iter != NULL;
+         iter = text_node_get_next (iter))
+        text_layout_mark_dirty (fixture->layout, TEXT_ITEM (iter));
+}
+
+static void
+test_layout_reuse (LayoutFixture *fixture,
+                   gconstpointer  user_data)
+{
+    // re-shaping keeps the layout of every block, whichever
+    // thread it was shaped on
+
+    fixture->root = text_layout_build_layout_tree (fixture->layout, fixture->context,
+                                                   fixture->frame, WIDTH);
+    collect_layouts (fixture, FALSE);
+
+    mark_all_dirty (fixture);
+    text_layout_relayout (fixture->layout, fixture->context, fixture->root, WIDTH);
+    collect_layouts (fixture, TRUE);
+
+    // Switching between parallel and serial passes
+    text_layout_set_parallel (fixture->layout, !text_layout_get_parallel (fixture->layout));
+    mark_all_dirty (fixture);
+    text_layout_relayout (fixture->layout, fixture->context, fixture->root, WIDTH);
+    collect_layouts (fixture, TRUE);
+}
+
+static void
+test_layout_font_change (LayoutFixture *fixture,
+                         gconstpointer  user_data)
+{
+    // blocks are shaped with the new font of the context
+
+    g_autoptr (PangoFontDescription) font = NULL;
+    TextNode *iter;
+
+    fixture->root = text_layout_build_layout_tree (fixture->layout, fixture->context,
+                                                   fixture->frame, WIDTH);
+
+    font = pango_font_description_from_string ("Sans 30");
+    pango_context_set_font_description (fixture->context, font);
+
+    mark_all_dirty (fixture);
+    text_layout_relayout (fixture->layout, fixture->context, fixture->root, WIDTH);
+
+    for (iter = text_node_get_first_child (TEXT_NODE (fixture->root));
+         iter != NULL;
+         iter = text_node_get_next (iter))
+    {
+        PangoLayout *layout;
+        PangoContext *context;
+
+        layout = text_layout_block_get_pango_layout (TEXT_LAYOUT_BLOCK (iter));
+        context = pango_layout_get_context (layout);
+
+        g_assert_true (pango_font_description_equal (pango_context_get_font_description (context), font));
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/layout/block/reuse", LayoutFixture, GINT_TO_POINTER (FALSE),
+                layout_fixture_set_up, test_layout_reuse,
+                layout_fixture_tear_down);
+    g_test_add ("/text-engine/layout/block/reuse-parallel", LayoutFixture, GINT_TO_POINTER (TRUE),
+                layout_fixture_set_up, test_layout_reuse,
+                layout_fixture_tear_down);
+    g_test_add ("/text-engine/layout/block/font-change-parallel", LayoutFixture, GINT_TO_POINTER (TRUE),
+                layout_fixture_set_up, test_layout_font_change,
+                layout_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -430,6 +430,94 @@ test_split_after (MarkFixture   *fixture,
     g_assert_true (cursor->paragraph == new);
 }
 
+static void
+test_buckets (MarkFixture   *fixture,
+              gconstpointer  user_data)
+{
+    // marks are found through the paragraph they lie in,
+    // and follow the paragraph when they are moved
+
+    g_autoptr (GPtrArray) marks = NULL;
+    TextMark *mark1;
+    TextMark *mark2;
+    TextParagraph *new;
+
+    mark1 = text_document_create_mark (fixture->doc, fixture->para1, 24, TEXT_GRAVITY_LEFT);
+    mark2 = text_document_create_mark (fixture->doc, fixture->para1, 2, TEXT_GRAVITY_LEFT);
+    text_document_create_mark (fixture->doc, fixture->para2, 2, TEXT_GRAVITY_LEFT);
+
+    marks = g_ptr_array_new ();
+    text_document_append_marks (fixture->doc, fixture->para1, marks);
+    g_assert_cmpuint (marks->len, ==, 2);
+
+    // Move mark1 into a new paragraph
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 9);
+    text_editor_split (fixture->editor, TEXT_EDITOR_CURSOR);
+    new = TEXT_PARAGRAPH (text_node_get_next (TEXT_NODE (fixture->para1)));
+
+    g_ptr_array_set_size (marks, 0);
+    text_document_append_marks (fixture->doc, fixture->para1, marks);
+    g_assert_cmpuint (marks->len, ==, 1);
+    g_assert_true (g_ptr_array_index (marks, 0) == mark2);
+
+    g_ptr_array_set_size (marks, 0);
+    text_document_append_marks (fixture->doc, new, marks);
+    g_assert_cmpuint (marks->len, ==, 1);
+    g_assert_true (g_ptr_array_index (marks, 0) == mark1);
+
+    // Deleted marks are forgotten
+    text_document_delete_mark (fixture->doc, mark1);
+    text_mark_free (mark1);
+
+    g_ptr_array_set_size (marks, 0);
+    text_document_append_marks (fixture->doc, new, marks);
+    g_assert_cmpuint (marks->len, ==, 0);
+}
+
+static void
+test_all_marks_order (MarkFixture   *fixture,
+                      gconstpointer  user_data)
+{
+    // all marks are listed in the order they were created, whichever
+    // paragraph they lie in, followed by the cursor
+
+    TextMark *created[6];
+    GSList *marks;
+    GSList *iter;
+    int i;
+
+    for (i = 0; i < (int) G_N_ELEMENTS (created); i++)
+    {
+        TextParagraph *paragraph = (i % 2) ? fixture->para1 : fixture->para2;
+
+        created[i] = text_document_create_mark (fixture->doc, paragraph, i, TEXT_GRAVITY_LEFT);
+    }
+
+    // Moving between paragraphs doesn't change the order
+    text_mark_set_position (created[0], fixture->para1, 0);
+
+    marks = text_document_get_all_marks (fixture->doc);
+    iter = marks;
+
+    for (i = 0; i < (int) G_N_ELEMENTS (created); i++)
+    {
+        g_assert_nonnull (iter);
+        g_assert_true (iter->data == created[i]);
+        iter = iter->next;
+    }
+
+    g_assert_nonnull (iter);
+    g_assert_true (iter->data == fixture->doc->cursor);
+
+    g_slist_free (marks);
+
+    for (i = 0; i < (int) G_N_ELEMENTS (created); i++)
+    {
+        text_document_delete_mark (fixture->doc, created[i]);
+        text_mark_free (created[i]);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -499,6 +587,13 @@ main (int argc, char *argv[])
                 mark_fixture_set_up, test_split_after,
                 mark_fixture_tear_down);
 
+    g_test_add ("/text-engine/editor/mark/test-buckets", MarkFixture, NULL,
+                mark_fixture_set_up, test_buckets,
+                mark_fixture_tear_down);
+    g_test_add ("/text-engine/editor/mark/test-all-marks-order", MarkFixture, NULL,
+                mark_fixture_set_up, test_all_marks_order,
+                mark_fixture_tear_down);
+
     return g_test_run ();
 }
 
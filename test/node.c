@@ -0,0 +1,478 @@
+/* node.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <tree/node.h>
+
+// TextNode is abstract, so the tests use a minimal subclass which
+// measures its weight and counts itself
+#define TEST_TYPE_NODE (test_node_get_type())
+
+G_DECLARE_FINAL_TYPE (TestNode, test_node, TEST, NODE, TextNode)
+
+enum {
+    AGGREGATE_WEIGHT,
+    AGGREGATE_COUNT,
+};
+
+struct _TestNode
+{
+    TextNode parent_instance;
+
+    int weight;
+};
+
+G_DEFINE_FINAL_TYPE (TestNode, test_node, TEXT_TYPE_NODE)
+
+static void
+test_node_measure (TextNode *node,
+                   int      *aggregates)
+{
+    aggregates [AGGREGATE_WEIGHT] += TEST_NODE (node)->weight;
+    aggregates [AGGREGATE_COUNT] += 1;
+}
+
+static void
+test_node_class_init (TestNodeClass *klass)
+{
+    TEXT_NODE_CLASS (klass)->measure = test_node_measure;
+}
+
+static void
+test_node_init (TestNode *self)
+{
+}
+
+static TextNode *
+test_node_new (void)
+{
+    TextNode *node;
+
+    node = g_object_new (TEST_TYPE_NODE, NULL);
+    text_node_update_aggregates (node);
+
+    return node;
+}
+
+static void
+test_node_set_weight (TextNode *node,
+                      int       weight)
+{
+    TEST_NODE (node)->weight = weight;
+    text_node_update_aggregates (node);
+}
+
+// The parent holds the only reference to the new child
+static TextNode *
+_insert (TextNode *parent,
+         int       index)
+{
+    TextNode *child;
+
+    child = test_node_new ();
+    text_node_insert_child (parent, child, index);
+    g_object_unref (child);
+
+    return child;
+}
+
+static TextNode *
+_insert_weighted (TextNode *parent,
+                  int       index,
+                  int       weight)
+{
+    TextNode *child;
+
+    child = _insert (parent, index);
+    test_node_set_weight (child, weight);
+
+    return child;
+}
+
+// Checks the sibling list, nth child and index of every child of
+// @parent against @expected
+static void
+_check_children (TextNode  *parent,
+                 GPtrArray *expected)
+{
+    TextNode *iter;
+    guint i;
+
+    g_assert_cmpint (text_node_get_num_children (parent), ==, expected->len);
+
+    for (i = 0, iter = text_node_get_first_child (parent);
+         i < expected->len;
+         i++, iter = text_node_get_next (iter))
+    {
+        g_assert_true (iter == g_ptr_array_index (expected, i));
+        g_assert_true (text_node_get_nth_child (parent, i) == iter);
+        g_assert_cmpint (text_node_get_index (iter), ==, i);
+    }
+
+    g_assert_null (iter);
+    g_assert_null (text_node_get_nth_child (parent, -1));
+    g_assert_null (text_node_get_nth_child (parent, expected->len));
+}
+
+static void
+test_node_insert_before (void)
+{
+    // inserting before a child shifts it and its later siblings
+
+    g_autoptr (TextNode) parent = test_node_new ();
+    g_autoptr (GPtrArray) expected = g_ptr_array_new ();
+    TextNode *first, *second, *child;
+
+    first = _insert (parent, 0);
+    second = _insert (parent, 1);
+    g_ptr_array_add (expected, first);
+    g_ptr_array_add (expected, second);
+
+    child = test_node_new ();
+    text_node_insert_child_before (parent, child, second);
+    g_object_unref (child);
+    g_ptr_array_insert (expected, 1, child);
+    _check_children (parent, expected);
+
+    child = test_node_new ();
+    text_node_insert_child_before (parent, child, first);
+    g_object_unref (child);
+    g_ptr_array_insert (expected, 0, child);
+    _check_children (parent, expected);
+}
+
+static void
+test_node_insert_after (void)
+{
+    // inserting after a child shifts only its later siblings
+
+    g_autoptr (TextNode) parent = test_node_new ();
+    g_autoptr (GPtrArray) expected = g_ptr_array_new ();
+    TextNode *first, *second, *child;
+
+    first = _insert (parent, 0);
+    second = _insert (parent, 1);
+    g_ptr_array_add (expected, first);
+    g_ptr_array_add (expected, second);
+
+    child = test_node_new ();
+    text_node_insert_child_after (parent, child, first);
+    g_object_unref (child);
+    g_ptr_array_insert (expected, 1, child);
+    _check_children (parent, expected);
+
+    child = test_node_new ();
+    text_node_insert_child_after (parent, child, second);
+    g_object_unref (child);
+    g_ptr_array_add (expected, child);
+    _check_children (parent, expected);
+}
+
+static void
+test_node_remove (void)
+{
+    // removed children are no longer indexed
+
+    g_autoptr (TextNode) parent = test_node_new ();
+    g_autoptr (GPtrArray) expected = g_ptr_array_new ();
+    TextNode *child;
+    int i;
+
+    for (i = 0; i < 5; i++)
+        g_ptr_array_add (expected, _insert (parent, i));
+
+    // Middle
+    child = g_ptr_array_steal_index (expected, 2);
+    g_object_ref (child);
+    text_node_delete_child (parent, child);
+    g_assert_cmpint (text_node_get_index (child), ==, -1);
+    g_object_unref (child);
+    _check_children (parent, expected);
+
+    // First and last
+    text_node_delete_child (parent, g_ptr_array_steal_index (expected, 0));
+    _check_children (parent, expected);
+
+    text_node_delete_child (parent, g_ptr_array_steal_index (expected, expected->len - 1));
+    _check_children (parent, expected);
+
+    // Everything
+    while (expected->len > 0)
+        text_node_delete_child (parent, g_ptr_array_steal_index (expected, 0));
+    _check_children (parent, expected);
+}
+
+static void
+test_node_random (void)
+{
+    // random edits keep the index in line with a reference list
+
+    g_autoptr (TextNode) parent = test_node_new ();
+    g_autoptr (GPtrArray) expected = g_ptr_array_new ();
+    int i;
+
+    for (i = 0; i < 2000; i++)
+    {
+        TextNode *compare;
+        TextNode *child;
+        int index;
+
+        // Favour insertions so the tree grows
+        if (expected->len == 0 || g_test_rand_int_range (0, 3) != 0)
+        {
+            index = g_test_rand_int_range (0, expected->len + 1);
+            child = test_node_new ();
+
+            if (index == (int) expected->len)
+                text_node_append_child (parent, child);
+            else if (g_test_rand_bit ())
+            {
+                compare = g_ptr_array_index (expected, index);
+                text_node_insert_child_before (parent, child, compare);
+            }
+            else
+            {
+                // Insert after the previous sibling instead
+                compare = text_node_get_nth_child (parent, index - 1);
+
+                if (compare)
+                    text_node_insert_child_after (parent, child, compare);
+                else
+                    text_node_prepend_child (parent, child);
+            }
+
+            g_object_unref (child);
+            g_ptr_array_insert (expected, index, child);
+        }
+        else
+        {
+            index = g_test_rand_int_range (0, expected->len);
+            child = g_ptr_array_steal_index (expected, index);
+            text_node_delete_child (parent, child);
+        }
+
+        // Checking every child each step is quadratic, so spot check
+        // a random child and only verify the whole list periodically
+        if (expected->len > 0)
+        {
+            index = g_test_rand_int_range (0, expected->len);
+            child = g_ptr_array_index (expected, index);
+
+            g_assert_true (text_node_get_nth_child (parent, index) == child);
+            g_assert_cmpint (text_node_get_index (child), ==, index);
+        }
+
+        if (i % 100 == 0)
+            _check_children (parent, expected);
+    }
+
+    _check_children (parent, expected);
+}
+
+static void
+test_node_aggregate_insert (void)
+{
+    // inserting a subtree adds its aggregates to every ancestor
+
+    g_autoptr (TextNode) root = test_node_new ();
+    TextNode *parent;
+
+    parent = _insert (root, 0);
+    _insert_weighted (parent, 0, 3);
+    _insert_weighted (parent, 1, 4);
+
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_WEIGHT), ==, 7);
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_COUNT), ==, 3);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 7);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_COUNT), ==, 4);
+
+    // An already populated subtree
+    parent = test_node_new ();
+    _insert_weighted (parent, 0, 5);
+    text_node_insert_child (root, parent, 0);
+    g_object_unref (parent);
+
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 12);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_COUNT), ==, 6);
+}
+
+static void
+test_node_aggregate_remove (void)
+{
+    // removing a subtree takes its aggregates out of every ancestor
+
+    g_autoptr (TextNode) root = test_node_new ();
+    g_autoptr (TextNode) removed = NULL;
+    TextNode *parent;
+    TextNode *child;
+
+    parent = _insert (root, 0);
+    _insert_weighted (parent, 0, 3);
+    child = _insert (parent, 1);
+    _insert_weighted (child, 0, 4);
+    _insert_weighted (child, 1, 2);
+
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 9);
+
+    removed = text_node_unparent (child);
+
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_WEIGHT), ==, 3);
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_COUNT), ==, 2);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 3);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_COUNT), ==, 3);
+
+    // The removed subtree keeps its own totals
+    g_assert_cmpint (text_node_get_aggregate (removed, AGGREGATE_WEIGHT), ==, 6);
+    g_assert_cmpint (text_node_get_aggregate (removed, AGGREGATE_COUNT), ==, 3);
+}
+
+static void
+test_node_aggregate_update (void)
+{
+    // updating a node applies the difference to every ancestor
+
+    g_autoptr (TextNode) root = test_node_new ();
+    TextNode *parent;
+    TextNode *child;
+
+    parent = _insert (root, 0);
+    _insert_weighted (parent, 0, 3);
+    child = _insert_weighted (parent, 1, 4);
+    _insert_weighted (root, 1, 1);
+
+    test_node_set_weight (child, 10);
+    g_assert_cmpint (text_node_get_aggregate (child, AGGREGATE_WEIGHT), ==, 10);
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_WEIGHT), ==, 13);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 14);
+
+    // A node's own contribution is separate from its children's
+    test_node_set_weight (parent, 2);
+    g_assert_cmpint (text_node_get_aggregate (parent, AGGREGATE_WEIGHT), ==, 15);
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_WEIGHT), ==, 16);
+
+    // Counts are untouched
+    g_assert_cmpint (text_node_get_aggregate (root, AGGREGATE_COUNT), ==, 5);
+
+    // Siblings after the updated node are offset by the difference
+    test_node_set_weight (child, 0);
+    g_assert_cmpint (text_node_get_offset (text_node_get_nth_child (root, 1), AGGREGATE_WEIGHT), ==, 5);
+}
+
+static void
+test_node_offset (void)
+{
+    // offsets sum the aggregates of every preceding node
+
+    g_autoptr (TextNode) root = test_node_new ();
+    TextNode *first, *second;
+    TextNode *nested[3];
+    int i;
+
+    first = _insert (root, 0);
+    for (i = 0; i < 3; i++)
+        nested[i] = _insert_weighted (first, i, i + 1);
+
+    second = _insert (root, 1);
+    _insert_weighted (second, 0, 10);
+
+    g_assert_cmpint (text_node_get_offset (root, AGGREGATE_WEIGHT), ==, 0);
+    g_assert_cmpint (text_node_get_offset (first, AGGREGATE_WEIGHT), ==, 0);
+    g_assert_cmpint (text_node_get_offset (nested[0], AGGREGATE_WEIGHT), ==, 0);
+    g_assert_cmpint (text_node_get_offset (nested[1], AGGREGATE_WEIGHT), ==, 1);
+    g_assert_cmpint (text_node_get_offset (nested[2], AGGREGATE_WEIGHT), ==, 3);
+    g_assert_cmpint (text_node_get_offset (second, AGGREGATE_WEIGHT), ==, 6);
+    g_assert_cmpint (text_node_get_offset (text_node_get_first_child (second), AGGREGATE_WEIGHT), ==, 6);
+
+    // Preceding siblings are counted along with their descendants,
+    // but the ancestors themselves are not
+    g_assert_cmpint (text_node_get_offset (nested[2], AGGREGATE_COUNT), ==, 2);
+    g_assert_cmpint (text_node_get_offset (second, AGGREGATE_COUNT), ==, 4);
+
+    // Offsets follow removals
+    text_node_delete_child (first, nested[1]);
+    g_assert_cmpint (text_node_get_offset (nested[2], AGGREGATE_WEIGHT), ==, 1);
+    g_assert_cmpint (text_node_get_offset (second, AGGREGATE_WEIGHT), ==, 4);
+}
+
+static void
+test_node_find_child (void)
+{
+    // a child contains the offsets from its start up to, but not
+    // including, its end
+
+    const int weights[TEXT_NODE_N_AGGREGATES] = { 1, 0, 0, 0 };
+    g_autoptr (TextNode) root = test_node_new ();
+    TextNode *children[4];
+    int preceding[TEXT_NODE_N_AGGREGATES];
+    int offset;
+
+    children[0] = _insert_weighted (root, 0, 3);
+    children[1] = _insert_weighted (root, 1, 0);
+    children[2] = _insert_weighted (root, 2, 2);
+    children[3] = _insert_weighted (root, 3, 1);
+
+    offset = 0;
+    g_assert_true (text_node_find_child (root, weights, &offset, preceding) == children[0]);
+    g_assert_cmpint (offset, ==, 0);
+    g_assert_cmpint (preceding[AGGREGATE_WEIGHT], ==, 0);
+
+    offset = 2;
+    g_assert_true (text_node_find_child (root, weights, &offset, NULL) == children[0]);
+    g_assert_cmpint (offset, ==, 2);
+
+    // The boundary belongs to the next child with any weight,
+    // skipping over empty children
+    offset = 3;
+    g_assert_true (text_node_find_child (root, weights, &offset, preceding) == children[2]);
+    g_assert_cmpint (offset, ==, 0);
+    g_assert_cmpint (preceding[AGGREGATE_WEIGHT], ==, 3);
+    g_assert_cmpint (preceding[AGGREGATE_COUNT], ==, 2);
+
+    offset = 5;
+    g_assert_true (text_node_find_child (root, weights, &offset, preceding) == children[3]);
+    g_assert_cmpint (offset, ==, 0);
+    g_assert_cmpint (preceding[AGGREGATE_WEIGHT], ==, 5);
+    g_assert_cmpint (preceding[AGGREGATE_COUNT], ==, 3);
+
+    // Out of range
+    offset = 6;
+    g_assert_null (text_node_find_child (root, weights, &offset, NULL));
+    offset = -1;
+    g_assert_null (text_node_find_child (root, weights, &offset, NULL));
+
+    // Boundaries move with updates
+    test_node_set_weight (children[1], 1);
+    offset = 3;
+    g_assert_true (text_node_find_child (root, weights, &offset, NULL) == children[1]);
+    offset = 4;
+    g_assert_true (text_node_find_child (root, weights, &offset, NULL) == children[2]);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/text-engine/tree/node/insert-before", test_node_insert_before);
+    g_test_add_func ("/text-engine/tree/node/insert-after", test_node_insert_after);
+    g_test_add_func ("/text-engine/tree/node/remove", test_node_remove);
+    g_test_add_func ("/text-engine/tree/node/random", test_node_random);
+    g_test_add_func ("/text-engine/tree/node/aggregate/insert", test_node_aggregate_insert);
+    g_test_add_func ("/text-engine/tree/node/aggregate/remove", test_node_aggregate_remove);
+    g_test_add_func ("/text-engine/tree/node/aggregate/update", test_node_aggregate_update);
+    g_test_add_func ("/text-engine/tree/node/offset", test_node_offset);
+    g_test_add_func ("/text-engine/tree/node/find-child", test_node_find_child);
+
+    return g_test_run ();
+}
@@ -0,0 +1,235 @@
+/* offset.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/document.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <editor/editor.h>
+
+typedef struct {
+    TextDocument *doc;
+    TextEditor *editor;
+
+    TextParagraph *para1;
+    TextParagraph *para2;
+    TextParagraph *para3;
+} OffsetFixture;
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+#define RUN4 "By J. R. R. Tolkien"
+
+static void
+offset_fixture_set_up (OffsetFixture *fixture,
+                       gconstpointer  user_data)
+{
+    TextFrame *frame;
+    TextParagraph *para1, *para2, *para3;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new ("")));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN2)));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    para2 = text_paragraph_new ();
+    text_paragraph_append_fragment(para2, TEXT_FRAGMENT (text_run_new (RUN3)));
+    text_frame_append_block (frame, TEXT_BLOCK (para2));
+
+    para3 = text_paragraph_new ();
+    text_paragraph_append_fragment(para3, TEXT_FRAGMENT (text_run_new (RUN4)));
+    text_frame_append_block (frame, TEXT_BLOCK (para3));
+
+    fixture->doc = text_document_new ();
+    fixture->doc->frame = frame;
+
+    fixture->editor = text_editor_new (fixture->doc);
+
+    text_editor_move_first (fixture->editor, TEXT_EDITOR_CURSOR);
+
+    fixture->para1 = para1;
+    fixture->para2 = para2;
+    fixture->para3 = para3;
+}
+
+static void
+offset_fixture_tear_down (OffsetFixture *fixture,
+                          gconstpointer  user_data)
+{
+    g_object_unref (fixture->editor);
+    g_object_unref (fixture->doc);
+}
+
+static void
+test_offset_lengths (OffsetFixture *fixture,
+                     gconstpointer  user_data)
+{
+    // lengths are maintained for every subtree
+
+    TextNode *frame = TEXT_NODE (fixture->doc->frame);
+
+    g_assert_cmpint (text_paragraph_get_length (fixture->para1), ==, g_utf8_strlen (RUN1 RUN2, -1));
+    g_assert_cmpint (text_paragraph_get_size_bytes (fixture->para1), ==, strlen (RUN1 RUN2));
+
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_CHARS), ==,
+                     g_utf8_strlen (RUN1 RUN2 RUN3 RUN4, -1));
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_BYTES), ==,
+                     strlen (RUN1 RUN2 RUN3 RUN4));
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_PARAGRAPHS), ==, 3);
+}
+
+static void
+test_offset_edit (OffsetFixture *fixture,
+                  gconstpointer  user_data)
+{
+    // lengths follow edits made through the editor
+
+    TextNode *frame = TEXT_NODE (fixture->doc->frame);
+
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "ñ");
+    g_assert_cmpint (text_paragraph_get_length (fixture->para1), ==, g_utf8_strlen (RUN1 RUN2, -1) + 1);
+    g_assert_cmpint (text_paragraph_get_size_bytes (fixture->para1), ==, strlen (RUN1 RUN2) + 2);
+
+    text_editor_split (fixture->editor, TEXT_EDITOR_CURSOR);
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_PARAGRAPHS), ==, 4);
+
+    text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, -1);
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_PARAGRAPHS), ==, 3);
+    g_assert_cmpint (text_node_get_aggregate (frame, TEXT_ITEM_AGGREGATE_CHARS), ==,
+                     g_utf8_strlen (RUN1 RUN2 RUN3 RUN4, -1) + 1);
+}
+
+static void
+test_offset_round_trip (OffsetFixture *fixture,
+                        gconstpointer  user_data)
+{
+    // every position converts to the offset of the same
+    // character in the plain text and back again
+
+    const char *text = RUN1 RUN2 "\n" RUN3 "\n" RUN4;
+    TextParagraph *paragraphs[] = { fixture->para1, fixture->para2, fixture->para3 };
+    int n_chars;
+    int i;
+
+    n_chars = (int) g_utf8_strlen (text, -1);
+
+    for (i = 0; i <= n_chars; i++)
+    {
+        TextParagraph *paragraph;
+        TextMark *mark;
+        const char *line;
+        const char *pos;
+        int n_line;
+        int index;
+
+        pos = g_utf8_offset_to_pointer (text, i);
+
+        // Find the expected position by scanning the plain text
+        n_line = 0;
+        line = text;
+
+        for (const char *c = text; c < pos; c++)
+        {
+            if (*c == '\n')
+            {
+                n_line++;
+                line = c + 1;
+            }
+        }
+
+        g_assert_true (text_document_get_position_at_char_offset (fixture->doc, i, &paragraph, &index));
+        g_assert_true (paragraph == paragraphs[n_line]);
+        g_assert_cmpint (index, ==, pos - line);
+
+        g_assert_true (text_document_get_position_at_byte_offset (fixture->doc, (int) (pos - text), &paragraph, &index));
+        g_assert_true (paragraph == paragraphs[n_line]);
+        g_assert_cmpint (index, ==, pos - line);
+
+        mark = text_document_create_mark_at_offset (fixture->doc, i, TEXT_GRAVITY_LEFT);
+        g_assert_nonnull (mark);
+        g_assert_cmpint (text_document_get_char_offset (fixture->doc, mark), ==, i);
+        g_assert_cmpint (text_document_get_byte_offset (fixture->doc, mark), ==, pos - text);
+        text_document_delete_mark (fixture->doc, mark);
+        text_mark_free (mark);
+    }
+}
+
+static void
+test_offset_paragraph (OffsetFixture *fixture,
+                       gconstpointer  user_data)
+{
+    // byte indices and character offsets within a paragraph
+    // convert both ways, directly for ASCII paragraphs
+
+    const char *text = RUN1 RUN2;
+    const char *ptr;
+
+    g_assert_false (text_paragraph_is_ascii (fixture->para1));
+    g_assert_true (text_paragraph_is_ascii (fixture->para3));
+
+    for (ptr = text; *ptr; ptr = g_utf8_next_char (ptr))
+    {
+        int offset = (int) g_utf8_pointer_to_offset (text, ptr);
+
+        g_assert_cmpint (text_paragraph_get_offset_at_index (fixture->para1, (int) (ptr - text)), ==, offset);
+        g_assert_cmpint (text_paragraph_get_index_at_offset (fixture->para1, offset), ==, ptr - text);
+    }
+
+    g_assert_cmpint (text_paragraph_get_index_at_offset (fixture->para1, 1000), ==, strlen (text));
+    g_assert_cmpint (text_paragraph_get_index_at_offset (fixture->para3, 7), ==, 7);
+    g_assert_cmpint (text_paragraph_get_offset_at_index (fixture->para3, 7), ==, 7);
+}
+
+static void
+test_offset_out_of_range (OffsetFixture *fixture,
+                          gconstpointer  user_data)
+{
+    // offsets past the end of the document are rejected
+
+    int n_chars;
+
+    n_chars = (int) g_utf8_strlen (RUN1 RUN2 "\n" RUN3 "\n" RUN4, -1);
+
+    g_assert_false (text_document_get_position_at_char_offset (fixture->doc, n_chars + 1, NULL, NULL));
+    g_assert_false (text_document_get_position_at_char_offset (fixture->doc, -1, NULL, NULL));
+    g_assert_null (text_document_create_mark_at_offset (fixture->doc, n_chars + 1, TEXT_GRAVITY_LEFT));
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/model/offset/lengths", OffsetFixture, NULL,
+                offset_fixture_set_up, test_offset_lengths,
+                offset_fixture_tear_down);
+    g_test_add ("/text-engine/model/offset/edit", OffsetFixture, NULL,
+                offset_fixture_set_up, test_offset_edit,
+                offset_fixture_tear_down);
+    g_test_add ("/text-engine/model/offset/round-trip", OffsetFixture, NULL,
+                offset_fixture_set_up, test_offset_round_trip,
+                offset_fixture_tear_down);
+    g_test_add ("/text-engine/model/offset/paragraph", OffsetFixture, NULL,
+                offset_fixture_set_up, test_offset_paragraph,
+                offset_fixture_tear_down);
+    g_test_add ("/text-engine/model/offset/out-of-range", OffsetFixture, NULL,
+                offset_fixture_set_up, test_offset_out_of_range,
+                offset_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,201 @@
+/* paragraph.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+
+typedef struct {
+    TextParagraph *paragraph;
+} ParagraphFixture;
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+
+#define TEXT RUN1 RUN2 RUN3
+
+static void
+paragraph_fixture_set_up (ParagraphFixture *fixture,
+                          gconstpointer     user_data)
+{
+    TextRun *run2;
+
+    fixture->paragraph = text_paragraph_new ();
+
+    // Leave the second run split over several slices
+    run2 = text_run_new ("there a little dög, ");
+    text_run_insert_text (run2, 6, "was ");
+
+    text_paragraph_append_fragment (fixture->paragraph, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment (fixture->paragraph, TEXT_FRAGMENT (text_run_new ("")));
+    text_paragraph_append_fragment (fixture->paragraph, TEXT_FRAGMENT (run2));
+    text_paragraph_append_fragment (fixture->paragraph, TEXT_FRAGMENT (text_run_new (RUN3)));
+}
+
+static void
+paragraph_fixture_tear_down (ParagraphFixture *fixture,
+                             gconstpointer     user_data)
+{
+    g_object_unref (fixture->paragraph);
+}
+
+static char *
+collect_range (TextParagraph *paragraph,
+               int            start_index,
+               int            end_index)
+{
+    TextParagraphIter iter;
+    GString *string;
+    const char *slice;
+    gsize length;
+
+    string = g_string_new (NULL);
+    text_paragraph_iter_init_range (&iter, paragraph, start_index, end_index);
+
+    while (text_paragraph_iter_next (&iter, &slice, &length))
+    {
+        g_assert_cmpuint (length, >, 0);
+        g_string_append_len (string, slice, length);
+    }
+
+    return g_string_free (string, FALSE);
+}
+
+static void
+test_paragraph_slices (ParagraphFixture *fixture,
+                       gconstpointer     user_data)
+{
+    // the slices of a paragraph form its text
+
+    g_autofree char *text = NULL;
+    g_autofree char *collected = NULL;
+
+    text = text_paragraph_get_text (fixture->paragraph);
+    g_assert_cmpstr (text, ==, TEXT);
+
+    collected = collect_range (fixture->paragraph, 0, -1);
+    g_assert_cmpstr (collected, ==, TEXT);
+}
+
+static void
+test_paragraph_slice_range (ParagraphFixture *fixture,
+                            gconstpointer     user_data)
+{
+    // every range yields the matching part of the text
+
+    int size;
+    int start;
+    int end;
+
+    size = (int) strlen (TEXT);
+
+    for (start = 0; start <= size; start++)
+    {
+        for (end = start; end <= size; end++)
+        {
+            g_autofree char *expected = NULL;
+            g_autofree char *collected = NULL;
+
+            expected = g_strndup (TEXT + start, end - start);
+            collected = collect_range (fixture->paragraph, start, end);
+            g_assert_cmpstr (collected, ==, expected);
+        }
+    }
+}
+
+static void
+test_paragraph_peek_text (ParagraphFixture *fixture,
+                          gconstpointer     user_data)
+{
+    // the flattened text is reused until the paragraph changes
+
+    const char *text;
+    TextNode *last;
+
+    text = text_paragraph_peek_text (fixture->paragraph);
+    g_assert_cmpstr (text, ==, TEXT);
+    g_assert_true (text_paragraph_peek_text (fixture->paragraph) == text);
+
+    last = text_node_get_last_child (TEXT_NODE (fixture->paragraph));
+    text_run_insert_text (TEXT_RUN (last), 0, "> ");
+    g_assert_cmpstr (text_paragraph_peek_text (fixture->paragraph), ==, RUN1 RUN2 "> " RUN3);
+
+    text_node_delete (last);
+    g_assert_cmpstr (text_paragraph_peek_text (fixture->paragraph), ==, RUN1 RUN2);
+}
+
+static void
+test_paragraph_peek_text_evicted (ParagraphFixture *fixture,
+                                  gconstpointer     user_data)
+{
+    // only recently peeked paragraphs keep their text, which is
+    // rebuilt once it has been evicted
+
+    GPtrArray *others;
+    int i;
+
+    others = g_ptr_array_new_with_free_func (g_object_unref);
+
+    g_assert_cmpstr (text_paragraph_peek_text (fixture->paragraph), ==, TEXT);
+
+    for (i = 0; i < 100; i++)
+    {
+        TextParagraph *other;
+        g_autofree char *number = g_strdup_printf ("%d", i);
+        g_autofree char *expected = g_strdup_printf ("Paragraph %d", i);
+
+        // Split over two runs, so the text has to be flattened
+        other = text_paragraph_new ();
+        text_paragraph_append_fragment (other, TEXT_FRAGMENT (text_run_new ("Paragraph ")));
+        text_paragraph_append_fragment (other, TEXT_FRAGMENT (text_run_new (number)));
+        g_ptr_array_add (others, other);
+
+        g_assert_cmpstr (text_paragraph_peek_text (other), ==, expected);
+    }
+
+    g_assert_cmpstr (text_paragraph_peek_text (fixture->paragraph), ==, TEXT);
+
+    // Owned copies stay valid however many paragraphs are peeked
+    for (i = 0; i < (int) others->len; i++)
+    {
+        g_autofree char *text = text_paragraph_get_text (g_ptr_array_index (others, i));
+        g_autofree char *expected = g_strdup_printf ("Paragraph %d", i);
+
+        g_assert_cmpstr (text, ==, expected);
+    }
+
+    g_ptr_array_unref (others);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/model/paragraph/slices", ParagraphFixture, NULL,
+                paragraph_fixture_set_up, test_paragraph_slices,
+                paragraph_fixture_tear_down);
+    g_test_add ("/text-engine/model/paragraph/slice-range", ParagraphFixture, NULL,
+                paragraph_fixture_set_up, test_paragraph_slice_range,
+                paragraph_fixture_tear_down);
+    g_test_add ("/text-engine/model/paragraph/peek-text", ParagraphFixture, NULL,
+                paragraph_fixture_set_up, test_paragraph_peek_text,
+                paragraph_fixture_tear_down);
+    g_test_add ("/text-engine/model/paragraph/peek-text-evicted", ParagraphFixture, NULL,
+                paragraph_fixture_set_up, test_paragraph_peek_text_evicted,
+                paragraph_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,210 @@
+/* run.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/run.h>
+#include <model/piecetable.h>
+
+static char *
+join_slices (TextRun *run)
+{
+    GString *string;
+    guint i;
+
+    string = g_string_new (NULL);
+
+    for (i = 0; i < text_run_get_n_slices (run); i++)
+    {
+        const char *slice;
+        gsize length;
+
+        slice = text_run_get_slice (run, i, &length);
+        g_string_append_len (string, slice, length);
+    }
+
+    return g_string_free (string, FALSE);
+}
+
+static void
+test_run_insert_erase (void)
+{
+    // edits are reflected in the text, the slices
+    // and the cached lengths of the run
+
+    g_autoptr (TextRun) run = NULL;
+    g_autofree char *joined = NULL;
+    g_autofree char *copy = NULL;
+
+    run = text_run_new ("Once upon a time");
+
+    text_run_insert_text (run, 5, "höpefully ");
+    text_run_insert_text (run, 0, "> ");
+    text_run_erase_text (run, 12, 6);
+
+    joined = join_slices (run);
+    g_assert_cmpstr (joined, ==, "> Once höpeupon a time");
+
+    copy = text_run_copy_text (run, 7, 5);
+    g_assert_cmpstr (copy, ==, "höpe");
+
+    g_assert_cmpstr (text_fragment_get_text (TEXT_FRAGMENT (run)), ==, "> Once höpeupon a time");
+    g_assert_cmpint (text_fragment_get_size_bytes (TEXT_FRAGMENT (run)), ==, strlen ("> Once höpeupon a time"));
+    g_assert_cmpint (text_fragment_get_length (TEXT_FRAGMENT (run)), ==, g_utf8_strlen ("> Once höpeupon a time", -1));
+}
+
+static void
+test_run_typing (void)
+{
+    // typing one character at a time into a long
+    // run does not fragment its text
+
+    g_autoptr (TextRun) run = NULL;
+    g_autofree char *text = NULL;
+    int i;
+
+    text = g_strnfill (1 << 20, 'a');
+    run = text_run_new (text);
+
+    for (i = 0; i < 1000; i++)
+        text_run_insert_text (run, 512 + i, "b");
+
+    g_assert_cmpuint (text_run_get_n_slices (run), <=, 3);
+    g_assert_cmpint (text_fragment_get_size_bytes (TEXT_FRAGMENT (run)), ==, (1 << 20) + 1000);
+}
+
+static void
+assert_piece (TextPieceTable *table,
+              guint           n,
+              const char     *expected)
+{
+    const char *piece;
+    gsize length;
+
+    piece = text_piece_table_get_piece (table, n, &length);
+    g_assert_cmpuint (length, ==, strlen (expected));
+    g_assert_true (memcmp (piece, expected, length) == 0);
+}
+
+static void
+test_run_backspace (void)
+{
+    // erasing what was just typed hands its bytes back
+    // to the add buffer, so the buffer doesn't grow
+
+    g_autoptr (TextPieceTable) table = NULL;
+    int i;
+
+    table = text_piece_table_new ("Once upon a time");
+
+    text_piece_table_insert (table, 5, "ö", -1);
+    text_piece_table_insert (table, 7, "x", -1);
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 3);
+    g_assert_cmpuint (text_piece_table_get_n_pieces (table), ==, 3);
+
+    text_piece_table_erase (table, 5, 3);
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 0);
+    g_assert_cmpuint (text_piece_table_get_n_pieces (table), ==, 2);
+
+    for (i = 0; i < 1000; i++)
+    {
+        text_piece_table_insert (table, 5, "ö", -1);
+        text_piece_table_insert (table, 7, "x", -1);
+        text_piece_table_erase (table, 5, 3);
+    }
+
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 0);
+    g_assert_cmpuint (text_piece_table_get_n_pieces (table), ==, 2);
+    assert_piece (table, 0, "Once ");
+    assert_piece (table, 1, "upon a time");
+
+    // typing again reuses the space given back
+    text_piece_table_insert (table, 5, "dög ", -1);
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 5);
+    g_assert_cmpuint (text_piece_table_get_n_pieces (table), ==, 3);
+    assert_piece (table, 0, "Once ");
+    assert_piece (table, 1, "dög ");
+    assert_piece (table, 2, "upon a time");
+
+    // only erasing the end of the typed text gives space back
+    text_piece_table_erase (table, 8, 2);
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 3);
+    assert_piece (table, 1, "dö");
+
+    text_piece_table_erase (table, 5, 1);
+    g_assert_cmpuint (text_piece_table_get_add_size (table), ==, 3);
+    assert_piece (table, 1, "ö");
+
+    g_assert_cmpuint (text_piece_table_get_length (table), ==, 17);
+    g_assert_cmpstr (text_piece_table_get_text (table), ==, "Once öupon a time");
+}
+
+static void
+test_run_index_at_offset (void)
+{
+    // character offsets are converted to byte indices
+
+    g_autoptr (TextRun) run = NULL;
+
+    run = text_run_new ("dög");
+    text_run_insert_text (run, 3, "öö");
+
+    g_assert_cmpint (text_run_get_index_at_offset (run, 0, 2), ==, 3);
+    g_assert_cmpint (text_run_get_index_at_offset (run, 1, 2), ==, 5);
+    g_assert_cmpint (text_run_get_index_at_offset (run, 0, 10), ==, 8);
+
+    g_assert_cmpint (text_run_get_offset_at_index (run, 3), ==, 2);
+    g_assert_cmpint (text_run_get_offset_at_index (run, 5), ==, 3);
+    g_assert_cmpint (text_run_get_offset_at_index (run, 8), ==, 5);
+}
+
+static void
+test_run_convert_keeps_slices (void)
+{
+    // converting between offsets and indices in
+    // non-ascii text does not flatten the run
+
+    g_autoptr (TextRun) run = NULL;
+    TextFragment *fragment;
+    const char *slice;
+    gsize length;
+
+    run = text_run_new ("dög");
+    text_run_insert_text (run, 0, "ö ");
+    fragment = TEXT_FRAGMENT (run);
+
+    g_assert_cmpuint (text_run_get_n_slices (run), ==, 2);
+    slice = text_run_get_slice (run, 1, &length);
+
+    g_assert_cmpint (text_fragment_get_index_at_offset (fragment, 3), ==, 4);
+    g_assert_cmpint (text_fragment_get_index_at_offset (fragment, 4), ==, 6);
+    g_assert_cmpint (text_fragment_get_offset_at_index (fragment, 4), ==, 3);
+    g_assert_cmpint (text_fragment_get_offset_at_index (fragment, 6), ==, 4);
+
+    g_assert_cmpuint (text_run_get_n_slices (run), ==, 2);
+    g_assert_true (text_run_get_slice (run, 1, &length) == slice);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/text-engine/model/run/insert-erase", test_run_insert_erase);
+    g_test_add_func ("/text-engine/model/run/typing", test_run_typing);
+    g_test_add_func ("/text-engine/model/run/backspace", test_run_backspace);
+    g_test_add_func ("/text-engine/model/run/index-at-offset", test_run_index_at_offset);
+    g_test_add_func ("/text-engine/model/run/convert-keeps-slices", test_run_convert_keeps_slices);
+
+    return g_test_run ();
+}
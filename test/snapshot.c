@@ -0,0 +1,199 @@
+/* snapshot.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/document.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <model/snapshot.h>
+#include <editor/editor.h>
+
+typedef struct {
+    TextDocument *doc;
+    TextEditor *editor;
+} SnapshotFixture;
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+
+#define TEXT RUN1 RUN2 "\n" RUN3 "\n"
+
+static void
+snapshot_fixture_set_up (SnapshotFixture *fixture,
+                         gconstpointer    user_data)
+{
+    TextFrame *frame;
+    TextParagraph *para1, *para2;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN2)));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    para2 = text_paragraph_new ();
+    text_paragraph_append_fragment(para2, TEXT_FRAGMENT (text_run_new (RUN3)));
+    text_frame_append_block (frame, TEXT_BLOCK (para2));
+
+    fixture->doc = text_document_new ();
+    fixture->doc->frame = frame;
+
+    fixture->editor = text_editor_new (fixture->doc);
+}
+
+static void
+snapshot_fixture_tear_down (SnapshotFixture *fixture,
+                            gconstpointer    user_data)
+{
+    g_object_unref (fixture->editor);
+    g_object_unref (fixture->doc);
+}
+
+static void
+assert_snapshot_text (TextSnapshot *snapshot,
+                      const char   *expected)
+{
+    g_autofree char *text = NULL;
+
+    text = text_snapshot_dump_plain_text (snapshot);
+    g_assert_cmpstr (text, ==, expected);
+}
+
+static void
+test_snapshot_sharing (SnapshotFixture *fixture,
+                       gconstpointer    user_data)
+{
+    // unchanged paragraphs are shared between snapshots,
+    // and edits don't show up in earlier snapshots
+
+    g_autoptr (TextSnapshot) first = NULL;
+    g_autoptr (TextSnapshot) second = NULL;
+    g_autoptr (TextSnapshot) third = NULL;
+
+    first = text_document_snapshot (fixture->doc);
+    assert_snapshot_text (first, TEXT);
+    g_assert_cmpuint (text_snapshot_get_n_paragraphs (first), ==, 2);
+    g_assert_cmpint (text_snapshot_get_length (first), ==, text_document_get_length (fixture->doc));
+
+    second = text_document_snapshot (fixture->doc);
+    g_assert_true (first == second);
+
+    text_editor_move_last (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, " Woof!");
+
+    third = text_document_snapshot (fixture->doc);
+    assert_snapshot_text (first, TEXT);
+    assert_snapshot_text (third, RUN1 RUN2 "\n" RUN3 " Woof!\n");
+
+    g_assert_true (text_snapshot_get_paragraph (first, 0) == text_snapshot_get_paragraph (third, 0));
+    g_assert_false (text_snapshot_get_paragraph (first, 1) == text_snapshot_get_paragraph (third, 1));
+    g_assert_cmpuint (text_snapshot_get_generation (third), ==,
+                      text_document_get_generation (fixture->doc));
+}
+
+static void
+test_snapshot_format (SnapshotFixture *fixture,
+                      gconstpointer    user_data)
+{
+    // formatting changes are copied too
+
+    g_autoptr (TextSnapshot) before = NULL;
+    g_autoptr (TextSnapshot) after = NULL;
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+    TextSnapshotParagraph *paragraph;
+    const TextSnapshotFragment *fragment;
+
+    before = text_document_snapshot (fixture->doc);
+
+    start = text_document_create_mark_at_offset (fixture->doc, 0, TEXT_GRAVITY_LEFT);
+    end = text_document_create_mark_at_offset (fixture->doc, 4, TEXT_GRAVITY_RIGHT);
+    text_editor_apply_format_bold (fixture->editor, start, end, TRUE);
+    text_document_delete_mark (fixture->doc, start);
+    text_document_delete_mark (fixture->doc, end);
+
+    after = text_document_snapshot (fixture->doc);
+
+    paragraph = text_snapshot_get_paragraph (before, 0);
+    g_assert_cmpuint (text_snapshot_paragraph_get_n_fragments (paragraph), ==, 2);
+    g_assert_false (text_snapshot_paragraph_get_fragment (paragraph, 0)->is_bold);
+
+    paragraph = text_snapshot_get_paragraph (after, 0);
+    g_assert_cmpstr (text_snapshot_paragraph_get_text (paragraph), ==, RUN1 RUN2);
+
+    fragment = text_snapshot_paragraph_get_fragment (paragraph, 0);
+    g_assert_cmpint (fragment->type, ==, TEXT_SNAPSHOT_RUN);
+    g_assert_cmpint (fragment->index, ==, 0);
+    g_assert_cmpint (fragment->size, ==, 4);
+    g_assert_true (fragment->is_bold);
+
+    fragment = text_snapshot_paragraph_get_fragment (paragraph, 1);
+    g_assert_cmpint (fragment->index, ==, 4);
+    g_assert_false (fragment->is_bold);
+
+    g_assert_true (text_snapshot_get_paragraph (before, 1) == text_snapshot_get_paragraph (after, 1));
+}
+
+static gpointer
+dump_snapshot (gpointer data)
+{
+    return text_snapshot_dump_plain_text (data);
+}
+
+static void
+test_snapshot_thread (SnapshotFixture *fixture,
+                      gconstpointer    user_data)
+{
+    // snapshots can be read on another thread while
+    // the document is being edited
+
+    TextSnapshot *snapshot;
+    GThread *thread;
+    g_autofree char *text = NULL;
+
+    snapshot = text_document_snapshot (fixture->doc);
+    thread = g_thread_new ("snapshot", dump_snapshot, snapshot);
+
+    text_editor_move_first (fixture->editor, TEXT_EDITOR_CURSOR);
+
+    for (int i = 0; i < 100; i++)
+        text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "x");
+
+    text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, 20);
+
+    text = g_thread_join (thread);
+    g_assert_cmpstr (text, ==, TEXT);
+
+    text_snapshot_unref (snapshot);
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/model/snapshot/sharing", SnapshotFixture, NULL,
+                snapshot_fixture_set_up, test_snapshot_sharing,
+                snapshot_fixture_tear_down);
+    g_test_add ("/text-engine/model/snapshot/format", SnapshotFixture, NULL,
+                snapshot_fixture_set_up, test_snapshot_format,
+                snapshot_fixture_tear_down);
+    g_test_add ("/text-engine/model/snapshot/thread", SnapshotFixture, NULL,
+                snapshot_fixture_set_up, test_snapshot_thread,
+                snapshot_fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,316 @@
+/* undo.c
+ *
+ * Copyright 2022 Matthew Jakeman <mjakeman26@outlook.co.nz>
+ *
+ * This file is dual-licensed under the terms of the Mozilla Public
+ * License 2.0 and the Lesser General Public License 2.1 (or any
+ * later version).
+ *
+ * SPDX-License-Identifier: MPL-2.0 OR LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <model/document.h>
+#include <model/paragraph.h>
+#include <model/run.h>
+#include <editor/editor.h>
+
+typedef struct {
+    TextDocument *doc;
+    TextEditor *editor;
+} UndoFixture;
+
+#define RUN1 "Once upon a time "
+#define RUN2 "there was a little dög, "
+#define RUN3 "and his name was Rövér."
+
+#define TEXT RUN1 RUN2 "\n" RUN3 "\n"
+
+static void
+undo_fixture_set_up (UndoFixture   *fixture,
+                     gconstpointer  user_data)
+{
+    TextFrame *frame;
+    TextParagraph *para1, *para2;
+
+    frame = text_frame_new ();
+
+    para1 = text_paragraph_new ();
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN1)));
+    text_paragraph_append_fragment(para1, TEXT_FRAGMENT (text_run_new (RUN2)));
+    text_frame_append_block (frame, TEXT_BLOCK (para1));
+
+    para2 = text_paragraph_new ();
+    text_paragraph_append_fragment(para2, TEXT_FRAGMENT (text_run_new (RUN3)));
+    text_frame_append_block (frame, TEXT_BLOCK (para2));
+
+    fixture->doc = text_document_new ();
+    fixture->doc->frame = frame;
+
+    fixture->editor = text_editor_new (fixture->doc);
+
+    text_editor_move_first (fixture->editor, TEXT_EDITOR_CURSOR);
+}
+
+static void
+undo_fixture_tear_down (UndoFixture   *fixture,
+                        gconstpointer  user_data)
+{
+    g_object_unref (fixture->editor);
+    g_object_unref (fixture->doc);
+}
+
+static void
+assert_text (UndoFixture *fixture,
+             const char  *expected)
+{
+    g_autofree char *text = NULL;
+
+    text = text_editor_dump_plain_text (fixture->editor);
+    g_assert_cmpstr (text, ==, expected);
+}
+
+static gboolean
+is_bold_at_offset (UndoFixture *fixture,
+                   int          offset)
+{
+    g_autoptr (TextMark) mark = NULL;
+    gboolean is_bold;
+
+    mark = text_document_create_mark_at_offset (fixture->doc, offset, TEXT_GRAVITY_LEFT);
+    is_bold = text_editor_get_format_bold_at_mark (fixture->editor, mark);
+    text_document_delete_mark (fixture->doc, mark);
+
+    return is_bold;
+}
+
+static void
+type (UndoFixture *fixture,
+      const char  *text)
+{
+    char str[7];
+
+    for (const char *c = text; *c; c = g_utf8_next_char (c))
+    {
+        str[g_unichar_to_utf8 (g_utf8_get_char (c), str)] = '\0';
+        text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, str);
+    }
+}
+
+static void
+test_undo_typing (UndoFixture   *fixture,
+                  gconstpointer  user_data)
+{
+    // consecutive keystrokes are undone a word at a time
+
+    g_assert_false (text_editor_can_undo (fixture->editor));
+
+    type (fixture, "Hëllo wörld ");
+    assert_text (fixture, "Hëllo wörld " TEXT);
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, "Hëllo " TEXT);
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+    g_assert_false (text_editor_undo (fixture->editor));
+
+    g_assert_true (text_editor_redo (fixture->editor));
+    g_assert_true (text_editor_redo (fixture->editor));
+    assert_text (fixture, "Hëllo wörld " TEXT);
+    g_assert_false (text_editor_can_redo (fixture->editor));
+
+    // Typing resumes at the restored cursor
+    type (fixture, "X");
+    assert_text (fixture, "Hëllo wörld X" TEXT);
+}
+
+static void
+test_undo_delete (UndoFixture   *fixture,
+                  gconstpointer  user_data)
+{
+    // deleted text is restored along with its
+    // formatting and paragraph breaks
+
+    g_autoptr (TextMark) start = NULL;
+    g_autoptr (TextMark) end = NULL;
+
+    start = text_document_create_mark_at_offset (fixture->doc, 5, TEXT_GRAVITY_LEFT);
+    end = text_document_create_mark_at_offset (fixture->doc, 9, TEXT_GRAVITY_RIGHT);
+    text_editor_apply_format_bold (fixture->editor, start, end, TRUE);
+    text_document_delete_mark (fixture->doc, start);
+    text_document_delete_mark (fixture->doc, end);
+
+    g_assert_true (is_bold_at_offset (fixture, 6));
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 3);
+    text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, 47);
+    assert_text (fixture, "Oncname was Rövér.\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_true (is_bold_at_offset (fixture, 6));
+    g_assert_false (is_bold_at_offset (fixture, 11));
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    g_assert_false (is_bold_at_offset (fixture, 6));
+
+    g_assert_true (text_editor_redo (fixture->editor));
+    g_assert_true (text_editor_redo (fixture->editor));
+    assert_text (fixture, "Oncname was Rövér.\n");
+}
+
+static void
+test_undo_backspace (UndoFixture   *fixture,
+                     gconstpointer  user_data)
+{
+    // repeated backspaces are undone at once
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 9);
+
+    for (int i = 0; i < 5; i++)
+        text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, -1);
+
+    assert_text (fixture, "Once a time " RUN2 "\n" RUN3 "\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+}
+
+static void
+test_undo_backspace_words (UndoFixture   *fixture,
+                           gconstpointer  user_data)
+{
+    // backspacing through several words is undone a word at a time
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 11);
+
+    for (int i = 0; i < 11; i++)
+        text_editor_delete (fixture->editor, TEXT_EDITOR_CURSOR, -1);
+
+    assert_text (fixture, " time " RUN2 "\n" RUN3 "\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, "Once time " RUN2 "\n" RUN3 "\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, "Once upon time " RUN2 "\n" RUN3 "\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+}
+
+static void
+test_undo_long_typing (UndoFixture   *fixture,
+                       gconstpointer  user_data)
+{
+    // typing without spaces is still split into bounded steps
+
+    g_autofree char *typed = g_strnfill (300, 'a');
+    g_autofree char *first = g_strnfill (256, 'a');
+    g_autofree char *expected = NULL;
+
+    type (fixture, typed);
+
+    expected = g_strconcat (typed, TEXT, NULL);
+    assert_text (fixture, expected);
+
+    g_free (expected);
+    expected = g_strconcat (first, TEXT, NULL);
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, expected);
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+}
+
+static void
+test_undo_split (UndoFixture   *fixture,
+                 gconstpointer  user_data)
+{
+    // splits and edits made in a transaction are undone together
+
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 4);
+
+    text_editor_begin_transaction (fixture->editor);
+    text_editor_split (fixture->editor, TEXT_EDITOR_CURSOR);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "Twice");
+    text_editor_commit_transaction (fixture->editor);
+
+    assert_text (fixture, "Once\nTwice upon a time " RUN2 "\n" RUN3 "\n");
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, TEXT);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+
+    g_assert_true (text_editor_redo (fixture->editor));
+    assert_text (fixture, "Once\nTwice upon a time " RUN2 "\n" RUN3 "\n");
+}
+
+static void
+test_undo_limit (UndoFixture   *fixture,
+                 gconstpointer  user_data)
+{
+    // the oldest steps are evicted first, but
+    // the most recent one is always kept
+
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "A");
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "B");
+    text_editor_move_right (fixture->editor, TEXT_EDITOR_CURSOR, 5);
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "C");
+    assert_text (fixture, "AOnce Bupon Ca time " RUN2 "\n" RUN3 "\n");
+
+    text_editor_set_history_limit (fixture->editor, 1);
+    g_assert_cmpuint (text_editor_get_history_limit (fixture->editor), ==, 1);
+
+    g_assert_true (text_editor_undo (fixture->editor));
+    assert_text (fixture, "AOnce Bupon a time " RUN2 "\n" RUN3 "\n");
+    g_assert_false (text_editor_can_undo (fixture->editor));
+
+    // Edits after undoing discard the steps to redo
+    g_assert_true (text_editor_can_redo (fixture->editor));
+    text_editor_insert_text (fixture->editor, TEXT_EDITOR_CURSOR, "D");
+    g_assert_false (text_editor_can_redo (fixture->editor));
+
+    text_editor_clear_history (fixture->editor);
+    g_assert_false (text_editor_can_undo (fixture->editor));
+}
+
+int
+main (int argc, char *argv[])
+{
+    setlocale (LC_ALL, "");
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/text-engine/editor/undo/typing", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_typing,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/delete", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_delete,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/backspace", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_backspace,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/backspace-words", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_backspace_words,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/long-typing", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_long_typing,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/split", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_split,
+                undo_fixture_tear_down);
+    g_test_add ("/text-engine/editor/undo/limit", UndoFixture, NULL,
+                undo_fixture_set_up, test_undo_limit,
+                undo_fixture_tear_down);
+
+    return g_test_run ();
+}